@@ -2,15 +2,20 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "knn_norm.h"
 #include "gen_data_config.h"
 
 int main (int argc, char** argv){
 
     FILE *trn_in, *tst_in;
     FILE *trn_data_out, *trn_label_out, *tst_data_out, *tst_label_out;
+    FILE *trn_norm_out;
 
     float feature;
+    float row[FEATURES];
     int label;
+    KnnNormAccum acc;
+    KnnNormStats stats;
     
     int i;
     char buffer[1024];
@@ -23,19 +28,45 @@ int main (int argc, char** argv){
     tst_data_out = fopen(TST_DATA_BIN, "w");
     tst_label_out = fopen(TST_LABEL_BIN, "w");
     
-    /* Generate trn set binary data files */
+    knnNormAccumInit(&acc, FEATURES);
+
+    /* Generate trn set binary data files, accumulate normalization statistics */
     printf("Generating training set binaries: %s and %s\n", TRN_DATA_BIN, TRN_LABEL_BIN);
     while(!feof(trn_in)){
         for (i = 0; i < FEATURES; i++){
             fscanf(trn_in, "%f,", &feature);
             printf("[%d] %f ", i, feature);
             fwrite(&feature, sizeof(float), 1, trn_data_out);
+            row[i] = feature;
         }
+        knnNormAccumAdd(&acc, row);
         fscanf(trn_in, "%d\n", &label);
         printf("%d\n", label);
         fwrite(&label, sizeof(label), 1, trn_label_out);
     }
 
+    /* Generate normalized trn set and statistics, raw binaries stay as they are */
+    if (NORMALIZE != KNN_NORM_NONE && knnNormAccumFinish(&acc, NORMALIZE, &stats) == 0){
+        printf("Generating normalized training set: %s and %s\n", TRN_NORM_BIN, NORM_STATS_BIN);
+        trn_norm_out = fopen(TRN_NORM_BIN, "w");
+        rewind(trn_in);
+        while(!feof(trn_in)){
+            for (i = 0; i < FEATURES; i++){
+                fscanf(trn_in, "%f,", &(row[i]));
+            }
+            fscanf(trn_in, "%d\n", &label);
+            knnNormApply(&stats, row, 1);
+            fwrite(row, sizeof(float), FEATURES, trn_norm_out);
+        }
+        fclose(trn_norm_out);
+        knnNormWrite(&stats, NORM_STATS_BIN);
+        for (i = 0; i < FEATURES; i++){
+            printf("[%d] offset %f scale %f\n", i, stats.offset[i], stats.scale[i]);
+        }
+        knnNormFree(&stats);
+    }
+    knnNormAccumFree(&acc);
+
     /* Generate tst set binary data files */
     printf("Generating testing set binaries: %s and %s\n", TST_DATA_BIN, TST_LABEL_BIN);
     while(!feof(tst_in)){
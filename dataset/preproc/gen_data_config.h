@@ -8,6 +8,14 @@
 //#define IRIS 1
 #define WINE 1
 
+/**********************************************************
+ * NORMALIZATION
+ *********************************************************/
+
+/* KNN_NORM_NONE, KNN_NORM_ZSCORE or KNN_NORM_MINMAX (knn_norm.h) */
+
+#define NORMALIZE       KNN_NORM_ZSCORE
+
 /**********************************************************
  * DATASET PROPERTIES
  *********************************************************/
@@ -25,6 +33,8 @@
 #define TST_DATA_BIN    "tst_data.bin"
 #define TRN_LABEL_BIN   "trn_label.bin"
 #define TST_LABEL_BIN   "tst_label.bin"
+#define TRN_NORM_BIN    "trn_norm_data.bin"     /**< Normalized training set */
+#define NORM_STATS_BIN  "trn_norm_stats.bin"    /**< Normalization statistics */
 #endif
 
 /* Wine */
@@ -42,4 +52,6 @@
 #define TST_DATA_BIN    "wine_tst_data.bin"
 #define TRN_LABEL_BIN   "wine_trn_label.bin"
 #define TST_LABEL_BIN   "wine_tst_label.bin"
+#define TRN_NORM_BIN    "wine_trn_norm_data.bin"    /**< Normalized training set */
+#define NORM_STATS_BIN  "wine_trn_norm_stats.bin"   /**< Normalization statistics */
 #endif
\ No newline at end of file
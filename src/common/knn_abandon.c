@@ -0,0 +1,123 @@
+/*
+ * @file knn_abandon.c
+ * @brief Early-abandoning distance scan with variance-ordered features
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "knn_abandon.h"
+#include "knn_norm.h"
+
+/************************************************************************/
+
+/** Variance of each feature, read by varianceCompare() */
+static const double *sort_variance;
+
+/** @brief qsort comparator, descending variance then ascending feature */
+static int varianceCompare(const void *x, const void *y){
+    int a = *(const int *) x, b = *(const int *) y;
+
+    if (sort_variance[a] != sort_variance[b]){
+        return (sort_variance[a] < sort_variance[b]) ? 1 : -1;
+    }
+    return a - b;
+}
+
+/**
+ * @brief Orders features by descending variance
+ *
+ * The variances come from the normalization accumulator (knn_norm.h),
+ * the same Welford pass gen_data runs over the training set.
+ *
+ * @param data Row-major feature vectors (num_obj x features)
+ * @param num_obj Number of objects
+ * @param features Feature dimensionality
+ * @param order Output, order[i] is the feature placed at position i
+ * @return 0 on success, -1 otherwise.
+ */
+int knnVarianceOrder(const float *data, int num_obj, int features, int *order){
+
+    KnnNormAccum acc;
+    int i, f;
+
+    if (knnNormAccumInit(&acc, features) != 0){
+        return -1;
+    }
+    for (i = 0; i < num_obj; i++){
+        knnNormAccumAdd(&acc, &(data[(size_t) i*features]));
+    }
+    for (f = 0; f < features; f++){
+        order[f] = f;
+    }
+    sort_variance = acc.m2;
+    qsort(order, features, sizeof(int), varianceCompare);
+    sort_variance = NULL;
+
+    knnNormAccumFree(&acc);
+    return 0;
+}
+
+/**
+ * @brief Reorders the features of every row in place
+ *
+ * @param data Row-major feature vectors (num_obj x features)
+ * @param num_obj Number of objects
+ * @param features Feature dimensionality
+ * @param order order[i] is the feature moved to position i
+ * @return 0 on success, -1 otherwise.
+ */
+int knnPermuteFeatures(float *data, int num_obj, int features, const int *order){
+
+    float *row = malloc(sizeof(float) * features);
+    int i, f;
+
+    if (row == NULL){
+        return -1;
+    }
+    for (i = 0; i < num_obj; i++){
+        memcpy(row, &(data[(size_t) i*features]), sizeof(float) * features);
+        for (f = 0; f < features; f++){
+            data[(size_t) i*features + f] = row[ order[f] ];
+        }
+    }
+    free(row);
+    return 0;
+}
+
+/**
+ * @brief knnNeighbours with early-abandoning distances
+ *
+ * @param queries Row-major query feature vectors (num_queries x features)
+ * @param num_queries Number of queries
+ * @param data Row-major training feature vectors (num_obj x features)
+ * @param num_obj Number of training objects
+ * @param features Feature dimensionality
+ * @param k Number of neighbours per query
+ * @param out Output neighbour lists (num_queries x k), ascending distance
+ * @return Total number of features summed over all candidates.
+ */
+uint64_t knnAbandonNeighbours(float *queries, int num_queries, float *data,
+        int num_obj, int features, int k, DistIndexPair *out){
+
+    uint64_t evaluated = 0;
+    DistIndexPair *list;
+    float d;
+    int i, j, n;
+
+    for (i = 0; i < num_queries; i++){
+        list = &(out[(size_t) i*k]);
+        n = 0;
+        for (j = 0; j < num_obj; j++){
+            d = distanceAbandon(&(queries[(size_t) i*features]),
+                    &(data[(size_t) j*features]), features,
+                    topKThreshold(list, n, k), &evaluated);
+            n = topKPush(list, n, k, d, j);
+        }
+        for (; n < k; n++){
+            list[n].distance = INFINITY;
+            list[n].index = -1;
+        }
+    }
+    return evaluated;
+}
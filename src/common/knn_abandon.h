@@ -0,0 +1,73 @@
+/*
+ * @file knn_abandon.h
+ * @brief Early-abandoning distance scan with variance-ordered features
+ *
+ * Once the K-best list is full, a candidate is only useful if its
+ * distance is below the K-th best. Squared euclidean partial sums never
+ * decrease, so the scan stops accumulating as soon as the partial sum
+ * exceeds that threshold. Features are reordered by descending variance
+ * over the training set so the large terms are summed first.
+ *
+ * Features are summed into a single accumulator with the same blocked
+ * loop and KNN_SQUARE_ADD as distance(), so a candidate that survives
+ * gets exactly the distance() value without recomputing it, and on the
+ * same (reordered) data the neighbour lists are identical to the full
+ * scan. Sums of non-negative terms never decrease under rounding either,
+ * so a partial sum above the threshold can be abandoned without slack.
+ */
+
+#ifndef KNN_ABANDON_H
+#define KNN_ABANDON_H
+
+#include <stdint.h>
+
+#include "knn_kernels.h"
+
+/** Features summed between two threshold checks, the block of distance() */
+#define KNN_ABANDON_STRIDE KNN_DISTANCE_BLOCK
+
+int knnVarianceOrder(const float *data, int num_obj, int features, int *order);
+int knnPermuteFeatures(float *data, int num_obj, int features, const int *order);
+uint64_t knnAbandonNeighbours(float *queries, int num_queries, float *data,
+        int num_obj, int features, int k, DistIndexPair *out);
+
+/**
+ * @brief Squared euclidean distance, abandoned once above a threshold
+ *
+ * The threshold is checked every KNN_ABANDON_STRIDE features, so the
+ * inner block is branch-free. A candidate that is not abandoned gets the
+ * exact distance() value, summed in the same order.
+ *
+ * @param a First feature vector
+ * @param b Second feature vector
+ * @param size Feature dimensionality
+ * @param threshold Current K-th best distance
+ * @param evaluated Incremented by the number of features summed
+ * @return The distance, or a partial sum above threshold if abandoned.
+ */
+static inline float distanceAbandon(float *a, float *b, int size,
+        float threshold, uint64_t *evaluated){
+
+    int i, j;
+    float diff;
+    float sum = 0.0;
+
+    for (i = 0; i + KNN_ABANDON_STRIDE <= size; i += KNN_ABANDON_STRIDE){
+        for (j = i; j < i + KNN_ABANDON_STRIDE; j++){
+            diff = (a[j] - b[j]);
+            sum = KNN_SQUARE_ADD(sum, diff);
+        }
+        if (sum > threshold){
+            *evaluated += i + KNN_ABANDON_STRIDE;
+            return sum;
+        }
+    }
+    for (; i < size; i++){
+        diff = (a[i] - b[i]);
+        sum = KNN_SQUARE_ADD(sum, diff);
+    }
+    *evaluated += size;
+    return sum;
+}
+
+#endif
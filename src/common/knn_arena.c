@@ -0,0 +1,123 @@
+/*
+ * @file knn_arena.c
+ * @brief Bump arenas for per-call scratch memory
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "knn_arena.h"
+
+/** Key of the per-thread arenas */
+static pthread_key_t arena_key;
+/** Creates arena_key once */
+static pthread_once_t arena_once = PTHREAD_ONCE_INIT;
+
+/************************************************************************/
+
+/** @brief Releases the arena of an exiting thread */
+static void arenaDestroy(void *arg){
+    knnArenaFree(arg);
+    free(arg);
+}
+
+/** @brief Creates the per-thread arena key */
+static void arenaKeyInit(void){
+    pthread_key_create(&arena_key, arenaDestroy);
+}
+
+/************************************************************************/
+
+/**
+ * @brief Creates an arena
+ *
+ * The slab is mapped from the hugetlb pool when pages are reserved
+ * there, otherwise allocated huge-page aligned and marked for
+ * transparent huge pages. Its pages are touched once so the first calls
+ * do not fault them in.
+ *
+ * @param arena Arena, release with knnArenaFree
+ * @param capacity Bytes, rounded up to KNN_ARENA_SLAB
+ * @return 0 on success, -1 otherwise.
+ */
+int knnArenaInit(KnnArena *arena, size_t capacity){
+
+    void *mem;
+
+    memset(arena, 0, sizeof(*arena));
+    capacity = (capacity + KNN_ARENA_SLAB - 1) & ~((size_t) KNN_ARENA_SLAB - 1);
+    capacity = (capacity > 0) ? capacity : KNN_ARENA_SLAB;
+#ifdef MAP_HUGETLB
+    mem = mmap(NULL, capacity, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (mem != MAP_FAILED){
+        arena->hugetlb = 1;
+    } else
+#endif
+    {
+        if (posix_memalign(&mem, KNN_ARENA_SLAB, capacity) != 0){
+            return -1;
+        }
+#ifdef MADV_HUGEPAGE
+        madvise(mem, capacity, MADV_HUGEPAGE);
+#endif
+    }
+    memset(mem, 0, capacity);
+    arena->base = mem;
+    arena->capacity = capacity;
+    return 0;
+}
+
+/** @brief Releases an arena */
+void knnArenaFree(KnnArena *arena){
+    if (arena->hugetlb){
+        munmap(arena->base, arena->capacity);
+    } else {
+        free(arena->base);
+    }
+    arena->base = NULL;
+    arena->capacity = 0;
+    arena->used = 0;
+}
+
+/**
+ * @brief Arena of the calling thread
+ *
+ * Created on the first call and replaced by a larger one when capacity
+ * exceeds its size and nothing is carved from it; released when the
+ * thread exits.
+ *
+ * @param capacity Bytes the caller is about to carve
+ * @return Arena with at least capacity bytes free, NULL if it cannot be
+ *         created or is in use and too small.
+ */
+KnnArena *knnArenaThread(size_t capacity){
+
+    KnnArena *arena;
+
+    pthread_once(&arena_once, arenaKeyInit);
+    arena = pthread_getspecific(arena_key);
+    if (arena != NULL && arena->capacity - arena->used >= capacity){
+        return arena;
+    }
+    if (arena != NULL && arena->used > 0){
+        return NULL;
+    }
+    if (arena == NULL){
+        arena = calloc(1, sizeof(KnnArena));
+        if (arena == NULL || pthread_setspecific(arena_key, arena) != 0){
+            free(arena);
+            return NULL;
+        }
+    } else {
+        knnArenaFree(arena);
+    }
+    if (knnArenaInit(arena, capacity) != 0){
+        pthread_setspecific(arena_key, NULL);
+        free(arena);
+        return NULL;
+    }
+    return arena;
+}
@@ -0,0 +1,74 @@
+/*
+ * @file knn_arena.h
+ * @brief Bump arenas for per-call scratch memory
+ *
+ * An arena is one slab of fixed capacity, aligned to and rounded up to a
+ * 2 MB huge page, from which scratch arrays are carved by bumping an
+ * offset. Allocation never calls malloc and never fails silently: a
+ * request past the capacity returns NULL, so the memory a worker uses is
+ * bounded by its arena. A call takes a mark on entry and releases it on
+ * exit, which frees everything it carved at once.
+ *
+ * knnArenaThread() hands every thread its own arena, created on first
+ * use and grown, while empty, when a call needs more than it has; once
+ * the working set is known, calls run without allocating.
+ */
+
+#ifndef KNN_ARENA_H
+#define KNN_ARENA_H
+
+#include <stddef.h>
+
+/** Slab alignment and granularity, one x86-64 / AArch64 huge page */
+#define KNN_ARENA_SLAB (2u << 20)
+/** Alignment of every allocation, one cache line */
+#define KNN_ARENA_ALIGN 64
+
+/** @brief Bump arena over one slab */
+typedef struct KnnArena_Struct{
+    char *base;             /**< Slab, KNN_ARENA_SLAB aligned */
+    size_t capacity;        /**< Slab size */
+    size_t used;            /**< Bytes carved so far */
+    size_t peak;            /**< Largest used since creation */
+    int hugetlb;            /**< Slab mapped from the hugetlb pool */
+}KnnArena;
+
+/** @brief Bytes an allocation of size takes in an arena */
+static inline size_t knnArenaSpan(size_t size){
+    return (size + KNN_ARENA_ALIGN - 1) & ~((size_t) KNN_ARENA_ALIGN - 1);
+}
+
+/**
+ * @brief Carves an array from an arena
+ *
+ * @param arena Arena
+ * @param size Bytes
+ * @return KNN_ARENA_ALIGN aligned memory, NULL if the arena is full.
+ */
+static inline void *knnArenaAlloc(KnnArena *arena, size_t size){
+    char *p;
+
+    if (arena->capacity - arena->used < knnArenaSpan(size)){
+        return NULL;
+    }
+    p = arena->base + arena->used;
+    arena->used += knnArenaSpan(size);
+    arena->peak = (arena->used > arena->peak) ? arena->used : arena->peak;
+    return p;
+}
+
+/** @brief Current position, to be handed back to knnArenaRelease */
+static inline size_t knnArenaMark(const KnnArena *arena){
+    return arena->used;
+}
+
+/** @brief Frees everything carved since a mark */
+static inline void knnArenaRelease(KnnArena *arena, size_t mark){
+    arena->used = mark;
+}
+
+int knnArenaInit(KnnArena *arena, size_t capacity);
+void knnArenaFree(KnnArena *arena);
+KnnArena *knnArenaThread(size_t capacity);
+
+#endif
@@ -0,0 +1,103 @@
+/*
+ * @file knn_cache.c
+ * @brief Persistent neighbour-list cache
+ */
+
+#include <string.h>
+
+#include "knn_cache.h"
+
+/************************************************************************/
+
+/**
+ * @brief Computes the key of a (training set, query set, metric) triple
+ *
+ * @param key Output key
+ * @param trn Training feature vectors (num_trn x features), before any
+ *            metric-specific preprocessing
+ * @param num_trn Training objects
+ * @param queries Query feature vectors (num_queries x features)
+ * @param num_queries Queries
+ * @param features Feature dimensionality
+ * @param metric Distance metric
+ */
+void knnCacheKeyInit(KnnCacheKey *key, const float *trn, int num_trn,
+        const float *queries, int num_queries, int features, int metric){
+
+    memset(key, 0, sizeof(*key));
+    key->trn_hash = knnDatasetHash(trn, NULL, num_trn, features);
+    key->query_hash = knnDatasetHash(queries, NULL, num_queries, features);
+    key->metric = metric;
+    key->features = features;
+    key->num_trn = num_trn;
+    key->num_queries = num_queries;
+}
+
+/**
+ * @brief Maps a cache if it matches a key and holds at least k neighbours
+ *
+ * @param path Cache file
+ * @param key Expected key
+ * @param k Neighbours needed per query
+ * @param cache Output cache, release with knnCacheClose
+ * @return 0 on a hit, -1 on a miss (no file, other key, kmax < k, corrupt).
+ */
+int knnCacheOpen(const char *path, const KnnCacheKey *key, int k, KnnCache *cache){
+
+    const KnnCacheMeta *meta;
+    uint64_t size;
+
+    memset(cache, 0, sizeof(*cache));
+    if (knnContainerMap(path, &cache->container) != 0){
+        return -1;
+    }
+    meta = knnContainerSection(&cache->container, KNN_CACHE_SECTION_KEY, &size);
+    if (cache->container.header->dataset_hash != knnHashBytes(key, sizeof(*key), KNN_FNV_OFFSET) ||
+        meta == NULL || size != sizeof(KnnCacheMeta) ||
+        memcmp(&meta->key, key, sizeof(*key)) != 0 || meta->kmax < (uint32_t) k){
+        knnContainerUnmap(&cache->container);
+        return -1;
+    }
+    cache->lists = knnContainerSection(&cache->container, KNN_CACHE_SECTION_LISTS, &size);
+    if (cache->lists == NULL ||
+        size != sizeof(DistIndexPair) * (uint64_t) key->num_queries * meta->kmax){
+        knnContainerUnmap(&cache->container);
+        return -1;
+    }
+    cache->kmax = (int) meta->kmax;
+    return 0;
+}
+
+/**
+ * @brief Writes the neighbour lists of a key
+ *
+ * @param path Cache file, replaced atomically
+ * @param key Key of the lists
+ * @param lists Neighbour lists (num_queries x kmax), sorted, ties by index
+ * @param kmax Entries per list
+ * @return 0 on success, -1 otherwise.
+ */
+int knnCacheWrite(const char *path, const KnnCacheKey *key,
+        const DistIndexPair *lists, int kmax){
+
+    KnnCacheMeta meta;
+    KnnSection sections[2];
+
+    memset(&meta, 0, sizeof(meta));
+    meta.key = *key;
+    meta.kmax = kmax;
+    sections[0].tag = KNN_CACHE_SECTION_KEY;
+    sections[0].data = &meta;
+    sections[0].size = sizeof(meta);
+    sections[1].tag = KNN_CACHE_SECTION_LISTS;
+    sections[1].data = lists;
+    sections[1].size = sizeof(DistIndexPair) * (uint64_t) key->num_queries * kmax;
+    return knnContainerWrite(path, knnHashBytes(key, sizeof(*key), KNN_FNV_OFFSET),
+            sections, 2);
+}
+
+/** @brief Unmaps a cache */
+void knnCacheClose(KnnCache *cache){
+    knnContainerUnmap(&cache->container);
+    cache->lists = NULL;
+}
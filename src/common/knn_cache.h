@@ -0,0 +1,60 @@
+/*
+ * @file knn_cache.h
+ * @brief Persistent neighbour-list cache
+ *
+ * Stores the Kmax nearest training objects of every query of a set in a
+ * container (knn_container.h), keyed by the content hashes of the
+ * training and query features and by the metric. The lists are sorted
+ * and ties keep the lowest index, so the first K entries are the K-NN
+ * list for any K <= Kmax; labels are not part of the key, so the same
+ * lists serve any K, vote rule or labelling of the same vectors. A run
+ * whose key matches maps the file and skips the distance phase.
+ *
+ *     section KNN_CACHE_SECTION_KEY    KnnCacheMeta
+ *     section KNN_CACHE_SECTION_LISTS  DistIndexPair[num_queries][kmax]
+ */
+
+#ifndef KNN_CACHE_H
+#define KNN_CACHE_H
+
+#include <stdint.h>
+
+#include "knn_kernels.h"
+#include "knn_container.h"
+
+/** Section tags */
+#define KNN_CACHE_SECTION_KEY   0x4E430001
+#define KNN_CACHE_SECTION_LISTS 0x4E430002
+
+/** @brief Cache key, everything the neighbour lists depend on */
+typedef struct KnnCacheKey_Struct{
+    uint64_t trn_hash;          /**< knnDatasetHash of the training features */
+    uint64_t query_hash;        /**< knnDatasetHash of the query features */
+    uint32_t metric;            /**< Distance metric (KnnMetric) */
+    uint32_t features;          /**< Feature dimensionality */
+    uint32_t num_trn;           /**< Training objects */
+    uint32_t num_queries;       /**< Queries */
+}KnnCacheKey;
+
+/** @brief Key section contents */
+typedef struct KnnCacheMeta_Struct{
+    KnnCacheKey key;            /**< Key of the lists */
+    uint32_t kmax;              /**< Entries per list */
+    uint32_t reserved;          /**< Zero */
+}KnnCacheMeta;
+
+/** @brief Mapped cache */
+typedef struct KnnCache_Struct{
+    KnnContainer container;     /**< Mapping */
+    const DistIndexPair *lists; /**< Neighbour lists (num_queries x kmax), in the mapping */
+    int kmax;                   /**< Entries per list */
+}KnnCache;
+
+void knnCacheKeyInit(KnnCacheKey *key, const float *trn, int num_trn,
+        const float *queries, int num_queries, int features, int metric);
+int knnCacheOpen(const char *path, const KnnCacheKey *key, int k, KnnCache *cache);
+int knnCacheWrite(const char *path, const KnnCacheKey *key,
+        const DistIndexPair *lists, int kmax);
+void knnCacheClose(KnnCache *cache);
+
+#endif
@@ -0,0 +1,254 @@
+/*
+ * @file knn_condense.c
+ * @brief Training set reduction: Wilson editing and Hart condensation
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "knn_condense.h"
+#include "knn_kernels.h"
+#include "knn_graph.h"
+
+/************************************************************************/
+
+/** @brief Nearest store object of a range of candidates, one per thread */
+typedef struct HartTask_Struct{
+    float *data;                /**< Row-major feature vectors */
+    int features;               /**< Feature dimensionality */
+    const int *store;           /**< Store snapshot, object indices */
+    int store_size;             /**< Objects in the snapshot */
+    const int *candidates;      /**< Candidates, object indices */
+    int first;                  /**< First candidate of this task */
+    int last;                   /**< One past the last candidate of this task */
+    DistIndexPair *nearest;     /**< Output, nearest snapshot object of each candidate */
+}HartTask;
+
+/** @brief Computes the nearest snapshot object of each candidate of a task */
+static void *hartWorker(void *arg){
+    HartTask *t = arg;
+    float d;
+    int c, s, x;
+
+    for (c = t->first; c < t->last; c++){
+        x = t->candidates[c];
+        t->nearest[c].distance = INFINITY;
+        t->nearest[c].index = -1;
+        for (s = 0; s < t->store_size; s++){
+            d = distance(&(t->data[(size_t) x*t->features]),
+                    &(t->data[(size_t) t->store[s]*t->features]), t->features);
+            if (d < t->nearest[c].distance){
+                t->nearest[c].distance = d;
+                t->nearest[c].index = t->store[s];
+            }
+        }
+    }
+    return NULL;
+}
+
+/************************************************************************/
+
+/**
+ * @brief Wilson editing, drops objects misclassified by their K neighbours
+ *
+ * Neighbours come from the all-kNN graph (self excluded), built in
+ * parallel; objects already dropped in keep[] are ignored entirely.
+ *
+ * @param data Row-major feature vectors (num_obj x features)
+ * @param labels Labels of the objects
+ * @param num_obj Number of objects
+ * @param features Feature dimensionality
+ * @param classes Number of classes
+ * @param k Number of voting neighbours
+ * @param threads Number of worker threads
+ * @param keep In: objects to consider. Out: objects kept
+ * @return Number of objects kept, -1 on error.
+ */
+int knnWilsonEdit(float *data, const int *labels, int num_obj, int features,
+        int classes, int k, int threads, int *keep){
+
+    float *subset = malloc(sizeof(float) * (size_t) num_obj * features);
+    int *sub_labels = malloc(sizeof(int) * num_obj);
+    int *index = malloc(sizeof(int) * num_obj);
+    int *closest = malloc(sizeof(int) * k);
+    int *votes = malloc(sizeof(int) * classes);
+    KnnGraph graph;
+    int i, j, n, kept = 0, status = 0;
+
+    if (subset == NULL || sub_labels == NULL || index == NULL ||
+        closest == NULL || votes == NULL){
+        status = -1;
+    } else {
+        for (i = 0, n = 0; i < num_obj; i++){
+            if (keep[i]){
+                index[n++] = i;
+            }
+        }
+        knnCompactSet(data, labels, num_obj, features, keep, subset, sub_labels);
+        if (knnGraphBuild(subset, n, features, k, threads, &graph) != 0){
+            status = -1;
+        } else {
+            for (i = 0; i < n; i++){
+                int size = graph.row_ptr[i+1] - graph.row_ptr[i];
+                for (j = 0; j < size; j++){
+                    closest[j] = sub_labels[ graph.edges[graph.row_ptr[i] + j].index ];
+                }
+                if (majorityVote(closest, size, votes, classes) != sub_labels[i]){
+                    keep[ index[i] ] = 0;
+                } else {
+                    kept++;
+                }
+            }
+            knnGraphFree(&graph);
+        }
+    }
+
+    free(subset); free(sub_labels); free(index); free(closest); free(votes);
+    return status ? -1 : kept;
+}
+
+/**
+ * @brief Hart's condensed nearest neighbour
+ *
+ * The store starts with the first object of each class. Each pass visits
+ * the objects outside the store in index order and adds those that 1-NN
+ * on the store misclassifies, until a pass adds nothing.
+ *
+ * A pass first computes in parallel the nearest object of a snapshot of
+ * the store for every candidate, then replays the candidates in order,
+ * comparing each only with the objects added since the snapshot. The
+ * result is the same as the sequential algorithm.
+ *
+ * @param data Row-major feature vectors (num_obj x features)
+ * @param labels Labels of the objects
+ * @param num_obj Number of objects
+ * @param features Feature dimensionality
+ * @param threads Number of worker threads
+ * @param keep In: objects to consider. Out: objects in the store
+ * @return Number of objects in the store, -1 on error.
+ */
+int knnHartCondense(float *data, const int *labels, int num_obj, int features,
+        int threads, int *keep){
+
+    int *store = malloc(sizeof(int) * num_obj);
+    int *candidates = malloc(sizeof(int) * num_obj);
+    int *in_store = calloc(num_obj, sizeof(int));
+    DistIndexPair *nearest = malloc(sizeof(DistIndexPair) * num_obj);
+    HartTask *tasks;
+    pthread_t *workers;
+    int store_size = 0, snapshot, num_candidates, added;
+    int i, c, s, t, x, chunk, best_label;
+    float d, best;
+
+    if (threads < 1){
+        threads = 1;
+    }
+    tasks = malloc(sizeof(HartTask) * threads);
+    workers = malloc(sizeof(pthread_t) * threads);
+    if (store == NULL || candidates == NULL || in_store == NULL ||
+        nearest == NULL || tasks == NULL || workers == NULL){
+        free(store); free(candidates); free(in_store); free(nearest);
+        free(tasks); free(workers);
+        return -1;
+    }
+
+    /* Seed with the first object of each class */
+    for (i = 0; i < num_obj; i++){
+        if (!keep[i]){
+            continue;
+        }
+        for (s = 0; s < store_size && labels[store[s]] != labels[i]; s++);
+        if (s == store_size){
+            store[store_size++] = i;
+            in_store[i] = 1;
+        }
+    }
+
+    do {
+        num_candidates = 0;
+        for (i = 0; i < num_obj; i++){
+            if (keep[i] && !in_store[i]){
+                candidates[num_candidates++] = i;
+            }
+        }
+
+        /* Nearest snapshot object of every candidate, in parallel */
+        snapshot = store_size;
+        chunk = (num_candidates + threads - 1) / threads;
+        for (t = 0; t < threads; t++){
+            tasks[t].data = data;
+            tasks[t].features = features;
+            tasks[t].store = store;
+            tasks[t].store_size = snapshot;
+            tasks[t].candidates = candidates;
+            tasks[t].first = (t * chunk < num_candidates) ? t * chunk : num_candidates;
+            tasks[t].last = (tasks[t].first + chunk < num_candidates) ?
+                    tasks[t].first + chunk : num_candidates;
+            tasks[t].nearest = nearest;
+        }
+        for (t = 1; t < threads; t++){
+            pthread_create(&workers[t], NULL, hartWorker, &tasks[t]);
+        }
+        hartWorker(&tasks[0]);
+        for (t = 1; t < threads; t++){
+            pthread_join(workers[t], NULL);
+        }
+
+        /* Sequential replay against the objects added during this pass */
+        added = 0;
+        for (c = 0; c < num_candidates; c++){
+            x = candidates[c];
+            best = nearest[c].distance;
+            best_label = (nearest[c].index >= 0) ? labels[nearest[c].index] : -1;
+            for (s = snapshot; s < store_size; s++){
+                d = distance(&(data[(size_t) x*features]),
+                        &(data[(size_t) store[s]*features]), features);
+                if (d < best){
+                    best = d;
+                    best_label = labels[store[s]];
+                }
+            }
+            if (best_label != labels[x]){
+                store[store_size++] = x;
+                in_store[x] = 1;
+                added++;
+            }
+        }
+    } while (added > 0);
+
+    for (i = 0; i < num_obj; i++){
+        keep[i] = in_store[i];
+    }
+
+    free(store); free(candidates); free(in_store); free(nearest);
+    free(tasks); free(workers);
+    return store_size;
+}
+
+/**
+ * @brief Copies the kept objects, in order, to new arrays
+ *
+ * @param data Row-major feature vectors (num_obj x features)
+ * @param labels Labels of the objects
+ * @param num_obj Number of objects
+ * @param features Feature dimensionality
+ * @param keep Objects to copy
+ * @param out_data Output feature vectors, room for every kept object
+ * @param out_labels Output labels, room for every kept object
+ * @return Number of objects copied.
+ */
+int knnCompactSet(const float *data, const int *labels, int num_obj,
+        int features, const int *keep, float *out_data, int *out_labels){
+
+    int i, n = 0;
+
+    for (i = 0; i < num_obj; i++){
+        if (keep[i]){
+            memcpy(&(out_data[(size_t) n*features]), &(data[(size_t) i*features]),
+                    sizeof(float) * features);
+            out_labels[n++] = labels[i];
+        }
+    }
+    return n;
+}
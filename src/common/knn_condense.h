@@ -0,0 +1,24 @@
+/*
+ * @file knn_condense.h
+ * @brief Training set reduction: Wilson editing and Hart condensation
+ *
+ * Wilson editing (ENN) drops objects their K nearest neighbours vote
+ * against, which cleans noise and overlapping class borders. Hart's
+ * condensed nearest neighbour (CNN) then keeps only a subset that still
+ * classifies every remaining object correctly with 1-NN.
+ *
+ * Both take and return a keep[] flag per object, so they can be chained
+ * and their result written out with knnCompactSet().
+ */
+
+#ifndef KNN_CONDENSE_H
+#define KNN_CONDENSE_H
+
+int knnWilsonEdit(float *data, const int *labels, int num_obj, int features,
+        int classes, int k, int threads, int *keep);
+int knnHartCondense(float *data, const int *labels, int num_obj, int features,
+        int threads, int *keep);
+int knnCompactSet(const float *data, const int *labels, int num_obj,
+        int features, const int *keep, float *out_data, int *out_labels);
+
+#endif
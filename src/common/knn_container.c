@@ -0,0 +1,224 @@
+/*
+ * @file knn_container.c
+ * @brief Persistent, mmap-able index container
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "knn_container.h"
+
+/************************************************************************/
+
+/** @brief Rounds a file offset up to the section alignment */
+static uint64_t containerAlign(uint64_t offset){
+    return (offset + KNN_CONTAINER_ALIGN - 1) & ~((uint64_t) KNN_CONTAINER_ALIGN - 1);
+}
+
+/** @brief Writes zero bytes up to a file offset */
+static int containerPad(FILE *fp, uint64_t from, uint64_t to){
+    static const unsigned char zeros[KNN_CONTAINER_ALIGN];
+    return (to > from && fwrite(zeros, 1, to - from, fp) != to - from) ? -1 : 0;
+}
+
+/************************************************************************/
+
+/**
+ * @brief Folds bytes into a 64-bit FNV-1a hash
+ *
+ * @param data Bytes to hash
+ * @param size Number of bytes
+ * @param hash Running hash, KNN_FNV_OFFSET to start
+ * @return The updated hash.
+ */
+uint64_t knnHashBytes(const void *data, size_t size, uint64_t hash){
+
+    const unsigned char *p = data;
+    size_t i;
+
+    for (i = 0; i < size; i++){
+        hash ^= p[i];
+        hash *= KNN_FNV_PRIME;
+    }
+    return hash;
+}
+
+/**
+ * @brief Content hash of a set: shape, features and labels
+ *
+ * @param data Row-major feature vectors (num_obj x features)
+ * @param labels Labels, NULL to hash the features only
+ * @param num_obj Number of objects
+ * @param features Feature dimensionality
+ * @return 64-bit FNV-1a hash.
+ */
+uint64_t knnDatasetHash(const float *data, const int *labels, int num_obj, int features){
+
+    int32_t shape[2];
+    uint64_t hash = KNN_FNV_OFFSET;
+
+    shape[0] = num_obj;
+    shape[1] = features;
+    hash = knnHashBytes(shape, sizeof(shape), hash);
+    hash = knnHashBytes(data, sizeof(float) * (size_t) num_obj * features, hash);
+    if (labels != NULL){
+        hash = knnHashBytes(labels, sizeof(int) * (size_t) num_obj, hash);
+    }
+    return hash;
+}
+
+/**
+ * @brief Writes a container, each section on its own page boundary
+ *
+ * The file is written under a temporary name and renamed, so a reader
+ * never maps a partly written container.
+ *
+ * @param path Output file
+ * @param dataset_hash Hash of the indexed set
+ * @param sections Sections to store, unique tags
+ * @param num_sections Number of sections, <= KNN_CONTAINER_MAX_SECTIONS
+ * @return 0 on success, -1 otherwise.
+ */
+int knnContainerWrite(const char *path, uint64_t dataset_hash,
+        const KnnSection *sections, int num_sections){
+
+    KnnContainerHeader hdr;
+    char *tmp;
+    FILE *fp;
+    uint64_t offset;
+    int i, status = 0;
+
+    if (num_sections < 0 || num_sections > KNN_CONTAINER_MAX_SECTIONS){
+        return -1;
+    }
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = KNN_CONTAINER_MAGIC;
+    hdr.version = KNN_CONTAINER_VERSION;
+    hdr.dataset_hash = dataset_hash;
+    hdr.num_sections = num_sections;
+    offset = containerAlign(sizeof(hdr));
+    for (i = 0; i < num_sections; i++){
+        hdr.sections[i].tag = sections[i].tag;
+        hdr.sections[i].offset = offset;
+        hdr.sections[i].size = sections[i].size;
+        offset = containerAlign(offset + sections[i].size);
+    }
+    hdr.file_size = offset;
+
+    tmp = malloc(strlen(path) + 5);
+    if (tmp == NULL){
+        return -1;
+    }
+    sprintf(tmp, "%s.tmp", path);
+    fp = fopen(tmp, "wb");
+    if (fp == NULL){
+        free(tmp);
+        return -1;
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        containerPad(fp, sizeof(hdr), containerAlign(sizeof(hdr))) != 0){
+        status = -1;
+    }
+    for (i = 0; i < num_sections && status == 0; i++){
+        if (fwrite(sections[i].data, 1, sections[i].size, fp) != sections[i].size ||
+            containerPad(fp, hdr.sections[i].offset + sections[i].size,
+                containerAlign(hdr.sections[i].offset + sections[i].size)) != 0){
+            status = -1;
+        }
+    }
+    if (fclose(fp) != 0 || status != 0 || rename(tmp, path) != 0){
+        remove(tmp);
+        status = -1;
+    }
+    free(tmp);
+    return status;
+}
+
+/**
+ * @brief Maps a container read-only and checks its header
+ *
+ * @param path Container file
+ * @param container Output, release with knnContainerUnmap
+ * @return 0 on success, -1 if the file is missing, truncated or not a
+ *         container of this version.
+ */
+int knnContainerMap(const char *path, KnnContainer *container){
+
+    const KnnContainerHeader *hdr;
+    struct stat st;
+    void *base;
+    uint32_t i;
+    int fd;
+
+    container->base = NULL;
+    fd = open(path, O_RDONLY);
+    if (fd < 0){
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(KnnContainerHeader)){
+        close(fd);
+        return -1;
+    }
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED){
+        return -1;
+    }
+    container->base = base;
+    container->size = st.st_size;
+    container->header = hdr = base;
+
+    if (hdr->magic != KNN_CONTAINER_MAGIC || hdr->version != KNN_CONTAINER_VERSION ||
+        hdr->file_size != (uint64_t) st.st_size ||
+        hdr->num_sections > KNN_CONTAINER_MAX_SECTIONS){
+        knnContainerUnmap(container);
+        return -1;
+    }
+    for (i = 0; i < hdr->num_sections; i++){
+        if (hdr->sections[i].offset % KNN_CONTAINER_ALIGN != 0 ||
+            hdr->sections[i].offset + hdr->sections[i].size > hdr->file_size){
+            knnContainerUnmap(container);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Looks up a section of a mapped container
+ *
+ * @param container Mapped container
+ * @param tag Section tag
+ * @param size Output size in bytes, may be NULL
+ * @return Pointer to the section inside the mapping, NULL if absent.
+ */
+const void *knnContainerSection(const KnnContainer *container, uint32_t tag,
+        uint64_t *size){
+
+    const KnnContainerHeader *hdr = container->header;
+    uint32_t i;
+
+    for (i = 0; i < hdr->num_sections; i++){
+        if (hdr->sections[i].tag == tag){
+            if (size != NULL){
+                *size = hdr->sections[i].size;
+            }
+            return container->base + hdr->sections[i].offset;
+        }
+    }
+    return NULL;
+}
+
+/** @brief Unmaps a container */
+void knnContainerUnmap(KnnContainer *container){
+    if (container->base != NULL){
+        munmap((void *) container->base, container->size);
+    }
+    container->base = NULL;
+    container->header = NULL;
+}
@@ -0,0 +1,83 @@
+/*
+ * @file knn_container.h
+ * @brief Persistent, mmap-able index container
+ *
+ * A container file holds the sections of one or more index structures
+ * behind a fixed header:
+ *
+ *     page 0     KnnContainerHeader (magic, version, dataset hash,
+ *                file size, section table of {tag, offset, size})
+ *     page 1..   sections, each starting on a KNN_CONTAINER_ALIGN boundary
+ *
+ * Sections hold plain arrays and refer to each other by offsets, never
+ * pointers, so a mapped file is used in place: knnContainerMap() checks
+ * the header and knnContainerSection() returns a pointer into the
+ * mapping, with no copy or deserialization. The dataset hash
+ * (knnDatasetHash, 64-bit FNV-1a over the features and labels) tells
+ * whether the indexed data changed since the container was written.
+ */
+
+#ifndef KNN_CONTAINER_H
+#define KNN_CONTAINER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Container file magic number ("KNNC") */
+#define KNN_CONTAINER_MAGIC 0x434E4E4B
+/** Container file format version */
+#define KNN_CONTAINER_VERSION 1
+/** Alignment of the header and of every section (one page) */
+#define KNN_CONTAINER_ALIGN 4096
+/** Largest number of sections in a container */
+#define KNN_CONTAINER_MAX_SECTIONS 32
+
+/** FNV-1a 64-bit offset basis */
+#define KNN_FNV_OFFSET 0xcbf29ce484222325ull
+/** FNV-1a 64-bit prime */
+#define KNN_FNV_PRIME 0x100000001b3ull
+
+/** @brief Section table entry */
+typedef struct KnnSectionEntry_Struct{
+    uint32_t tag;               /**< Section tag, unique in the container */
+    uint32_t reserved;          /**< Zero */
+    uint64_t offset;            /**< Byte offset from the start of the file */
+    uint64_t size;              /**< Size in bytes */
+}KnnSectionEntry;
+
+/** @brief Container header, first page of the file */
+typedef struct KnnContainerHeader_Struct{
+    uint32_t magic;             /**< KNN_CONTAINER_MAGIC */
+    uint32_t version;           /**< KNN_CONTAINER_VERSION */
+    uint64_t dataset_hash;      /**< knnDatasetHash of the indexed set */
+    uint64_t file_size;         /**< Size of the whole file in bytes */
+    uint32_t num_sections;      /**< Entries used in sections[] */
+    uint32_t reserved;          /**< Zero */
+    KnnSectionEntry sections[KNN_CONTAINER_MAX_SECTIONS];  /**< Section table */
+}KnnContainerHeader;
+
+/** @brief Section to write */
+typedef struct KnnSection_Struct{
+    uint32_t tag;               /**< Section tag */
+    const void *data;           /**< Contents */
+    uint64_t size;              /**< Size in bytes */
+}KnnSection;
+
+/** @brief Mapped container */
+typedef struct KnnContainer_Struct{
+    const unsigned char *base;  /**< Start of the mapping */
+    size_t size;                /**< Size of the mapping */
+    const KnnContainerHeader *header;   /**< Header, at base */
+}KnnContainer;
+
+uint64_t knnHashBytes(const void *data, size_t size, uint64_t hash);
+uint64_t knnDatasetHash(const float *data, const int *labels, int num_obj, int features);
+
+int knnContainerWrite(const char *path, uint64_t dataset_hash,
+        const KnnSection *sections, int num_sections);
+int knnContainerMap(const char *path, KnnContainer *container);
+const void *knnContainerSection(const KnnContainer *container, uint32_t tag,
+        uint64_t *size);
+void knnContainerUnmap(KnnContainer *container);
+
+#endif
@@ -0,0 +1,124 @@
+/*
+ * @file knn_context.c
+ * @brief Reentrant classification API for embedding applications
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "knn_context.h"
+#include "knn_layout.h"
+
+/** @brief Classification context, read-only once created */
+struct KnnContext_Struct{
+    KnnBlockedSet set;      /**< Training set in blocked layout */
+    int k;                  /**< Number of neighbours */
+    int classes;            /**< Number of classes */
+    size_t dist_size;       /**< Bytes of the distance row in the scratch */
+};
+
+/** @brief Rounds a size up to the layout alignment */
+static inline size_t contextAlign(size_t size){
+    return (size + KNN_LAYOUT_ALIGN - 1) & ~((size_t) KNN_LAYOUT_ALIGN - 1);
+}
+
+/************************************************************************/
+
+/**
+ * @brief Creates a classification context
+ *
+ * @param train Training set, copied; the caller may release it afterwards
+ * @param opts Options
+ * @param ctx Output context, release with knnContextDestroy
+ * @return 0 on success, -1 on invalid options or allocation failure.
+ */
+int knnContextCreate(const KnnTrainSet *train, const KnnOptions *opts, KnnContext **ctx){
+
+    KnnContext *c;
+    int i, block = opts->block ? opts->block : KNN_LAYOUT_BLOCK16;
+
+    if (train->num_obj < 1 || train->features < 1 || opts->k < 1 ||
+        opts->k > train->num_obj || opts->classes < 1){
+        return -1;
+    }
+    for (i = 0; i < train->num_obj; i++){
+        if (train->labels[i] < 0 || train->labels[i] >= opts->classes){
+            return -1;
+        }
+    }
+    c = malloc(sizeof(KnnContext));
+    if (c == NULL){
+        return -1;
+    }
+    if (knnBlockedFromRows(train->data, train->labels, train->num_obj,
+            train->features, block, &c->set) != 0){
+        free(c);
+        return -1;
+    }
+    c->k = opts->k;
+    c->classes = opts->classes;
+    c->dist_size = contextAlign(sizeof(float) * c->set.num_blocks * c->set.block);
+    *ctx = c;
+    return 0;
+}
+
+/**
+ * @brief Bytes of scratch memory one knnClassifyBatch call needs
+ *
+ * The size does not depend on the batch size; it includes the slack to
+ * align the buffer internally, so any malloc'd buffer will do.
+ */
+size_t knnScratchSize(const KnnContext *ctx){
+    return KNN_LAYOUT_ALIGN + ctx->dist_size
+            + contextAlign(sizeof(DistIndexPair) * ctx->k)
+            + contextAlign(sizeof(int) * ctx->k)
+            + contextAlign(sizeof(int) * ctx->classes);
+}
+
+/**
+ * @brief Classifies a batch of queries
+ *
+ * Squared euclidean distance and majority vote; ties in distance keep the
+ * lowest training index, ties in the vote the lowest class. No memory is
+ * allocated. Concurrent calls on the same context are safe as long as
+ * each uses its own scratch buffer.
+ *
+ * @param ctx Context
+ * @param scratch Scratch buffer of knnScratchSize(ctx) bytes, any alignment
+ * @param queries Row-major query feature vectors (num_queries x features)
+ * @param num_queries Number of queries
+ * @param out_labels Output labels (num_queries)
+ * @param out_neighbours Output neighbour lists (num_queries x k, ascending
+ *                       distance, training indices), NULL if not needed
+ * @return 0 on success, -1 on invalid arguments.
+ */
+int knnClassifyBatch(const KnnContext *ctx, void *scratch, const float *queries,
+        int num_queries, int *out_labels, DistIndexPair *out_neighbours){
+
+    char *mem;
+    float *dist;
+    DistIndexPair *list;
+    int *closest, *votes;
+    int k = ctx->k;
+
+    if (scratch == NULL || queries == NULL || out_labels == NULL || num_queries < 0){
+        return -1;
+    }
+    mem = (char *) contextAlign((uintptr_t) scratch);
+    dist = (float *) mem;
+    list = (DistIndexPair *) (mem + ctx->dist_size);
+    closest = (int *) ((char *) list + contextAlign(sizeof(DistIndexPair) * k));
+    votes = (int *) ((char *) closest + contextAlign(sizeof(int) * k));
+
+    knnBlockedClassifyScratch(&ctx->set, queries, num_queries, k, ctx->classes,
+            dist, list, closest, votes, out_labels, out_neighbours);
+    return 0;
+}
+
+/** @brief Releases a context */
+void knnContextDestroy(KnnContext *ctx){
+    if (ctx != NULL){
+        knnBlockedFree(&ctx->set);
+        free(ctx);
+    }
+}
@@ -0,0 +1,51 @@
+/*
+ * @file knn_context.h
+ * @brief Reentrant classification API for embedding applications
+ *
+ * knnContextCreate() copies a training set once into the blocked layout
+ * of knn_layout.h; the context is read-only afterwards, so any number of
+ * threads may classify against it at the same time. Every call brings its
+ * own scratch memory, sized by knnScratchSize(), and knnClassifyBatch()
+ * performs no allocation: an application keeps a warm context and one
+ * scratch buffer per thread and pays the setup once.
+ *
+ *     KnnContext *ctx;
+ *     void *scratch;
+ *
+ *     knnContextCreate(&train, &opts, &ctx);
+ *     scratch = malloc(knnScratchSize(ctx));
+ *     knnClassifyBatch(ctx, scratch, queries, n, labels, NULL);
+ */
+
+#ifndef KNN_CONTEXT_H
+#define KNN_CONTEXT_H
+
+#include <stddef.h>
+
+#include "knn_kernels.h"
+
+/** @brief Training set handed to knnContextCreate, copied by it */
+typedef struct KnnTrainSet_Struct{
+    const float *data;      /**< Row-major feature vectors (num_obj x features) */
+    const int *labels;      /**< Labels in [0, classes) */
+    int num_obj;            /**< Number of objects */
+    int features;           /**< Feature dimensionality */
+}KnnTrainSet;
+
+/** @brief Classification options */
+typedef struct KnnOptions_Struct{
+    int k;                  /**< Number of neighbours */
+    int classes;            /**< Number of classes */
+    int block;              /**< Layout block, KNN_LAYOUT_BLOCK8/16, 0 for the default */
+}KnnOptions;
+
+/** @brief Opaque classification context */
+typedef struct KnnContext_Struct KnnContext;
+
+int knnContextCreate(const KnnTrainSet *train, const KnnOptions *opts, KnnContext **ctx);
+size_t knnScratchSize(const KnnContext *ctx);
+int knnClassifyBatch(const KnnContext *ctx, void *scratch, const float *queries,
+        int num_queries, int *out_labels, DistIndexPair *out_neighbours);
+void knnContextDestroy(KnnContext *ctx);
+
+#endif
@@ -0,0 +1,158 @@
+/*
+ * @file knn_dataset.c
+ * @brief Dataset binary file loading and writing
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "knn_dataset.h"
+
+/**
+ *  @brief Reads one set (feature vectors and labels) to memory
+ *
+ *  Each file is read with a single bulk fread straight into its
+ *  destination array.
+ *
+ *  @param data_bin Feature vectors binary file
+ *  @param label_bin Labels binary file
+ *  @param num_obj Number of objects to read
+ *  @param features Number of features per object
+ *  @param data Output row-major feature vectors (num_obj x features)
+ *  @param labels Output labels (num_obj)
+ *  @return 0 on success, -1 otherwise.
+ */
+int loadBinarySet(const char *data_bin, const char *label_bin,
+        int num_obj, int features, float **data, int **labels){
+
+    FILE *fp_data, *fp_label;
+    size_t n_features = (size_t) num_obj * features;
+    float *tmp_data;
+    int *tmp_label;
+    int status = 0;
+
+    fp_data = fopen(data_bin, "rb");
+    fp_label = fopen(label_bin, "rb");
+    tmp_data = malloc(sizeof(float) * n_features);
+    tmp_label = malloc(sizeof(int) * num_obj);
+
+    if (fp_data == NULL || fp_label == NULL ||
+        tmp_data == NULL || tmp_label == NULL){
+        status = -1;
+    } else if (fread(tmp_data, sizeof(float), n_features, fp_data) != n_features ||
+        fread(tmp_label, sizeof(int), num_obj, fp_label) != (size_t) num_obj){
+        status = -1;
+    }
+
+    if (fp_data != NULL){
+        fclose(fp_data);
+    }
+    if (fp_label != NULL){
+        fclose(fp_label);
+    }
+    if (status != 0){
+        free(tmp_data);
+        free(tmp_label);
+        return status;
+    }
+
+    *data = tmp_data;
+    *labels = tmp_label;
+    return 0;
+}
+
+/**
+ *  @brief Reads the labels of one set to memory
+ *
+ *  Used by the out-of-core mode, which streams the feature vectors.
+ *
+ *  @param label_bin Labels binary file
+ *  @param num_obj Number of objects to read
+ *  @param labels Output labels (num_obj)
+ *  @return 0 on success, -1 otherwise.
+ */
+int loadBinaryLabels(const char *label_bin, int num_obj, int **labels){
+
+    FILE *fp_label = fopen(label_bin, "rb");
+    int *tmp_label = malloc(sizeof(int) * num_obj);
+    int status = 0;
+
+    if (fp_label == NULL || tmp_label == NULL ||
+        fread(tmp_label, sizeof(int), num_obj, fp_label) != (size_t) num_obj){
+        status = -1;
+    }
+    if (fp_label != NULL){
+        fclose(fp_label);
+    }
+    if (status != 0){
+        free(tmp_label);
+        return status;
+    }
+    *labels = tmp_label;
+    return 0;
+}
+
+/**
+ *  @brief Reads the feature vectors of one set to memory
+ *
+ *  Used by clients that only send the vectors, such as the load generator.
+ *
+ *  @param data_bin Feature vectors binary file
+ *  @param num_obj Number of objects to read
+ *  @param features Number of features per object
+ *  @param data Output feature vectors (num_obj x features)
+ *  @return 0 on success, -1 otherwise.
+ */
+int loadBinaryData(const char *data_bin, int num_obj, int features, float **data){
+
+    FILE *fp_data = fopen(data_bin, "rb");
+    float *tmp_data = malloc(sizeof(float) * (size_t) num_obj * features);
+    int status = 0;
+
+    if (fp_data == NULL || tmp_data == NULL ||
+        fread(tmp_data, sizeof(float) * features, num_obj, fp_data) != (size_t) num_obj){
+        status = -1;
+    }
+    if (fp_data != NULL){
+        fclose(fp_data);
+    }
+    if (status != 0){
+        free(tmp_data);
+        return status;
+    }
+    *data = tmp_data;
+    return 0;
+}
+
+/**
+ *  @brief Writes a raw array to <prefix>_<suffix>.bin
+ *
+ *  Output of the dataset tools (knn_compile, knn_condense), in the same
+ *  raw format the loaders above read.
+ *
+ *  @param prefix Output file prefix
+ *  @param suffix Output file suffix, e.g. "data" or "label"
+ *  @param array Array to write
+ *  @param size Size of one element
+ *  @param count Number of elements
+ *  @return 0 on success, -1 otherwise.
+ */
+int writeBinaryArray(const char *prefix, const char *suffix, const void *array,
+        size_t size, size_t count){
+
+    char path[KNN_DATASET_PATH_LEN];
+    FILE *fp;
+    int status = 0;
+
+    snprintf(path, sizeof(path), "%s_%s.bin", prefix, suffix);
+    fp = fopen(path, "wb");
+    if (fp == NULL){
+        return -1;
+    }
+    if (fwrite(array, size, count, fp) != count){
+        status = -1;
+    }
+    fclose(fp);
+    printf("Wrote %s\n", path);
+    return status;
+}
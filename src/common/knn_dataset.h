@@ -0,0 +1,25 @@
+/*
+ * @file knn_dataset.h
+ * @brief Dataset binary file loading and writing
+ *
+ * The dataset binaries generated by dataset/preproc/gen_data.c are raw
+ * arrays: sp-float feature vectors stored row-major and one int label
+ * per object.
+ */
+
+#ifndef KNN_DATASET_H
+#define KNN_DATASET_H
+
+#include <stddef.h>
+
+/** Longest binary file name built by writeBinaryArray */
+#define KNN_DATASET_PATH_LEN 1024
+
+int loadBinarySet(const char *data_bin, const char *label_bin,
+        int num_obj, int features, float **data, int **labels);
+int loadBinaryLabels(const char *label_bin, int num_obj, int **labels);
+int loadBinaryData(const char *data_bin, int num_obj, int features, float **data);
+int writeBinaryArray(const char *prefix, const char *suffix, const void *array,
+        size_t size, size_t count);
+
+#endif
@@ -0,0 +1,183 @@
+/*
+ * @file knn_eval.c
+ * @brief Single-pass K sweep and k-fold cross-validation
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "knn_eval.h"
+
+/************************************************************************/
+
+/**
+ * @brief Computes the kmax nearest training objects of each query
+ *
+ * Ties are broken in favour of the lowest training index.
+ *
+ * @param queries Row-major query feature vectors (num_queries x features)
+ * @param num_queries Number of queries
+ * @param data Row-major training feature vectors (num_obj x features)
+ * @param num_obj Number of training objects
+ * @param features Feature dimensionality
+ * @param kmax Number of neighbours per query
+ * @param out Output neighbour lists (num_queries x kmax), ascending distance
+ */
+void knnNeighbours(float *queries, int num_queries, float *data, int num_obj,
+        int features, int kmax, DistIndexPair *out){
+
+    int i, j, n;
+    DistIndexPair *list;
+
+    for (i = 0; i < num_queries; i++){
+        list = &(out[(size_t) i*kmax]);
+        n = 0;
+        for (j = 0; j < num_obj; j++){
+            n = topKPush(list, n, kmax,
+                    distance(&(queries[i*features]), &(data[j*features]), features), j);
+        }
+        for (; n < kmax; n++){
+            list[n].distance = INFINITY;
+            list[n].index = -1;
+        }
+    }
+}
+
+/**
+ * @brief Scores one query for every K from its sorted neighbour list
+ *
+ * Votes are added one neighbour at a time. Only the class that just got
+ * a vote can overtake the current winner, so the majorityVote() result
+ * for every prefix is tracked in O(1) per neighbour. When the list is
+ * shorter than kmax, larger K reuse the vote of the whole list.
+ *
+ * @param list Sorted neighbour list
+ * @param size Number of entries in the list
+ * @param kmax Largest K scored
+ * @param label_trn Training set labels
+ * @param truth Correct label of the query
+ * @param votes Scratch array of classes vote counters
+ * @param classes Number of classes
+ * @param correct Per-K correct counters, incremented in place
+ */
+void knnSweepQuery(const DistIndexPair *list, int size, int kmax,
+        const int *label_trn, int truth, int *votes, int classes, int *correct){
+
+    int k, c;
+    int assigned_label = 0;
+    int vote = 0;
+
+    memset(votes, 0, sizeof(int) * classes);
+    for (k = 0; k < kmax; k++){
+        if (k < size && list[k].index >= 0){
+            c = label_trn[ list[k].index ];
+            votes[c]++;
+            if (votes[c] > vote || (votes[c] == vote && c < assigned_label)){
+                vote = votes[c];
+                assigned_label = c;
+            }
+        }
+        if (assigned_label == truth){
+            correct[k]++;
+        }
+    }
+}
+
+/**
+ * @brief Counts correct predictions for every K <= kmax
+ *
+ * @param neighbours Neighbour lists from knnNeighbours (num_queries x kmax)
+ * @param num_queries Number of queries
+ * @param kmax Number of neighbours per query
+ * @param label_trn Training set labels
+ * @param label_tst Correct labels of the queries
+ * @param classes Number of classes
+ * @param correct Output, correct[k-1] is the number of hits with K = k
+ */
+void knnSweepK(const DistIndexPair *neighbours, int num_queries, int kmax,
+        const int *label_trn, const int *label_tst, int classes, int *correct){
+
+    int i;
+    int *votes = malloc(sizeof(int) * classes);
+
+    memset(correct, 0, sizeof(int) * kmax);
+    for (i = 0; i < num_queries; i++){
+        knnSweepQuery(&(neighbours[(size_t) i*kmax]), kmax, kmax, label_trn,
+                label_tst[i], votes, classes, correct);
+    }
+    free(votes);
+}
+
+/************************************************************************/
+
+/** @brief xorshift32 step, keeps fold assignment independent of rand() */
+static unsigned xorshift32(unsigned *state){
+    unsigned x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+/**
+ * @brief k-fold cross-validation of every K <= kmax in a single pass
+ *
+ * Objects are shuffled into folds. Each object is the query of its own
+ * fold exactly once, so its kmax nearest neighbours among the objects of
+ * the other folds are computed once and scored for every K.
+ *
+ * @param data Row-major feature vectors (num_obj x features)
+ * @param labels Labels of the objects
+ * @param num_obj Number of objects
+ * @param features Feature dimensionality
+ * @param classes Number of classes
+ * @param kmax Largest K evaluated
+ * @param folds Number of folds
+ * @param seed Seed of the fold assignment
+ * @param correct Output (folds x kmax), hits of fold f with K = k at [f*kmax + k-1]
+ * @param fold_size Output (folds), number of objects in each fold
+ */
+void knnCrossValidate(float *data, const int *labels, int num_obj,
+        int features, int classes, int kmax, int folds, unsigned seed,
+        int *correct, int *fold_size){
+
+    int *fold = malloc(sizeof(int) * num_obj);
+    int *order = malloc(sizeof(int) * num_obj);
+    int *votes = malloc(sizeof(int) * classes);
+    DistIndexPair *list = malloc(sizeof(DistIndexPair) * kmax);
+    unsigned state = seed ? seed : 1;
+    int i, j, n, tmp;
+
+    /* Shuffle, then deal objects round-robin into folds */
+    for (i = 0; i < num_obj; i++){
+        order[i] = i;
+    }
+    for (i = num_obj - 1; i > 0; i--){
+        j = (int) (xorshift32(&state) % (unsigned) (i + 1));
+        tmp = order[i]; order[i] = order[j]; order[j] = tmp;
+    }
+    memset(fold_size, 0, sizeof(int) * folds);
+    for (i = 0; i < num_obj; i++){
+        fold[ order[i] ] = i % folds;
+        fold_size[i % folds]++;
+    }
+
+    memset(correct, 0, sizeof(int) * folds * kmax);
+    for (i = 0; i < num_obj; i++){
+        n = 0;
+        for (j = 0; j < num_obj; j++){
+            if (fold[j] != fold[i]){
+                n = topKPush(list, n, kmax,
+                        distance(&(data[i*features]), &(data[j*features]), features), j);
+            }
+        }
+        for (; n < kmax; n++){
+            list[n].distance = INFINITY;
+            list[n].index = -1;
+        }
+        knnSweepQuery(list, kmax, kmax, labels, labels[i], votes, classes,
+                &(correct[fold[i]*kmax]));
+    }
+
+    free(fold); free(order); free(votes); free(list);
+}
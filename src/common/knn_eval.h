@@ -0,0 +1,26 @@
+/*
+ * @file knn_eval.h
+ * @brief Single-pass K sweep and k-fold cross-validation
+ *
+ * The Kmax nearest neighbours of every query are computed once, in
+ * ascending distance order; the prediction for every K <= Kmax is then
+ * derived from that list in O(Kmax) per query, so evaluating all K
+ * costs about the same as a single classification run.
+ */
+
+#ifndef KNN_EVAL_H
+#define KNN_EVAL_H
+
+#include "knn_kernels.h"
+
+void knnNeighbours(float *queries, int num_queries, float *data, int num_obj,
+        int features, int kmax, DistIndexPair *out);
+void knnSweepQuery(const DistIndexPair *list, int size, int kmax,
+        const int *label_trn, int truth, int *votes, int classes, int *correct);
+void knnSweepK(const DistIndexPair *neighbours, int num_queries, int kmax,
+        const int *label_trn, const int *label_tst, int classes, int *correct);
+void knnCrossValidate(float *data, const int *labels, int num_obj,
+        int features, int classes, int kmax, int folds, unsigned seed,
+        int *correct, int *fold_size);
+
+#endif
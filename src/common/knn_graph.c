@@ -0,0 +1,305 @@
+/*
+ * @file knn_graph.c
+ * @brief All-kNN graph of a single set (training set against itself)
+ *
+ * Work is handed out one tile row at a time: a worker takes row block bi
+ * and computes the tiles (bi, bj) for every bj >= bi. Each tile is
+ * computed into a private buffer, then pushed to the rows of block bi and
+ * to the rows of block bj, each under that block's lock. A worker holds
+ * at most one lock at a time.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "knn_graph.h"
+#include "knn_eval.h"
+
+/************************************************************************/
+
+/** @brief State shared by the graph builder threads */
+typedef struct GraphBuild_Struct{
+    float *data;                /**< Row-major feature vectors */
+    int num_obj;                /**< Number of objects */
+    int features;               /**< Feature dimensionality */
+    int k;                      /**< Neighbours per object */
+    int num_blocks;             /**< Number of row blocks */
+    int next_block;             /**< Next tile row to hand out (atomic) */
+    DistIndexPair *lists;       /**< Top-K list of each object (num_obj x k) */
+    int *sizes;                 /**< Entries in each top-K list */
+    pthread_mutex_t *locks;     /**< One lock per row block */
+    int failed;                 /**< A worker could not allocate its tile (atomic) */
+}GraphBuild;
+
+/** @brief Graph file header */
+typedef struct GraphHeader_Struct{
+    uint32_t magic;             /**< KNN_GRAPH_MAGIC */
+    uint32_t version;           /**< KNN_GRAPH_VERSION */
+    int32_t num_obj;            /**< Number of rows */
+    int32_t k;                  /**< Neighbours requested per row */
+    int64_t nnz;                /**< Number of edges */
+}GraphHeader;
+
+/************************************************************************/
+
+/**
+ * @brief Computes tile (bi, bj) and pushes it to both row blocks
+ *
+ * @param gb Builder state
+ * @param bi Row block
+ * @param bj Column block, bj >= bi
+ * @param tile Private tile buffer (KNN_GRAPH_TILE^2)
+ */
+static void graphTile(GraphBuild *gb, int bi, int bj, float *tile){
+
+    int r0 = bi * KNN_GRAPH_TILE, c0 = bj * KNN_GRAPH_TILE;
+    int nr = gb->num_obj - r0, nc = gb->num_obj - c0;
+    int r, c, i, j;
+    float d;
+
+    if (nr > KNN_GRAPH_TILE) nr = KNN_GRAPH_TILE;
+    if (nc > KNN_GRAPH_TILE) nc = KNN_GRAPH_TILE;
+
+    for (r = 0; r < nr; r++){
+        for (c = (bi == bj) ? r + 1 : 0; c < nc; c++){
+            tile[r*KNN_GRAPH_TILE + c] = distance(&(gb->data[(size_t) (r0 + r)*gb->features]),
+                    &(gb->data[(size_t) (c0 + c)*gb->features]), gb->features);
+        }
+    }
+
+    /* Rows of block bi, and both directions of a diagonal tile */
+    pthread_mutex_lock(&gb->locks[bi]);
+    for (r = 0; r < nr; r++){
+        i = r0 + r;
+        for (c = (bi == bj) ? r + 1 : 0; c < nc; c++){
+            j = c0 + c;
+            d = tile[r*KNN_GRAPH_TILE + c];
+            gb->sizes[i] = topKPushByIndex(&(gb->lists[(size_t) i*gb->k]), gb->sizes[i], gb->k, d, j);
+            if (bi == bj){
+                gb->sizes[j] = topKPushByIndex(&(gb->lists[(size_t) j*gb->k]), gb->sizes[j], gb->k, d, i);
+            }
+        }
+    }
+    pthread_mutex_unlock(&gb->locks[bi]);
+
+    if (bi == bj){
+        return;
+    }
+
+    /* Rows of block bj, transposed */
+    pthread_mutex_lock(&gb->locks[bj]);
+    for (c = 0; c < nc; c++){
+        j = c0 + c;
+        for (r = 0; r < nr; r++){
+            gb->sizes[j] = topKPushByIndex(&(gb->lists[(size_t) j*gb->k]), gb->sizes[j], gb->k,
+                    tile[r*KNN_GRAPH_TILE + c], r0 + r);
+        }
+    }
+    pthread_mutex_unlock(&gb->locks[bj]);
+}
+
+/** @brief Builder thread, processes tile rows until none are left */
+static void *graphWorker(void *arg){
+    GraphBuild *gb = arg;
+    float *tile = malloc(sizeof(float) * KNN_GRAPH_TILE * KNN_GRAPH_TILE);
+    int bi, bj;
+
+    if (tile == NULL){
+        __atomic_store_n(&gb->failed, 1, __ATOMIC_RELEASE);
+        return NULL;
+    }
+    while ((bi = __atomic_fetch_add(&gb->next_block, 1, __ATOMIC_RELAXED)) < gb->num_blocks){
+        for (bj = bi; bj < gb->num_blocks; bj++){
+            graphTile(gb, bi, bj, tile);
+        }
+    }
+    free(tile);
+    return NULL;
+}
+
+/************************************************************************/
+
+/**
+ * @brief Builds the all-kNN graph of a set, self-matches excluded
+ *
+ * @param data Row-major feature vectors (num_obj x features)
+ * @param num_obj Number of objects
+ * @param features Feature dimensionality
+ * @param k Neighbours per object
+ * @param threads Number of worker threads
+ * @param graph Output graph, release with knnGraphFree
+ * @return 0 on success, -1 otherwise.
+ */
+int knnGraphBuild(float *data, int num_obj, int features, int k,
+        int threads, KnnGraph *graph){
+
+    GraphBuild gb;
+    pthread_t *workers;
+    int i, t, n;
+
+    gb.data = data;
+    gb.num_obj = num_obj;
+    gb.features = features;
+    gb.k = k;
+    gb.num_blocks = (num_obj + KNN_GRAPH_TILE - 1) / KNN_GRAPH_TILE;
+    gb.next_block = 0;
+    gb.failed = 0;
+    gb.lists = malloc(sizeof(DistIndexPair) * (size_t) num_obj * k);
+    gb.sizes = calloc(num_obj, sizeof(int));
+    gb.locks = malloc(sizeof(pthread_mutex_t) * gb.num_blocks);
+    if (threads < 1){
+        threads = 1;
+    }
+    workers = malloc(sizeof(pthread_t) * threads);
+    if (gb.lists == NULL || gb.sizes == NULL || gb.locks == NULL || workers == NULL){
+        free(gb.lists); free(gb.sizes); free(gb.locks); free(workers);
+        return -1;
+    }
+    for (i = 0; i < gb.num_blocks; i++){
+        pthread_mutex_init(&gb.locks[i], NULL);
+    }
+
+    for (t = 1; t < threads; t++){
+        pthread_create(&workers[t], NULL, graphWorker, &gb);
+    }
+    graphWorker(&gb);
+    for (t = 1; t < threads; t++){
+        pthread_join(workers[t], NULL);
+    }
+    for (i = 0; i < gb.num_blocks; i++){
+        pthread_mutex_destroy(&gb.locks[i]);
+    }
+
+    /* Compact the lists into CSR */
+    graph->num_obj = num_obj;
+    graph->k = k;
+    graph->row_ptr = malloc(sizeof(int) * (num_obj + 1));
+    graph->edges = NULL;
+    if (graph->row_ptr != NULL){
+        graph->row_ptr[0] = 0;
+        for (i = 0; i < num_obj; i++){
+            graph->row_ptr[i+1] = graph->row_ptr[i] + gb.sizes[i];
+        }
+        graph->edges = malloc(sizeof(DistIndexPair) * (graph->row_ptr[num_obj] + 1));
+    }
+    if (gb.failed || graph->row_ptr == NULL || graph->edges == NULL){
+        free(graph->row_ptr); free(graph->edges);
+        graph->row_ptr = NULL;
+        graph->edges = NULL;
+        free(gb.lists); free(gb.sizes); free(gb.locks); free(workers);
+        return -1;
+    }
+    for (i = 0; i < num_obj; i++){
+        n = gb.sizes[i];
+        memcpy(&(graph->edges[graph->row_ptr[i]]), &(gb.lists[(size_t) i*k]),
+                sizeof(DistIndexPair) * n);
+    }
+
+    free(gb.lists); free(gb.sizes); free(gb.locks); free(workers);
+    return 0;
+}
+
+/**
+ * @brief Writes a graph: header, row_ptr[num_obj+1], edges[nnz]
+ *
+ * @param graph Graph to write
+ * @param path Output file
+ * @return 0 on success, -1 otherwise.
+ */
+int knnGraphWrite(const KnnGraph *graph, const char *path){
+
+    GraphHeader hdr;
+    FILE *fp = fopen(path, "wb");
+    int status = 0;
+
+    if (fp == NULL){
+        return -1;
+    }
+    hdr.magic = KNN_GRAPH_MAGIC;
+    hdr.version = KNN_GRAPH_VERSION;
+    hdr.num_obj = graph->num_obj;
+    hdr.k = graph->k;
+    hdr.nnz = graph->row_ptr[graph->num_obj];
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        fwrite(graph->row_ptr, sizeof(int), graph->num_obj + 1, fp) != (size_t) graph->num_obj + 1 ||
+        fwrite(graph->edges, sizeof(DistIndexPair), hdr.nnz, fp) != (size_t) hdr.nnz){
+        status = -1;
+    }
+    fclose(fp);
+    return status;
+}
+
+/**
+ * @brief Reads a graph written by knnGraphWrite
+ *
+ * @param path Input file
+ * @param graph Output graph, release with knnGraphFree
+ * @return 0 on success, -1 otherwise.
+ */
+int knnGraphRead(const char *path, KnnGraph *graph){
+
+    GraphHeader hdr;
+    FILE *fp = fopen(path, "rb");
+    int status = 0;
+
+    if (fp == NULL){
+        return -1;
+    }
+    graph->row_ptr = NULL;
+    graph->edges = NULL;
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        hdr.magic != KNN_GRAPH_MAGIC || hdr.version != KNN_GRAPH_VERSION){
+        fclose(fp);
+        return -1;
+    }
+    graph->num_obj = hdr.num_obj;
+    graph->k = hdr.k;
+    graph->row_ptr = malloc(sizeof(int) * (hdr.num_obj + 1));
+    graph->edges = malloc(sizeof(DistIndexPair) * (hdr.nnz + 1));
+    if (graph->row_ptr == NULL || graph->edges == NULL ||
+        fread(graph->row_ptr, sizeof(int), hdr.num_obj + 1, fp) != (size_t) hdr.num_obj + 1 ||
+        fread(graph->edges, sizeof(DistIndexPair), hdr.nnz, fp) != (size_t) hdr.nnz){
+        knnGraphFree(graph);
+        status = -1;
+    }
+    fclose(fp);
+    return status;
+}
+
+/**
+ * @brief Leave-one-out accuracy of every K <= graph k
+ *
+ * Each object is classified by its own graph row, which never contains
+ * itself, so the row is exactly its neighbour list in the leave-one-out
+ * training set.
+ *
+ * @param graph All-kNN graph of the set
+ * @param labels Labels of the objects
+ * @param classes Number of classes
+ * @param correct Output, correct[k-1] is the number of hits with K = k
+ */
+void knnGraphLeaveOneOut(const KnnGraph *graph, const int *labels,
+        int classes, int *correct){
+
+    int *votes = malloc(sizeof(int) * classes);
+    int i;
+
+    memset(correct, 0, sizeof(int) * graph->k);
+    for (i = 0; i < graph->num_obj; i++){
+        knnSweepQuery(&(graph->edges[graph->row_ptr[i]]),
+                graph->row_ptr[i+1] - graph->row_ptr[i], graph->k,
+                labels, labels[i], votes, classes, correct);
+    }
+    free(votes);
+}
+
+/** @brief Releases a graph */
+void knnGraphFree(KnnGraph *graph){
+    free(graph->row_ptr);
+    free(graph->edges);
+    graph->row_ptr = NULL;
+    graph->edges = NULL;
+}
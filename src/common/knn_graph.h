@@ -0,0 +1,39 @@
+/*
+ * @file knn_graph.h
+ * @brief All-kNN graph of a single set (training set against itself)
+ *
+ * Every pair is computed once in blocked upper-triangle tiles and pushed
+ * to the top-K lists of both objects, exploiting d(i,j) = d(j,i);
+ * self-matches are excluded. The result is a CSR neighbour graph.
+ */
+
+#ifndef KNN_GRAPH_H
+#define KNN_GRAPH_H
+
+#include "knn_kernels.h"
+
+/** Objects per side of a distance tile */
+#define KNN_GRAPH_TILE 64
+
+/** Graph file magic number ("KNNG") */
+#define KNN_GRAPH_MAGIC 0x474E4E4B
+/** Graph file format version */
+#define KNN_GRAPH_VERSION 1
+
+/** @brief CSR neighbour graph */
+typedef struct KnnGraph_Struct{
+    int num_obj;            /**< Number of objects (rows) */
+    int k;                  /**< Neighbours requested per object */
+    int *row_ptr;           /**< Row i spans [row_ptr[i], row_ptr[i+1]) */
+    DistIndexPair *edges;   /**< Neighbours of each row, ascending distance */
+}KnnGraph;
+
+int knnGraphBuild(float *data, int num_obj, int features, int k,
+        int threads, KnnGraph *graph);
+int knnGraphWrite(const KnnGraph *graph, const char *path);
+int knnGraphRead(const char *path, KnnGraph *graph);
+void knnGraphLeaveOneOut(const KnnGraph *graph, const int *labels,
+        int classes, int *correct);
+void knnGraphFree(KnnGraph *graph);
+
+#endif
@@ -0,0 +1,146 @@
+/*
+ * @file knn_hist.c
+ * @brief HDR-style latency histogram
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "knn_hist.h"
+
+/************************************************************************/
+
+/** @brief Bucket of a value */
+static inline int histIndex(int sub_bits, uint64_t value){
+
+    int shift;
+
+    if (value < (1ull << sub_bits)){
+        return (int) value;
+    }
+    /* value >> shift falls in [2^(sub_bits-1), 2^sub_bits) */
+    shift = 63 - __builtin_clzll(value) - (sub_bits - 1);
+    return (1 << sub_bits) + (shift - 1) * (1 << (sub_bits - 1))
+            + (int) ((value >> shift) - (1ull << (sub_bits - 1)));
+}
+
+/** @brief Largest value that falls in a bucket */
+static uint64_t histHighest(int sub_bits, int index){
+
+    int half = 1 << (sub_bits - 1), shift;
+
+    if (index < (1 << sub_bits)){
+        return (uint64_t) index;
+    }
+    shift = (index - (1 << sub_bits)) / half + 1;
+    return ((uint64_t) ((index - (1 << sub_bits)) % half + half) << shift)
+            + (1ull << shift) - 1;
+}
+
+/************************************************************************/
+
+/**
+ * @brief Allocates an empty histogram
+ *
+ * @param hist Histogram, release with knnHistFree
+ * @param max_value Largest value tracked
+ * @param sub_bits Sub-bucket bits (1..16), relative error below 2^-(sub_bits-1)
+ * @return 0 on success, -1 otherwise.
+ */
+int knnHistInit(KnnHist *hist, uint64_t max_value, int sub_bits){
+
+    memset(hist, 0, sizeof(*hist));
+    if (sub_bits < 1 || sub_bits > 16 || max_value < 1){
+        return -1;
+    }
+    hist->sub_bits = sub_bits;
+    hist->max_value = max_value;
+    hist->num_buckets = histIndex(sub_bits, max_value) + 1;
+    hist->counts = calloc(hist->num_buckets, sizeof(uint64_t));
+    if (hist->counts == NULL){
+        return -1;
+    }
+    hist->min = UINT64_MAX;
+    return 0;
+}
+
+/** @brief Records a value, clamped to max_value */
+void knnHistRecord(KnnHist *hist, uint64_t value){
+
+    if (value > hist->max_value){
+        value = hist->max_value;
+    }
+    hist->counts[ histIndex(hist->sub_bits, value) ]++;
+    hist->total++;
+    hist->sum += (double) value;
+    hist->min = (value < hist->min) ? value : hist->min;
+    hist->max = (value > hist->max) ? value : hist->max;
+}
+
+/**
+ * @brief Adds the counts of a histogram with the same shape
+ *
+ * @param dst Histogram to add to
+ * @param src Histogram created with the same max_value and sub_bits
+ */
+void knnHistAdd(KnnHist *dst, const KnnHist *src){
+
+    int i;
+
+    for (i = 0; i < dst->num_buckets; i++){
+        dst->counts[i] += src->counts[i];
+    }
+    dst->total += src->total;
+    dst->sum += src->sum;
+    dst->min = (src->min < dst->min) ? src->min : dst->min;
+    dst->max = (src->max > dst->max) ? src->max : dst->max;
+}
+
+/**
+ * @brief Value at a percentile
+ *
+ * @param hist Histogram
+ * @param percentile Percentile in [0, 100]
+ * @return Highest value of the bucket holding the percentile, capped at
+ *         the largest recorded value; 0 if the histogram is empty.
+ */
+uint64_t knnHistValueAt(const KnnHist *hist, double percentile){
+
+    uint64_t rank, seen = 0, value;
+    int i;
+
+    if (hist->total == 0){
+        return 0;
+    }
+    percentile = (percentile < 0.0) ? 0.0 : (percentile > 100.0) ? 100.0 : percentile;
+    rank = (uint64_t) (percentile / 100.0 * hist->total + 0.5);
+    rank = (rank < 1) ? 1 : rank;
+    for (i = 0; i < hist->num_buckets; i++){
+        seen += hist->counts[i];
+        if (seen >= rank){
+            break;
+        }
+    }
+    value = histHighest(hist->sub_bits, i);
+    return (value > hist->max) ? hist->max : value;
+}
+
+/** @brief Mean of the recorded values, 0 if empty */
+double knnHistMean(const KnnHist *hist){
+    return hist->total ? hist->sum / hist->total : 0.0;
+}
+
+/** @brief Clears the recorded values */
+void knnHistReset(KnnHist *hist){
+    memset(hist->counts, 0, sizeof(uint64_t) * hist->num_buckets);
+    hist->total = 0;
+    hist->sum = 0.0;
+    hist->min = UINT64_MAX;
+    hist->max = 0;
+}
+
+/** @brief Releases a histogram */
+void knnHistFree(KnnHist *hist){
+    free(hist->counts);
+    hist->counts = NULL;
+}
@@ -0,0 +1,41 @@
+/*
+ * @file knn_hist.h
+ * @brief HDR-style latency histogram
+ *
+ * Log-linear buckets: values below 2^sub_bits get one bucket each, every
+ * following power of two is split in 2^(sub_bits-1) equal buckets, so
+ * every recorded value is kept with a relative error below 2^-(sub_bits-1)
+ * over the whole range at a fixed memory cost. Recording is one count
+ * leading zeros and an increment; histograms of several threads are
+ * merged by adding their counts.
+ */
+
+#ifndef KNN_HIST_H
+#define KNN_HIST_H
+
+#include <stdint.h>
+
+/** Default sub-bucket bits, below 1% relative error */
+#define KNN_HIST_SUB_BITS 8
+
+/** @brief Log-linear histogram of non-negative integer values */
+typedef struct KnnHist_Struct{
+    int sub_bits;           /**< Linear sub-buckets per power of two, log2 */
+    int num_buckets;        /**< Number of buckets */
+    uint64_t max_value;     /**< Largest value tracked, larger ones are clamped */
+    uint64_t *counts;       /**< Count of each bucket */
+    uint64_t total;         /**< Number of recorded values */
+    uint64_t min;           /**< Smallest recorded value */
+    uint64_t max;           /**< Largest recorded value */
+    double sum;             /**< Sum of the recorded values */
+}KnnHist;
+
+int knnHistInit(KnnHist *hist, uint64_t max_value, int sub_bits);
+void knnHistRecord(KnnHist *hist, uint64_t value);
+void knnHistAdd(KnnHist *dst, const KnnHist *src);
+uint64_t knnHistValueAt(const KnnHist *hist, double percentile);
+double knnHistMean(const KnnHist *hist);
+void knnHistReset(KnnHist *hist);
+void knnHistFree(KnnHist *hist);
+
+#endif
@@ -0,0 +1,240 @@
+/*
+ * @file knn_kernels.c
+ * @brief KNN computational kernels
+ *
+ * Squared euclidean distance kernels, top-K selectors and the
+ * majority vote used to assign a label to each testing object.
+ */
+
+#include "knn_kernels.h"
+
+/************************************************************************/
+
+/* Distance kernels */
+
+/** @brief Calculates squared euclidean distance between 2 feature vectors
+ *
+ *  Summed in order, in blocks of KNN_DISTANCE_BLOCK features, with
+ *  KNN_SQUARE_ADD: the early-abandoning scan (knn_abandon.h) sums the
+ *  same way, so both return bit-identical distances.
+ *
+ *	@param a First feature vector
+ *	@param b Second feature vector
+ *	@param size Feature dimensionality
+ *	@return The desired distance.
+ */
+float distance(float* a, float* b, int size){
+
+    int i, j;
+    float diff;
+    float sum = 0.0;
+    for (i = 0; i + KNN_DISTANCE_BLOCK <= size; i += KNN_DISTANCE_BLOCK){
+        for (j = i; j < i + KNN_DISTANCE_BLOCK; j++){
+            diff = (a[j] - b[j]);
+            sum = KNN_SQUARE_ADD(sum, diff);
+        }
+    }
+    for (; i < size; i++){
+        diff = (a[i] - b[i]);
+        sum = KNN_SQUARE_ADD(sum, diff);
+    }
+    return sum;
+}
+
+/** @brief Squared euclidean distance with 4 independent accumulators
+ *
+ *  Breaks the dependency chain on a single sum so the FP adds of
+ *  consecutive features can be pipelined.
+ *
+ *	@param a First feature vector
+ *	@param b Second feature vector
+ *	@param size Feature dimensionality
+ *	@return The desired distance.
+ */
+float distanceUnrolled(float* a, float* b, int size){
+
+    int i;
+    float d0, d1, d2, d3;
+    float s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+
+    for (i = 0; i + 4 <= size; i += 4){
+        d0 = a[i]   - b[i];
+        d1 = a[i+1] - b[i+1];
+        d2 = a[i+2] - b[i+2];
+        d3 = a[i+3] - b[i+3];
+        s0 += d0 * d0;
+        s1 += d1 * d1;
+        s2 += d2 * d2;
+        s3 += d3 * d3;
+    }
+    for (; i < size; i++){
+        d0 = a[i] - b[i];
+        s0 += d0 * d0;
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+/** @brief Squared euclidean distances from one query to n row-major objects
+ *
+ *	@param query Feature vector of the query
+ *	@param data Row-major feature vectors (n x size)
+ *	@param n Number of objects in data
+ *	@param size Feature dimensionality
+ *	@param out Output array of n distances
+ */
+void distanceBatch(float* query, float* data, int n, int size, float* out){
+
+    int i;
+    for (i = 0; i < n; i++){
+        out[i] = distance(query, &(data[i*size]), size);
+    }
+}
+
+/************************************************************************/
+
+/* Top-K selectors */
+
+/** @brief Sorts an array of floats with Selection Sort for K iterations O(n*K)
+ *
+ * @param array Array of floats to be sorted
+ * @param size The size of the array
+ * @param k Number of iterations (sorted objects)
+ * @return Void.
+ */
+void selectionSortK(DistLabelPair *array, int size, int k){
+    int i, j;
+    int min;
+    float tmp_distance;
+    int tmp_label;
+
+    for (i = 0; i < k; i++){
+        min = i;
+        for (j = i + 1; j < size; j++){
+            if (array[min].distance > array[j].distance){
+                min = j;
+            }
+        }
+        if (min != i){
+            tmp_distance = array[i].distance; tmp_label = array[i].label;
+            array[i].distance = array[min].distance; array[i].label = array[min].label;
+            array[min].distance = tmp_distance; array[min].label = tmp_label;
+        }
+    }
+}
+
+/** @brief Selects the k smallest distances with a bounded sorted list O(n + k*m)
+ *
+ * Only candidates that beat the current K-th best pay for an insertion,
+ * so the common case is one compare per element. The input is not modified.
+ *
+ * @param distances Array of distances
+ * @param size The size of the array
+ * @param k Number of neighbours to select
+ * @param out Output list of k neighbours, in ascending distance
+ * @return Number of neighbours written to out.
+ */
+int selectInsertionK(const float *distances, int size, int k, DistIndexPair *out){
+    int i;
+    int n = 0;
+
+    for (i = 0; i < size; i++){
+        n = topKPush(out, n, k, distances[i], i);
+    }
+    return n;
+}
+
+/** @brief Orders two candidates, ties are broken by index */
+static inline int heapWorse(const DistIndexPair *a, const DistIndexPair *b){
+    return (a->distance > b->distance) ||
+            (a->distance == b->distance && a->index > b->index);
+}
+
+/** @brief Restores the max-heap property from node i downwards */
+static void heapSiftDown(DistIndexPair *heap, int size, int i){
+    int child;
+    DistIndexPair tmp;
+
+    while ((child = 2*i + 1) < size){
+        if (child + 1 < size && heapWorse(&heap[child+1], &heap[child])){
+            child++;
+        }
+        if (!heapWorse(&heap[child], &heap[i])){
+            break;
+        }
+        tmp = heap[i]; heap[i] = heap[child]; heap[child] = tmp;
+        i = child;
+    }
+}
+
+/** @brief Selects the k smallest distances with a bounded max-heap O(n log k)
+ *
+ * The worst of the current K candidates sits at the root, so rejecting
+ * an element costs one compare and accepting it O(log k).
+ * The input is not modified.
+ *
+ * @param distances Array of distances
+ * @param size The size of the array
+ * @param k Number of neighbours to select
+ * @param out Output list of k neighbours, in ascending distance
+ * @return Number of neighbours written to out.
+ */
+int selectHeapK(const float *distances, int size, int k, DistIndexPair *out){
+    int i, j, n;
+    DistIndexPair tmp;
+
+    n = (size < k) ? size : k;
+    for (i = 0; i < n; i++){
+        out[i].distance = distances[i];
+        out[i].index = i;
+    }
+    for (i = n/2 - 1; i >= 0; i--){
+        heapSiftDown(out, n, i);
+    }
+    for (i = n; i < size; i++){
+        if (distances[i] < out[0].distance){
+            out[0].distance = distances[i];
+            out[0].index = i;
+            heapSiftDown(out, n, 0);
+        }
+    }
+    /* Heap sort into ascending order */
+    for (j = n - 1; j > 0; j--){
+        tmp = out[0]; out[0] = out[j]; out[j] = tmp;
+        heapSiftDown(out, j, 0);
+    }
+    return n;
+}
+
+/************************************************************************/
+
+/* Voting */
+
+/** @brief Assigns the most voted class among the labels of K neighbours
+ *
+ * Ties are resolved in favour of the lowest class index.
+ *
+ * @param labels Class labels of the K nearest neighbours
+ * @param k Number of neighbours
+ * @param votes Scratch array of CLASSES vote counters
+ * @param classes Number of classes
+ * @return The assigned label.
+ */
+int majorityVote(const int *labels, int k, int *votes, int classes){
+    int j;
+    int vote = 0;
+    int assigned_label = 0;
+
+    for (j = 0; j < classes; j++){
+        votes[j] = 0;
+    }
+    for (j = 0; j < k; j++){
+        votes[ labels[j] ]++;
+    }
+    for (j = 0; j < classes; j++){
+        if (votes[j] > vote){
+            vote = votes[j];
+            assigned_label = j;
+        }
+    }
+    return assigned_label;
+}
@@ -0,0 +1,147 @@
+/*
+ * @file knn_kernels.h
+ * @brief KNN computational kernels
+ *
+ * Distance kernels, top-K selectors and voting routines shared by the
+ * SW classifier and the micro-benchmark suite. Every kernel takes its
+ * dimensions as arguments so it can be measured on its own.
+ */
+
+#ifndef KNN_KERNELS_H
+#define KNN_KERNELS_H
+
+#include <math.h>
+
+/** @brief Distance from test object A to trn object B, an label of B */
+typedef struct DistLabelPair_Struct{
+    float distance;   /**< Distance from a given test object to B */
+    int label;        /**< Class label of B */
+}DistLabelPair;
+
+/** @brief Distance from test object A to trn object B, and index of B */
+typedef struct DistIndexPair_Struct{
+    float distance;   /**< Distance from a given test object to B */
+    int index;        /**< Index of B in the training set */
+}DistIndexPair;
+
+/************************************************************************/
+
+/* Distance kernels (squared euclidean) */
+
+/** Features per block of distance(), shared with the early-abandoning scan */
+#define KNN_DISTANCE_BLOCK 4
+
+/**
+ * Adds the square of d to sum. Fused explicitly when the target has FMA:
+ * whether the compiler contracts a*b+c depends on the surrounding code,
+ * so kernels that must round alike (distance() and distanceAbandon())
+ * spell it out.
+ */
+#ifdef __FP_FAST_FMAF
+#define KNN_SQUARE_ADD(sum, d) fmaf((d), (d), (sum))
+#else
+#define KNN_SQUARE_ADD(sum, d) ((sum) + (d) * (d))
+#endif
+
+float distance(float* a, float* b, int size);
+float distanceUnrolled(float* a, float* b, int size);
+void distanceBatch(float* query, float* data, int n, int size, float* out);
+
+/* Top-K selectors */
+
+void selectionSortK(DistLabelPair *array, int size, int k);
+int selectInsertionK(const float *distances, int size, int k, DistIndexPair *out);
+int selectHeapK(const float *distances, int size, int k, DistIndexPair *out);
+
+/* Voting */
+
+int majorityVote(const int *labels, int k, int *votes, int classes);
+
+/************************************************************************/
+
+/**
+ * @brief Inserts a candidate in a sorted list of at most k neighbours
+ *
+ * The list is kept in ascending distance order. Ties keep the candidate
+ * that was inserted first, which matches the order selectionSortK picks
+ * equal distances in.
+ *
+ * @param list Sorted neighbour list with room for k entries
+ * @param size Current number of entries in the list
+ * @param k Maximum number of entries
+ * @param dist Distance of the candidate
+ * @param index Index of the candidate
+ * @return The new number of entries in the list.
+ */
+static inline int topKPush(DistIndexPair *list, int size, int k,
+        float dist, int index){
+    int i;
+
+    if (size == k){
+        if (!(dist < list[k-1].distance)){
+            return size;
+        }
+        i = k - 1;
+    } else {
+        i = size++;
+    }
+    while (i > 0 && list[i-1].distance > dist){
+        list[i] = list[i-1];
+        i--;
+    }
+    list[i].distance = dist;
+    list[i].index = index;
+    return size;
+}
+
+/**
+ * @brief Inserts a candidate in a list ordered by (distance, index)
+ *
+ * Unlike topKPush, equal distances are ordered on the index, so the list
+ * does not depend on the order candidates arrive in (several threads,
+ * reordered or pruned scans). Visiting candidates in ascending index
+ * order gives the same list as topKPush.
+ *
+ * @param list Sorted neighbour list with room for k entries
+ * @param size Current number of entries in the list
+ * @param k Maximum number of entries
+ * @param dist Distance of the candidate
+ * @param index Index of the candidate
+ * @return The new number of entries in the list.
+ */
+static inline int topKPushByIndex(DistIndexPair *list, int size, int k,
+        float dist, int index){
+    int i;
+
+    if (size == k){
+        if (!(dist < list[k-1].distance ||
+             (dist == list[k-1].distance && index < list[k-1].index))){
+            return size;
+        }
+        i = k - 1;
+    } else {
+        i = size++;
+    }
+    while (i > 0 && (list[i-1].distance > dist ||
+           (list[i-1].distance == dist && list[i-1].index > index))){
+        list[i] = list[i-1];
+        i--;
+    }
+    list[i].distance = dist;
+    list[i].index = index;
+    return size;
+}
+
+/**
+ * @brief Current pruning threshold of a sorted neighbour list
+ *
+ * @param list Sorted neighbour list
+ * @param size Current number of entries in the list
+ * @param k Maximum number of entries
+ * @return Distance of the K-th best candidate, or infinity if not full.
+ */
+static inline float topKThreshold(const DistIndexPair *list, int size, int k){
+    return (size < k) ? INFINITY : list[k-1].distance;
+}
+
+#endif
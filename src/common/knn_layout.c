@@ -0,0 +1,309 @@
+/*
+ * @file knn_layout.c
+ * @brief Blocked feature-major (SoA) training set layout
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "knn_layout.h"
+#include "knn_kernels.h"
+#include "knn_arena.h"
+
+/************************************************************************/
+
+/**
+ * @brief Allocates a blocked set and its padded arrays
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+static int blockedAlloc(int num_obj, int features, int block, KnnBlockedSet *set){
+
+    size_t padded;
+    void *mem;
+
+    if (block != KNN_LAYOUT_BLOCK8 && block != KNN_LAYOUT_BLOCK16){
+        return -1;
+    }
+    set->num_obj = num_obj;
+    set->features = features;
+    set->block = block;
+    set->num_blocks = (num_obj + block - 1) / block;
+    padded = (size_t) set->num_blocks * block;
+
+    if (posix_memalign(&mem, KNN_LAYOUT_ALIGN, sizeof(float) * padded * features) != 0){
+        return -1;
+    }
+    set->data = mem;
+    set->labels = malloc(sizeof(int) * padded);
+    if (set->labels == NULL){
+        free(set->data);
+        return -1;
+    }
+    memset(set->data, 0, sizeof(float) * padded * features);
+    memset(set->labels, -1, sizeof(int) * padded);
+    return 0;
+}
+
+/**
+ * @brief Scatters consecutive rows into their blocks
+ *
+ * @param set Blocked set
+ * @param rows Row-major feature vectors of objects first .. first+count-1
+ * @param first Index of the first row
+ * @param count Number of rows
+ */
+static void blockedScatter(KnnBlockedSet *set, const float *rows, int first, int count){
+
+    int r, f, obj;
+    float *dst;
+
+    for (r = 0; r < count; r++){
+        obj = first + r;
+        dst = &(set->data[(size_t) (obj / set->block) * set->features * set->block
+                + obj % set->block]);
+        for (f = 0; f < set->features; f++){
+            dst[(size_t) f * set->block] = rows[(size_t) r * set->features + f];
+        }
+    }
+}
+
+/** @brief KNN_LAYOUT_BLOCK8 floats held as one vector (GCC vector extension) */
+typedef float LayoutLanes __attribute__((vector_size(KNN_LAYOUT_BLOCK8 * sizeof(float))));
+
+/**
+ * @brief Distances from a query to every block, block size as a literal
+ *
+ * One accumulator lane per object of the block; each feature of the query
+ * is broadcast and subtracted from a contiguous column, vertical adds
+ * only. Lanes are explicit vectors, the auto-vectorizer gives up on the
+ * unrolled per-object loop.
+ */
+static inline __attribute__((always_inline)) void blockedDistances(
+        const float *data, int num_blocks, int features, int block,
+        const float *query, float *out){
+
+    const int vecs = block / KNN_LAYOUT_BLOCK8;
+    LayoutLanes acc[KNN_LAYOUT_BLOCK16 / KNN_LAYOUT_BLOCK8];
+    const LayoutLanes *col;
+    LayoutLanes d;
+    float q;
+    int b, f, v;
+
+    data = __builtin_assume_aligned(data, KNN_LAYOUT_ALIGN);
+    for (b = 0; b < num_blocks; b++){
+        col = (const LayoutLanes *) &(data[(size_t) b * features * block]);
+        for (v = 0; v < vecs; v++){
+            acc[v] = (LayoutLanes) { 0 };
+        }
+        for (f = 0; f < features; f++){
+            q = query[f];
+            for (v = 0; v < vecs; v++){
+                d = col[f*vecs + v] - q;
+                acc[v] += d * d;
+            }
+        }
+        memcpy(&(out[b*block]), acc, sizeof(float) * block);
+    }
+}
+
+/************************************************************************/
+
+/**
+ * @brief Converts a row-major set to the blocked layout
+ *
+ * @param rows Row-major feature vectors (num_obj x features)
+ * @param labels Labels of the objects
+ * @param num_obj Number of objects
+ * @param features Feature dimensionality
+ * @param block Objects per block, KNN_LAYOUT_BLOCK8 or KNN_LAYOUT_BLOCK16
+ * @param set Output set, release with knnBlockedFree
+ * @return 0 on success, -1 otherwise.
+ */
+int knnBlockedFromRows(const float *rows, const int *labels, int num_obj,
+        int features, int block, KnnBlockedSet *set){
+
+    if (blockedAlloc(num_obj, features, block, set) != 0){
+        return -1;
+    }
+    blockedScatter(set, rows, 0, num_obj);
+    memcpy(set->labels, labels, sizeof(int) * num_obj);
+    return 0;
+}
+
+/**
+ * @brief Reads a set from the dataset binaries straight into the blocked layout
+ *
+ * The features file is read one block of rows at a time and scattered,
+ * so no row-major copy of the whole set is kept.
+ *
+ * @param data_bin Feature vectors binary file
+ * @param label_bin Labels binary file
+ * @param num_obj Number of objects to read
+ * @param features Number of features per object
+ * @param block Objects per block, KNN_LAYOUT_BLOCK8 or KNN_LAYOUT_BLOCK16
+ * @param set Output set, release with knnBlockedFree
+ * @return 0 on success, -1 otherwise.
+ */
+int knnBlockedLoad(const char *data_bin, const char *label_bin, int num_obj,
+        int features, int block, KnnBlockedSet *set){
+
+    FILE *fp_data, *fp_label;
+    float *rows;
+    int first, count;
+    int status = 0;
+
+    if (blockedAlloc(num_obj, features, block, set) != 0){
+        return -1;
+    }
+    fp_data = fopen(data_bin, "rb");
+    fp_label = fopen(label_bin, "rb");
+    rows = malloc(sizeof(float) * block * features);
+
+    if (fp_data == NULL || fp_label == NULL || rows == NULL){
+        status = -1;
+    } else {
+        for (first = 0; first < num_obj && status == 0; first += block){
+            count = (num_obj - first < block) ? num_obj - first : block;
+            if (fread(rows, sizeof(float) * features, count, fp_data) != (size_t) count){
+                status = -1;
+            } else {
+                blockedScatter(set, rows, first, count);
+            }
+        }
+        if (status == 0 &&
+            fread(set->labels, sizeof(int), num_obj, fp_label) != (size_t) num_obj){
+            status = -1;
+        }
+    }
+
+    if (fp_data != NULL){
+        fclose(fp_data);
+    }
+    if (fp_label != NULL){
+        fclose(fp_label);
+    }
+    free(rows);
+    if (status != 0){
+        knnBlockedFree(set);
+    }
+    return status;
+}
+
+/**
+ * @brief Squared euclidean distances from a query to every object
+ *
+ * @param set Blocked training set
+ * @param query Query feature vector
+ * @param out Output distances in object order (num_blocks x block),
+ *            padding objects get infinity
+ */
+void knnBlockedDistances(const KnnBlockedSet *set, const float *query, float *out){
+
+    int i;
+
+    if (set->block == KNN_LAYOUT_BLOCK16){
+        blockedDistances(set->data, set->num_blocks, set->features,
+                KNN_LAYOUT_BLOCK16, query, out);
+    } else {
+        blockedDistances(set->data, set->num_blocks, set->features,
+                KNN_LAYOUT_BLOCK8, query, out);
+    }
+    for (i = set->num_obj; i < set->num_blocks * set->block; i++){
+        out[i] = INFINITY;
+    }
+}
+
+/**
+ * @brief knnBlockedClassify with caller-provided scratch
+ *
+ * Allocates nothing, so it serves both the arena-backed classifier and
+ * the reentrant context API.
+ *
+ * @param set Blocked training set
+ * @param queries Row-major query feature vectors (num_queries x features)
+ * @param num_queries Number of queries
+ * @param k Number of neighbours
+ * @param classes Number of classes
+ * @param dist Scratch distance row (num_blocks x block)
+ * @param list Scratch neighbour list (k)
+ * @param closest Scratch neighbour labels (k)
+ * @param votes Scratch vote counters (classes)
+ * @param out Output labels (num_queries)
+ * @param out_neighbours Output neighbour lists (num_queries x k, ascending
+ *                       distance), NULL if not needed
+ */
+void knnBlockedClassifyScratch(const KnnBlockedSet *set, const float *queries,
+        int num_queries, int k, int classes, float *dist, DistIndexPair *list,
+        int *closest, int *votes, int *out, DistIndexPair *out_neighbours){
+
+    int i, j, n;
+
+    for (i = 0; i < num_queries; i++){
+        knnBlockedDistances(set, &(queries[(size_t) i * set->features]), dist);
+        n = 0;
+        for (j = 0; j < set->num_obj; j++){
+            if (n < k || dist[j] < list[k-1].distance){
+                n = topKPush(list, n, k, dist[j], j);
+            }
+        }
+        for (j = 0; j < n; j++){
+            closest[j] = set->labels[list[j].index];
+        }
+        out[i] = majorityVote(closest, n, votes, classes);
+        if (out_neighbours != NULL){
+            memcpy(&(out_neighbours[(size_t) i * k]), list, sizeof(DistIndexPair) * n);
+        }
+    }
+}
+
+/**
+ * @brief Classifies a batch of queries against a blocked set
+ *
+ * Squared euclidean distance and majority vote; ties in distance keep
+ * the lowest training index, as in the default classifier. Scratch is
+ * carved from the calling thread's arena.
+ *
+ * @param set Blocked training set
+ * @param queries Row-major query feature vectors (num_queries x features)
+ * @param num_queries Number of queries
+ * @param k Number of neighbours
+ * @param classes Number of classes
+ * @param out Output labels (num_queries)
+ * @return 0 on success, -1 if the scratch space cannot be allocated.
+ */
+int knnBlockedClassify(const KnnBlockedSet *set, const float *queries,
+        int num_queries, int k, int classes, int *out){
+
+    size_t dist_size = sizeof(float) * set->num_blocks * set->block;
+    KnnArena *arena = knnArenaThread(knnArenaSpan(dist_size)
+            + knnArenaSpan(sizeof(DistIndexPair) * k)
+            + knnArenaSpan(sizeof(int) * k) + knnArenaSpan(sizeof(int) * classes));
+    size_t mark;
+    float *dist;
+    DistIndexPair *list;
+    int *closest, *votes;
+
+    if (arena == NULL){
+        return -1;
+    }
+    mark = knnArenaMark(arena);
+    dist = knnArenaAlloc(arena, dist_size);
+    list = knnArenaAlloc(arena, sizeof(DistIndexPair) * k);
+    closest = knnArenaAlloc(arena, sizeof(int) * k);
+    votes = knnArenaAlloc(arena, sizeof(int) * classes);
+    knnBlockedClassifyScratch(set, queries, num_queries, k, classes, dist, list,
+            closest, votes, out, NULL);
+
+    knnArenaRelease(arena, mark);
+    return 0;
+}
+
+/** @brief Releases a blocked set */
+void knnBlockedFree(KnnBlockedSet *set){
+    free(set->data);
+    free(set->labels);
+    set->data = NULL;
+    set->labels = NULL;
+}
@@ -0,0 +1,49 @@
+/*
+ * @file knn_layout.h
+ * @brief Blocked feature-major (SoA) training set layout
+ *
+ * Objects are grouped in blocks of KNN_LAYOUT_BLOCK8 or KNN_LAYOUT_BLOCK16.
+ * Within a block, feature f of every object is contiguous:
+ *
+ *     data[(b*features + f)*block + l] = feature f of object b*block + l
+ *
+ * so a query is compared against a whole block with vertical adds only,
+ * one feature broadcast at a time. The array is 64-byte aligned and the
+ * last block is padded with zeros; padding labels are -1.
+ */
+
+#ifndef KNN_LAYOUT_H
+#define KNN_LAYOUT_H
+
+#include "knn_kernels.h"
+
+/** Small block, one AVX register of floats */
+#define KNN_LAYOUT_BLOCK8 8
+/** Large block, one AVX-512 register or one cache line of floats */
+#define KNN_LAYOUT_BLOCK16 16
+/** Alignment of the blocked array */
+#define KNN_LAYOUT_ALIGN 64
+
+/** @brief Training set in blocked feature-major layout */
+typedef struct KnnBlockedSet_Struct{
+    int num_obj;        /**< Number of objects */
+    int features;       /**< Feature dimensionality */
+    int block;          /**< Objects per block, 8 or 16 */
+    int num_blocks;     /**< Number of blocks, last one padded */
+    float *data;        /**< Blocked feature-major features, 64-byte aligned */
+    int *labels;        /**< Labels in object order, -1 for padding */
+}KnnBlockedSet;
+
+int knnBlockedFromRows(const float *rows, const int *labels, int num_obj,
+        int features, int block, KnnBlockedSet *set);
+int knnBlockedLoad(const char *data_bin, const char *label_bin, int num_obj,
+        int features, int block, KnnBlockedSet *set);
+void knnBlockedDistances(const KnnBlockedSet *set, const float *query, float *out);
+void knnBlockedClassifyScratch(const KnnBlockedSet *set, const float *queries,
+        int num_queries, int k, int classes, float *dist, DistIndexPair *list,
+        int *closest, int *votes, int *out, DistIndexPair *out_neighbours);
+int knnBlockedClassify(const KnnBlockedSet *set, const float *queries,
+        int num_queries, int k, int classes, int *out);
+void knnBlockedFree(KnnBlockedSet *set);
+
+#endif
@@ -0,0 +1,576 @@
+/*
+ * @file knn_lsh.c
+ * @brief Locality-sensitive hashing index (E2LSH, multi-probe)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "knn_lsh.h"
+#include "knn_arena.h"
+
+/** 2 pi, M_PI is not C99 */
+#define LSH_TWO_PI 6.283185307179586
+
+/************************************************************************/
+
+/** @brief State shared by the index builder threads */
+typedef struct LshBuild_Struct{
+    KnnLsh *lsh;                /**< Index being built */
+    float *data;                /**< Row-major feature vectors */
+    int next_table;             /**< Next table to hand out (atomic) */
+    int failed;                 /**< A worker could not allocate its scratch (atomic) */
+}LshBuild;
+
+/** @brief Index file header */
+typedef struct LshHeader_Struct{
+    uint32_t magic;             /**< KNN_LSH_MAGIC */
+    uint32_t version;           /**< KNN_LSH_VERSION */
+    int32_t tables;             /**< Number of hash tables */
+    int32_t hashes;             /**< Hash functions per table */
+    int32_t features;           /**< Feature dimensionality */
+    int32_t num_obj;            /**< Number of indexed objects */
+    int32_t num_buckets;        /**< Buckets per table */
+    float width;                /**< Bucket width */
+}LshHeader;
+
+/** @brief One multi-probe perturbation of a table key */
+typedef struct LshProbe_Struct{
+    float score;                /**< Distance of the projection to the slot boundary */
+    uint32_t delta;             /**< Added to the key, +r_j or -r_j */
+}LshProbe;
+
+/** @brief xorshift32 step */
+static unsigned xorshift32(unsigned *state){
+    unsigned x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+/** @brief Sizes of the index arrays */
+static size_t lshProjSize(const KnnLsh *lsh){
+    return (size_t) lsh->tables * lsh->hashes * lsh->features;
+}
+static size_t lshHashSize(const KnnLsh *lsh){
+    return (size_t) lsh->tables * lsh->hashes;
+}
+static size_t lshPtrSize(const KnnLsh *lsh){
+    return (size_t) lsh->tables * (lsh->num_buckets + 1);
+}
+static size_t lshItemSize(const KnnLsh *lsh){
+    return (size_t) lsh->tables * lsh->num_obj;
+}
+
+/** @brief Allocates the arrays of an index whose sizes are set */
+static int lshAlloc(KnnLsh *lsh){
+    lsh->mapped = 0;
+    lsh->proj = malloc(sizeof(float) * lshProjSize(lsh));
+    lsh->offset = malloc(sizeof(float) * lshHashSize(lsh));
+    lsh->mult = malloc(sizeof(uint32_t) * lshHashSize(lsh));
+    lsh->bucket_ptr = calloc(lshPtrSize(lsh), sizeof(int));
+    lsh->items = malloc(sizeof(int) * (lshItemSize(lsh) + 1));
+    if (lsh->proj == NULL || lsh->offset == NULL || lsh->mult == NULL ||
+        lsh->bucket_ptr == NULL || lsh->items == NULL){
+        knnLshFree(lsh);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Projections of a vector in one table, in units of the bucket width
+ *
+ * @param lsh Index
+ * @param table Table
+ * @param x Feature vector
+ * @param pos Output (a_j . x + b_j) / w (hashes)
+ * @return Key of the vector in the table.
+ */
+static uint32_t lshKey(const KnnLsh *lsh, int table, const float *x, float *pos){
+
+    const float *a = &(lsh->proj[(size_t) table * lsh->hashes * lsh->features]);
+    const float *b = &(lsh->offset[table * lsh->hashes]);
+    const uint32_t *r = &(lsh->mult[table * lsh->hashes]);
+    uint32_t key = 0;
+    float dot;
+    int j, f;
+
+    for (j = 0; j < lsh->hashes; j++){
+        dot = b[j];
+        for (f = 0; f < lsh->features; f++){
+            dot += a[j*lsh->features + f] * x[f];
+        }
+        pos[j] = dot / lsh->width;
+        key += (uint32_t) (int32_t) floorf(pos[j]) * r[j];
+    }
+    return key;
+}
+
+/** @brief Hashes every object into one table, counting sort into CSR */
+static void lshBuildTable(KnnLsh *lsh, float *data, int table,
+        uint32_t *bucket, int *cursor){
+
+    int *ptr = &(lsh->bucket_ptr[(size_t) table * (lsh->num_buckets + 1)]);
+    int *items = &(lsh->items[(size_t) table * lsh->num_obj]);
+    float pos[KNN_LSH_MAX_HASHES];
+    uint32_t mask = (uint32_t) lsh->num_buckets - 1;
+    int i, b;
+
+    for (b = 0; b <= lsh->num_buckets; b++){
+        ptr[b] = 0;
+    }
+    for (i = 0; i < lsh->num_obj; i++){
+        bucket[i] = lshKey(lsh, table, &(data[(size_t) i * lsh->features]), pos) & mask;
+        ptr[bucket[i] + 1]++;
+    }
+    for (b = 0; b < lsh->num_buckets; b++){
+        ptr[b+1] += ptr[b];
+    }
+    memcpy(cursor, ptr, sizeof(int) * lsh->num_buckets);
+    for (i = 0; i < lsh->num_obj; i++){
+        items[cursor[bucket[i]]++] = i;
+    }
+}
+
+/** @brief Builder thread, hashes tables until none are left */
+static void *lshWorker(void *arg){
+    LshBuild *lb = arg;
+    uint32_t *bucket = malloc(sizeof(uint32_t) * lb->lsh->num_obj);
+    int *cursor = malloc(sizeof(int) * lb->lsh->num_buckets);
+    int t;
+
+    if (bucket == NULL || cursor == NULL){
+        __atomic_store_n(&lb->failed, 1, __ATOMIC_RELEASE);
+        free(bucket);
+        free(cursor);
+        return NULL;
+    }
+    while ((t = __atomic_fetch_add(&lb->next_table, 1, __ATOMIC_RELAXED)) < lb->lsh->tables){
+        lshBuildTable(lb->lsh, lb->data, t, bucket, cursor);
+    }
+    free(bucket);
+    free(cursor);
+    return NULL;
+}
+
+/** @brief Sorts probes by ascending boundary distance (insertion, few entries) */
+static void probeSort(LshProbe *probe, int n){
+    LshProbe p;
+    int i, j;
+
+    for (i = 1; i < n; i++){
+        p = probe[i];
+        for (j = i; j > 0 && probe[j-1].score > p.score; j--){
+            probe[j] = probe[j-1];
+        }
+        probe[j] = p;
+    }
+}
+
+/************************************************************************/
+
+/**
+ * @brief Estimates a bucket width from the data
+ *
+ * KNN_LSH_WIDTH_FACTOR times the mean euclidean distance from up to
+ * KNN_LSH_WIDTH_SAMPLE random objects to their nearest neighbour.
+ *
+ * @param data Row-major feature vectors (num_obj x features)
+ * @param num_obj Number of objects
+ * @param features Feature dimensionality
+ * @param seed Seed of the sample
+ * @return Bucket width.
+ */
+float knnLshWidth(float *data, int num_obj, int features, unsigned seed){
+
+    unsigned state = seed ? seed : 1;
+    int samples = (num_obj < KNN_LSH_WIDTH_SAMPLE) ? num_obj : KNN_LSH_WIDTH_SAMPLE;
+    double sum = 0.0;
+    float best, d;
+    int s, i, j;
+
+    for (s = 0; s < samples; s++){
+        i = (int) (xorshift32(&state) % (unsigned) num_obj);
+        best = INFINITY;
+        for (j = 0; j < num_obj; j++){
+            d = distance(&(data[(size_t) i*features]), &(data[(size_t) j*features]), features);
+            if (j != i && d < best){
+                best = d;
+            }
+        }
+        sum += isinf(best) ? 0.0 : sqrtf(best);
+    }
+    return (sum > 0.0) ? (float) (KNN_LSH_WIDTH_FACTOR * sum / samples) : 1.0f;
+}
+
+/**
+ * @brief Builds an LSH index, one table per worker at a time
+ *
+ * @param data Row-major feature vectors (num_obj x features)
+ * @param num_obj Number of objects
+ * @param features Feature dimensionality
+ * @param tables Number of hash tables L
+ * @param hashes Hash functions per table M, <= KNN_LSH_MAX_HASHES
+ * @param width Bucket width, <= 0 to estimate it with knnLshWidth
+ * @param seed Seed of the hash functions
+ * @param threads Number of worker threads
+ * @param lsh Output index, release with knnLshFree
+ * @return 0 on success, -1 otherwise.
+ */
+int knnLshBuild(float *data, int num_obj, int features, int tables, int hashes,
+        float width, unsigned seed, int threads, KnnLsh *lsh){
+
+    unsigned state = seed ? seed : 1;
+    LshBuild lb;
+    pthread_t *workers;
+    double u1, u2;
+    size_t i;
+    int t;
+
+    if (tables < 1 || hashes < 1 || hashes > KNN_LSH_MAX_HASHES || num_obj < 1){
+        return -1;
+    }
+    lsh->tables = tables;
+    lsh->hashes = hashes;
+    lsh->features = features;
+    lsh->num_obj = num_obj;
+    for (lsh->num_buckets = 1; lsh->num_buckets < num_obj; lsh->num_buckets <<= 1);
+    lsh->width = (width > 0.0f) ? width : knnLshWidth(data, num_obj, features, seed);
+    if (lshAlloc(lsh) != 0){
+        return -1;
+    }
+
+    for (i = 0; i < lshProjSize(lsh); i++){
+        u1 = (xorshift32(&state) + 1.0) / 4294967297.0;
+        u2 = xorshift32(&state) / 4294967296.0;
+        lsh->proj[i] = (float) (sqrt(-2.0 * log(u1)) * cos(LSH_TWO_PI * u2));
+    }
+    for (i = 0; i < lshHashSize(lsh); i++){
+        lsh->offset[i] = (float) (lsh->width * (xorshift32(&state) / 4294967296.0));
+        lsh->mult[i] = xorshift32(&state) | 1u;
+    }
+
+    if (threads < 1){
+        threads = 1;
+    }
+    workers = malloc(sizeof(pthread_t) * threads);
+    if (workers == NULL){
+        knnLshFree(lsh);
+        return -1;
+    }
+    lb.lsh = lsh;
+    lb.data = data;
+    lb.next_table = 0;
+    lb.failed = 0;
+    for (t = 1; t < threads; t++){
+        pthread_create(&workers[t], NULL, lshWorker, &lb);
+    }
+    lshWorker(&lb);
+    for (t = 1; t < threads; t++){
+        pthread_join(workers[t], NULL);
+    }
+    free(workers);
+    if (lb.failed){
+        knnLshFree(lsh);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Gathers the distinct candidates of one query from every table
+ *
+ * @param lsh Index
+ * @param query Query feature vector
+ * @param probes Extra buckets probed per table, 0 for the query bucket only
+ * @param seen Bitset of num_obj bits, clear on entry; the bits of the
+ *             returned candidates are left set for the caller to clear
+ * @param cand Output candidate indices, room for num_obj entries
+ * @return Number of candidates.
+ */
+int knnLshCandidates(const KnnLsh *lsh, const float *query, int probes,
+        uint64_t *seen, int *cand){
+
+    LshProbe probe[2 * KNN_LSH_MAX_HASHES];
+    float pos[KNN_LSH_MAX_HASHES];
+    uint32_t mask = (uint32_t) lsh->num_buckets - 1;
+    uint32_t key, b;
+    const uint32_t *r;
+    const int *ptr, *items;
+    float frac;
+    int t, j, p, c, obj, num_cand = 0;
+
+    if (probes > 2 * lsh->hashes){
+        probes = 2 * lsh->hashes;
+    }
+    for (t = 0; t < lsh->tables; t++){
+        ptr = &(lsh->bucket_ptr[(size_t) t * (lsh->num_buckets + 1)]);
+        items = &(lsh->items[(size_t) t * lsh->num_obj]);
+        r = &(lsh->mult[t * lsh->hashes]);
+        key = lshKey(lsh, t, query, pos);
+        if (probes > 0){
+            for (j = 0; j < lsh->hashes; j++){
+                frac = pos[j] - floorf(pos[j]);
+                probe[2*j].score = frac;
+                probe[2*j].delta = (uint32_t) 0 - r[j];
+                probe[2*j + 1].score = 1.0f - frac;
+                probe[2*j + 1].delta = r[j];
+            }
+            probeSort(probe, 2 * lsh->hashes);
+        }
+        for (p = -1; p < probes; p++){
+            b = (p < 0 ? key : key + probe[p].delta) & mask;
+            for (c = ptr[b]; c < ptr[b+1]; c++){
+                obj = items[c];
+                if (!(seen[obj >> 6] & (1ull << (obj & 63)))){
+                    seen[obj >> 6] |= 1ull << (obj & 63);
+                    cand[num_cand++] = obj;
+                }
+            }
+        }
+    }
+    return num_cand;
+}
+
+/**
+ * @brief K nearest neighbours of a batch of queries among the LSH candidates
+ *
+ * @param lsh Index of data
+ * @param queries Row-major query feature vectors (num_queries x features)
+ * @param num_queries Number of queries
+ * @param data Indexed feature vectors
+ * @param k Number of neighbours
+ * @param probes Extra buckets probed per table, 0 for the query bucket only
+ * @param out Output neighbour lists (num_queries x k), sorted by distance,
+ *            ties by index; missing entries get index -1
+ * @param candidates Output number of distinct candidates re-ranked over
+ *                   all queries, may be NULL
+ * @return 0 on success, -1 if the scratch space cannot be allocated.
+ */
+int knnLshNeighbours(const KnnLsh *lsh, float *queries, int num_queries,
+        float *data, int k, int probes, DistIndexPair *out, uint64_t *candidates){
+
+    size_t seen_size = sizeof(uint64_t) * ((lsh->num_obj + 63) / 64);
+    KnnArena *arena = knnArenaThread(knnArenaSpan(seen_size)
+            + knnArenaSpan(sizeof(int) * lsh->num_obj));
+    uint64_t *seen;
+    int *cand;
+    DistIndexPair *list;
+    float *q;
+    size_t mark;
+    uint64_t total = 0;
+    int i, c, n, num_cand, obj;
+
+    if (arena == NULL){
+        return -1;
+    }
+    mark = knnArenaMark(arena);
+    seen = knnArenaAlloc(arena, seen_size);
+    cand = knnArenaAlloc(arena, sizeof(int) * lsh->num_obj);
+    memset(seen, 0, seen_size);
+    for (i = 0; i < num_queries; i++){
+        q = &(queries[(size_t) i * lsh->features]);
+        num_cand = knnLshCandidates(lsh, q, probes, seen, cand);
+
+        list = &(out[(size_t) i*k]);
+        n = 0;
+        for (c = 0; c < num_cand; c++){
+            obj = cand[c];
+            seen[obj >> 6] = 0;
+            n = topKPushByIndex(list, n, k,
+                    distance(q, &(data[(size_t) obj * lsh->features]), lsh->features), obj);
+        }
+        for (; n < k; n++){
+            list[n].distance = INFINITY;
+            list[n].index = -1;
+        }
+        total += num_cand;
+    }
+
+    knnArenaRelease(arena, mark);
+    if (candidates != NULL){
+        *candidates = total;
+    }
+    return 0;
+}
+
+/**
+ * @brief Writes an index: header, proj, offset, mult, bucket_ptr, items
+ *
+ * @param lsh Index to write
+ * @param path Output file
+ * @return 0 on success, -1 otherwise.
+ */
+int knnLshWrite(const KnnLsh *lsh, const char *path){
+
+    LshHeader hdr;
+    FILE *fp = fopen(path, "wb");
+    int status = 0;
+
+    if (fp == NULL){
+        return -1;
+    }
+    hdr.magic = KNN_LSH_MAGIC;
+    hdr.version = KNN_LSH_VERSION;
+    hdr.tables = lsh->tables;
+    hdr.hashes = lsh->hashes;
+    hdr.features = lsh->features;
+    hdr.num_obj = lsh->num_obj;
+    hdr.num_buckets = lsh->num_buckets;
+    hdr.width = lsh->width;
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        fwrite(lsh->proj, sizeof(float), lshProjSize(lsh), fp) != lshProjSize(lsh) ||
+        fwrite(lsh->offset, sizeof(float), lshHashSize(lsh), fp) != lshHashSize(lsh) ||
+        fwrite(lsh->mult, sizeof(uint32_t), lshHashSize(lsh), fp) != lshHashSize(lsh) ||
+        fwrite(lsh->bucket_ptr, sizeof(int), lshPtrSize(lsh), fp) != lshPtrSize(lsh) ||
+        fwrite(lsh->items, sizeof(int), lshItemSize(lsh), fp) != lshItemSize(lsh)){
+        status = -1;
+    }
+    fclose(fp);
+    return status;
+}
+
+/**
+ * @brief Reads an index written by knnLshWrite
+ *
+ * @param path Input file
+ * @param lsh Output index, release with knnLshFree
+ * @return 0 on success, -1 otherwise.
+ */
+int knnLshRead(const char *path, KnnLsh *lsh){
+
+    LshHeader hdr;
+    FILE *fp = fopen(path, "rb");
+    int status = 0;
+
+    if (fp == NULL){
+        return -1;
+    }
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        hdr.magic != KNN_LSH_MAGIC || hdr.version != KNN_LSH_VERSION ||
+        hdr.hashes < 1 || hdr.hashes > KNN_LSH_MAX_HASHES){
+        fclose(fp);
+        return -1;
+    }
+    lsh->tables = hdr.tables;
+    lsh->hashes = hdr.hashes;
+    lsh->features = hdr.features;
+    lsh->num_obj = hdr.num_obj;
+    lsh->num_buckets = hdr.num_buckets;
+    lsh->width = hdr.width;
+    if (lshAlloc(lsh) != 0){
+        fclose(fp);
+        return -1;
+    }
+    if (fread(lsh->proj, sizeof(float), lshProjSize(lsh), fp) != lshProjSize(lsh) ||
+        fread(lsh->offset, sizeof(float), lshHashSize(lsh), fp) != lshHashSize(lsh) ||
+        fread(lsh->mult, sizeof(uint32_t), lshHashSize(lsh), fp) != lshHashSize(lsh) ||
+        fread(lsh->bucket_ptr, sizeof(int), lshPtrSize(lsh), fp) != lshPtrSize(lsh) ||
+        fread(lsh->items, sizeof(int), lshItemSize(lsh), fp) != lshItemSize(lsh)){
+        knnLshFree(lsh);
+        status = -1;
+    }
+    fclose(fp);
+    return status;
+}
+
+/**
+ * @brief Writes an index as the sections of a container
+ *
+ * @param lsh Index to write
+ * @param dataset_hash knnDatasetHash of the indexed set
+ * @param path Output container file
+ * @return 0 on success, -1 otherwise.
+ */
+int knnLshWriteContainer(const KnnLsh *lsh, uint64_t dataset_hash, const char *path){
+
+    KnnSection sections[6];
+    LshHeader meta;
+
+    meta.magic = KNN_LSH_MAGIC;
+    meta.version = KNN_LSH_VERSION;
+    meta.tables = lsh->tables;
+    meta.hashes = lsh->hashes;
+    meta.features = lsh->features;
+    meta.num_obj = lsh->num_obj;
+    meta.num_buckets = lsh->num_buckets;
+    meta.width = lsh->width;
+
+    sections[0] = (KnnSection) { KNN_LSH_SECTION_META, &meta, sizeof(meta) };
+    sections[1] = (KnnSection) { KNN_LSH_SECTION_PROJ, lsh->proj,
+            sizeof(float) * lshProjSize(lsh) };
+    sections[2] = (KnnSection) { KNN_LSH_SECTION_OFFSET, lsh->offset,
+            sizeof(float) * lshHashSize(lsh) };
+    sections[3] = (KnnSection) { KNN_LSH_SECTION_MULT, lsh->mult,
+            sizeof(uint32_t) * lshHashSize(lsh) };
+    sections[4] = (KnnSection) { KNN_LSH_SECTION_PTR, lsh->bucket_ptr,
+            sizeof(int) * lshPtrSize(lsh) };
+    sections[5] = (KnnSection) { KNN_LSH_SECTION_ITEMS, lsh->items,
+            sizeof(int) * lshItemSize(lsh) };
+    return knnContainerWrite(path, dataset_hash, sections, 6);
+}
+
+/**
+ * @brief Uses the index stored in a mapped container, without copying it
+ *
+ * The arrays point into the mapping, which must outlive the index;
+ * knnLshFree only forgets them.
+ *
+ * @param container Mapped container
+ * @param lsh Output index
+ * @return 0 on success, -1 if the container holds no valid index.
+ */
+int knnLshMap(const KnnContainer *container, KnnLsh *lsh){
+
+    const LshHeader *meta;
+    uint64_t size[6];
+
+    meta = knnContainerSection(container, KNN_LSH_SECTION_META, &size[0]);
+    if (meta == NULL || size[0] != sizeof(LshHeader) ||
+        meta->magic != KNN_LSH_MAGIC || meta->version != KNN_LSH_VERSION){
+        return -1;
+    }
+    lsh->tables = meta->tables;
+    lsh->hashes = meta->hashes;
+    lsh->features = meta->features;
+    lsh->num_obj = meta->num_obj;
+    lsh->num_buckets = meta->num_buckets;
+    lsh->width = meta->width;
+    lsh->mapped = 1;
+    lsh->proj = (float *) knnContainerSection(container, KNN_LSH_SECTION_PROJ, &size[1]);
+    lsh->offset = (float *) knnContainerSection(container, KNN_LSH_SECTION_OFFSET, &size[2]);
+    lsh->mult = (uint32_t *) knnContainerSection(container, KNN_LSH_SECTION_MULT, &size[3]);
+    lsh->bucket_ptr = (int *) knnContainerSection(container, KNN_LSH_SECTION_PTR, &size[4]);
+    lsh->items = (int *) knnContainerSection(container, KNN_LSH_SECTION_ITEMS, &size[5]);
+
+    if (lsh->hashes < 1 || lsh->hashes > KNN_LSH_MAX_HASHES ||
+        lsh->proj == NULL || size[1] != sizeof(float) * lshProjSize(lsh) ||
+        lsh->offset == NULL || size[2] != sizeof(float) * lshHashSize(lsh) ||
+        lsh->mult == NULL || size[3] != sizeof(uint32_t) * lshHashSize(lsh) ||
+        lsh->bucket_ptr == NULL || size[4] != sizeof(int) * lshPtrSize(lsh) ||
+        lsh->items == NULL || size[5] != sizeof(int) * lshItemSize(lsh)){
+        knnLshFree(lsh);
+        return -1;
+    }
+    return 0;
+}
+
+/** @brief Releases an index, or forgets a mapped one */
+void knnLshFree(KnnLsh *lsh){
+    if (!lsh->mapped){
+        free(lsh->proj);
+        free(lsh->offset);
+        free(lsh->mult);
+        free(lsh->bucket_ptr);
+        free(lsh->items);
+    }
+    lsh->proj = NULL;
+    lsh->offset = NULL;
+    lsh->mult = NULL;
+    lsh->bucket_ptr = NULL;
+    lsh->items = NULL;
+}
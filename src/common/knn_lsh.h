@@ -0,0 +1,81 @@
+/*
+ * @file knn_lsh.h
+ * @brief Locality-sensitive hashing index (E2LSH, multi-probe)
+ *
+ * Each of the L tables hashes an object with M p-stable projections,
+ *
+ *     h_j(x) = floor((a_j . x + b_j) / w),  a_j ~ N(0, I), b_j ~ U[0, w)
+ *
+ * and combines the M integers into one 32-bit key, sum(h_j * r_j) with
+ * random odd multipliers r_j; the low bits select the bucket. Buckets are
+ * stored in CSR form per table (bucket_ptr, items), built with a counting
+ * sort, one table per worker thread.
+ *
+ * A query visits its own bucket in every table plus, with multi-probe,
+ * the buckets obtained by moving one h_j to the neighbouring slot
+ * (key +- r_j), closest slot boundaries first. Candidates are
+ * deduplicated with a bitset and re-ranked with distance(), so returned
+ * distances are exact; neighbours that no probed bucket holds are missed.
+ *
+ * An index is saved either as its own file (knnLshWrite) or as sections
+ * of a container (knnLshWriteContainer), which knnLshMap uses in place.
+ */
+
+#ifndef KNN_LSH_H
+#define KNN_LSH_H
+
+#include <stdint.h>
+
+#include "knn_kernels.h"
+#include "knn_container.h"
+
+/** Index file magic number ("KNNL") */
+#define KNN_LSH_MAGIC 0x4C4E4E4B
+/** Index file format version */
+#define KNN_LSH_VERSION 1
+
+/** Container section tags of an index */
+#define KNN_LSH_SECTION_META    0x4C530001
+#define KNN_LSH_SECTION_PROJ    0x4C530002
+#define KNN_LSH_SECTION_OFFSET  0x4C530003
+#define KNN_LSH_SECTION_MULT    0x4C530004
+#define KNN_LSH_SECTION_PTR     0x4C530005
+#define KNN_LSH_SECTION_ITEMS   0x4C530006
+
+/** Largest number of hash functions per table */
+#define KNN_LSH_MAX_HASHES 32
+/** Bucket width in units of the sampled nearest-neighbour distance */
+#define KNN_LSH_WIDTH_FACTOR 4.0f
+/** Objects sampled to estimate the bucket width */
+#define KNN_LSH_WIDTH_SAMPLE 256
+
+/** @brief LSH index of a training set */
+typedef struct KnnLsh_Struct{
+    int tables;         /**< Number of hash tables L */
+    int hashes;         /**< Hash functions per table M */
+    int features;       /**< Feature dimensionality */
+    int num_obj;        /**< Number of indexed objects */
+    int num_buckets;    /**< Buckets per table, power of two */
+    float width;        /**< Bucket width w */
+    float *proj;        /**< Projection vectors (tables x hashes x features) */
+    float *offset;      /**< Offsets b (tables x hashes) */
+    uint32_t *mult;     /**< Key multipliers r (tables x hashes) */
+    int *bucket_ptr;    /**< Bucket b of table t spans [bucket_ptr[t*(B+1)+b], +1) */
+    int *items;         /**< Object indices grouped by bucket (tables x num_obj) */
+    int mapped;         /**< Arrays point into a mapped container, not owned */
+}KnnLsh;
+
+float knnLshWidth(float *data, int num_obj, int features, unsigned seed);
+int knnLshBuild(float *data, int num_obj, int features, int tables, int hashes,
+        float width, unsigned seed, int threads, KnnLsh *lsh);
+int knnLshCandidates(const KnnLsh *lsh, const float *query, int probes,
+        uint64_t *seen, int *cand);
+int knnLshNeighbours(const KnnLsh *lsh, float *queries, int num_queries,
+        float *data, int k, int probes, DistIndexPair *out, uint64_t *candidates);
+int knnLshWrite(const KnnLsh *lsh, const char *path);
+int knnLshRead(const char *path, KnnLsh *lsh);
+int knnLshWriteContainer(const KnnLsh *lsh, uint64_t dataset_hash, const char *path);
+int knnLshMap(const KnnContainer *container, KnnLsh *lsh);
+void knnLshFree(KnnLsh *lsh);
+
+#endif
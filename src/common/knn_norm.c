@@ -0,0 +1,222 @@
+/*
+ * @file knn_norm.c
+ * @brief Feature normalization statistics (z-score / min-max)
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "knn_norm.h"
+
+/************************************************************************/
+
+/** @brief Statistics file header */
+typedef struct NormHeader_Struct{
+    uint32_t magic;             /**< KNN_NORM_MAGIC */
+    uint32_t version;           /**< KNN_NORM_VERSION */
+    int32_t features;           /**< Feature dimensionality */
+    int32_t mode;               /**< KnnNormMode */
+}NormHeader;
+
+/** @brief Allocates the arrays of a set of statistics */
+static int normAlloc(int features, int mode, KnnNormStats *stats){
+    stats->features = features;
+    stats->mode = mode;
+    stats->offset = malloc(sizeof(float) * features);
+    stats->scale = malloc(sizeof(float) * features);
+    if (stats->offset == NULL || stats->scale == NULL){
+        knnNormFree(stats);
+        return -1;
+    }
+    return 0;
+}
+
+/************************************************************************/
+
+/**
+ * @brief Starts an empty accumulator
+ *
+ * @param acc Accumulator, release with knnNormAccumFree
+ * @param features Feature dimensionality
+ * @return 0 on success, -1 otherwise.
+ */
+int knnNormAccumInit(KnnNormAccum *acc, int features){
+
+    int f;
+
+    acc->features = features;
+    acc->count = 0;
+    acc->mean = calloc(features, sizeof(double));
+    acc->m2 = calloc(features, sizeof(double));
+    acc->min = malloc(sizeof(float) * features);
+    acc->max = malloc(sizeof(float) * features);
+    if (acc->mean == NULL || acc->m2 == NULL || acc->min == NULL || acc->max == NULL){
+        knnNormAccumFree(acc);
+        return -1;
+    }
+    for (f = 0; f < features; f++){
+        acc->min[f] = INFINITY;
+        acc->max[f] = -INFINITY;
+    }
+    return 0;
+}
+
+/**
+ * @brief Adds one object to the running statistics (Welford update)
+ *
+ * @param acc Accumulator
+ * @param row Feature vector of the object
+ */
+void knnNormAccumAdd(KnnNormAccum *acc, const float *row){
+
+    double delta;
+    int f;
+
+    acc->count++;
+    for (f = 0; f < acc->features; f++){
+        delta = row[f] - acc->mean[f];
+        acc->mean[f] += delta / acc->count;
+        acc->m2[f] += delta * (row[f] - acc->mean[f]);
+        if (row[f] < acc->min[f]){
+            acc->min[f] = row[f];
+        }
+        if (row[f] > acc->max[f]){
+            acc->max[f] = row[f];
+        }
+    }
+}
+
+/**
+ * @brief Turns the running statistics into a normalization
+ *
+ * @param acc Accumulator with at least one object
+ * @param mode KnnNormMode
+ * @param stats Output, release with knnNormFree
+ * @return 0 on success, -1 otherwise.
+ */
+int knnNormAccumFinish(const KnnNormAccum *acc, int mode, KnnNormStats *stats){
+
+    double spread;
+    int f;
+
+    if (acc->count < 1 || normAlloc(acc->features, mode, stats) != 0){
+        return -1;
+    }
+    for (f = 0; f < acc->features; f++){
+        switch (mode){
+        case KNN_NORM_ZSCORE:
+            stats->offset[f] = (float) acc->mean[f];
+            spread = sqrt(acc->m2[f] / acc->count);
+            break;
+        case KNN_NORM_MINMAX:
+            stats->offset[f] = acc->min[f];
+            spread = (double) acc->max[f] - acc->min[f];
+            break;
+        default:
+            stats->offset[f] = 0.0f;
+            spread = 1.0;
+            break;
+        }
+        stats->scale[f] = (spread > 0.0) ? (float) (1.0 / spread) : 1.0f;
+    }
+    return 0;
+}
+
+/** @brief Releases an accumulator */
+void knnNormAccumFree(KnnNormAccum *acc){
+    free(acc->mean); free(acc->m2); free(acc->min); free(acc->max);
+    acc->mean = acc->m2 = NULL;
+    acc->min = acc->max = NULL;
+}
+
+/**
+ * @brief Normalizes feature vectors in place, one multiply-add per feature
+ *
+ * @param stats Normalization
+ * @param data Row-major feature vectors (num_obj x features)
+ * @param num_obj Number of objects
+ */
+void knnNormApply(const KnnNormStats *stats, float *data, int num_obj){
+
+    const float *restrict offset = stats->offset;
+    const float *restrict scale = stats->scale;
+    float *restrict row;
+    int i, f;
+
+    for (i = 0; i < num_obj; i++){
+        row = &(data[(size_t) i * stats->features]);
+        for (f = 0; f < stats->features; f++){
+            row[f] = (row[f] - offset[f]) * scale[f];
+        }
+    }
+}
+
+/**
+ * @brief Writes statistics: header, offset[features], scale[features]
+ *
+ * @param stats Statistics to write
+ * @param path Output file
+ * @return 0 on success, -1 otherwise.
+ */
+int knnNormWrite(const KnnNormStats *stats, const char *path){
+
+    NormHeader hdr;
+    FILE *fp = fopen(path, "wb");
+    int status = 0;
+
+    if (fp == NULL){
+        return -1;
+    }
+    hdr.magic = KNN_NORM_MAGIC;
+    hdr.version = KNN_NORM_VERSION;
+    hdr.features = stats->features;
+    hdr.mode = stats->mode;
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        fwrite(stats->offset, sizeof(float), stats->features, fp) != (size_t) stats->features ||
+        fwrite(stats->scale, sizeof(float), stats->features, fp) != (size_t) stats->features){
+        status = -1;
+    }
+    fclose(fp);
+    return status;
+}
+
+/**
+ * @brief Reads statistics written by knnNormWrite
+ *
+ * @param path Input file
+ * @param stats Output, release with knnNormFree
+ * @return 0 on success, -1 otherwise.
+ */
+int knnNormRead(const char *path, KnnNormStats *stats){
+
+    NormHeader hdr;
+    FILE *fp = fopen(path, "rb");
+    int status = 0;
+
+    if (fp == NULL){
+        return -1;
+    }
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        hdr.magic != KNN_NORM_MAGIC || hdr.version != KNN_NORM_VERSION ||
+        normAlloc(hdr.features, hdr.mode, stats) != 0){
+        fclose(fp);
+        return -1;
+    }
+    if (fread(stats->offset, sizeof(float), hdr.features, fp) != (size_t) hdr.features ||
+        fread(stats->scale, sizeof(float), hdr.features, fp) != (size_t) hdr.features){
+        knnNormFree(stats);
+        status = -1;
+    }
+    fclose(fp);
+    return status;
+}
+
+/** @brief Releases a set of statistics */
+void knnNormFree(KnnNormStats *stats){
+    free(stats->offset);
+    free(stats->scale);
+    stats->offset = NULL;
+    stats->scale = NULL;
+}
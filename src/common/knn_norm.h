@@ -0,0 +1,62 @@
+/*
+ * @file knn_norm.h
+ * @brief Feature normalization statistics (z-score / min-max)
+ *
+ * Statistics are computed once over the training set in a streaming pass
+ * (Welford for mean and variance, running min and max) when the dataset
+ * binaries are generated. Each feature is mapped to
+ *
+ *     x' = (x - offset[f]) * scale[f]
+ *
+ * with offset = mean, scale = 1/stddev (z-score) or offset = min,
+ * scale = 1/(max - min) (min-max); constant features keep scale 1. The
+ * normalized training set is written next to the raw binaries and the
+ * statistics to their own file, so the raw binaries read by the
+ * bare-metal programs are unchanged. Queries are normalized with a
+ * single pass before the scan; the distance loops never see raw values.
+ */
+
+#ifndef KNN_NORM_H
+#define KNN_NORM_H
+
+/** Statistics file magic number ("KNNS") */
+#define KNN_NORM_MAGIC 0x534E4E4B
+/** Statistics file format version */
+#define KNN_NORM_VERSION 1
+
+/** @brief Normalization modes */
+typedef enum KnnNormMode_Enum{
+    KNN_NORM_NONE = 0,      /**< Raw features */
+    KNN_NORM_ZSCORE,        /**< Zero mean, unit variance */
+    KNN_NORM_MINMAX         /**< Training range mapped to [0, 1] */
+}KnnNormMode;
+
+/** @brief Streaming statistics accumulator, one object at a time */
+typedef struct KnnNormAccum_Struct{
+    int features;       /**< Feature dimensionality */
+    long count;         /**< Objects added */
+    double *mean;       /**< Running mean (features) */
+    double *m2;         /**< Running sum of squared deviations (features) */
+    float *min;         /**< Running minimum (features) */
+    float *max;         /**< Running maximum (features) */
+}KnnNormAccum;
+
+/** @brief Normalization applied to every feature vector */
+typedef struct KnnNormStats_Struct{
+    int features;       /**< Feature dimensionality */
+    int mode;           /**< KnnNormMode */
+    float *offset;      /**< Subtracted from each feature (features) */
+    float *scale;       /**< Multiplied after the offset (features) */
+}KnnNormStats;
+
+int knnNormAccumInit(KnnNormAccum *acc, int features);
+void knnNormAccumAdd(KnnNormAccum *acc, const float *row);
+int knnNormAccumFinish(const KnnNormAccum *acc, int mode, KnnNormStats *stats);
+void knnNormAccumFree(KnnNormAccum *acc);
+
+void knnNormApply(const KnnNormStats *stats, float *data, int num_obj);
+int knnNormWrite(const KnnNormStats *stats, const char *path);
+int knnNormRead(const char *path, KnnNormStats *stats);
+void knnNormFree(KnnNormStats *stats);
+
+#endif
@@ -0,0 +1,266 @@
+/*
+ * @file knn_order.c
+ * @brief Space-filling-curve ordering of a training set and block pruning
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "knn_order.h"
+
+/************************************************************************/
+
+/** @brief Morton key of an object */
+typedef struct MortonKey_Struct{
+    uint64_t key;       /**< Interleaved quantized features */
+    int index;          /**< Original object index */
+}MortonKey;
+
+/** @brief qsort comparator, ascending key then ascending index */
+static int mortonCompare(const void *x, const void *y){
+    const MortonKey *a = x, *b = y;
+
+    if (a->key != b->key){
+        return (a->key < b->key) ? -1 : 1;
+    }
+    return a->index - b->index;
+}
+
+/** @brief qsort comparator, ascending box distance then ascending block */
+static int boxCompare(const void *x, const void *y){
+    const DistIndexPair *a = x, *b = y;
+
+    if (a->distance != b->distance){
+        return (a->distance < b->distance) ? -1 : 1;
+    }
+    return a->index - b->index;
+}
+
+/************************************************************************/
+
+/**
+ * @brief Orders objects along a Morton curve
+ *
+ * Each feature is quantized over its range to 64 / features bits (at
+ * least 1, at most 16); the key interleaves them from the most
+ * significant bit down. Only the first 64 features enter the key, one
+ * bit each at that size; features past the 64th are ignored.
+ *
+ * @param data Row-major feature vectors (num_obj x features)
+ * @param num_obj Number of objects
+ * @param features Feature dimensionality
+ * @param perm Output, perm[i] is the original index of the i-th object in curve order
+ * @return 0 on success, -1 otherwise.
+ */
+int knnMortonOrder(const float *data, int num_obj, int features, int *perm){
+
+    MortonKey *keys = malloc(sizeof(MortonKey) * num_obj);
+    float *lo = malloc(sizeof(float) * features);
+    float *scale = malloc(sizeof(float) * features);
+    uint32_t *cell = malloc(sizeof(uint32_t) * features);
+    int bits = 64 / features;
+    int dims = (features < 64) ? features : 64;
+    float hi, x;
+    int i, f, b;
+
+    if (keys == NULL || lo == NULL || scale == NULL || cell == NULL){
+        free(keys); free(lo); free(scale); free(cell);
+        return -1;
+    }
+    if (bits < 1) bits = 1;
+    if (bits > 16) bits = 16;
+
+    for (f = 0; f < features; f++){
+        lo[f] = INFINITY;
+        hi = -INFINITY;
+        for (i = 0; i < num_obj; i++){
+            x = data[(size_t) i*features + f];
+            if (x < lo[f]) lo[f] = x;
+            if (x > hi) hi = x;
+        }
+        scale[f] = (hi > lo[f]) ? ((1u << bits) - 1) / (hi - lo[f]) : 0.0f;
+    }
+
+    for (i = 0; i < num_obj; i++){
+        for (f = 0; f < dims; f++){
+            x = (data[(size_t) i*features + f] - lo[f]) * scale[f];
+            cell[f] = (x < (float) ((1u << bits) - 1)) ? (uint32_t) x : (1u << bits) - 1;
+        }
+        keys[i].key = 0;
+        keys[i].index = i;
+        for (b = bits - 1; b >= 0; b--){
+            for (f = 0; f < dims; f++){
+                keys[i].key = (keys[i].key << 1) | ((cell[f] >> b) & 1u);
+            }
+        }
+    }
+
+    qsort(keys, num_obj, sizeof(MortonKey), mortonCompare);
+    for (i = 0; i < num_obj; i++){
+        perm[i] = keys[i].index;
+    }
+
+    free(keys); free(lo); free(scale); free(cell);
+    return 0;
+}
+
+/**
+ * @brief Reorders rows and labels in place
+ *
+ * @param data Row-major feature vectors (num_obj x features)
+ * @param labels Labels of the objects, may be NULL
+ * @param num_obj Number of objects
+ * @param features Feature dimensionality
+ * @param perm perm[i] is the original index of the object moved to row i
+ * @return 0 on success, -1 otherwise.
+ */
+int knnApplyOrder(float *data, int *labels, int num_obj, int features,
+        const int *perm){
+
+    float *tmp_data = malloc(sizeof(float) * (size_t) num_obj * features);
+    int *tmp_label = malloc(sizeof(int) * num_obj);
+    int i;
+
+    if (tmp_data == NULL || tmp_label == NULL){
+        free(tmp_data); free(tmp_label);
+        return -1;
+    }
+    memcpy(tmp_data, data, sizeof(float) * (size_t) num_obj * features);
+    for (i = 0; i < num_obj; i++){
+        memcpy(&(data[(size_t) i*features]), &(tmp_data[(size_t) perm[i]*features]),
+                sizeof(float) * features);
+    }
+    if (labels != NULL){
+        memcpy(tmp_label, labels, sizeof(int) * num_obj);
+        for (i = 0; i < num_obj; i++){
+            labels[i] = tmp_label[ perm[i] ];
+        }
+    }
+    free(tmp_data); free(tmp_label);
+    return 0;
+}
+
+/**
+ * @brief Computes the bounding box of every KNN_BOX_BLOCK consecutive objects
+ *
+ * @param data Row-major feature vectors (num_obj x features), curve order
+ * @param num_obj Number of objects
+ * @param features Feature dimensionality
+ * @param boxes Output, release with knnBoxesFree
+ * @return 0 on success, -1 otherwise.
+ */
+int knnBoxesBuild(const float *data, int num_obj, int features, KnnBoxes *boxes){
+
+    int b, i, f, end;
+    float x, *lo, *hi;
+
+    boxes->num_blocks = (num_obj + KNN_BOX_BLOCK - 1) / KNN_BOX_BLOCK;
+    boxes->num_obj = num_obj;
+    boxes->features = features;
+    boxes->lo = malloc(sizeof(float) * (size_t) boxes->num_blocks * features);
+    boxes->hi = malloc(sizeof(float) * (size_t) boxes->num_blocks * features);
+    if (boxes->lo == NULL || boxes->hi == NULL){
+        knnBoxesFree(boxes);
+        return -1;
+    }
+
+    for (b = 0; b < boxes->num_blocks; b++){
+        lo = &(boxes->lo[(size_t) b*features]);
+        hi = &(boxes->hi[(size_t) b*features]);
+        for (f = 0; f < features; f++){
+            lo[f] = INFINITY;
+            hi[f] = -INFINITY;
+        }
+        end = (b + 1) * KNN_BOX_BLOCK;
+        if (end > num_obj) end = num_obj;
+        for (i = b * KNN_BOX_BLOCK; i < end; i++){
+            for (f = 0; f < features; f++){
+                x = data[(size_t) i*features + f];
+                if (x < lo[f]) lo[f] = x;
+                if (x > hi[f]) hi[f] = x;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Neighbours of each query, visiting blocks nearest box first
+ *
+ * Blocks are sorted by the squared distance from the query to their box;
+ * the scan stops at the first box farther than the current K-th best
+ * (with KNN_BOX_SLACK for rounding). Neighbours are reported by original
+ * index and ordered by (distance, original index), so the lists equal
+ * those of knnNeighbours() on the original order.
+ *
+ * @param boxes Boxes of the reordered training set
+ * @param queries Row-major query feature vectors (num_queries x features)
+ * @param num_queries Number of queries
+ * @param data Reordered training feature vectors
+ * @param perm Original index of each reordered object
+ * @param k Number of neighbours per query
+ * @param out Output neighbour lists (num_queries x k), original indices
+ * @param skipped Output number of blocks skipped over all queries
+ * @return 0 on success, -1 if the block order cannot be allocated.
+ */
+int knnBoxNeighbours(const KnnBoxes *boxes, float *queries, int num_queries,
+        float *data, const int *perm, int k, DistIndexPair *out, uint64_t *skipped){
+
+    int features = boxes->features;
+    DistIndexPair *order = malloc(sizeof(DistIndexPair) * boxes->num_blocks);
+    DistIndexPair *list;
+    const float *lo, *hi;
+    float *q, gap, sum;
+    int i, b, f, j, n, end;
+
+    if (order == NULL){
+        return -1;
+    }
+    *skipped = 0;
+    for (i = 0; i < num_queries; i++){
+        q = &(queries[(size_t) i*features]);
+        list = &(out[(size_t) i*k]);
+
+        for (b = 0; b < boxes->num_blocks; b++){
+            lo = &(boxes->lo[(size_t) b*features]);
+            hi = &(boxes->hi[(size_t) b*features]);
+            sum = 0.0f;
+            for (f = 0; f < features; f++){
+                gap = (q[f] < lo[f]) ? lo[f] - q[f] : (q[f] > hi[f]) ? q[f] - hi[f] : 0.0f;
+                sum += gap * gap;
+            }
+            order[b].distance = sum;
+            order[b].index = b;
+        }
+        qsort(order, boxes->num_blocks, sizeof(DistIndexPair), boxCompare);
+
+        n = 0;
+        for (b = 0; b < boxes->num_blocks; b++){
+            if (order[b].distance > topKThreshold(list, n, k) * KNN_BOX_SLACK){
+                *skipped += boxes->num_blocks - b;
+                break;
+            }
+            end = (order[b].index + 1) * KNN_BOX_BLOCK;
+            if (end > boxes->num_obj) end = boxes->num_obj;
+            for (j = order[b].index * KNN_BOX_BLOCK; j < end; j++){
+                n = topKPushByIndex(list, n, k,
+                        distance(q, &(data[(size_t) j*features]), features), perm[j]);
+            }
+        }
+        for (; n < k; n++){
+            list[n].distance = INFINITY;
+            list[n].index = -1;
+        }
+    }
+
+    free(order);
+    return 0;
+}
+
+/** @brief Releases the boxes */
+void knnBoxesFree(KnnBoxes *boxes){
+    free(boxes->lo);
+    free(boxes->hi);
+    boxes->lo = NULL;
+    boxes->hi = NULL;
+}
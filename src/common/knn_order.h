@@ -0,0 +1,43 @@
+/*
+ * @file knn_order.h
+ * @brief Space-filling-curve ordering of a training set and block pruning
+ *
+ * Compiling a dataset reorders its objects along a Morton (Z-order) curve
+ * over quantized features, so consecutive rows are close in feature
+ * space, and keeps the permutation back to the original indices. Every
+ * KNN_BOX_BLOCK consecutive objects of the reordered set get a bounding
+ * box; a scan visits blocks nearest-box first and skips every block
+ * whose box is farther than the current K-th best.
+ */
+
+#ifndef KNN_ORDER_H
+#define KNN_ORDER_H
+
+#include <stdint.h>
+
+#include "knn_kernels.h"
+
+/** Objects per bounding box */
+#define KNN_BOX_BLOCK 64
+
+/** Relative rounding slack of the box distance test */
+#define KNN_BOX_SLACK (1.0f + 1e-5f)
+
+/** @brief Per-block bounding boxes of a reordered set */
+typedef struct KnnBoxes_Struct{
+    int num_blocks;     /**< Number of blocks, last one may be partial */
+    int num_obj;        /**< Number of objects */
+    int features;       /**< Feature dimensionality */
+    float *lo;          /**< Lower corner of each box (num_blocks x features) */
+    float *hi;          /**< Upper corner of each box (num_blocks x features) */
+}KnnBoxes;
+
+int knnMortonOrder(const float *data, int num_obj, int features, int *perm);
+int knnApplyOrder(float *data, int *labels, int num_obj, int features,
+        const int *perm);
+int knnBoxesBuild(const float *data, int num_obj, int features, KnnBoxes *boxes);
+int knnBoxNeighbours(const KnnBoxes *boxes, float *queries, int num_queries,
+        float *data, const int *perm, int k, DistIndexPair *out, uint64_t *skipped);
+void knnBoxesFree(KnnBoxes *boxes);
+
+#endif
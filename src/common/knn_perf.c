@@ -0,0 +1,350 @@
+/*
+ * @file knn_perf.c
+ * @brief Hardware performance counters scoped to classifier phases
+ *
+ * Linux: one perf_event group per process (the first counter that opens
+ * is the leader), read atomically with PERF_FORMAT_GROUP.
+ * Bare-metal: Cortex-A9 PMU accessed through CP15, the cycle counter
+ * plus 4 event counters. The A9 PMU has no event for the external L2
+ * (PL310), so the LLC column is reported as unavailable there.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "knn_perf.h"
+
+/************************************************************************/
+
+/* Global Variables */
+
+/** Counter available on this platform */
+static int perf_avail[KNN_COUNTERS];
+/** Counter values at the start of each open scope */
+static uint64_t perf_start[KNN_PHASES][KNN_COUNTERS];
+/** Accumulated counts of each phase */
+static uint64_t perf_total[KNN_PHASES][KNN_COUNTERS];
+
+/** Phase names used in the report */
+static const char *perf_phase_names[KNN_PHASES] = {
+    "load", "distance", "selection", "voting" };
+
+/** Counter names used in the report */
+static const char *perf_counter_names[KNN_COUNTERS] = {
+    "cycles", "instr", "L1D-miss", "LLC-miss", "br-miss", "dTLB-miss" };
+
+/************************************************************************/
+
+#if defined(__linux__)
+
+/* Linux - perf_event_open */
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/** Cache event encoding, see perf_event_open(2) */
+#define PERF_CACHE_EVENT(cache, op, result) \
+    ((cache) | ((op) << 8) | ((result) << 16))
+
+/** @brief perf event type and config of each counter */
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} perf_events[KNN_COUNTERS] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, PERF_CACHE_EVENT(PERF_COUNT_HW_CACHE_L1D,
+        PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+    { PERF_TYPE_HW_CACHE, PERF_CACHE_EVENT(PERF_COUNT_HW_CACHE_LL,
+        PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { PERF_TYPE_HW_CACHE, PERF_CACHE_EVENT(PERF_COUNT_HW_CACHE_DTLB,
+        PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+};
+
+/** Group leader file descriptor */
+static int perf_leader = -1;
+/** File descriptor of each counter */
+static int perf_fd[KNN_COUNTERS];
+/** Position of each counter in a group read */
+static int perf_slot[KNN_COUNTERS];
+/** Number of counters in the group */
+static int perf_nr = 0;
+
+/** @brief Layout of a PERF_FORMAT_GROUP read */
+typedef struct PerfGroupRead_Struct{
+    uint64_t nr;                        /**< Number of values */
+    uint64_t time_enabled;              /**< Time the group was enabled */
+    uint64_t time_running;              /**< Time the group was on the PMU */
+    uint64_t values[KNN_COUNTERS];      /**< Counter values */
+}PerfGroupRead;
+
+/** @brief Opens a counter for the calling process on any CPU */
+static int perfOpen(int c, int group_fd){
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = perf_events[c].type;
+    attr.config = perf_events[c].config;
+    attr.disabled = (group_fd == -1);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP |
+            PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int) syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+/** @brief Opens the counter group and starts counting */
+static int perfPlatformInit(void){
+    int c, fd;
+
+    for (c = 0; c < KNN_COUNTERS; c++){
+        perf_fd[c] = -1;
+        fd = perfOpen(c, perf_leader);
+        if (fd < 0){
+            continue;
+        }
+        if (perf_leader == -1){
+            perf_leader = fd;
+        }
+        perf_fd[c] = fd;
+        perf_slot[c] = perf_nr++;
+        perf_avail[c] = 1;
+    }
+    if (perf_leader == -1){
+        return 0;
+    }
+    ioctl(perf_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(perf_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return perf_nr;
+}
+
+/** @brief Snapshot of all counters, scaled if the group was multiplexed */
+static void perfPlatformRead(uint64_t *values){
+    PerfGroupRead buf;
+    double scale = 1.0;
+    int c;
+
+    memset(values, 0, sizeof(uint64_t) * KNN_COUNTERS);
+    if (perf_leader == -1 || read(perf_leader, &buf, sizeof(buf)) <= 0){
+        return;
+    }
+    if (buf.time_running != 0 && buf.time_running < buf.time_enabled){
+        scale = (double) buf.time_enabled / buf.time_running;
+    }
+    for (c = 0; c < KNN_COUNTERS; c++){
+        if (perf_avail[c]){
+            values[c] = (uint64_t) (buf.values[perf_slot[c]] * scale);
+        }
+    }
+}
+
+/** @brief Width mask of the counters */
+static uint64_t perfPlatformMask(void){
+    return ~0ull;
+}
+
+/** @brief Closes the counter group */
+static void perfPlatformClose(void){
+    int c;
+
+    for (c = 0; c < KNN_COUNTERS; c++){
+        if (perf_fd[c] >= 0){
+            close(perf_fd[c]);
+        }
+        perf_fd[c] = -1;
+    }
+    perf_leader = -1;
+    perf_nr = 0;
+}
+
+#elif defined(__arm__)
+
+/* Bare-metal - Cortex-A9 PMU */
+
+/** A9 event numbers of each counter, -1 if unavailable, 0xFF for PMCCNTR */
+static const int pmu_events[KNN_COUNTERS] = {
+    0xFF,       /* PMCCNTR */
+    0x68,       /* Instructions coming out of the core renaming stage */
+    0x03,       /* L1 data cache refill */
+    -1,         /* No PMU event for the external PL310 L2 */
+    0x10,       /* Branch mispredicted or not predicted */
+    0x05,       /* Data TLB refill */
+};
+
+/** Event counter assigned to each counter */
+static int pmu_slot[KNN_COUNTERS];
+
+/** @brief Starts the cycle counter and programs the event counters */
+static int perfPlatformInit(void){
+    uint32_t pmcr, enable = 0x80000000;
+    int c, n = 0;
+
+    for (c = 0; c < KNN_COUNTERS; c++){
+        if (pmu_events[c] == 0xFF){
+            perf_avail[c] = 1;
+        } else if (pmu_events[c] >= 0){
+            pmu_slot[c] = n;
+            /* PMSELR, PMXEVTYPER */
+            __asm__ volatile("mcr p15, 0, %0, c9, c12, 5" :: "r"(n));
+            __asm__ volatile("isb");
+            __asm__ volatile("mcr p15, 0, %0, c9, c13, 1" :: "r"(pmu_events[c]));
+            enable |= 1u << n;
+            perf_avail[c] = 1;
+            n++;
+        }
+    }
+    /* PMCR: enable, reset event counters and cycle counter */
+    __asm__ volatile("mrc p15, 0, %0, c9, c12, 0" : "=r"(pmcr));
+    pmcr |= 0x7;
+    __asm__ volatile("mcr p15, 0, %0, c9, c12, 0" :: "r"(pmcr));
+    /* PMCNTENSET */
+    __asm__ volatile("mcr p15, 0, %0, c9, c12, 1" :: "r"(enable));
+    return n + 1;
+}
+
+/** @brief Snapshot of all counters */
+static void perfPlatformRead(uint64_t *values){
+    uint32_t val;
+    int c;
+
+    for (c = 0; c < KNN_COUNTERS; c++){
+        val = 0;
+        if (pmu_events[c] == 0xFF){
+            __asm__ volatile("mrc p15, 0, %0, c9, c13, 0" : "=r"(val));
+        } else if (pmu_events[c] >= 0){
+            __asm__ volatile("mcr p15, 0, %0, c9, c12, 5" :: "r"(pmu_slot[c]));
+            __asm__ volatile("isb");
+            __asm__ volatile("mrc p15, 0, %0, c9, c13, 2" : "=r"(val));
+        }
+        values[c] = val;
+    }
+}
+
+/** @brief Width mask of the counters, deltas wrap at 32 bits */
+static uint64_t perfPlatformMask(void){
+    return 0xFFFFFFFFull;
+}
+
+/** @brief Stops all counters (PMCNTENCLR) */
+static void perfPlatformClose(void){
+    __asm__ volatile("mcr p15, 0, %0, c9, c12, 2" :: "r"(0xFFFFFFFFu));
+}
+
+#else
+
+/* No counters on this platform */
+
+static int perfPlatformInit(void){ return 0; }
+static void perfPlatformRead(uint64_t *values){
+    memset(values, 0, sizeof(uint64_t) * KNN_COUNTERS);
+}
+static uint64_t perfPlatformMask(void){ return ~0ull; }
+static void perfPlatformClose(void){}
+
+#endif
+
+/************************************************************************/
+
+/**
+ * @brief Opens and starts the hardware counters
+ * @return Number of available counters, 0 if none could be opened.
+ */
+int knnPerfInit(void){
+    memset(perf_avail, 0, sizeof(perf_avail));
+    memset(perf_total, 0, sizeof(perf_total));
+    return perfPlatformInit();
+}
+
+/**
+ * @brief Opens a scope of the given phase
+ * @param phase Classifier phase
+ */
+void knnPerfBegin(KnnPhase phase){
+    perfPlatformRead(perf_start[phase]);
+}
+
+/**
+ * @brief Closes a scope, adding its counts to the phase totals
+ * @param phase Classifier phase
+ */
+void knnPerfEnd(KnnPhase phase){
+    uint64_t now[KNN_COUNTERS];
+    uint64_t mask = perfPlatformMask();
+    int c;
+
+    perfPlatformRead(now);
+    for (c = 0; c < KNN_COUNTERS; c++){
+        perf_total[phase][c] += (now[c] - perf_start[phase][c]) & mask;
+    }
+}
+
+/**
+ * @brief Accumulated count of a phase
+ * @param phase Classifier phase
+ * @param counter Hardware event
+ * @return The count, 0 if the counter is unavailable.
+ */
+uint64_t knnPerfCount(KnnPhase phase, KnnCounter counter){
+    return perf_total[phase][counter];
+}
+
+/**
+ * @brief Prints the counts of every phase, IPC and events per distance
+ * @param num_distances Number of distances calculated (tst x trn objects)
+ */
+void knnPerfReport(uint64_t num_distances){
+    int p, c;
+    double ipc;
+
+    printf("\nPerformance Counters\n%-10s", "phase");
+    for (c = 0; c < KNN_COUNTERS; c++){
+        printf(" %14s", perf_counter_names[c]);
+    }
+    printf(" %6s\n", "IPC");
+
+    for (p = 0; p < KNN_PHASES; p++){
+        printf("%-10s", perf_phase_names[p]);
+        for (c = 0; c < KNN_COUNTERS; c++){
+            if (perf_avail[c]){
+                printf(" %14llu", (unsigned long long) perf_total[p][c]);
+            } else {
+                printf(" %14s", "n/a");
+            }
+        }
+        ipc = 0.0;
+        if (perf_total[p][KNN_CTR_CYCLES] != 0){
+            ipc = (double) perf_total[p][KNN_CTR_INSTRUCTIONS] / perf_total[p][KNN_CTR_CYCLES];
+        }
+        printf(" %6.2f\n", ipc);
+    }
+
+    if (num_distances == 0){
+        return;
+    }
+    printf("\nPer distance (%llu distances)\n%-10s",
+            (unsigned long long) num_distances, "phase");
+    for (c = 0; c < KNN_COUNTERS; c++){
+        printf(" %14s", perf_counter_names[c]);
+    }
+    printf("\n");
+    for (p = 0; p < KNN_PHASES; p++){
+        printf("%-10s", perf_phase_names[p]);
+        for (c = 0; c < KNN_COUNTERS; c++){
+            if (perf_avail[c]){
+                printf(" %14.4f", (double) perf_total[p][c] / num_distances);
+            } else {
+                printf(" %14s", "n/a");
+            }
+        }
+        printf("\n");
+    }
+}
+
+/** @brief Stops and releases the hardware counters */
+void knnPerfClose(void){
+    perfPlatformClose();
+}
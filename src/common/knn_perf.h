@@ -0,0 +1,47 @@
+/*
+ * @file knn_perf.h
+ * @brief Hardware performance counters scoped to classifier phases
+ *
+ * Counts cycles, instructions, L1D/LLC misses, branch misses and dTLB
+ * misses inside the load, distance, selection and voting phases.
+ * On Linux the counters are opened with perf_event_open, on the
+ * bare-metal builds they are read directly from the Cortex-A9 PMU,
+ * so both platforms produce the same report.
+ *
+ * Scopes are meant to wrap whole phases, not single objects: on Linux
+ * every knnPerfBegin/knnPerfEnd costs one read() system call.
+ */
+
+#ifndef KNN_PERF_H
+#define KNN_PERF_H
+
+#include <stdint.h>
+
+/** @brief Instrumented classifier phases */
+typedef enum KnnPhase_Enum{
+    KNN_PHASE_LOAD = 0,         /**< Reading the dataset */
+    KNN_PHASE_DISTANCE,         /**< Distance matrix calculation */
+    KNN_PHASE_SELECTION,        /**< Top-K selection */
+    KNN_PHASE_VOTING,           /**< Label assignment */
+    KNN_PHASES                  /**< Number of phases */
+}KnnPhase;
+
+/** @brief Counted hardware events */
+typedef enum KnnCounter_Enum{
+    KNN_CTR_CYCLES = 0,         /**< Core clock cycles */
+    KNN_CTR_INSTRUCTIONS,       /**< Retired instructions */
+    KNN_CTR_L1D_MISSES,         /**< L1 data cache refills */
+    KNN_CTR_LLC_MISSES,         /**< Last level cache misses */
+    KNN_CTR_BRANCH_MISSES,      /**< Mispredicted branches */
+    KNN_CTR_DTLB_MISSES,        /**< Data TLB refills */
+    KNN_COUNTERS                /**< Number of counters */
+}KnnCounter;
+
+int knnPerfInit(void);
+void knnPerfBegin(KnnPhase phase);
+void knnPerfEnd(KnnPhase phase);
+uint64_t knnPerfCount(KnnPhase phase, KnnCounter counter);
+void knnPerfReport(uint64_t num_distances);
+void knnPerfClose(void);
+
+#endif
@@ -0,0 +1,228 @@
+/*
+ * @file knn_pipeline.c
+ * @brief Classification pipelines specialized for fixed FEATURES and K
+ *
+ * Every pipeline inlines the same body, pipelineBody(); the specialized
+ * ones pass features and k as literals, which the compiler propagates
+ * into the distance, insertion and vote loops.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "knn_pipeline.h"
+#include "knn_policy.h"
+#include "knn_arena.h"
+
+/** Distances computed before each selection pass */
+#define KNN_PIPELINE_TILE 256
+
+/** @brief KNN_POLICY_LANES floats held as one vector (GCC vector extension) */
+typedef float PipelineLanes __attribute__((vector_size(KNN_POLICY_LANES * sizeof(float))));
+
+/************************************************************************/
+
+/**
+ * @brief Squared euclidean distance on explicit vector lanes
+ *
+ * With a literal size GCC fully unrolls knnDistance_L2SQ, hoists the
+ * query into scalar registers and loses the vectorization; explicit
+ * lanes keep it in SIMD registers. The tail is handled by
+ * knnDistance_L2SQ.
+ */
+static inline __attribute__((always_inline)) float pipelineDistance(
+        const float *a, const float *b, int size){
+
+    PipelineLanes acc = { 0 }, va, vb;
+    float r = 0.0f;
+    int i, l;
+
+    for (i = 0; i + KNN_POLICY_LANES <= size; i += KNN_POLICY_LANES){
+        memcpy(&va, &(a[i]), sizeof(va));
+        memcpy(&vb, &(b[i]), sizeof(vb));
+        va -= vb;
+        acc += va * va;
+    }
+    for (l = 0; l < KNN_POLICY_LANES; l++){
+        r += acc[l];
+    }
+    if (i < size){
+        r += knnDistance_L2SQ(&(a[i]), &(b[i]), size - i);
+    }
+    return r;
+}
+
+/************************************************************************/
+
+/**
+ * @brief Shared pipeline body
+ *
+ * The K-best list starts full of infinite distances, so a candidate only
+ * costs one compare against list[k-1] unless it gets in.
+ *
+ * @param list Scratch neighbour list of k entries
+ * @param votes Scratch array of classes vote counters
+ */
+static inline __attribute__((always_inline)) void pipelineBody(
+        const float *queries, int num_queries, const float *data,
+        const int *labels, int num_obj, int features, int k, int classes,
+        DistIndexPair *list, int *votes, int *out){
+
+    float tile[KNN_PIPELINE_TILE];
+    int i, j, j0, n, c, assigned_label, vote;
+
+    for (i = 0; i < num_queries; i++){
+        const float *q = &(queries[(size_t) i*features]);
+
+        for (j = 0; j < k; j++){
+            list[j].distance = INFINITY;
+            list[j].index = -1;
+        }
+        for (j0 = 0; j0 < num_obj; j0 += KNN_PIPELINE_TILE){
+            n = (num_obj - j0 < KNN_PIPELINE_TILE) ? num_obj - j0 : KNN_PIPELINE_TILE;
+            for (j = 0; j < n; j++){
+                tile[j] = pipelineDistance(q, &(data[(size_t) (j0 + j)*features]), features);
+            }
+            for (j = 0; j < n; j++){
+                if (tile[j] < list[k-1].distance){
+                    topKPush(list, k, k, tile[j], j0 + j);
+                }
+            }
+        }
+
+        for (c = 0; c < classes; c++){
+            votes[c] = 0;
+        }
+        for (j = 0; j < k; j++){
+            if (list[j].index >= 0){
+                votes[ labels[list[j].index] ]++;
+            }
+        }
+        assigned_label = 0;
+        vote = 0;
+        for (c = 0; c < classes; c++){
+            if (votes[c] > vote){
+                vote = votes[c];
+                assigned_label = c;
+            }
+        }
+        out[i] = assigned_label;
+    }
+}
+
+/**
+ * @brief Defines knnPipeline_<F>_<K>
+ */
+#define KNN_DEFINE_PIPELINE(F, K) \
+static int knnPipeline_##F##_##K(const float *queries, int num_queries, \
+        const float *data, const int *labels, int num_obj, int features, \
+        int k, int classes, int *out){ \
+    DistIndexPair list[K]; \
+    int votes[KNN_PIPELINE_MAX_CLASSES]; \
+    (void) features; (void) k; \
+    pipelineBody(queries, num_queries, data, labels, num_obj, F, K, \
+            classes, list, votes, out); \
+    return 0; \
+}
+
+/** @brief Defines the pipelines of one feature count, K = 1..16 */
+#define KNN_DEFINE_PIPELINES(F) \
+    KNN_DEFINE_PIPELINE(F, 1)  KNN_DEFINE_PIPELINE(F, 2) \
+    KNN_DEFINE_PIPELINE(F, 3)  KNN_DEFINE_PIPELINE(F, 4) \
+    KNN_DEFINE_PIPELINE(F, 5)  KNN_DEFINE_PIPELINE(F, 6) \
+    KNN_DEFINE_PIPELINE(F, 7)  KNN_DEFINE_PIPELINE(F, 8) \
+    KNN_DEFINE_PIPELINE(F, 9)  KNN_DEFINE_PIPELINE(F, 10) \
+    KNN_DEFINE_PIPELINE(F, 11) KNN_DEFINE_PIPELINE(F, 12) \
+    KNN_DEFINE_PIPELINE(F, 13) KNN_DEFINE_PIPELINE(F, 14) \
+    KNN_DEFINE_PIPELINE(F, 15) KNN_DEFINE_PIPELINE(F, 16)
+
+/** @brief Dispatch table row of one feature count, indexed by K - 1 */
+#define KNN_PIPELINE_ROW(F) { F, { \
+    knnPipeline_##F##_1,  knnPipeline_##F##_2,  knnPipeline_##F##_3,  knnPipeline_##F##_4, \
+    knnPipeline_##F##_5,  knnPipeline_##F##_6,  knnPipeline_##F##_7,  knnPipeline_##F##_8, \
+    knnPipeline_##F##_9,  knnPipeline_##F##_10, knnPipeline_##F##_11, knnPipeline_##F##_12, \
+    knnPipeline_##F##_13, knnPipeline_##F##_14, knnPipeline_##F##_15, knnPipeline_##F##_16 } }
+
+KNN_DEFINE_PIPELINES(4)
+KNN_DEFINE_PIPELINES(12)
+KNN_DEFINE_PIPELINES(16)
+KNN_DEFINE_PIPELINES(32)
+KNN_DEFINE_PIPELINES(64)
+
+/** @brief Specialized pipelines of one feature count */
+typedef struct PipelineRow_Struct{
+    int features;                           /**< Feature dimensionality */
+    KnnPipelineFn fn[KNN_PIPELINE_MAX_K];   /**< Pipeline of each K, at K - 1 */
+}PipelineRow;
+
+/** Dispatch table of the specialized pipelines */
+static const PipelineRow pipelines[] = {
+    KNN_PIPELINE_ROW(4),
+    KNN_PIPELINE_ROW(12),
+    KNN_PIPELINE_ROW(16),
+    KNN_PIPELINE_ROW(32),
+    KNN_PIPELINE_ROW(64)
+};
+
+/************************************************************************/
+
+/**
+ * @brief Generic pipeline, any features, K and number of classes
+ *
+ * The list and vote counters are carved from the calling thread's arena.
+ *
+ * @return 0 on success, -1 if the scratch space cannot be allocated.
+ */
+int knnPipelineGeneric(const float *queries, int num_queries,
+        const float *data, const int *labels, int num_obj, int features,
+        int k, int classes, int *out){
+
+    KnnArena *arena = knnArenaThread(knnArenaSpan(sizeof(DistIndexPair) * k)
+            + knnArenaSpan(sizeof(int) * classes));
+    size_t mark;
+
+    if (arena == NULL){
+        return -1;
+    }
+    mark = knnArenaMark(arena);
+    pipelineBody(queries, num_queries, data, labels, num_obj, features, k,
+            classes, knnArenaAlloc(arena, sizeof(DistIndexPair) * k),
+            knnArenaAlloc(arena, sizeof(int) * classes), out);
+    knnArenaRelease(arena, mark);
+    return 0;
+}
+
+/**
+ * @brief Looks up the specialized pipeline of a shape
+ *
+ * @param features Feature dimensionality
+ * @param k Number of neighbours
+ * @param classes Number of classes
+ * @return Specialized pipeline, NULL if the shape has none.
+ */
+KnnPipelineFn knnPipelineFind(int features, int k, int classes){
+    unsigned i;
+
+    if (k < 1 || k > KNN_PIPELINE_MAX_K || classes > KNN_PIPELINE_MAX_CLASSES){
+        return NULL;
+    }
+    for (i = 0; i < sizeof(pipelines)/sizeof(pipelines[0]); i++){
+        if (pipelines[i].features == features){
+            return pipelines[i].fn[k-1];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Returns the specialized pipeline of a shape, or the generic one
+ *
+ * @param features Feature dimensionality
+ * @param k Number of neighbours
+ * @param classes Number of classes
+ * @return Pipeline to classify with.
+ */
+KnnPipelineFn knnPipelineSelect(int features, int k, int classes){
+    KnnPipelineFn fn = knnPipelineFind(features, k, classes);
+    return fn ? fn : knnPipelineGeneric;
+}
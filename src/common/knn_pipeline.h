@@ -0,0 +1,51 @@
+/*
+ * @file knn_pipeline.h
+ * @brief Classification pipelines specialized for fixed FEATURES and K
+ *
+ * data.h fixes the dataset shape at compile time. Pipelines lift that
+ * restriction for data loaded at runtime: KNN_DEFINE_PIPELINE expands a
+ * distance + top-K + vote loop with FEATURES and K as literal constants,
+ * so the distance loop is fully unrolled, the K-best list is a fixed-size
+ * local array and votes[] is statically sized. knn_pipeline.c
+ * instantiates the common shapes; knnPipelineSelect() looks one up and
+ * falls back to a generic loop for any other shape.
+ */
+
+#ifndef KNN_PIPELINE_H
+#define KNN_PIPELINE_H
+
+#include "knn_kernels.h"
+
+/** Largest number of classes handled by the specialized pipelines */
+#define KNN_PIPELINE_MAX_CLASSES 64
+/** Largest K with a specialized pipeline */
+#define KNN_PIPELINE_MAX_K 16
+
+/**
+ * @brief Classifies a batch of queries (squared euclidean, majority vote)
+ *
+ * Ties in distance keep the lowest training index, ties in the vote the
+ * lowest class, as in the default classifier.
+ *
+ * @param queries Row-major query feature vectors (num_queries x features)
+ * @param num_queries Number of queries
+ * @param data Row-major training feature vectors (num_obj x features)
+ * @param labels Training set labels
+ * @param num_obj Number of training objects
+ * @param features Feature dimensionality (fixed in specialized pipelines)
+ * @param k Number of neighbours (fixed in specialized pipelines)
+ * @param classes Number of classes
+ * @param out Output labels (num_queries)
+ * @return 0 on success, -1 if the scratch space cannot be allocated.
+ */
+typedef int (*KnnPipelineFn)(const float *queries, int num_queries,
+        const float *data, const int *labels, int num_obj, int features,
+        int k, int classes, int *out);
+
+KnnPipelineFn knnPipelineFind(int features, int k, int classes);
+KnnPipelineFn knnPipelineSelect(int features, int k, int classes);
+int knnPipelineGeneric(const float *queries, int num_queries,
+        const float *data, const int *labels, int num_obj, int features,
+        int k, int classes, int *out);
+
+#endif
@@ -0,0 +1,156 @@
+/*
+ * @file knn_pivot.c
+ * @brief Pivot-based lower-bound pruning (LAESA)
+ */
+
+#include <stdlib.h>
+
+#include "knn_pivot.h"
+
+/************************************************************************/
+
+/**
+ * @brief Selects pivots by max-min spread and fills the distance table
+ *
+ * The first pivot is the object farthest from object 0; each next pivot
+ * is the object whose nearest pivot so far is farthest away.
+ *
+ * @param data Row-major training feature vectors (num_obj x features)
+ * @param num_obj Number of training objects
+ * @param features Feature dimensionality
+ * @param num_pivots Number of pivots, clamped to num_obj
+ * @param pivots Output, release with knnPivotsFree
+ * @return 0 on success, -1 otherwise.
+ */
+int knnPivotsBuild(float *data, int num_obj, int features, int num_pivots,
+        KnnPivots *pivots){
+
+    float *nearest = malloc(sizeof(float) * num_obj);
+    float d, best;
+    int i, p, next;
+
+    if (num_pivots > num_obj){
+        num_pivots = num_obj;
+    }
+    pivots->num_pivots = num_pivots;
+    pivots->num_obj = num_obj;
+    pivots->index = malloc(sizeof(int) * num_pivots);
+    pivots->table = malloc(sizeof(float) * (size_t) num_obj * num_pivots);
+    if (nearest == NULL || pivots->index == NULL || pivots->table == NULL){
+        free(nearest);
+        knnPivotsFree(pivots);
+        return -1;
+    }
+
+    /* Farthest object from object 0 */
+    next = 0;
+    best = -1.0f;
+    for (i = 0; i < num_obj; i++){
+        d = distance(&(data[0]), &(data[(size_t) i*features]), features);
+        if (d > best){
+            best = d;
+            next = i;
+        }
+        nearest[i] = INFINITY;
+    }
+
+    for (p = 0; p < num_pivots; p++){
+        pivots->index[p] = next;
+        best = -1.0f;
+        for (i = 0; i < num_obj; i++){
+            d = sqrtf(distance(&(data[(size_t) next*features]),
+                    &(data[(size_t) i*features]), features));
+            pivots->table[(size_t) i*num_pivots + p] = d;
+            if (d < nearest[i]){
+                nearest[i] = d;
+            }
+        }
+        for (i = 0; i < num_obj; i++){
+            if (nearest[i] > best){
+                best = nearest[i];
+                next = i;
+            }
+        }
+    }
+
+    free(nearest);
+    return 0;
+}
+
+/**
+ * @brief knnNeighbours with pivot lower-bound pruning
+ *
+ * @param pivots Pivots of the training set
+ * @param queries Row-major query feature vectors (num_queries x features)
+ * @param num_queries Number of queries
+ * @param data Row-major training feature vectors (num_obj x features)
+ * @param num_obj Number of training objects
+ * @param features Feature dimensionality
+ * @param k Number of neighbours per query
+ * @param out Output neighbour lists (num_queries x k), ascending distance
+ * @return Number of training objects pruned over all queries, UINT64_MAX
+ * if the per-query scratch could not be allocated.
+ */
+uint64_t knnPivotNeighbours(const KnnPivots *pivots, float *queries,
+        int num_queries, float *data, int num_obj, int features, int k,
+        DistIndexPair *out){
+
+    int np = pivots->num_pivots;
+    float *qp = malloc(sizeof(float) * np);
+    const float *row;
+    DistIndexPair *list;
+    float radius, bound, t;
+    uint64_t pruned = 0;
+    int i, j, p, n;
+
+    if (qp == NULL){
+        return UINT64_MAX;
+    }
+
+    for (i = 0; i < num_queries; i++){
+        float *q = &(queries[(size_t) i*features]);
+
+        list = &(out[(size_t) i*k]);
+        for (p = 0; p < np; p++){
+            qp[p] = sqrtf(distance(q, &(data[(size_t) pivots->index[p]*features]), features));
+        }
+
+        /* Radius of the K-best ball, updated only when the list changes */
+        n = 0;
+        radius = INFINITY;
+        for (j = 0; j < num_obj; j++){
+            row = &(pivots->table[(size_t) j*np]);
+            for (p = 0; p < np; p++){
+                t = row[p];
+                bound = fabsf(qp[p] - t) - KNN_PIVOT_SLACK * (qp[p] + t);
+                if (bound > radius){
+                    break;
+                }
+            }
+            if (p < np){
+                pruned++;
+                continue;
+            }
+            n = topKPush(list, n, k,
+                    distance(q, &(data[(size_t) j*features]), features), j);
+            if (n == k){
+                radius = sqrtf(list[k-1].distance);
+            }
+        }
+        for (; n < k; n++){
+            list[n].distance = INFINITY;
+            list[n].index = -1;
+        }
+    }
+
+    free(qp);
+    return pruned;
+}
+
+/** @brief Releases the pivots */
+void knnPivotsFree(KnnPivots *pivots){
+    free(pivots->index);
+    free(pivots->table);
+    pivots->index = NULL;
+    pivots->table = NULL;
+}
@@ -0,0 +1,42 @@
+/*
+ * @file knn_pivot.h
+ * @brief Pivot-based lower-bound pruning (LAESA)
+ *
+ * P training objects spread by max-min selection act as pivots; the
+ * euclidean distance of every training object to each pivot is stored.
+ * By the triangle inequality |d(q,p) - d(x,p)| <= d(q,x), so a training
+ * object whose largest pivot bound exceeds the current K-th best
+ * distance is skipped without calling the distance kernel.
+ *
+ * Bounds are taken on square-rooted distances computed in float; each
+ * one is lowered by a relative slack covering their rounding, so only
+ * objects that could not enter the K-best list are pruned and the
+ * neighbour lists are identical to the full scan.
+ */
+
+#ifndef KNN_PIVOT_H
+#define KNN_PIVOT_H
+
+#include <stdint.h>
+
+#include "knn_kernels.h"
+
+/** Relative rounding slack applied to each pivot bound */
+#define KNN_PIVOT_SLACK 1e-5f
+
+/** @brief Pivots and the pivot distance table of a training set */
+typedef struct KnnPivots_Struct{
+    int num_pivots;     /**< Number of pivots P */
+    int num_obj;        /**< Number of training objects */
+    int *index;         /**< Training index of each pivot */
+    float *table;       /**< Euclidean distance of each object to each pivot (num_obj x P) */
+}KnnPivots;
+
+int knnPivotsBuild(float *data, int num_obj, int features, int num_pivots,
+        KnnPivots *pivots);
+uint64_t knnPivotNeighbours(const KnnPivots *pivots, float *queries,
+        int num_queries, float *data, int num_obj, int features, int k,
+        DistIndexPair *out);
+void knnPivotsFree(KnnPivots *pivots);
+
+#endif
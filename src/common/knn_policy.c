@@ -0,0 +1,167 @@
+/*
+ * @file knn_policy.c
+ * @brief Specialized classifiers of every (metric, vote) pair
+ */
+
+#include <string.h>
+
+#include "knn_policy.h"
+
+/************************************************************************/
+
+KNN_DEFINE_CLASSIFIER(L2SQ, MAJORITY)
+KNN_DEFINE_CLASSIFIER(L2SQ, INVDIST)
+KNN_DEFINE_CLASSIFIER(L1, MAJORITY)
+KNN_DEFINE_CLASSIFIER(L1, INVDIST)
+KNN_DEFINE_CLASSIFIER(LINF, MAJORITY)
+KNN_DEFINE_CLASSIFIER(LINF, INVDIST)
+KNN_DEFINE_CLASSIFIER(COSINE, MAJORITY)
+KNN_DEFINE_CLASSIFIER(COSINE, INVDIST)
+
+KNN_DEFINE_NEIGHBOURS(L2SQ)
+KNN_DEFINE_NEIGHBOURS(L1)
+KNN_DEFINE_NEIGHBOURS(LINF)
+KNN_DEFINE_NEIGHBOURS(COSINE)
+
+/** Classifier of each (metric, vote) pair */
+static const KnnClassifierFn classifiers[KNN_METRICS][KNN_VOTES] = {
+    { knnClassify_L2SQ_MAJORITY,   knnClassify_L2SQ_INVDIST },
+    { knnClassify_L1_MAJORITY,     knnClassify_L1_INVDIST },
+    { knnClassify_LINF_MAJORITY,   knnClassify_LINF_INVDIST },
+    { knnClassify_COSINE_MAJORITY, knnClassify_COSINE_INVDIST }
+};
+
+/** Neighbour search of each metric */
+static const KnnNeighboursFn searches[KNN_METRICS] = {
+    knnNeighbours_L2SQ, knnNeighbours_L1, knnNeighbours_LINF, knnNeighbours_COSINE
+};
+
+/** Command line names of the metrics, in KnnMetric order */
+static const char *metric_names[KNN_METRICS] = { "l2", "l1", "linf", "cos" };
+
+/** Command line names of the vote policies, in KnnVote order */
+static const char *vote_names[KNN_VOTES] = { "majority", "invdist" };
+
+/************************************************************************/
+
+/**
+ * @brief Returns the specialized classifier of a (metric, vote) pair
+ *
+ * @param metric Distance metric
+ * @param vote Vote policy
+ * @return Classifier, NULL if either argument is out of range.
+ */
+KnnClassifierFn knnPolicyClassifier(KnnMetric metric, KnnVote vote){
+    if (metric < 0 || metric >= KNN_METRICS || vote < 0 || vote >= KNN_VOTES){
+        return NULL;
+    }
+    return classifiers[metric][vote];
+}
+
+/**
+ * @brief Returns the neighbour search of a metric
+ *
+ * @return Search, NULL if the metric is out of range.
+ */
+KnnNeighboursFn knnPolicyNeighbours(KnnMetric metric){
+    if (metric < 0 || metric >= KNN_METRICS){
+        return NULL;
+    }
+    return searches[metric];
+}
+
+/**
+ * @brief Votes on a sorted neighbour list
+ *
+ * Same weights and tie-breaking as the specialized classifiers, chosen at
+ * run time: used on precomputed lists, where the scan is already done.
+ *
+ * @param list Sorted neighbour list, entries with index -1 are skipped
+ * @param k Number of entries voting
+ * @param labels Training set labels
+ * @param vote Vote policy
+ * @param classes Number of classes
+ * @param votes Scratch array of classes vote weights
+ * @return Assigned label.
+ */
+int knnPolicyVote(const DistIndexPair *list, int k, const int *labels,
+        KnnVote vote, int classes, float *votes){
+
+    int j, c, assigned_label = 0;
+    float best = 0.0f;
+
+    for (c = 0; c < classes; c++){
+        votes[c] = 0.0f;
+    }
+    for (j = 0; j < k && list[j].index >= 0; j++){
+        votes[ labels[list[j].index] ] += (vote == KNN_VOTE_INVDIST)
+                ? KNN_VOTE_INVDIST_WEIGHT(list[j].distance)
+                : KNN_VOTE_MAJORITY_WEIGHT(list[j].distance);
+    }
+    for (c = 0; c < classes; c++){
+        if (votes[c] > best){
+            best = votes[c];
+            assigned_label = c;
+        }
+    }
+    return assigned_label;
+}
+
+/**
+ * @brief Parses a metric name (l2, l1, linf, cos)
+ *
+ * @return KnnMetric value, -1 if unknown.
+ */
+int knnParseMetric(const char *name){
+    int i;
+    for (i = 0; i < KNN_METRICS; i++){
+        if (strcmp(name, metric_names[i]) == 0){
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Parses a vote policy name (majority, invdist)
+ *
+ * @return KnnVote value, -1 if unknown.
+ */
+int knnParseVote(const char *name){
+    int i;
+    for (i = 0; i < KNN_VOTES; i++){
+        if (strcmp(name, vote_names[i]) == 0){
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Scales every row to unit L2 norm, as required by KNN_METRIC_COSINE
+ *
+ * All-zero rows are left untouched.
+ *
+ * @param data Row-major feature vectors (num_obj x features)
+ * @param num_obj Number of objects
+ * @param features Feature dimensionality
+ */
+void knnNormalizeRows(float *data, int num_obj, int features){
+
+    int i, j;
+    float *row, norm;
+
+    for (i = 0; i < num_obj; i++){
+        row = &(data[(size_t) i*features]);
+        norm = 0.0f;
+        for (j = 0; j < features; j++){
+            norm += row[j] * row[j];
+        }
+        if (norm > 0.0f){
+            norm = 1.0f / sqrtf(norm);
+            for (j = 0; j < features; j++){
+                row[j] *= norm;
+            }
+        }
+    }
+}
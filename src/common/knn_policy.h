@@ -0,0 +1,211 @@
+/*
+ * @file knn_policy.h
+ * @brief Compile-time metric and voting policies
+ *
+ * A metric policy is a set of macros (INIT, ACC, COMBINE, FINAL) and a
+ * vote policy a WEIGHT macro. KNN_DEFINE_DISTANCE and
+ * KNN_DEFINE_CLASSIFIER paste them into specialized functions, one per
+ * metric and per (metric, vote) pair, so each inner loop is straight-line
+ * code with no per-element branch or indirect call. Runtime selection
+ * happens once per batch through knnPolicyClassifier().
+ *
+ * Distances accumulate into KNN_POLICY_LANES independent partial results,
+ * which lets the compiler vectorize the loop without reassociating FP
+ * math (-ffast-math is not required).
+ */
+
+#ifndef KNN_POLICY_H
+#define KNN_POLICY_H
+
+#include <math.h>
+
+#include "knn_kernels.h"
+
+/** Independent accumulators per distance, one SIMD register of floats */
+#define KNN_POLICY_LANES 8
+
+/** Added to distances before inverting them in the weighted vote */
+#define KNN_INVDIST_EPS 1e-6f
+
+/************************************************************************/
+
+/* Metric policies */
+
+/* Squared euclidean (L2^2) */
+#define KNN_METRIC_L2SQ_INIT            0.0f
+#define KNN_METRIC_L2SQ_ACC(acc, a, b)  { float d_ = (a) - (b); (acc) += d_ * d_; }
+#define KNN_METRIC_L2SQ_COMBINE(x, y)   ((x) + (y))
+#define KNN_METRIC_L2SQ_FINAL(acc)      (acc)
+
+/* Manhattan (L1) */
+#define KNN_METRIC_L1_INIT              0.0f
+#define KNN_METRIC_L1_ACC(acc, a, b)    { (acc) += fabsf((a) - (b)); }
+#define KNN_METRIC_L1_COMBINE(x, y)     ((x) + (y))
+#define KNN_METRIC_L1_FINAL(acc)        (acc)
+
+/* Chebyshev (L-infinity), compare-select rather than fmaxf so it vectorizes */
+#define KNN_METRIC_LINF_INIT            0.0f
+#define KNN_METRIC_LINF_ACC(acc, a, b)  { float d_ = fabsf((a) - (b)); (acc) = (d_ > (acc)) ? d_ : (acc); }
+#define KNN_METRIC_LINF_COMBINE(x, y)   (((y) > (x)) ? (y) : (x))
+#define KNN_METRIC_LINF_FINAL(acc)      (acc)
+
+/* Cosine distance of pre-normalized vectors (see knnNormalizeRows) */
+#define KNN_METRIC_COSINE_INIT          0.0f
+#define KNN_METRIC_COSINE_ACC(acc, a, b) { (acc) += (a) * (b); }
+#define KNN_METRIC_COSINE_COMBINE(x, y) ((x) + (y))
+#define KNN_METRIC_COSINE_FINAL(acc)    (1.0f - (acc))
+
+/* Vote policies */
+
+/* Unweighted majority */
+#define KNN_VOTE_MAJORITY_WEIGHT(d)     1.0f
+/* Inverse-distance weighting */
+#define KNN_VOTE_INVDIST_WEIGHT(d)      (1.0f / ((d) + KNN_INVDIST_EPS))
+
+/************************************************************************/
+
+/**
+ * @brief Defines knnDistance_<METRIC>(a, b, size)
+ */
+#define KNN_DEFINE_DISTANCE(METRIC) \
+static inline float knnDistance_##METRIC(const float *a, const float *b, int size){ \
+    float acc[KNN_POLICY_LANES]; \
+    float r; \
+    int i, l; \
+    for (l = 0; l < KNN_POLICY_LANES; l++){ \
+        acc[l] = KNN_METRIC_##METRIC##_INIT; \
+    } \
+    for (i = 0; i + KNN_POLICY_LANES <= size; i += KNN_POLICY_LANES){ \
+        for (l = 0; l < KNN_POLICY_LANES; l++){ \
+            KNN_METRIC_##METRIC##_ACC(acc[l], a[i+l], b[i+l]); \
+        } \
+    } \
+    for (l = 0; l < KNN_POLICY_LANES && i + l < size; l++){ \
+        KNN_METRIC_##METRIC##_ACC(acc[l], a[i+l], b[i+l]); \
+    } \
+    r = acc[0]; \
+    for (l = 1; l < KNN_POLICY_LANES; l++){ \
+        r = KNN_METRIC_##METRIC##_COMBINE(r, acc[l]); \
+    } \
+    return KNN_METRIC_##METRIC##_FINAL(r); \
+}
+
+/**
+ * @brief Defines knnClassify_<METRIC>_<VOTE>, see knnPolicyClassifier
+ */
+#define KNN_DEFINE_CLASSIFIER(METRIC, VOTE) \
+void knnClassify_##METRIC##_##VOTE(float *queries, int num_queries, \
+        float *data, const int *labels, int num_obj, int features, int k, \
+        int classes, DistIndexPair *list, float *votes, int *out){ \
+    int i, j, n, c, assigned_label; \
+    float vote; \
+    for (i = 0; i < num_queries; i++){ \
+        const float *q = &(queries[(size_t) i*features]); \
+        n = 0; \
+        for (j = 0; j < num_obj; j++){ \
+            n = topKPush(list, n, k, \
+                    knnDistance_##METRIC(q, &(data[(size_t) j*features]), features), j); \
+        } \
+        for (c = 0; c < classes; c++){ \
+            votes[c] = 0.0f; \
+        } \
+        for (j = 0; j < n; j++){ \
+            votes[ labels[list[j].index] ] += KNN_VOTE_##VOTE##_WEIGHT(list[j].distance); \
+        } \
+        assigned_label = 0; \
+        vote = 0.0f; \
+        for (c = 0; c < classes; c++){ \
+            if (votes[c] > vote){ \
+                vote = votes[c]; \
+                assigned_label = c; \
+            } \
+        } \
+        out[i] = assigned_label; \
+    } \
+}
+
+/**
+ * @brief Defines knnNeighbours_<METRIC>, see knnPolicyNeighbours
+ */
+#define KNN_DEFINE_NEIGHBOURS(METRIC) \
+void knnNeighbours_##METRIC(float *queries, int num_queries, float *data, \
+        int num_obj, int features, int kmax, DistIndexPair *out){ \
+    int i, j, n; \
+    for (i = 0; i < num_queries; i++){ \
+        const float *q = &(queries[(size_t) i*features]); \
+        DistIndexPair *list = &(out[(size_t) i*kmax]); \
+        n = 0; \
+        for (j = 0; j < num_obj; j++){ \
+            n = topKPush(list, n, kmax, \
+                    knnDistance_##METRIC(q, &(data[(size_t) j*features]), features), j); \
+        } \
+        for (; n < kmax; n++){ \
+            list[n].distance = INFINITY; \
+            list[n].index = -1; \
+        } \
+    } \
+}
+
+KNN_DEFINE_DISTANCE(L2SQ)
+KNN_DEFINE_DISTANCE(L1)
+KNN_DEFINE_DISTANCE(LINF)
+KNN_DEFINE_DISTANCE(COSINE)
+
+/************************************************************************/
+
+/** @brief Available metrics */
+typedef enum KnnMetric_Enum{
+    KNN_METRIC_L2SQ = 0,        /**< Squared euclidean */
+    KNN_METRIC_L1,              /**< Manhattan */
+    KNN_METRIC_LINF,            /**< Chebyshev */
+    KNN_METRIC_COSINE,          /**< Cosine, vectors pre-normalized */
+    KNN_METRICS                 /**< Number of metrics */
+}KnnMetric;
+
+/** @brief Available vote policies */
+typedef enum KnnVote_Enum{
+    KNN_VOTE_MAJORITY = 0,      /**< Unweighted majority */
+    KNN_VOTE_INVDIST,           /**< Inverse-distance weighting */
+    KNN_VOTES                   /**< Number of vote policies */
+}KnnVote;
+
+/**
+ * @brief Specialized classifier of one (metric, vote) pair
+ *
+ * @param queries Row-major query feature vectors (num_queries x features)
+ * @param num_queries Number of queries
+ * @param data Row-major training feature vectors (num_obj x features)
+ * @param labels Training set labels
+ * @param num_obj Number of training objects
+ * @param features Feature dimensionality
+ * @param k Number of neighbours
+ * @param classes Number of classes
+ * @param list Scratch neighbour list of k entries
+ * @param votes Scratch array of classes vote weights
+ * @param out Output labels (num_queries)
+ */
+typedef void (*KnnClassifierFn)(float *queries, int num_queries,
+        float *data, const int *labels, int num_obj, int features, int k,
+        int classes, DistIndexPair *list, float *votes, int *out);
+
+/**
+ * @brief Sorted kmax nearest neighbours under one metric
+ *
+ * Same ordering as the classifiers (ties keep the lowest index), so the
+ * first k entries of a list are the neighbours they vote with.
+ *
+ * @param out Output neighbour lists (num_queries x kmax), missing entries
+ *            get index -1
+ */
+typedef void (*KnnNeighboursFn)(float *queries, int num_queries, float *data,
+        int num_obj, int features, int kmax, DistIndexPair *out);
+
+KnnClassifierFn knnPolicyClassifier(KnnMetric metric, KnnVote vote);
+KnnNeighboursFn knnPolicyNeighbours(KnnMetric metric);
+int knnPolicyVote(const DistIndexPair *list, int k, const int *labels,
+        KnnVote vote, int classes, float *votes);
+int knnParseMetric(const char *name);
+int knnParseVote(const char *name);
+void knnNormalizeRows(float *data, int num_obj, int features);
+
+#endif
@@ -0,0 +1,428 @@
+/*
+ * @file knn_project.c
+ * @brief Dimensionality reduction: PCA or Johnson-Lindenstrauss projection
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "knn_project.h"
+
+/** 2 pi, M_PI is not C99 */
+#define PROJ_TWO_PI 6.283185307179586
+
+/************************************************************************/
+
+/** @brief Projection file header */
+typedef struct ProjHeader_Struct{
+    uint32_t magic;             /**< KNN_PROJ_MAGIC */
+    uint32_t version;           /**< KNN_PROJ_VERSION */
+    int32_t in_dim;             /**< Input feature dimensionality */
+    int32_t out_dim;            /**< Projected dimensionality */
+}ProjHeader;
+
+/** @brief Allocates the arrays of a projection */
+static int projAlloc(int in_dim, int out_dim, KnnProjection *proj){
+    proj->in_dim = in_dim;
+    proj->out_dim = out_dim;
+    proj->mean = calloc(in_dim, sizeof(float));
+    proj->matrix = malloc(sizeof(float) * (size_t) out_dim * in_dim);
+    if (proj->mean == NULL || proj->matrix == NULL){
+        knnProjectionFree(proj);
+        return -1;
+    }
+    return 0;
+}
+
+/** @brief xorshift32 step */
+static unsigned xorshift32(unsigned *state){
+    unsigned x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+/**
+ * @brief Cyclic Jacobi eigen decomposition of a symmetric matrix
+ *
+ * @param a Symmetric n x n matrix, destroyed; eigenvalues end on the diagonal
+ * @param v Output eigenvectors, column j belongs to eigenvalue a[j][j]
+ * @param n Matrix order
+ */
+static void jacobiEigen(double *a, double *v, int n){
+
+    double off, theta, t, c, s, tau, apq, app, aqq;
+    double akp, akq, vkp, vkq;
+    int sweep, p, q, k;
+
+    for (p = 0; p < n; p++){
+        for (q = 0; q < n; q++){
+            v[p*n + q] = (p == q) ? 1.0 : 0.0;
+        }
+    }
+
+    for (sweep = 0; sweep < KNN_PCA_SWEEPS; sweep++){
+        off = 0.0;
+        for (p = 0; p < n; p++){
+            for (q = p + 1; q < n; q++){
+                off += a[p*n + q] * a[p*n + q];
+            }
+        }
+        if (off < 1e-22){
+            break;
+        }
+        for (p = 0; p < n; p++){
+            for (q = p + 1; q < n; q++){
+                apq = a[p*n + q];
+                if (fabs(apq) < 1e-300){
+                    continue;
+                }
+                app = a[p*n + p];
+                aqq = a[q*n + q];
+                theta = (aqq - app) / (2.0 * apq);
+                t = ((theta >= 0.0) ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta*theta + 1.0));
+                c = 1.0 / sqrt(t*t + 1.0);
+                s = t * c;
+                tau = s / (1.0 + c);
+
+                a[p*n + p] = app - t * apq;
+                a[q*n + q] = aqq + t * apq;
+                a[p*n + q] = a[q*n + p] = 0.0;
+                for (k = 0; k < n; k++){
+                    if (k != p && k != q){
+                        akp = a[k*n + p];
+                        akq = a[k*n + q];
+                        a[k*n + p] = a[p*n + k] = akp - s * (akq + tau * akp);
+                        a[k*n + q] = a[q*n + k] = akq + s * (akp - tau * akq);
+                    }
+                    vkp = v[k*n + p];
+                    vkq = v[k*n + q];
+                    v[k*n + p] = vkp - s * (vkq + tau * vkp);
+                    v[k*n + q] = vkq + s * (vkp - tau * vkq);
+                }
+            }
+        }
+    }
+}
+
+/************************************************************************/
+
+/**
+ * @brief Fits PCA on a set
+ *
+ * @param data Row-major feature vectors (num_obj x features)
+ * @param num_obj Number of objects
+ * @param features Feature dimensionality
+ * @param out_dim Number of principal components kept, <= features
+ * @param proj Output, release with knnProjectionFree
+ * @return 0 on success, -1 otherwise.
+ */
+int knnPcaFit(const float *data, int num_obj, int features, int out_dim,
+        KnnProjection *proj){
+
+    double *mean, *cov, *vec;
+    int *order;
+    int i, j, f, g, best;
+    double x;
+
+    if (out_dim < 1 || out_dim > features || projAlloc(features, out_dim, proj) != 0){
+        return -1;
+    }
+    mean = calloc(features, sizeof(double));
+    cov = calloc((size_t) features * features, sizeof(double));
+    vec = malloc(sizeof(double) * features * features);
+    order = malloc(sizeof(int) * features);
+    if (mean == NULL || cov == NULL || vec == NULL || order == NULL){
+        free(mean); free(cov); free(vec); free(order);
+        knnProjectionFree(proj);
+        return -1;
+    }
+
+    for (i = 0; i < num_obj; i++){
+        for (f = 0; f < features; f++){
+            mean[f] += data[(size_t) i*features + f];
+        }
+    }
+    for (f = 0; f < features; f++){
+        mean[f] /= num_obj;
+        proj->mean[f] = (float) mean[f];
+    }
+    for (i = 0; i < num_obj; i++){
+        for (f = 0; f < features; f++){
+            x = data[(size_t) i*features + f] - mean[f];
+            for (g = f; g < features; g++){
+                cov[f*features + g] += x * (data[(size_t) i*features + g] - mean[g]);
+            }
+        }
+    }
+    for (f = 0; f < features; f++){
+        for (g = f; g < features; g++){
+            cov[f*features + g] /= num_obj;
+            cov[g*features + f] = cov[f*features + g];
+        }
+    }
+
+    jacobiEigen(cov, vec, features);
+
+    /* Components by descending eigenvalue */
+    for (f = 0; f < features; f++){
+        order[f] = f;
+    }
+    for (i = 0; i < out_dim; i++){
+        best = i;
+        for (j = i + 1; j < features; j++){
+            if (cov[order[j]*features + order[j]] > cov[order[best]*features + order[best]]){
+                best = j;
+            }
+        }
+        f = order[i]; order[i] = order[best]; order[best] = f;
+        for (f = 0; f < features; f++){
+            proj->matrix[(size_t) i*features + f] = (float) vec[f*features + order[i]];
+        }
+    }
+
+    free(mean); free(cov); free(vec); free(order);
+    return 0;
+}
+
+/**
+ * @brief Draws a Johnson-Lindenstrauss random projection
+ *
+ * Entries are N(0, 1/out_dim) (Box-Muller), so squared distances are
+ * preserved in expectation. The mean is zero.
+ *
+ * @param features Input feature dimensionality
+ * @param out_dim Projected dimensionality
+ * @param seed Seed of the generator
+ * @param proj Output, release with knnProjectionFree
+ * @return 0 on success, -1 otherwise.
+ */
+int knnRandomFit(int features, int out_dim, unsigned seed, KnnProjection *proj){
+
+    unsigned state = seed ? seed : 1;
+    double u1, u2, scale = 1.0 / sqrt((double) out_dim);
+    size_t i;
+
+    if (out_dim < 1 || projAlloc(features, out_dim, proj) != 0){
+        return -1;
+    }
+    for (i = 0; i < (size_t) out_dim * features; i++){
+        u1 = (xorshift32(&state) + 1.0) / 4294967297.0;
+        u2 = xorshift32(&state) / 4294967296.0;
+        proj->matrix[i] = (float) (scale * sqrt(-2.0 * log(u1)) * cos(PROJ_TWO_PI * u2));
+    }
+    return 0;
+}
+
+/**
+ * @brief Projects a set with a blocked matrix multiply
+ *
+ * Rows and input features are tiled so a tile of centred rows and the
+ * matching columns of the matrix stay in cache while every output
+ * dimension is accumulated.
+ *
+ * @param proj Projection
+ * @param data Row-major feature vectors (num_obj x in_dim)
+ * @param num_obj Number of objects
+ * @param out Output row-major projected vectors (num_obj x out_dim)
+ */
+void knnProject(const KnnProjection *proj, const float *data, int num_obj, float *out){
+
+    float tile[KNN_PROJ_TILE_ROWS][KNN_PROJ_TILE_FEATURES];
+    int in = proj->in_dim, dim = proj->out_dim;
+    int r0, f0, nr, nf, r, f, d;
+    const float *m;
+    float acc;
+
+    memset(out, 0, sizeof(float) * (size_t) num_obj * dim);
+    for (r0 = 0; r0 < num_obj; r0 += KNN_PROJ_TILE_ROWS){
+        nr = (num_obj - r0 < KNN_PROJ_TILE_ROWS) ? num_obj - r0 : KNN_PROJ_TILE_ROWS;
+        for (f0 = 0; f0 < in; f0 += KNN_PROJ_TILE_FEATURES){
+            nf = (in - f0 < KNN_PROJ_TILE_FEATURES) ? in - f0 : KNN_PROJ_TILE_FEATURES;
+            for (r = 0; r < nr; r++){
+                for (f = 0; f < nf; f++){
+                    tile[r][f] = data[(size_t) (r0 + r)*in + f0 + f] - proj->mean[f0 + f];
+                }
+            }
+            for (d = 0; d < dim; d++){
+                m = &(proj->matrix[(size_t) d*in + f0]);
+                for (r = 0; r < nr; r++){
+                    acc = 0.0f;
+                    for (f = 0; f < nf; f++){
+                        acc += tile[r][f] * m[f];
+                    }
+                    out[(size_t) (r0 + r)*dim + d] += acc;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Reads a set from the dataset binaries and projects it on the fly
+ *
+ * Rows are read and projected KNN_PROJ_TILE_ROWS at a time; only the
+ * projected set is kept in memory.
+ *
+ * @param data_bin Feature vectors binary file
+ * @param label_bin Labels binary file
+ * @param num_obj Number of objects to read
+ * @param proj Projection, in_dim features per stored object
+ * @param data Output row-major projected vectors (num_obj x out_dim)
+ * @param labels Output labels (num_obj)
+ * @return 0 on success, -1 otherwise.
+ */
+int knnLoadProjected(const char *data_bin, const char *label_bin, int num_obj,
+        const KnnProjection *proj, float **data, int **labels){
+
+    FILE *fp_data = fopen(data_bin, "rb");
+    FILE *fp_label = fopen(label_bin, "rb");
+    float *rows = malloc(sizeof(float) * KNN_PROJ_TILE_ROWS * proj->in_dim);
+    float *tmp_data = malloc(sizeof(float) * (size_t) num_obj * proj->out_dim);
+    int *tmp_label = malloc(sizeof(int) * num_obj);
+    int first, count, status = 0;
+
+    if (fp_data == NULL || fp_label == NULL || rows == NULL ||
+        tmp_data == NULL || tmp_label == NULL){
+        status = -1;
+    } else {
+        for (first = 0; first < num_obj && status == 0; first += KNN_PROJ_TILE_ROWS){
+            count = (num_obj - first < KNN_PROJ_TILE_ROWS) ? num_obj - first : KNN_PROJ_TILE_ROWS;
+            if (fread(rows, sizeof(float) * proj->in_dim, count, fp_data) != (size_t) count){
+                status = -1;
+            } else {
+                knnProject(proj, rows, count, &(tmp_data[(size_t) first*proj->out_dim]));
+            }
+        }
+        if (status == 0 &&
+            fread(tmp_label, sizeof(int), num_obj, fp_label) != (size_t) num_obj){
+            status = -1;
+        }
+    }
+
+    if (fp_data != NULL){
+        fclose(fp_data);
+    }
+    if (fp_label != NULL){
+        fclose(fp_label);
+    }
+    free(rows);
+    if (status != 0){
+        free(tmp_data);
+        free(tmp_label);
+        return status;
+    }
+    *data = tmp_data;
+    *labels = tmp_label;
+    return 0;
+}
+
+/**
+ * @brief Re-ranks candidates with exact distances in the original space
+ *
+ * @param candidates Candidate lists from the reduced space (num_queries x num_candidates)
+ * @param num_candidates Candidates per query
+ * @param queries Original query feature vectors (num_queries x features)
+ * @param num_queries Number of queries
+ * @param data Original training feature vectors
+ * @param features Original feature dimensionality
+ * @param k Number of neighbours kept, <= num_candidates
+ * @param out Output neighbour lists (num_queries x k), original-space distances
+ */
+void knnRerankNeighbours(const DistIndexPair *candidates, int num_candidates,
+        float *queries, int num_queries, float *data, int features, int k,
+        DistIndexPair *out){
+
+    const DistIndexPair *c;
+    DistIndexPair *list;
+    int i, j, n;
+
+    for (i = 0; i < num_queries; i++){
+        c = &(candidates[(size_t) i*num_candidates]);
+        list = &(out[(size_t) i*k]);
+        n = 0;
+        for (j = 0; j < num_candidates && c[j].index >= 0; j++){
+            n = topKPushByIndex(list, n, k,
+                    distance(&(queries[(size_t) i*features]),
+                             &(data[(size_t) c[j].index*features]), features),
+                    c[j].index);
+        }
+        for (; n < k; n++){
+            list[n].distance = INFINITY;
+            list[n].index = -1;
+        }
+    }
+}
+
+/**
+ * @brief Writes a projection: header, mean[in_dim], matrix[out_dim x in_dim]
+ *
+ * @param proj Projection to write
+ * @param path Output file
+ * @return 0 on success, -1 otherwise.
+ */
+int knnProjectionWrite(const KnnProjection *proj, const char *path){
+
+    ProjHeader hdr;
+    size_t size = (size_t) proj->out_dim * proj->in_dim;
+    FILE *fp = fopen(path, "wb");
+    int status = 0;
+
+    if (fp == NULL){
+        return -1;
+    }
+    hdr.magic = KNN_PROJ_MAGIC;
+    hdr.version = KNN_PROJ_VERSION;
+    hdr.in_dim = proj->in_dim;
+    hdr.out_dim = proj->out_dim;
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        fwrite(proj->mean, sizeof(float), proj->in_dim, fp) != (size_t) proj->in_dim ||
+        fwrite(proj->matrix, sizeof(float), size, fp) != size){
+        status = -1;
+    }
+    fclose(fp);
+    return status;
+}
+
+/**
+ * @brief Reads a projection written by knnProjectionWrite
+ *
+ * @param path Input file
+ * @param proj Output, release with knnProjectionFree
+ * @return 0 on success, -1 otherwise.
+ */
+int knnProjectionRead(const char *path, KnnProjection *proj){
+
+    ProjHeader hdr;
+    FILE *fp = fopen(path, "rb");
+    int status = 0;
+
+    if (fp == NULL){
+        return -1;
+    }
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        hdr.magic != KNN_PROJ_MAGIC || hdr.version != KNN_PROJ_VERSION ||
+        projAlloc(hdr.in_dim, hdr.out_dim, proj) != 0){
+        fclose(fp);
+        return -1;
+    }
+    if (fread(proj->mean, sizeof(float), hdr.in_dim, fp) != (size_t) hdr.in_dim ||
+        fread(proj->matrix, sizeof(float), (size_t) hdr.out_dim * hdr.in_dim, fp) !=
+            (size_t) hdr.out_dim * hdr.in_dim){
+        knnProjectionFree(proj);
+        status = -1;
+    }
+    fclose(fp);
+    return status;
+}
+
+/** @brief Releases a projection */
+void knnProjectionFree(KnnProjection *proj){
+    free(proj->mean);
+    free(proj->matrix);
+    proj->mean = NULL;
+    proj->matrix = NULL;
+}
@@ -0,0 +1,54 @@
+/*
+ * @file knn_project.h
+ * @brief Dimensionality reduction: PCA or Johnson-Lindenstrauss projection
+ *
+ * A projection maps a features-dimensional vector x to the
+ * out_dim-dimensional M (x - mean). PCA fits M to the leading
+ * eigenvectors of the training covariance (Jacobi rotations); the random
+ * projection draws M from N(0, 1/out_dim) and needs no fitting pass.
+ * Sets are projected with a blocked matrix multiply, either in memory or
+ * while they are read from the dataset binaries. Optionally the top
+ * candidates found in the reduced space are re-ranked with exact
+ * distances in the original space.
+ */
+
+#ifndef KNN_PROJECT_H
+#define KNN_PROJECT_H
+
+#include "knn_kernels.h"
+
+/** Projection file magic number ("KNNP") */
+#define KNN_PROJ_MAGIC 0x504E4E4B
+/** Projection file format version */
+#define KNN_PROJ_VERSION 1
+
+/** Rows per tile of the blocked projection */
+#define KNN_PROJ_TILE_ROWS 64
+/** Input features per tile of the blocked projection */
+#define KNN_PROJ_TILE_FEATURES 64
+
+/** Maximum Jacobi sweeps of the PCA eigen decomposition */
+#define KNN_PCA_SWEEPS 64
+
+/** @brief Linear projection, out = matrix (x - mean) */
+typedef struct KnnProjection_Struct{
+    int in_dim;         /**< Input feature dimensionality */
+    int out_dim;        /**< Projected dimensionality */
+    float *mean;        /**< Subtracted before projecting (in_dim) */
+    float *matrix;      /**< Row-major out_dim x in_dim */
+}KnnProjection;
+
+int knnPcaFit(const float *data, int num_obj, int features, int out_dim,
+        KnnProjection *proj);
+int knnRandomFit(int features, int out_dim, unsigned seed, KnnProjection *proj);
+void knnProject(const KnnProjection *proj, const float *data, int num_obj, float *out);
+int knnLoadProjected(const char *data_bin, const char *label_bin, int num_obj,
+        const KnnProjection *proj, float **data, int **labels);
+void knnRerankNeighbours(const DistIndexPair *candidates, int num_candidates,
+        float *queries, int num_queries, float *data, int features, int k,
+        DistIndexPair *out);
+int knnProjectionWrite(const KnnProjection *proj, const char *path);
+int knnProjectionRead(const char *path, KnnProjection *proj);
+void knnProjectionFree(KnnProjection *proj);
+
+#endif
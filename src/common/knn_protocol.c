@@ -0,0 +1,152 @@
+/*
+ * @file knn_protocol.c
+ * @brief Binary framing of the query server (src/sw_server)
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "knn_protocol.h"
+
+/************************************************************************/
+
+/**
+ * @brief Reads exactly size bytes
+ *
+ * @return 0 on success, -1 on error or end of stream.
+ */
+int knnProtoReadFull(int fd, void *buf, size_t size){
+
+    unsigned char *p = buf;
+    ssize_t n;
+
+    while (size > 0){
+        n = read(fd, p, size);
+        if (n < 0 && errno == EINTR){
+            continue;
+        }
+        if (n <= 0){
+            return -1;
+        }
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+/**
+ * @brief Writes exactly size bytes, without raising SIGPIPE
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+int knnProtoWriteFull(int fd, const void *buf, size_t size){
+
+    const unsigned char *p = buf;
+    ssize_t n;
+
+    while (size > 0){
+        n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR){
+            continue;
+        }
+        if (n <= 0){
+            return -1;
+        }
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+/**
+ * @brief Connects to a server socket
+ *
+ * @param path Socket path
+ * @return Connected descriptor, -1 otherwise.
+ */
+int knnProtoConnect(const char *path){
+
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)){
+        return -1;
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0){
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Sends one request frame
+ *
+ * @param fd Connected descriptor
+ * @param id Request id, echoed in the response
+ * @param vectors Row-major feature vectors (count x features)
+ * @param count Number of vectors
+ * @param features Features per vector
+ * @param k Number of neighbours
+ * @param flags KNN_PROTO_NEIGHBOURS or 0
+ * @return 0 on success, -1 otherwise.
+ */
+int knnProtoSend(int fd, uint32_t id, const float *vectors, int count,
+        int features, int k, int flags){
+
+    KnnRequestHeader hdr;
+
+    hdr.magic = KNN_PROTO_REQUEST_MAGIC;
+    hdr.version = KNN_PROTO_VERSION;
+    hdr.flags = flags;
+    hdr.id = id;
+    hdr.count = count;
+    hdr.features = features;
+    hdr.k = k;
+    if (knnProtoWriteFull(fd, &hdr, sizeof(hdr)) != 0 ||
+        knnProtoWriteFull(fd, vectors, sizeof(float) * (size_t) count * features) != 0){
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Receives one response frame
+ *
+ * @param fd Connected descriptor
+ * @param hdr Output header
+ * @param labels Output labels, room for max_count entries
+ * @param neighbours Output neighbour lists, room for max_count x max_k
+ *                   entries, may be NULL if none were requested
+ * @param max_count Largest vector count expected
+ * @param max_k Largest K expected
+ * @return 0 on success, -1 on a stream error or an oversized frame.
+ */
+int knnProtoReceive(int fd, KnnResponseHeader *hdr, int *labels,
+        KnnNeighbour *neighbours, int max_count, int max_k){
+
+    if (knnProtoReadFull(fd, hdr, sizeof(*hdr)) != 0 ||
+        hdr->magic != KNN_PROTO_RESPONSE_MAGIC || hdr->version != KNN_PROTO_VERSION ||
+        hdr->count > (uint32_t) max_count || hdr->k > (uint32_t) max_k ||
+        (hdr->k > 0 && neighbours == NULL)){
+        return -1;
+    }
+    if (knnProtoReadFull(fd, labels, sizeof(int) * hdr->count) != 0){
+        return -1;
+    }
+    if (hdr->k > 0 &&
+        knnProtoReadFull(fd, neighbours, sizeof(KnnNeighbour) * hdr->count * hdr->k) != 0){
+        return -1;
+    }
+    return 0;
+}
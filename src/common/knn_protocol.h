@@ -0,0 +1,86 @@
+/*
+ * @file knn_protocol.h
+ * @brief Binary framing of the query server (src/sw_server)
+ *
+ * A client sends request frames over a Unix domain stream socket and
+ * gets one response frame per request, in request order:
+ *
+ *     request   KnnRequestHeader, float features[count x features]
+ *     response  KnnResponseHeader, int32 labels[count],
+ *               KnnNeighbour neighbours[count x k] if KNN_PROTO_NEIGHBOURS
+ *
+ * Integers are in host byte order; client and server share the machine.
+ * A client may pipeline several requests before reading responses.
+ */
+
+#ifndef KNN_PROTOCOL_H
+#define KNN_PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Request frame magic number ("KNNQ") */
+#define KNN_PROTO_REQUEST_MAGIC 0x514E4E4B
+/** Response frame magic number ("KNNR") */
+#define KNN_PROTO_RESPONSE_MAGIC 0x524E4E4B
+/** Protocol version */
+#define KNN_PROTO_VERSION 1
+
+/** Request flag: return the neighbour lists along with the labels */
+#define KNN_PROTO_NEIGHBOURS 0x1
+
+/** Largest K a request may ask for */
+#define KNN_PROTO_MAX_K 64
+/** Largest number of feature vectors in one request */
+#define KNN_PROTO_MAX_COUNT 4096
+/** Largest feature dimensionality of a request */
+#define KNN_PROTO_MAX_FEATURES 4096
+
+/** Default server socket path */
+#define KNN_PROTO_SOCKET "/tmp/knn_server.sock"
+
+/** @brief Response status codes */
+typedef enum KnnProtoStatus_Enum{
+    KNN_PROTO_OK = 0,           /**< Classified */
+    KNN_PROTO_BAD_FRAME,        /**< Wrong magic or version */
+    KNN_PROTO_BAD_SHAPE,        /**< Wrong feature count, K or vector count */
+    KNN_PROTO_BUSY              /**< Server out of memory or shutting down */
+}KnnProtoStatus;
+
+/** @brief Request frame header */
+typedef struct KnnRequestHeader_Struct{
+    uint32_t magic;             /**< KNN_PROTO_REQUEST_MAGIC */
+    uint16_t version;           /**< KNN_PROTO_VERSION */
+    uint16_t flags;             /**< KNN_PROTO_NEIGHBOURS or 0 */
+    uint32_t id;                /**< Echoed in the response */
+    uint32_t count;             /**< Feature vectors in the frame */
+    uint32_t features;          /**< Features per vector, must match the server */
+    uint32_t k;                 /**< Neighbours, 1 .. KNN_PROTO_MAX_K */
+}KnnRequestHeader;
+
+/** @brief Response frame header */
+typedef struct KnnResponseHeader_Struct{
+    uint32_t magic;             /**< KNN_PROTO_RESPONSE_MAGIC */
+    uint16_t version;           /**< KNN_PROTO_VERSION */
+    uint16_t status;            /**< KnnProtoStatus */
+    uint32_t id;                /**< Id of the request */
+    uint32_t count;             /**< Labels in the frame, 0 unless status is OK */
+    uint32_t k;                 /**< Neighbours per vector in the frame, 0 if none */
+    uint32_t reserved;          /**< Zero */
+}KnnResponseHeader;
+
+/** @brief Neighbour entry of a response */
+typedef struct KnnNeighbour_Struct{
+    float distance;             /**< Squared euclidean distance */
+    int32_t index;              /**< Index in the server's training set */
+}KnnNeighbour;
+
+int knnProtoReadFull(int fd, void *buf, size_t size);
+int knnProtoWriteFull(int fd, const void *buf, size_t size);
+int knnProtoConnect(const char *path);
+int knnProtoSend(int fd, uint32_t id, const float *vectors, int count,
+        int features, int k, int flags);
+int knnProtoReceive(int fd, KnnResponseHeader *hdr, int *labels,
+        KnnNeighbour *neighbours, int max_count, int max_k);
+
+#endif
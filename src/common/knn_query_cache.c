@@ -0,0 +1,299 @@
+/*
+ * @file knn_query_cache.c
+ * @brief Sharded query result cache with CLOCK eviction
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "knn_query_cache.h"
+#include "knn_container.h"
+
+/************************************************************************/
+
+/** @brief Quantized key of one feature */
+static inline int32_t qcQuantize(const KnnQueryCache *cache, float x){
+
+    float q;
+    int32_t bits;
+
+    if (cache->inv_quantum == 0.0f){
+        x = (x == 0.0f) ? 0.0f : x;     /* -0 and +0 are the same query */
+        memcpy(&bits, &x, sizeof(bits));
+        return bits;
+    }
+    q = floorf(x * cache->inv_quantum + 0.5f);
+    q = (q < -2147483520.0f) ? -2147483520.0f : (q > 2147483520.0f) ? 2147483520.0f : q;
+    return (int32_t) q;
+}
+
+/** @brief Hash of the quantized key of a vector and K */
+static uint64_t qcHash(const KnnQueryCache *cache, const float *vector, int k){
+
+    uint64_t hash = knnHashBytes(&k, sizeof(k), KNN_FNV_OFFSET);
+    int32_t key;
+    int f;
+
+    for (f = 0; f < cache->features; f++){
+        key = qcQuantize(cache, vector[f]);
+        hash = knnHashBytes(&key, sizeof(key), hash);
+    }
+    return hash ^ (hash >> 29);
+}
+
+/** @brief Whether a slot holds the key of a vector */
+static int qcMatch(const KnnQueryCache *cache, const KnnQcShard *shard, int slot,
+        uint64_t hash, const float *vector, int k){
+
+    const int32_t *key = &(shard->keys[(size_t) slot * cache->features]);
+    int f;
+
+    if (shard->slots[slot].hash != hash || shard->slots[slot].k != k){
+        return 0;
+    }
+    for (f = 0; f < cache->features; f++){
+        if (key[f] != qcQuantize(cache, vector[f])){
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/** @brief Shard of a hash, from its top bits (the chain uses the low ones) */
+static inline KnnQcShard *qcShard(KnnQueryCache *cache, uint64_t hash){
+    return &(cache->shards[(hash >> 40) & (cache->num_shards - 1)]);
+}
+
+/** @brief Removes a slot from its hash chain and frees it */
+static void qcUnlink(KnnQcShard *shard, int slot){
+
+    int32_t *link = &(shard->head[shard->slots[slot].hash & shard->mask]);
+
+    while (*link != slot){
+        link = &(shard->slots[*link].next);
+    }
+    *link = shard->slots[slot].next;
+    shard->slots[slot].used = 0;
+}
+
+/** @brief Picks a free slot, evicting with the CLOCK sweep when full */
+static int qcVictim(KnnQcShard *shard, uint64_t generation){
+
+    KnnQcSlot *s;
+
+    for (;;){
+        s = &(shard->slots[shard->hand]);
+        shard->hand = (shard->hand + 1 < shard->num_slots) ? shard->hand + 1 : 0;
+        if (!s->used){
+            return (int) (s - shard->slots);
+        }
+        if (s->ref && s->generation == generation){
+            s->ref = 0;
+            continue;
+        }
+        qcUnlink(shard, (int) (s - shard->slots));
+        if (s->generation == generation){
+            shard->evictions++;
+        }
+        return (int) (s - shard->slots);
+    }
+}
+
+/************************************************************************/
+
+/**
+ * @brief Creates an empty cache
+ *
+ * @param cache Cache, release with knnQueryCacheFree
+ * @param capacity Total number of entries
+ * @param shards Number of shards, rounded up to a power of two, 0 for
+ *               KNN_QCACHE_SHARDS
+ * @param features Feature dimensionality
+ * @param max_k Longest neighbour list stored, 0 to store labels only
+ * @param quantum Quantization step of the key, 0 for exact keys
+ * @return 0 on success, -1 otherwise.
+ */
+int knnQueryCacheInit(KnnQueryCache *cache, int capacity, int shards,
+        int features, int max_k, float quantum){
+
+    KnnQcShard *shard;
+    int s, chains;
+
+    memset(cache, 0, sizeof(*cache));
+    if (capacity < 1 || features < 1 || max_k < 0 || quantum < 0.0f){
+        return -1;
+    }
+    for (cache->num_shards = 1; cache->num_shards < (shards > 0 ? shards : KNN_QCACHE_SHARDS);
+            cache->num_shards *= 2){
+    }
+    cache->features = features;
+    cache->max_k = max_k;
+    cache->inv_quantum = (quantum > 0.0f) ? 1.0f / quantum : 0.0f;
+    cache->shards = calloc(cache->num_shards, sizeof(KnnQcShard));
+    if (cache->shards == NULL){
+        return -1;
+    }
+    for (s = 0; s < cache->num_shards; s++){
+        shard = &(cache->shards[s]);
+        shard->num_slots = (capacity + cache->num_shards - 1) / cache->num_shards;
+        for (chains = 1; chains < shard->num_slots; chains *= 2){
+        }
+        shard->mask = chains - 1;
+        pthread_mutex_init(&shard->lock, NULL);
+        shard->slots = calloc(shard->num_slots, sizeof(KnnQcSlot));
+        shard->keys = malloc(sizeof(int32_t) * (size_t) shard->num_slots * features);
+        shard->neighbours = malloc(sizeof(DistIndexPair) * ((size_t) shard->num_slots * max_k + 1));
+        shard->head = malloc(sizeof(int32_t) * chains);
+        if (shard->slots == NULL || shard->keys == NULL || shard->neighbours == NULL ||
+            shard->head == NULL){
+            cache->num_shards = s + 1;
+            knnQueryCacheFree(cache);
+            return -1;
+        }
+        memset(shard->head, -1, sizeof(int32_t) * chains);
+    }
+    return 0;
+}
+
+/**
+ * @brief Looks up the result of a query
+ *
+ * @param cache Cache
+ * @param vector Query feature vector
+ * @param k Number of neighbours of the result
+ * @param label Output label on a hit
+ * @param neighbours Output neighbour list (k entries) on a hit, NULL if
+ *                   not needed; entries stored without one do not match
+ * @return 1 on a hit, 0 on a miss.
+ */
+int knnQueryCacheLookup(KnnQueryCache *cache, const float *vector, int k,
+        int *label, DistIndexPair *neighbours){
+
+    uint64_t hash = qcHash(cache, vector, k);
+    uint64_t generation = __atomic_load_n(&cache->generation, __ATOMIC_ACQUIRE);
+    KnnQcShard *shard = qcShard(cache, hash);
+    int slot, hit = 0;
+
+    pthread_mutex_lock(&shard->lock);
+    for (slot = shard->head[hash & shard->mask]; slot >= 0; slot = shard->slots[slot].next){
+        if (qcMatch(cache, shard, slot, hash, vector, k)){
+            break;
+        }
+    }
+    if (slot >= 0 && shard->slots[slot].generation != generation){
+        qcUnlink(shard, slot);
+    } else if (slot >= 0 && (neighbours == NULL || shard->slots[slot].has_neighbours)){
+        shard->slots[slot].ref = 1;
+        *label = shard->slots[slot].label;
+        if (neighbours != NULL){
+            memcpy(neighbours, &(shard->neighbours[(size_t) slot * cache->max_k]),
+                    sizeof(DistIndexPair) * k);
+        }
+        hit = 1;
+    }
+    if (hit){
+        shard->hits++;
+    } else {
+        shard->misses++;
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return hit;
+}
+
+/**
+ * @brief Stores the result of a query in the current generation
+ *
+ * Replaces an entry with the same key. Results computed before a
+ * knnQueryCacheInvalidate() should not be inserted after it.
+ *
+ * @param cache Cache
+ * @param vector Query feature vector
+ * @param k Number of neighbours of the result
+ * @param label Label
+ * @param neighbours Neighbour list (k entries), NULL to store the label
+ *                   only; also dropped when k > max_k
+ */
+void knnQueryCacheInsert(KnnQueryCache *cache, const float *vector, int k,
+        int label, const DistIndexPair *neighbours){
+
+    uint64_t hash = qcHash(cache, vector, k);
+    uint64_t generation = __atomic_load_n(&cache->generation, __ATOMIC_ACQUIRE);
+    KnnQcShard *shard = qcShard(cache, hash);
+    int32_t *key;
+    int slot, f;
+
+    neighbours = (k <= cache->max_k) ? neighbours : NULL;
+    pthread_mutex_lock(&shard->lock);
+    for (slot = shard->head[hash & shard->mask]; slot >= 0; slot = shard->slots[slot].next){
+        if (qcMatch(cache, shard, slot, hash, vector, k)){
+            break;
+        }
+    }
+    if (slot < 0){
+        slot = qcVictim(shard, generation);
+        key = &(shard->keys[(size_t) slot * cache->features]);
+        for (f = 0; f < cache->features; f++){
+            key[f] = qcQuantize(cache, vector[f]);
+        }
+        shard->slots[slot].hash = hash;
+        shard->slots[slot].k = k;
+        shard->slots[slot].used = 1;
+        shard->slots[slot].next = shard->head[hash & shard->mask];
+        shard->head[hash & shard->mask] = slot;
+    }
+    shard->slots[slot].generation = generation;
+    shard->slots[slot].label = label;
+    shard->slots[slot].ref = 0;
+    shard->slots[slot].has_neighbours = neighbours != NULL;
+    if (neighbours != NULL){
+        memcpy(&(shard->neighbours[(size_t) slot * cache->max_k]), neighbours,
+                sizeof(DistIndexPair) * k);
+    }
+    shard->inserts++;
+    pthread_mutex_unlock(&shard->lock);
+}
+
+/** @brief Invalidates every entry, e.g. after the training set changed */
+void knnQueryCacheInvalidate(KnnQueryCache *cache){
+    __atomic_add_fetch(&cache->generation, 1, __ATOMIC_ACQ_REL);
+}
+
+/** @brief Sums the counters of every shard */
+void knnQueryCacheStats(KnnQueryCache *cache, KnnQueryCacheStats *stats){
+
+    KnnQcShard *shard;
+    int s, i;
+
+    memset(stats, 0, sizeof(*stats));
+    for (s = 0; s < cache->num_shards; s++){
+        shard = &(cache->shards[s]);
+        pthread_mutex_lock(&shard->lock);
+        stats->hits += shard->hits;
+        stats->misses += shard->misses;
+        stats->inserts += shard->inserts;
+        stats->evictions += shard->evictions;
+        stats->capacity += shard->num_slots;
+        for (i = 0; i < shard->num_slots; i++){
+            stats->entries += shard->slots[i].used;
+        }
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
+
+/** @brief Releases a cache */
+void knnQueryCacheFree(KnnQueryCache *cache){
+
+    int s;
+
+    for (s = 0; s < cache->num_shards && cache->shards != NULL; s++){
+        pthread_mutex_destroy(&cache->shards[s].lock);
+        free(cache->shards[s].slots);
+        free(cache->shards[s].keys);
+        free(cache->shards[s].neighbours);
+        free(cache->shards[s].head);
+    }
+    free(cache->shards);
+    cache->shards = NULL;
+    cache->num_shards = 0;
+}
@@ -0,0 +1,92 @@
+/*
+ * @file knn_query_cache.h
+ * @brief Sharded query result cache with CLOCK eviction
+ *
+ * Maps a query vector and K to its label and, optionally, its neighbour
+ * list. Vectors are keyed on their quantized features: with a quantum q
+ * every feature is rounded to a multiple of q, so near-duplicates (same
+ * cell of the grid) share an entry; with q = 0 the key is the exact bit
+ * pattern. The key is stored in the entry and compared in full, hash
+ * collisions never return a wrong result.
+ *
+ * Entries live in a fixed number of slots split over shards, each with
+ * its own lock, hash chains and CLOCK hand, so memory is bounded at
+ * init and concurrent lookups rarely contend. A hit sets the slot's
+ * reference bit; an insert into a full shard sweeps the hand, clearing
+ * reference bits, and evicts the first slot found unreferenced.
+ *
+ * Every entry carries the generation it was computed in.
+ * knnQueryCacheInvalidate() bumps the generation when the training set
+ * changes, in O(1); stale entries are misses and are reclaimed lazily.
+ */
+
+#ifndef KNN_QUERY_CACHE_H
+#define KNN_QUERY_CACHE_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "knn_kernels.h"
+
+/** Default number of shards */
+#define KNN_QCACHE_SHARDS 16
+
+/** @brief Cache slot */
+typedef struct KnnQcSlot_Struct{
+    uint64_t hash;              /**< Hash of the quantized key and K */
+    uint64_t generation;        /**< Generation the result belongs to */
+    int32_t next;               /**< Next slot in the hash chain, -1 at the end */
+    int32_t label;              /**< Cached label */
+    int16_t k;                  /**< K of the result */
+    uint8_t has_neighbours;     /**< Neighbour list stored */
+    uint8_t ref;                /**< CLOCK reference bit */
+    uint8_t used;               /**< Slot holds an entry */
+}KnnQcSlot;
+
+/** @brief Shard: slots, chains and CLOCK hand behind one lock */
+typedef struct KnnQcShard_Struct{
+    pthread_mutex_t lock;       /**< Protects the shard */
+    KnnQcSlot *slots;           /**< Slots */
+    int32_t *keys;              /**< Quantized key of each slot (slots x features) */
+    DistIndexPair *neighbours;  /**< Neighbour list of each slot (slots x max_k) */
+    int32_t *head;              /**< First slot of each hash chain */
+    int num_slots;              /**< Slots in the shard */
+    int mask;                   /**< Hash chains - 1, a power of two minus one */
+    int hand;                   /**< CLOCK hand */
+    uint64_t hits;              /**< Lookups answered */
+    uint64_t misses;            /**< Lookups not answered */
+    uint64_t inserts;           /**< Entries stored */
+    uint64_t evictions;         /**< Entries evicted by the CLOCK sweep */
+}KnnQcShard;
+
+/** @brief Query cache */
+typedef struct KnnQueryCache_Struct{
+    KnnQcShard *shards;         /**< Shards */
+    int num_shards;             /**< Shards, a power of two */
+    int features;               /**< Feature dimensionality */
+    int max_k;                  /**< Largest neighbour list stored */
+    float inv_quantum;          /**< 1 / quantum, 0 for exact keys */
+    uint64_t generation;        /**< Current generation (atomic) */
+}KnnQueryCache;
+
+/** @brief Counters summed over the shards */
+typedef struct KnnQueryCacheStats_Struct{
+    uint64_t hits;              /**< Lookups answered */
+    uint64_t misses;            /**< Lookups not answered */
+    uint64_t inserts;           /**< Entries stored */
+    uint64_t evictions;         /**< Entries evicted */
+    uint64_t entries;           /**< Slots in use, stale ones included */
+    uint64_t capacity;          /**< Slots */
+}KnnQueryCacheStats;
+
+int knnQueryCacheInit(KnnQueryCache *cache, int capacity, int shards,
+        int features, int max_k, float quantum);
+int knnQueryCacheLookup(KnnQueryCache *cache, const float *vector, int k,
+        int *label, DistIndexPair *neighbours);
+void knnQueryCacheInsert(KnnQueryCache *cache, const float *vector, int k,
+        int label, const DistIndexPair *neighbours);
+void knnQueryCacheInvalidate(KnnQueryCache *cache);
+void knnQueryCacheStats(KnnQueryCache *cache, KnnQueryCacheStats *stats);
+void knnQueryCacheFree(KnnQueryCache *cache);
+
+#endif
@@ -0,0 +1,578 @@
+/*
+ * @file knn_store.c
+ * @brief Growable training set with tombstones and incremental indexing
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "knn_store.h"
+#include "knn_arena.h"
+
+/************************************************************************/
+
+/** @brief Feature vector of an object */
+static float *storeRow(const KnnStore *store, int id){
+    return &(store->data[id / KNN_STORE_CHUNK][(size_t) (id % KNN_STORE_CHUNK) * store->features]);
+}
+
+/** @brief Tombstone flag of an object */
+static unsigned char *storeTomb(const KnnStore *store, int id){
+    return &(store->tomb[id / KNN_STORE_CHUNK][id % KNN_STORE_CHUNK]);
+}
+
+/** @brief Label of an object */
+static int *storeLabel(const KnnStore *store, int id){
+    return &(store->labels[id / KNN_STORE_CHUNK][id % KNN_STORE_CHUNK]);
+}
+
+/** @brief Makes room for num_obj objects, existing chunks never move */
+static int storeReserve(KnnStore *store, int num_obj){
+
+    int needed = (num_obj + KNN_STORE_CHUNK - 1) / KNN_STORE_CHUNK;
+    int max;
+    void *p;
+
+    if (needed > store->max_chunks){
+        max = store->max_chunks ? store->max_chunks : 4;
+        while (max < needed){
+            max *= 2;
+        }
+        if ((p = realloc(store->data, sizeof(float *) * max)) == NULL){
+            return -1;
+        }
+        store->data = p;
+        if ((p = realloc(store->labels, sizeof(int *) * max)) == NULL){
+            return -1;
+        }
+        store->labels = p;
+        if ((p = realloc(store->tomb, sizeof(unsigned char *) * max)) == NULL){
+            return -1;
+        }
+        store->tomb = p;
+        store->max_chunks = max;
+    }
+    while (store->num_chunks < needed){
+        store->data[store->num_chunks] =
+                malloc(sizeof(float) * KNN_STORE_CHUNK * store->features);
+        store->labels[store->num_chunks] = malloc(sizeof(int) * KNN_STORE_CHUNK);
+        store->tomb[store->num_chunks] = calloc(KNN_STORE_CHUNK, 1);
+        if (store->data[store->num_chunks] == NULL ||
+            store->labels[store->num_chunks] == NULL ||
+            store->tomb[store->num_chunks] == NULL){
+            free(store->data[store->num_chunks]);
+            free(store->labels[store->num_chunks]);
+            free(store->tomb[store->num_chunks]);
+            return -1;
+        }
+        store->num_chunks++;
+    }
+    return 0;
+}
+
+/** @brief Releases an attached index */
+static void storeDropIndex(KnnLsh *lsh){
+    if (lsh != NULL){
+        knnLshFree(lsh);
+        free(lsh);
+    }
+}
+
+/**
+ * @brief Builds an index over the current objects, outside the write lock
+ *
+ * Caller holds compact_lock, so no compaction renumbers ids 0 .. n-1 of
+ * the snapshot before the index is swapped in; tombstoned rows are
+ * indexed and skipped at query time, objects appended meanwhile are left
+ * to the delta scan. The index it replaces, if any, is released.
+ */
+static int storeRebuildIndex(KnnStore *store){
+
+    KnnLsh *lsh = malloc(sizeof(KnnLsh));
+    KnnLsh *old;
+    float *rows;
+    int n, i;
+
+    pthread_rwlock_rdlock(&store->lock);
+    n = store->count;
+    rows = malloc(sizeof(float) * ((size_t) n * store->features + 1));
+    if (rows != NULL){
+        for (i = 0; i < n; i++){
+            memcpy(&(rows[(size_t) i * store->features]), storeRow(store, i),
+                    sizeof(float) * store->features);
+        }
+    }
+    pthread_rwlock_unlock(&store->lock);
+
+    if (lsh == NULL || rows == NULL || n == 0 ||
+        knnLshBuild(rows, n, store->features, store->lsh_tables, store->lsh_hashes,
+            0.0f, KNN_STORE_LSH_SEED, store->threads, lsh) != 0){
+        free(lsh);
+        free(rows);
+        return (n == 0) ? 0 : -1;
+    }
+    free(rows);
+
+    pthread_rwlock_wrlock(&store->lock);
+    old = store->lsh;
+    store->lsh = lsh;
+    store->indexed = n;
+    pthread_rwlock_unlock(&store->lock);
+    storeDropIndex(old);
+    return 0;
+}
+
+/** @brief Arena bytes storeNeighbours carves, caller holds the read lock */
+static size_t storeScratchSize(const KnnStore *store){
+    int indexed = (store->lsh != NULL) ? store->indexed : 0;
+    return knnArenaSpan(sizeof(uint64_t) * ((indexed + 63) / 64))
+            + knnArenaSpan(sizeof(int) * indexed);
+}
+
+/**
+ * @brief K nearest live neighbours of a batch, caller holds the read lock
+ *
+ * @param arena Arena with storeScratchSize() bytes free, released on return
+ * @return Number of candidates re-ranked.
+ */
+static uint64_t storeNeighbours(KnnStore *store, KnnArena *arena,
+        const float *queries, int num_queries, int k, DistIndexPair *out){
+
+    int indexed = (store->lsh != NULL) ? store->indexed : 0;
+    size_t mark = knnArenaMark(arena);
+    uint64_t *seen = NULL;
+    int *cand = NULL;
+    DistIndexPair *list;
+    float *q;
+    uint64_t total = 0;
+    int i, c, n, id, num_cand;
+
+    if (indexed > 0){
+        seen = knnArenaAlloc(arena, sizeof(uint64_t) * ((indexed + 63) / 64));
+        cand = knnArenaAlloc(arena, sizeof(int) * indexed);
+        memset(seen, 0, sizeof(uint64_t) * ((indexed + 63) / 64));
+    }
+    for (i = 0; i < num_queries; i++){
+        q = (float *) &(queries[(size_t) i * store->features]);
+        list = &(out[(size_t) i*k]);
+        n = 0;
+        num_cand = (indexed > 0) ? knnLshCandidates(store->lsh, q, store->lsh_probes, seen, cand) : 0;
+        for (c = 0; c < num_cand; c++){
+            id = cand[c];
+            seen[id >> 6] = 0;
+            if (!*storeTomb(store, id)){
+                n = topKPushByIndex(list, n, k,
+                        distance(q, storeRow(store, id), store->features), id);
+            }
+        }
+        for (id = indexed; id < store->count; id++){
+            if (!*storeTomb(store, id)){
+                n = topKPushByIndex(list, n, k,
+                        distance(q, storeRow(store, id), store->features), id);
+            }
+        }
+        total += num_cand + (store->count - indexed);
+        for (; n < k; n++){
+            list[n].distance = INFINITY;
+            list[n].index = -1;
+        }
+    }
+    knnArenaRelease(arena, mark);
+    return total;
+}
+
+/** @brief Background compaction thread */
+static void *storeCompactor(void *arg){
+
+    KnnStore *store = arg;
+    int waited, compact, reindex;
+
+    while (!__atomic_load_n(&store->compactor_stop, __ATOMIC_ACQUIRE)){
+        for (waited = 0; waited < store->compact_interval_ms &&
+                !__atomic_load_n(&store->compactor_stop, __ATOMIC_ACQUIRE); waited++){
+            usleep(1000);
+        }
+        pthread_rwlock_rdlock(&store->lock);
+        compact = store->dead > 0 && store->dead >= store->compact_ratio * store->count;
+        reindex = store->lsh != NULL && store->count > store->indexed &&
+                store->count - store->indexed >= store->reindex_ratio * store->indexed;
+        pthread_rwlock_unlock(&store->lock);
+        if (compact){
+            knnStoreCompact(store);
+        } else if (reindex){
+            knnStoreReindex(store);
+        }
+    }
+    return NULL;
+}
+
+/************************************************************************/
+
+/**
+ * @brief Initializes an empty store
+ *
+ * @param store Store, release with knnStoreFree
+ * @param features Feature dimensionality
+ * @return 0 on success, -1 otherwise.
+ */
+int knnStoreInit(KnnStore *store, int features){
+
+    memset(store, 0, sizeof(*store));
+    store->features = features;
+    store->threads = 1;
+    store->reindex_ratio = KNN_STORE_REINDEX_RATIO;
+    if (pthread_rwlock_init(&store->lock, NULL) != 0){
+        return -1;
+    }
+    if (pthread_mutex_init(&store->compact_lock, NULL) != 0){
+        pthread_rwlock_destroy(&store->lock);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Appends objects
+ *
+ * @param store Store
+ * @param rows Row-major feature vectors (num_obj x features)
+ * @param labels Labels (num_obj)
+ * @param num_obj Number of objects
+ * @return Id of the first appended object, -1 on allocation failure.
+ */
+int knnStoreAppend(KnnStore *store, const float *rows, const int *labels, int num_obj){
+
+    int first, i;
+
+    pthread_rwlock_wrlock(&store->lock);
+    first = store->count;
+    if (storeReserve(store, first + num_obj) != 0){
+        pthread_rwlock_unlock(&store->lock);
+        return -1;
+    }
+    for (i = 0; i < num_obj; i++){
+        memcpy(storeRow(store, first + i), &(rows[(size_t) i * store->features]),
+                sizeof(float) * store->features);
+        *storeLabel(store, first + i) = labels[i];
+        *storeTomb(store, first + i) = 0;
+    }
+    store->count += num_obj;
+    store->generation++;
+    pthread_rwlock_unlock(&store->lock);
+    return first;
+}
+
+/**
+ * @brief Tombstones an object
+ *
+ * @param store Store
+ * @param id Id of the object in the current generation
+ * @return 0 on success, -1 if the id is out of range or already removed.
+ */
+int knnStoreRemove(KnnStore *store, int id){
+
+    int status = -1;
+
+    pthread_rwlock_wrlock(&store->lock);
+    if (id >= 0 && id < store->count && !*storeTomb(store, id)){
+        *storeTomb(store, id) = 1;
+        store->dead++;
+        store->generation++;
+        status = 0;
+    }
+    pthread_rwlock_unlock(&store->lock);
+    return status;
+}
+
+/** @brief Number of live (not tombstoned) objects */
+int knnStoreLive(KnnStore *store){
+
+    int live;
+
+    pthread_rwlock_rdlock(&store->lock);
+    live = store->count - store->dead;
+    pthread_rwlock_unlock(&store->lock);
+    return live;
+}
+
+/** @brief Reads the store counters under the read lock */
+void knnStoreStats(KnnStore *store, KnnStoreStats *stats){
+
+    pthread_rwlock_rdlock(&store->lock);
+    stats->count = store->count;
+    stats->dead = store->dead;
+    stats->indexed = store->indexed;
+    stats->attached = store->lsh != NULL;
+    stats->generation = store->generation;
+    stats->compactions = store->compactions;
+    stats->reindexes = store->reindexes;
+    pthread_rwlock_unlock(&store->lock);
+}
+
+/**
+ * @brief Copies the live objects into contiguous arrays, in id order
+ *
+ * @param store Store
+ * @param data Output row-major feature vectors, room for every live object
+ * @param labels Output labels, may be NULL
+ * @param ids Output id of each copied object, may be NULL
+ * @return Number of objects copied.
+ */
+int knnStoreGather(KnnStore *store, float *data, int *labels, int *ids){
+
+    int id, n = 0;
+
+    pthread_rwlock_rdlock(&store->lock);
+    for (id = 0; id < store->count; id++){
+        if (!*storeTomb(store, id)){
+            memcpy(&(data[(size_t) n * store->features]), storeRow(store, id),
+                    sizeof(float) * store->features);
+            if (labels != NULL){
+                labels[n] = *storeLabel(store, id);
+            }
+            if (ids != NULL){
+                ids[n] = id;
+            }
+            n++;
+        }
+    }
+    pthread_rwlock_unlock(&store->lock);
+    return n;
+}
+
+/**
+ * @brief K nearest live neighbours of a batch of queries
+ *
+ * Exact over the delta and, without an index, over every object; with an
+ * index, the indexed objects contribute their LSH candidates only.
+ *
+ * @param store Store
+ * @param queries Row-major query feature vectors (num_queries x features)
+ * @param num_queries Number of queries
+ * @param k Number of neighbours
+ * @param out Output neighbour lists (num_queries x k) of ids, sorted by
+ *            distance, ties by id; missing entries get index -1
+ * @param generation Output generation the ids belong to, may be NULL
+ * @param candidates Output number of candidates re-ranked, may be NULL
+ * @return 0 on success, -1 if the scratch space cannot be allocated.
+ */
+int knnStoreNeighbours(KnnStore *store, const float *queries, int num_queries,
+        int k, DistIndexPair *out, uint64_t *generation, uint64_t *candidates){
+
+    KnnArena *arena;
+    uint64_t total;
+
+    pthread_rwlock_rdlock(&store->lock);
+    arena = knnArenaThread(storeScratchSize(store));
+    if (arena == NULL){
+        pthread_rwlock_unlock(&store->lock);
+        return -1;
+    }
+    total = storeNeighbours(store, arena, queries, num_queries, k, out);
+    if (generation != NULL){
+        *generation = store->generation;
+    }
+    if (candidates != NULL){
+        *candidates = total;
+    }
+    pthread_rwlock_unlock(&store->lock);
+    return 0;
+}
+
+/**
+ * @brief Classifies a batch of queries (majority vote) against the live objects
+ *
+ * @param store Store
+ * @param queries Row-major query feature vectors (num_queries x features)
+ * @param num_queries Number of queries
+ * @param k Number of neighbours
+ * @param classes Number of classes
+ * @param out Output labels (num_queries)
+ * @return 0 on success, -1 if the scratch space cannot be allocated.
+ */
+int knnStoreClassify(KnnStore *store, const float *queries, int num_queries,
+        int k, int classes, int *out){
+
+    KnnArena *arena;
+    DistIndexPair *list;
+    int *closest, *votes;
+    size_t mark;
+    int i, j, n;
+
+    pthread_rwlock_rdlock(&store->lock);
+    arena = knnArenaThread(knnArenaSpan(sizeof(DistIndexPair) * (size_t) num_queries * k)
+            + knnArenaSpan(sizeof(int) * k) + knnArenaSpan(sizeof(int) * classes)
+            + storeScratchSize(store));
+    if (arena == NULL){
+        pthread_rwlock_unlock(&store->lock);
+        return -1;
+    }
+    mark = knnArenaMark(arena);
+    list = knnArenaAlloc(arena, sizeof(DistIndexPair) * (size_t) num_queries * k);
+    closest = knnArenaAlloc(arena, sizeof(int) * k);
+    votes = knnArenaAlloc(arena, sizeof(int) * classes);
+    storeNeighbours(store, arena, queries, num_queries, k, list);
+    for (i = 0; i < num_queries; i++){
+        for (n = 0, j = 0; j < k && list[(size_t) i*k + j].index >= 0; j++){
+            closest[n++] = *storeLabel(store, list[(size_t) i*k + j].index);
+        }
+        out[i] = (n > 0) ? majorityVote(closest, n, votes, classes) : -1;
+    }
+    knnArenaRelease(arena, mark);
+    pthread_rwlock_unlock(&store->lock);
+    return 0;
+}
+
+/**
+ * @brief Attaches an LSH index, compacting first
+ *
+ * @param store Store
+ * @param tables Number of hash tables
+ * @param hashes Hash functions per table
+ * @param probes Extra buckets probed per table at query time
+ * @param threads Threads of the index builds
+ * @return 0 on success, -1 otherwise.
+ */
+int knnStoreIndex(KnnStore *store, int tables, int hashes, int probes, int threads){
+
+    pthread_mutex_lock(&store->compact_lock);
+    pthread_rwlock_wrlock(&store->lock);
+    store->lsh_tables = tables;
+    store->lsh_hashes = hashes;
+    store->lsh_probes = probes;
+    store->threads = threads;
+    pthread_rwlock_unlock(&store->lock);
+    pthread_mutex_unlock(&store->compact_lock);
+    return (knnStoreCompact(store) < 0) ? -1 : 0;
+}
+
+/**
+ * @brief Rebuilds the attached index over every object, folding in the delta
+ *
+ * Queries keep using the previous index until the new one is swapped in.
+ *
+ * @param store Store
+ * @return 0 on success or without an attached index, -1 otherwise.
+ */
+int knnStoreReindex(KnnStore *store){
+
+    int status = 0;
+
+    pthread_mutex_lock(&store->compact_lock);
+    if (store->lsh_tables > 0){
+        status = storeRebuildIndex(store);
+        if (status == 0){
+            pthread_rwlock_wrlock(&store->lock);
+            store->reindexes++;
+            pthread_rwlock_unlock(&store->lock);
+        }
+    }
+    pthread_mutex_unlock(&store->compact_lock);
+    return status;
+}
+
+/**
+ * @brief Drops the tombstoned objects and renumbers the others in order
+ *
+ * Rows are moved within their chunks under the write lock; the attached
+ * index, if any, is then rebuilt outside it.
+ *
+ * @param store Store
+ * @return Number of objects dropped, -1 if the index rebuild failed.
+ */
+int knnStoreCompact(KnnStore *store){
+
+    KnnLsh *old;
+    int id, n = 0, dropped, chunks;
+
+    pthread_mutex_lock(&store->compact_lock);
+    pthread_rwlock_wrlock(&store->lock);
+    for (id = 0; id < store->count; id++){
+        if (!*storeTomb(store, id)){
+            if (n != id){
+                memcpy(storeRow(store, n), storeRow(store, id), sizeof(float) * store->features);
+                *storeLabel(store, n) = *storeLabel(store, id);
+                *storeTomb(store, n) = 0;
+            }
+            n++;
+        }
+    }
+    dropped = store->count - n;
+    store->count = n;
+    store->dead = 0;
+    chunks = (n + KNN_STORE_CHUNK - 1) / KNN_STORE_CHUNK;
+    while (store->num_chunks > chunks){
+        store->num_chunks--;
+        free(store->data[store->num_chunks]);
+        free(store->labels[store->num_chunks]);
+        free(store->tomb[store->num_chunks]);
+    }
+    old = store->lsh;
+    store->lsh = NULL;
+    store->indexed = 0;
+    store->generation++;
+    store->compactions++;
+    pthread_rwlock_unlock(&store->lock);
+    storeDropIndex(old);
+
+    if (store->lsh_tables > 0 && storeRebuildIndex(store) != 0){
+        dropped = -1;
+    }
+    pthread_mutex_unlock(&store->compact_lock);
+    return dropped;
+}
+
+/**
+ * @brief Starts the background compaction thread
+ *
+ * @param store Store
+ * @param ratio Tombstoned fraction of the objects that triggers a compaction;
+ *              the delta is re-indexed past store->reindex_ratio
+ * @param interval_ms Polling interval in milliseconds
+ * @return 0 on success, -1 otherwise.
+ */
+int knnStoreStartCompactor(KnnStore *store, float ratio, int interval_ms){
+
+    if (store->compactor_running){
+        return -1;
+    }
+    store->compact_ratio = ratio;
+    store->compact_interval_ms = interval_ms;
+    store->compactor_stop = 0;
+    if (pthread_create(&store->compactor, NULL, storeCompactor, store) != 0){
+        return -1;
+    }
+    store->compactor_running = 1;
+    return 0;
+}
+
+/** @brief Stops the background compaction thread, waiting for it */
+void knnStoreStopCompactor(KnnStore *store){
+    if (store->compactor_running){
+        __atomic_store_n(&store->compactor_stop, 1, __ATOMIC_RELEASE);
+        pthread_join(store->compactor, NULL);
+        store->compactor_running = 0;
+    }
+}
+
+/** @brief Stops the compactor and releases a store */
+void knnStoreFree(KnnStore *store){
+
+    int c;
+
+    knnStoreStopCompactor(store);
+    for (c = 0; c < store->num_chunks; c++){
+        free(store->data[c]);
+        free(store->labels[c]);
+        free(store->tomb[c]);
+    }
+    free(store->data);
+    free(store->labels);
+    free(store->tomb);
+    storeDropIndex(store->lsh);
+    pthread_rwlock_destroy(&store->lock);
+    pthread_mutex_destroy(&store->compact_lock);
+    memset(store, 0, sizeof(*store));
+}
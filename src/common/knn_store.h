@@ -0,0 +1,101 @@
+/*
+ * @file knn_store.h
+ * @brief Growable training set with tombstones and incremental indexing
+ *
+ * Objects live in fixed-size chunks of KNN_STORE_CHUNK rows, so appending
+ * never moves existing rows. An object is identified by its id, its
+ * position in append order; removal only sets a tombstone, and ids stay
+ * valid until the next compaction, which drops the tombstoned rows and
+ * renumbers the others in order. Every mutation bumps the generation
+ * counter, so a caller can tell whether ids it holds are still current.
+ *
+ * An LSH index can be attached: it covers ids below store->indexed, and
+ * objects appended later form a delta that queries scan exhaustively.
+ * The CSR buckets of the index cannot take inserts, so the delta is
+ * folded in by re-indexing: knnStoreReindex() builds a new index over a
+ * snapshot outside the write lock and swaps it in, queries keep using
+ * the old one meanwhile. Compaction renumbers ids, so it detaches the
+ * index and rebuilds it the same way; queries meanwhile scan
+ * exhaustively. A background thread compacts once the tombstoned
+ * fraction exceeds a threshold, and re-indexes once the delta exceeds
+ * reindex_ratio of the indexed objects.
+ *
+ * Queries take a read lock and mutations a write lock (pthread rwlock),
+ * so queries run concurrently with each other and never see a half
+ * applied update.
+ */
+
+#ifndef KNN_STORE_H
+#define KNN_STORE_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "knn_kernels.h"
+#include "knn_lsh.h"
+
+/** Objects per chunk */
+#define KNN_STORE_CHUNK 1024
+/** Seed of the LSH functions of attached indexes */
+#define KNN_STORE_LSH_SEED 42
+/** Default delta size, as a fraction of the indexed objects, that triggers a re-index */
+#define KNN_STORE_REINDEX_RATIO 0.25f
+
+/** @brief Growable chunked training set */
+typedef struct KnnStore_Struct{
+    int features;               /**< Feature dimensionality */
+    int num_chunks;             /**< Allocated chunks */
+    int max_chunks;             /**< Capacity of the chunk pointer arrays */
+    int count;                  /**< Objects stored, ids 0 .. count-1 */
+    int dead;                   /**< Tombstoned objects among them */
+    uint64_t generation;        /**< Bumped by every append, removal and compaction */
+    uint64_t compactions;       /**< Compactions performed */
+    uint64_t reindexes;         /**< Index rebuilds that folded in the delta */
+    float **data;               /**< Row-major feature vectors of each chunk */
+    int **labels;               /**< Labels of each chunk */
+    unsigned char **tomb;       /**< Tombstone flags of each chunk */
+    KnnLsh *lsh;                /**< Index of ids < indexed, NULL if detached */
+    int indexed;                /**< Objects covered by the index */
+    int lsh_tables;             /**< Tables of the attached index, 0 for none */
+    int lsh_hashes;             /**< Hash functions per table */
+    int lsh_probes;             /**< Extra buckets probed per table */
+    int threads;                /**< Threads of index builds */
+    pthread_rwlock_t lock;      /**< Read lock for queries, write lock for updates */
+    pthread_mutex_t compact_lock;   /**< Serializes compactions */
+    pthread_t compactor;        /**< Background compaction thread */
+    int compactor_running;      /**< compactor was started */
+    int compactor_stop;         /**< Asks the compactor to exit (atomic) */
+    float compact_ratio;        /**< Tombstoned fraction that triggers compaction */
+    float reindex_ratio;        /**< Delta fraction of indexed that triggers a re-index */
+    int compact_interval_ms;    /**< Compactor polling interval */
+}KnnStore;
+
+/** @brief Consistent snapshot of the store counters */
+typedef struct KnnStoreStats_Struct{
+    int count;                  /**< Objects stored */
+    int dead;                   /**< Tombstoned objects among them */
+    int indexed;                /**< Objects covered by the index */
+    int attached;               /**< An index is attached */
+    uint64_t generation;        /**< Mutation counter */
+    uint64_t compactions;       /**< Compactions performed */
+    uint64_t reindexes;         /**< Index rebuilds that folded in the delta */
+}KnnStoreStats;
+
+int knnStoreInit(KnnStore *store, int features);
+int knnStoreAppend(KnnStore *store, const float *rows, const int *labels, int num_obj);
+int knnStoreRemove(KnnStore *store, int id);
+int knnStoreLive(KnnStore *store);
+void knnStoreStats(KnnStore *store, KnnStoreStats *stats);
+int knnStoreGather(KnnStore *store, float *data, int *labels, int *ids);
+int knnStoreNeighbours(KnnStore *store, const float *queries, int num_queries,
+        int k, DistIndexPair *out, uint64_t *generation, uint64_t *candidates);
+int knnStoreClassify(KnnStore *store, const float *queries, int num_queries,
+        int k, int classes, int *out);
+int knnStoreIndex(KnnStore *store, int tables, int hashes, int probes, int threads);
+int knnStoreReindex(KnnStore *store);
+int knnStoreCompact(KnnStore *store);
+int knnStoreStartCompactor(KnnStore *store, float ratio, int interval_ms);
+void knnStoreStopCompactor(KnnStore *store);
+void knnStoreFree(KnnStore *store);
+
+#endif
@@ -0,0 +1,214 @@
+/*
+ * @file knn_stream.c
+ * @brief Out-of-core scan of a training set streamed from its binary
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "knn_stream.h"
+#include "knn_timer.h"
+
+/************************************************************************/
+
+/** @brief One read buffer */
+typedef struct StreamBuffer_Struct{
+    float *data;                /**< block_obj rows */
+    int first;                  /**< Index of the first row */
+    int count;                  /**< Rows held, valid when full */
+    int full;                   /**< Filled by the reader, not yet scanned */
+}StreamBuffer;
+
+/** @brief State shared by the reader and the scan */
+typedef struct StreamShared_Struct{
+    FILE *fp;                   /**< Training features file */
+    int num_obj;                /**< Rows to read */
+    int features;               /**< Feature dimensionality */
+    int block;                  /**< Rows per block */
+    StreamBuffer buf[KNN_STREAM_BUFFERS];   /**< Read buffers, used in turn */
+    int error;                  /**< Set by the reader on a short read */
+    int stop;                   /**< Set by the scan to abandon the reads */
+    uint64_t read_ns;           /**< Time spent in reads */
+    pthread_mutex_t lock;       /**< Protects full, error and stop */
+    pthread_cond_t cond;        /**< Signals any change of them */
+}StreamShared;
+
+/** @brief Reader thread, fills the buffers in turn */
+static void *streamReader(void *arg){
+
+    StreamShared *ss = arg;
+    StreamBuffer *buf;
+    uint64_t t;
+    int first, count, stop, b = 0;
+
+    for (first = 0; first < ss->num_obj; first += count, b = (b + 1) % KNN_STREAM_BUFFERS){
+        count = (ss->num_obj - first < ss->block) ? ss->num_obj - first : ss->block;
+        buf = &(ss->buf[b]);
+
+        pthread_mutex_lock(&ss->lock);
+        while (buf->full && !ss->stop){
+            pthread_cond_wait(&ss->cond, &ss->lock);
+        }
+        stop = ss->stop;
+        pthread_mutex_unlock(&ss->lock);
+        if (stop){
+            break;
+        }
+
+        t = knnNanos();
+        if (fread(buf->data, sizeof(float) * ss->features, count, ss->fp) != (size_t) count){
+            pthread_mutex_lock(&ss->lock);
+            ss->error = 1;
+            pthread_cond_broadcast(&ss->cond);
+            pthread_mutex_unlock(&ss->lock);
+            break;
+        }
+        ss->read_ns += knnNanos() - t;
+
+        pthread_mutex_lock(&ss->lock);
+        buf->first = first;
+        buf->count = count;
+        buf->full = 1;
+        pthread_cond_broadcast(&ss->cond);
+        pthread_mutex_unlock(&ss->lock);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Scans one block against every query, a tile of rows at a time
+ *
+ * @param buf Block
+ * @param features Feature dimensionality
+ * @param queries Query feature vectors
+ * @param num_queries Number of queries
+ * @param k Number of neighbours
+ * @param lists Top-K list of each query (num_queries x k)
+ * @param sizes Entries in each list
+ */
+static void streamScan(const StreamBuffer *buf, int features, float *queries,
+        int num_queries, int k, DistIndexPair *lists, int *sizes){
+
+    int t0, n, i, r;
+    float *q, d;
+
+    for (t0 = 0; t0 < buf->count; t0 += KNN_STREAM_TILE){
+        n = (buf->count - t0 < KNN_STREAM_TILE) ? buf->count - t0 : KNN_STREAM_TILE;
+        for (i = 0; i < num_queries; i++){
+            q = &(queries[(size_t) i * features]);
+            for (r = t0; r < t0 + n; r++){
+                d = distance(q, &(buf->data[(size_t) r * features]), features);
+                sizes[i] = topKPushByIndex(&(lists[(size_t) i * k]), sizes[i], k,
+                        d, buf->first + r);
+            }
+        }
+    }
+}
+
+/************************************************************************/
+
+/**
+ * @brief K nearest neighbours of a query batch, streaming the training set
+ *
+ * @param data_bin Training features binary file
+ * @param num_obj Number of training objects
+ * @param features Feature dimensionality
+ * @param queries Row-major query feature vectors (num_queries x features)
+ * @param num_queries Number of queries
+ * @param k Number of neighbours, <= num_obj
+ * @param block_obj Rows per read block
+ * @param out Output neighbour lists (num_queries x k), sorted by distance,
+ *            ties by index, as knnNeighbours
+ * @param stats Output timing, may be NULL
+ * @return 0 on success, -1 on a read or allocation failure.
+ */
+int knnStreamNeighbours(const char *data_bin, int num_obj, int features,
+        float *queries, int num_queries, int k, int block_obj,
+        DistIndexPair *out, KnnStreamStats *stats){
+
+    StreamShared ss;
+    StreamBuffer *buf;
+    pthread_t reader;
+    int *sizes = calloc(num_queries, sizeof(int));
+    uint64_t t, t_start = knnNanos(), scan_ns = 0, wait_ns = 0;
+    int first, b, status = 0, blocks = 0;
+
+    memset(&ss, 0, sizeof(ss));
+    ss.fp = fopen(data_bin, "rb");
+    ss.num_obj = num_obj;
+    ss.features = features;
+    ss.block = (block_obj > 0) ? block_obj : 1;
+    for (b = 0; b < KNN_STREAM_BUFFERS; b++){
+        ss.buf[b].data = malloc(sizeof(float) * (size_t) ss.block * features);
+        if (ss.buf[b].data == NULL){
+            status = -1;
+        }
+    }
+    if (ss.fp == NULL || sizes == NULL || status != 0){
+        for (b = 0; b < KNN_STREAM_BUFFERS; b++){
+            free(ss.buf[b].data);
+        }
+        if (ss.fp != NULL){
+            fclose(ss.fp);
+        }
+        free(sizes);
+        return -1;
+    }
+    /* Large blocks are read straight into the buffers, no stdio copy */
+    setvbuf(ss.fp, NULL, _IONBF, 0);
+    pthread_mutex_init(&ss.lock, NULL);
+    pthread_cond_init(&ss.cond, NULL);
+    pthread_create(&reader, NULL, streamReader, &ss);
+
+    for (first = 0, b = 0; first < num_obj; b = (b + 1) % KNN_STREAM_BUFFERS){
+        buf = &(ss.buf[b]);
+        t = knnNanos();
+        pthread_mutex_lock(&ss.lock);
+        while (!buf->full && !ss.error){
+            pthread_cond_wait(&ss.cond, &ss.lock);
+        }
+        pthread_mutex_unlock(&ss.lock);
+        wait_ns += knnNanos() - t;
+        if (!buf->full){
+            status = -1;
+            break;
+        }
+
+        t = knnNanos();
+        streamScan(buf, features, queries, num_queries, k, out, sizes);
+        scan_ns += knnNanos() - t;
+        first += buf->count;
+        blocks++;
+
+        pthread_mutex_lock(&ss.lock);
+        buf->full = 0;
+        pthread_cond_broadcast(&ss.cond);
+        pthread_mutex_unlock(&ss.lock);
+    }
+
+    pthread_mutex_lock(&ss.lock);
+    ss.stop = 1;
+    pthread_cond_broadcast(&ss.cond);
+    pthread_mutex_unlock(&ss.lock);
+    pthread_join(reader, NULL);
+
+    if (stats != NULL){
+        stats->bytes = (uint64_t) first * features * sizeof(float);
+        stats->blocks = blocks;
+        stats->read_ns = ss.read_ns;
+        stats->scan_ns = scan_ns;
+        stats->wait_ns = wait_ns;
+        stats->total_ns = knnNanos() - t_start;
+    }
+
+    pthread_mutex_destroy(&ss.lock);
+    pthread_cond_destroy(&ss.cond);
+    for (b = 0; b < KNN_STREAM_BUFFERS; b++){
+        free(ss.buf[b].data);
+    }
+    fclose(ss.fp);
+    free(sizes);
+    return status;
+}
@@ -0,0 +1,40 @@
+/*
+ * @file knn_stream.h
+ * @brief Out-of-core scan of a training set streamed from its binary
+ *
+ * The training features file is read in blocks of block_obj rows by a
+ * dedicated reader thread into one of KNN_STREAM_BUFFERS buffers, while
+ * the calling thread scans the other against the whole query batch. Only
+ * the buffers and the queries' top-K lists are held in memory, so the
+ * training set may be larger than RAM, and reading overlaps computation:
+ * the scan waits on the disk only when a block is computed faster than
+ * the next one is read.
+ */
+
+#ifndef KNN_STREAM_H
+#define KNN_STREAM_H
+
+#include <stdint.h>
+
+#include "knn_kernels.h"
+
+/** Read buffers, one being filled while the other is scanned */
+#define KNN_STREAM_BUFFERS 2
+/** Rows of a block scanned against every query before moving on */
+#define KNN_STREAM_TILE 256
+
+/** @brief Timing of a streamed scan */
+typedef struct KnnStreamStats_Struct{
+    uint64_t bytes;         /**< Bytes read */
+    int blocks;             /**< Blocks read */
+    uint64_t read_ns;       /**< Time the reader spent in reads */
+    uint64_t scan_ns;       /**< Time the scan spent computing */
+    uint64_t wait_ns;       /**< Time the scan spent waiting for a block */
+    uint64_t total_ns;      /**< Wall time of the whole scan */
+}KnnStreamStats;
+
+int knnStreamNeighbours(const char *data_bin, int num_obj, int features,
+        float *queries, int num_queries, int k, int block_obj,
+        DistIndexPair *out, KnnStreamStats *stats);
+
+#endif
@@ -0,0 +1,58 @@
+/*
+ * @file knn_timer.h
+ * @brief Cycle counter and wall clock timing helpers
+ *
+ * knnCycles() reads the cheapest free-running counter the CPU offers
+ * (TSC on x86, the virtual counter on AArch64) and falls back to the
+ * monotonic clock in nanoseconds elsewhere.
+ */
+
+#ifndef KNN_TIMER_H
+#define KNN_TIMER_H
+
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/** @brief Monotonic wall clock in nanoseconds */
+static inline uint64_t knnNanos(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+/** @brief Raw cycle counter value */
+static inline uint64_t knnCycles(void){
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t val;
+    __asm__ volatile("isb; mrs %0, cntvct_el0" : "=r"(val));
+    return val;
+#else
+    return knnNanos();
+#endif
+}
+
+/**
+ * @brief Measures the cycle counter frequency against the wall clock
+ *
+ * @param ms Calibration interval in milliseconds
+ * @return Counter ticks per nanosecond.
+ */
+static inline double knnCyclesPerNano(int ms){
+    uint64_t n0, n1, c0, c1;
+
+    n0 = knnNanos();
+    c0 = knnCycles();
+    do {
+        n1 = knnNanos();
+    } while (n1 - n0 < (uint64_t) ms * 1000000ull);
+    c1 = knnCycles();
+    return (double) (c1 - c0) / (double) (n1 - n0);
+}
+
+#endif
@@ -0,0 +1,111 @@
+/*
+ * @file knn_trace.c
+ * @brief Timeline tracing of per-core and per-DMA-channel activity
+ */
+
+#include <string.h>
+
+#include "knn_trace.h"
+
+/************************************************************************/
+
+/** Track names shown in the trace viewer */
+static const char *trace_track_names[KNN_TRACKS] = {
+    "CPU0", "CPU1", "DMA0 MM2S", "DMA0 S2MM", "DMA1 MM2S", "DMA1 S2MM" };
+
+/** Activity names shown in the trace viewer */
+static const char *trace_names[KNN_TRACE_NAMES] = {
+    "submit", "busy-wait", "cache", "distance", "selection", "voting",
+    "barrier", "transfer" };
+
+/************************************************************************/
+
+/**
+ * @brief Initialises a ring buffer in caller-provided memory
+ *
+ * @param mem Memory of at least KNN_TRACE_BUFFER_SIZE(capacity) bytes
+ * @param capacity Number of events, must be a power of 2
+ * @param pid Process id of the buffer in the exported trace
+ * @return The buffer.
+ */
+KnnTraceBuffer *knnTraceInit(void *mem, uint32_t capacity, uint32_t pid){
+    KnnTraceBuffer *buf = mem;
+
+    buf->head = 0;
+    buf->mask = capacity - 1;
+    buf->pid = pid;
+    buf->pad = 0;
+    return buf;
+}
+
+/** @brief Index of the oldest event still held by a buffer */
+static uint32_t traceFirst(const KnnTraceBuffer *buf){
+    return (buf->head > buf->mask + 1) ? buf->head - (buf->mask + 1) : 0;
+}
+
+/**
+ * @brief Writes the buffers as a Chrome trace-event JSON document
+ *
+ * Timestamps are made relative to the oldest event of all buffers. When
+ * a ring has wrapped, end events whose begin was overwritten are dropped
+ * so every track stays balanced.
+ *
+ * @param fp Output stream
+ * @param buffers Buffers to export, one per core
+ * @param num_buffers Number of buffers
+ */
+void knnTraceExport(FILE *fp, KnnTraceBuffer **buffers, int num_buffers){
+
+    const double us_per_tick = 1e6 / (double) KNN_TRACE_TICKS_PER_SECOND;
+    int depth[KNN_TRACKS];
+    int used[KNN_TRACKS];
+    uint64_t t0 = UINT64_MAX;
+    const KnnTraceEvent *ev;
+    uint32_t i;
+    int b, t, first = 1;
+
+    for (b = 0; b < num_buffers; b++){
+        if (buffers[b]->head != traceFirst(buffers[b])){
+            ev = &(buffers[b]->events[traceFirst(buffers[b]) & buffers[b]->mask]);
+            if (ev->ts < t0){
+                t0 = ev->ts;
+            }
+        }
+    }
+
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (b = 0; b < num_buffers; b++){
+        memset(depth, 0, sizeof(depth));
+        memset(used, 0, sizeof(used));
+        for (i = traceFirst(buffers[b]); i != buffers[b]->head; i++){
+            ev = &(buffers[b]->events[i & buffers[b]->mask]);
+            if (ev->track >= KNN_TRACKS || ev->name >= KNN_TRACE_NAMES){
+                continue;
+            }
+            if (ev->ph == KNN_TRACE_PH_END){
+                if (depth[ev->track] == 0){
+                    continue;
+                }
+                depth[ev->track]--;
+            } else {
+                depth[ev->track]++;
+            }
+            used[ev->track] = 1;
+            fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,"
+                    "\"pid\":%u,\"tid\":%d,\"args\":{\"arg\":%u}}",
+                    first ? "" : ",\n", trace_names[ev->name],
+                    (ev->ph == KNN_TRACE_PH_END) ? 'E' : 'B',
+                    (double) (ev->ts - t0) * us_per_tick,
+                    (unsigned) buffers[b]->pid, ev->track, (unsigned) ev->arg);
+            first = 0;
+        }
+        for (t = 0; t < KNN_TRACKS; t++){
+            if (used[t]){
+                fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,"
+                        "\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                        (unsigned) buffers[b]->pid, t, trace_track_names[t]);
+            }
+        }
+    }
+    fprintf(fp, "\n]}\n");
+}
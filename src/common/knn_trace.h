@@ -0,0 +1,123 @@
+/*
+ * @file knn_trace.h
+ * @brief Timeline tracing of per-core and per-DMA-channel activity
+ *
+ * Each core owns a ring buffer of timestamped begin/end events. An
+ * event carries the track it belongs to (a core or a DMA channel), so
+ * the core that drives a DMA engine also records the engine activity.
+ * Buffers are flushed at the end of a run in Chrome trace-event JSON
+ * (chrome://tracing, Perfetto).
+ *
+ * Timestamps come from the Zynq global timer on the bare-metal builds,
+ * which is shared by both cores, and from the monotonic clock on Linux.
+ * Recording compiles to nothing unless KNN_TRACE_ENABLE is defined.
+ */
+
+#ifndef KNN_TRACE_H
+#define KNN_TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#if defined(__linux__)
+#include "knn_timer.h"
+/** Trace timestamp ticks per second */
+#define KNN_TRACE_TICKS_PER_SECOND 1000000000ull
+#else
+#include "xtime_l.h"
+/** Trace timestamp ticks per second */
+#define KNN_TRACE_TICKS_PER_SECOND ((uint64_t) COUNTS_PER_SECOND)
+#endif
+
+/** @brief Timeline tracks */
+typedef enum KnnTraceTrack_Enum{
+    KNN_TRACK_CPU0 = 0,         /**< Core 0 */
+    KNN_TRACK_CPU1,             /**< Core 1 */
+    KNN_TRACK_DMA0_TX,          /**< DMA 0 MM2S channel */
+    KNN_TRACK_DMA0_RX,          /**< DMA 0 S2MM channel */
+    KNN_TRACK_DMA1_TX,          /**< DMA 1 MM2S channel */
+    KNN_TRACK_DMA1_RX,          /**< DMA 1 S2MM channel */
+    KNN_TRACKS                  /**< Number of tracks */
+}KnnTraceTrack;
+
+/** @brief Traced activities */
+typedef enum KnnTraceName_Enum{
+    KNN_TRACE_SUBMIT = 0,       /**< Programming a DMA transfer */
+    KNN_TRACE_BUSY_WAIT,        /**< Polling a DMA channel */
+    KNN_TRACE_CACHE,            /**< Cache flush or invalidate */
+    KNN_TRACE_DISTANCE,         /**< Distance calculation */
+    KNN_TRACE_SELECTION,        /**< Top-K selection */
+    KNN_TRACE_VOTING,           /**< Label assignment */
+    KNN_TRACE_BARRIER,          /**< Waiting on the other core */
+    KNN_TRACE_TRANSFER,         /**< DMA channel moving data */
+    KNN_TRACE_NAMES             /**< Number of names */
+}KnnTraceName;
+
+/** Event phase: begin */
+#define KNN_TRACE_PH_BEGIN 0
+/** Event phase: end */
+#define KNN_TRACE_PH_END 1
+
+/** @brief A single timestamped event, 16 bytes */
+typedef struct KnnTraceEvent_Struct{
+    uint64_t ts;                /**< Timestamp in timer ticks */
+    uint32_t arg;               /**< Free argument, e.g. tst object index */
+    uint8_t track;              /**< KnnTraceTrack */
+    uint8_t name;               /**< KnnTraceName */
+    uint8_t ph;                 /**< KNN_TRACE_PH_BEGIN or KNN_TRACE_PH_END */
+    uint8_t pad;                /**< Unused */
+}KnnTraceEvent;
+
+/** @brief Ring buffer of events owned by a single core */
+typedef struct KnnTraceBuffer_Struct{
+    uint32_t head;              /**< Number of events recorded since init */
+    uint32_t mask;              /**< Capacity - 1, capacity is a power of 2 */
+    uint32_t pid;               /**< Process id in the exported trace */
+    uint32_t pad;               /**< Unused */
+    KnnTraceEvent events[1];    /**< Capacity events follow the header */
+}KnnTraceBuffer;
+
+/** Bytes taken by a buffer of the given capacity */
+#define KNN_TRACE_BUFFER_SIZE(capacity) \
+    (sizeof(KnnTraceBuffer) + ((capacity) - 1) * sizeof(KnnTraceEvent))
+
+KnnTraceBuffer *knnTraceInit(void *mem, uint32_t capacity, uint32_t pid);
+void knnTraceExport(FILE *fp, KnnTraceBuffer **buffers, int num_buffers);
+
+/** @brief Current trace timestamp */
+static inline uint64_t knnTraceNow(void){
+#if defined(__linux__)
+    return knnNanos();
+#else
+    XTime t;
+    XTime_GetTime(&t);
+    return (uint64_t) t;
+#endif
+}
+
+/** @brief Appends an event, overwriting the oldest when the ring is full */
+static inline void knnTraceRecord(KnnTraceBuffer *buf, int track, int name,
+        int ph, uint32_t arg){
+    KnnTraceEvent *ev = &(buf->events[buf->head & buf->mask]);
+
+    ev->ts = knnTraceNow();
+    ev->arg = arg;
+    ev->track = (uint8_t) track;
+    ev->name = (uint8_t) name;
+    ev->ph = (uint8_t) ph;
+    buf->head++;
+}
+
+#ifdef KNN_TRACE_ENABLE
+/** Opens an activity on a track */
+#define KNN_TRACE_BEGIN(buf, track, name, arg) \
+    knnTraceRecord((buf), (track), (name), KNN_TRACE_PH_BEGIN, (arg))
+/** Closes the innermost open activity on a track */
+#define KNN_TRACE_END(buf, track, name, arg) \
+    knnTraceRecord((buf), (track), (name), KNN_TRACE_PH_END, (arg))
+#else
+#define KNN_TRACE_BEGIN(buf, track, name, arg) ((void) 0)
+#define KNN_TRACE_END(buf, track, name, arg) ((void) 0)
+#endif
+
+#endif
@@ -64,13 +64,14 @@ int main(int argc, char** argv){
 
 	/* Total execution */
 	XTime t_start, t_end;
-	/* Kernel execution (Distance calculation) */
-	XTime t_kernel_start, t_kernel_end;
+	/* Kernel execution (Distance calculation), summed over testing objects */
+	XTime t_kernel_start, t_kernel_end, t_kernel = 0;
 
 	XTime_GetTime(&t_start);
 
-	/**< Distance matrix, each entry associated with the trn object label */
-    DistLabelPair dist_label[NUM_TST_OBJ][NUM_TRN_OBJ];
+	/**< Distances of one testing object, each entry associated with the trn object label.
+	 *   Static: only one row is kept, a full matrix overflows the stack beyond iris */
+    static DistLabelPair dist_label[NUM_TRN_OBJ];
 
     int correct = 0;					/**< Number of correctly classified objects */
     int vote = 0;						/**< Occurrence of a given class */
@@ -121,14 +122,12 @@ int main(int argc, char** argv){
 
     float terminator = 1E30;
 
-    float distances_buffer[NUM_TRN_OBJ];
-
-    /* Calculate distance matrix */
-
-    XTime_GetTime(&t_kernel_start);
+    static float distances_buffer[NUM_TRN_OBJ];
 
     /* For object in testing set */
     for (i = 0; i < NUM_TST_OBJ; i++){
+    	XTime_GetTime(&t_kernel_start);
+
     	/* HW -  Send 1 testing object to HW memory */
     	my_send_to_fifo((void *) &(data_tst[i*FEATURES]), sizeof(float) * FEATURES);
 
@@ -148,24 +147,22 @@ int main(int argc, char** argv){
     	bytes_read = my_receive_from_fifo((void *) distances_buffer, sizeof(float) * NUM_TRN_OBJ);
 
         for(j = 0; j < NUM_TRN_OBJ; j++){
-        	dist_label[i][j].distance = distances_buffer[j];
-        	dist_label[i][j].label = label_trn[j];
-        	//printf("tst obj %d - distance to trn obj %d of class %d is %f \n", i, j, label_trn[j], dist_label[i][j].distance);
+        	dist_label[j].distance = distances_buffer[j];
+        	dist_label[j].label = label_trn[j];
+        	//printf("tst obj %d - distance to trn obj %d of class %d is %f \n", i, j, label_trn[j], dist_label[j].distance);
         }
-    }
 
-    XTime_GetTime(&t_kernel_end);
+        XTime_GetTime(&t_kernel_end);
+        t_kernel += t_kernel_end - t_kernel_start;
 
-    /* From the distance matrix assign labels to testing objects */
-    for (i = 0; i <  NUM_TST_OBJ; i++){
-        
-        selectionSortK((DistLabelPair*) (dist_label[i]), NUM_TRN_OBJ, K);
+        /* From the distance row assign a label to the testing object */
+        selectionSortK(dist_label, NUM_TRN_OBJ, K);
         for (j = 0; j < CLASSES; j++){
             votes[j] = 0;
         }
         
         for (j = 0; j < K; j++){
-            votes[ dist_label[i][j].label ]++;
+            votes[ dist_label[j].label ]++;
         }
         
         assigned_label = 0;
@@ -199,9 +196,9 @@ int main(int argc, char** argv){
 	xil_printf("Total of %d correctly classified out of %d", correct, NUM_TST_OBJ);
 
     xil_printf("\nTiming Report (us)\nKernel Execution: %d\nTotal Execution: %d\n%d;%d;",
-       		(int) (1.0 * (t_kernel_end - t_kernel_start) / (COUNTS_PER_SECOND/1000000)),
+       		(int) (1.0 * t_kernel / (COUNTS_PER_SECOND/1000000)),
    			(int) (1.0 * (t_end - t_start) / (COUNTS_PER_SECOND/1000000)),
-   			(int) (1.0 * (t_kernel_end - t_kernel_start) / (COUNTS_PER_SECOND/1000000)),
+   			(int) (1.0 * t_kernel / (COUNTS_PER_SECOND/1000000)),
    			(int) (1.0 * (t_end - t_start) / (COUNTS_PER_SECOND/1000000))
     );
 
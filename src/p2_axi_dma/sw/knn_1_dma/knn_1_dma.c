@@ -23,6 +23,7 @@
 #include "xil_cache_l.h"
 
 #include "data_1_dma.h"
+#include "knn_perf.h"
 
 /************************************************************************/
 
@@ -74,6 +75,9 @@ int main(){
 	/* Start Timer */
 	XTime_GetTime(&t_start);
 
+	/* Start HW performance counters */
+	knnPerfInit();
+
 	/* Initialise DMA in poll mode for simple transfer */
 	Status = init_XAxiDma_SimplePollMode(DMA_0_DEV_ID);
 	if (Status != XST_SUCCESS) {
@@ -174,6 +178,7 @@ int XAxiDma_Simple_KNN(u16 device_0_ID){
 	/* Distance Calculation */
 
 	XTime_GetTime(&t_kernel_start);
+	knnPerfBegin(KNN_PHASE_DISTANCE);
 
 	/* For each object in testing set */
 	for (i = 0; i < NUM_TST_OBJ; i++) {
@@ -214,6 +219,7 @@ int XAxiDma_Simple_KNN(u16 device_0_ID){
 	    while (XAxiDma_Busy(&AxiDma0,XAXIDMA_DEVICE_TO_DMA)){}
 	}
 
+	knnPerfEnd(KNN_PHASE_DISTANCE);
 	XTime_GetTime(&t_kernel_end);
 
 	/************************************************************************/
@@ -228,7 +234,11 @@ int XAxiDma_Simple_KNN(u16 device_0_ID){
 
 	/* From the distance matrix assign labels to testing objects */
 	for (i = 0; i < NUM_TST_OBJ; i++){
+		knnPerfBegin(KNN_PHASE_SELECTION);
 		selectionSortK((float *)(&distances[i*NUM_TRN_OBJ]), closest, NUM_TRN_OBJ, K);
+		knnPerfEnd(KNN_PHASE_SELECTION);
+
+		knnPerfBegin(KNN_PHASE_VOTING);
 		for (j = 0; j < CLASSES; j++){
 			votes[j] = 0;
 		}
@@ -247,6 +257,7 @@ int XAxiDma_Simple_KNN(u16 device_0_ID){
 			}
 		}
 		label_prediction[i] = assigned_label;
+		knnPerfEnd(KNN_PHASE_VOTING);
 	}
 
 	/************************************************************************/
@@ -272,6 +283,8 @@ int XAxiDma_Simple_KNN(u16 device_0_ID){
 			(int) (1.0 * (t_kernel_end - t_kernel_start) / (COUNTS_PER_SECOND/1000000)),
 			(int) (1.0 * (t_end - t_start) / (COUNTS_PER_SECOND/1000000))
 	);
+
+	knnPerfReport((u64) NUM_TST_OBJ * NUM_TRN_OBJ);
 	return XST_SUCCESS;
 }
 
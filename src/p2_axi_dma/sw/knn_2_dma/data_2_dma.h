@@ -67,3 +67,16 @@ char label_strings[CLASSES][100] = {
 
 /** Base address for storing distance matrix (TST_OBJ x TRN_OBJ) */
 #define OUT_DIST_BASE_ADDR 		(float *)	0x019000000
+
+/************************************************************************/
+
+/* Tracing */
+
+/** Record a Chrome trace timeline of the run, printed at the end */
+//#define KNN_TRACE_ENABLE 1
+/** Events held by each core trace ring buffer (power of 2) */
+#define TRACE_CAPACITY 65536
+/** Base address of the CPU0 trace ring buffer */
+#define TRACE_CPU0_BASE_ADDR 	(void *)	0x01C000000
+/** Base address of the CPU1 trace ring buffer */
+#define TRACE_CPU1_BASE_ADDR 	(void *)	0x01C200000
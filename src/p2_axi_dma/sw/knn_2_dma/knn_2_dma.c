@@ -22,6 +22,8 @@
 #include "xil_cache_l.h"
 
 #include "data_2_dma.h"
+#include "knn_perf.h"
+#include "knn_trace.h"
 
 /************************************************************************/
 
@@ -52,6 +54,9 @@ void selectionSortK(float *distances, int *smallest, int size, int k);
 /** Global AXI DMA instance */
 XAxiDma AxiDma0, AxiDma1;
 
+/** CPU0 trace ring buffer */
+KnnTraceBuffer *trace;
+
 /* Timing variables */
 
 /* Total execution */
@@ -61,6 +66,45 @@ XTime t_kernel_start, t_kernel_end;
 
 /************************************************************************/
 
+/**
+ * @brief Starts a simple DMA transfer, tracing its activity on a channel
+ * @param dma DMA instance
+ * @param track Trace track of the channel
+ * @param buffer Buffer address
+ * @param length Transfer length in bytes
+ * @param direction XAXIDMA_DMA_TO_DEVICE or XAXIDMA_DEVICE_TO_DMA
+ * @param obj Index of the tst object being processed
+ * @return XST_SUCCESS on success, XST_FAILURE otherwise
+ */
+static inline int tracedTransfer(XAxiDma *dma, int track, UINTPTR buffer,
+		u32 length, int direction, u32 obj){
+
+	int status;
+
+	KNN_TRACE_BEGIN(trace, KNN_TRACK_CPU0, KNN_TRACE_SUBMIT, obj);
+	status = XAxiDma_SimpleTransfer(dma, buffer, length, direction);
+	KNN_TRACE_END(trace, KNN_TRACK_CPU0, KNN_TRACE_SUBMIT, obj);
+	KNN_TRACE_BEGIN(trace, track, KNN_TRACE_TRANSFER, obj);
+	return status;
+}
+
+/**
+ * @brief Busy-waits for a DMA channel, closing its traced activity
+ * @param dma DMA instance
+ * @param track Trace track of the channel
+ * @param direction XAXIDMA_DMA_TO_DEVICE or XAXIDMA_DEVICE_TO_DMA
+ * @param obj Index of the tst object being processed
+ */
+static inline void tracedWait(XAxiDma *dma, int track, int direction, u32 obj){
+
+	KNN_TRACE_BEGIN(trace, KNN_TRACK_CPU0, KNN_TRACE_BUSY_WAIT, obj);
+	while (XAxiDma_Busy(dma, direction)){}
+	KNN_TRACE_END(trace, track, KNN_TRACE_TRANSFER, obj);
+	KNN_TRACE_END(trace, KNN_TRACK_CPU0, KNN_TRACE_BUSY_WAIT, obj);
+}
+
+/************************************************************************/
+
 /**
  * @brief main program
  * @return XST_SUCCESS on success.
@@ -74,6 +118,13 @@ int main(){
 	/* Start Timer */
 	XTime_GetTime(&t_start);
 
+	/* Start HW performance counters */
+	knnPerfInit();
+
+#ifdef KNN_TRACE_ENABLE
+	trace = knnTraceInit(TRACE_CPU0_BASE_ADDR, TRACE_CAPACITY, 0);
+#endif
+
 	/* Initialise DMA in poll mode for simple transfer */
 	Status = init_XAxiDma_SimplePollMode(DMA_0_DEV_ID, DMA_1_DEV_ID);
 	if (Status != XST_SUCCESS) {
@@ -195,14 +246,15 @@ int XAxiDma_Simple_KNN(u16 device_0_ID, u16 device_1_ID){
 	/* Distance Calculation */
 
 	XTime_GetTime(&t_kernel_start);
+	knnPerfBegin(KNN_PHASE_DISTANCE);
 
 	/* For each object in testing set */
 	for (i = 0; i < NUM_TST_OBJ; i+= 2) {
 
 		/* Send a test object - DMA 0 */
 		tx_buffer_ptr = (float *)&(data_tst[i*FEATURES]);
-		status = XAxiDma_SimpleTransfer(&AxiDma0, (UINTPTR) tx_buffer_ptr,
-				SIZE_FEATURE * FEATURES, XAXIDMA_DMA_TO_DEVICE);
+		status = tracedTransfer(&AxiDma0, KNN_TRACK_DMA0_TX, (UINTPTR) tx_buffer_ptr,
+				SIZE_FEATURE * FEATURES, XAXIDMA_DMA_TO_DEVICE, i);
 		if (status != XST_SUCCESS){
 			xil_printf("DMA0: Failed snd tst obj\n");
 			return XST_FAILURE;
@@ -211,8 +263,8 @@ int XAxiDma_Simple_KNN(u16 device_0_ID, u16 device_1_ID){
 		if ((i+1) < NUM_TST_OBJ){
 			/* Send a test object - DMA 1 */
 			tx_buffer_ptr = (float *)&(data_tst[(i+1)*FEATURES]);
-			status = XAxiDma_SimpleTransfer(&AxiDma1, (UINTPTR) tx_buffer_ptr,
-					SIZE_FEATURE * FEATURES, XAXIDMA_DMA_TO_DEVICE);
+			status = tracedTransfer(&AxiDma1, KNN_TRACK_DMA1_TX, (UINTPTR) tx_buffer_ptr,
+					SIZE_FEATURE * FEATURES, XAXIDMA_DMA_TO_DEVICE, i+1);
 			if (status != XST_SUCCESS){
 				xil_printf("DMA1: Failed snd tst obj\n");
 				return XST_FAILURE;
@@ -220,15 +272,15 @@ int XAxiDma_Simple_KNN(u16 device_0_ID, u16 device_1_ID){
 		}
 
 		/* Wait for TX */
-		while (XAxiDma_Busy(&AxiDma0, XAXIDMA_DMA_TO_DEVICE)){};
+		tracedWait(&AxiDma0, KNN_TRACK_DMA0_TX, XAXIDMA_DMA_TO_DEVICE, i);
 		if ((i+1) < NUM_TST_OBJ){
-			while (XAxiDma_Busy(&AxiDma1, XAXIDMA_DMA_TO_DEVICE)){};
+			tracedWait(&AxiDma1, KNN_TRACK_DMA1_TX, XAXIDMA_DMA_TO_DEVICE, i+1);
 		}
 
 		/* Receive distance buffer - DMA 0 */
 		rx_buffer_ptr = (float *) (distances + i*NUM_TRN_OBJ);
-		status = XAxiDma_SimpleTransfer(&AxiDma0,(UINTPTR) (rx_buffer_ptr),
-				sizeof(float) * NUM_TRN_OBJ , XAXIDMA_DEVICE_TO_DMA);
+		status = tracedTransfer(&AxiDma0, KNN_TRACK_DMA0_RX, (UINTPTR) (rx_buffer_ptr),
+				sizeof(float) * NUM_TRN_OBJ, XAXIDMA_DEVICE_TO_DMA, i);
 		if (status != XST_SUCCESS) {
 			xil_printf("DMA0: Failed rcv dist\n");
 			return XST_FAILURE;
@@ -237,8 +289,8 @@ int XAxiDma_Simple_KNN(u16 device_0_ID, u16 device_1_ID){
 		/* Receive distance buffer - DMA 1 */
 		if ((i+1) < NUM_TST_OBJ){
 			rx_buffer_ptr = (float *) (distances + (i+1)*NUM_TRN_OBJ);
-			status = XAxiDma_SimpleTransfer(&AxiDma1,(UINTPTR) (rx_buffer_ptr),
-					sizeof(float) * NUM_TRN_OBJ , XAXIDMA_DEVICE_TO_DMA);
+			status = tracedTransfer(&AxiDma1, KNN_TRACK_DMA1_RX, (UINTPTR) (rx_buffer_ptr),
+					sizeof(float) * NUM_TRN_OBJ, XAXIDMA_DEVICE_TO_DMA, i+1);
 			if (status != XST_SUCCESS) {
 				xil_printf("DMA1: Failed rcv dist\n");
 				return XST_FAILURE;
@@ -247,9 +299,8 @@ int XAxiDma_Simple_KNN(u16 device_0_ID, u16 device_1_ID){
 
 		/* Send full training set - DMA 0 */
 		tx_buffer_ptr = (float *)data_trn;
-		status = XAxiDma_SimpleTransfer(&AxiDma0, (UINTPTR) tx_buffer_ptr,
-						NUM_TRN_OBJ * SIZE_FEATURE * FEATURES,
-						XAXIDMA_DMA_TO_DEVICE);
+		status = tracedTransfer(&AxiDma0, KNN_TRACK_DMA0_TX, (UINTPTR) tx_buffer_ptr,
+				NUM_TRN_OBJ * SIZE_FEATURE * FEATURES, XAXIDMA_DMA_TO_DEVICE, i);
 	    if (status != XST_SUCCESS) {
 	    	xil_printf("DMA0: Failed snd trn\n");
 	    	return XST_FAILURE;
@@ -257,9 +308,8 @@ int XAxiDma_Simple_KNN(u16 device_0_ID, u16 device_1_ID){
 
 	    if ((i+1) < NUM_TST_OBJ){
 			/* Send full training set - DMA 1 */
-			status = XAxiDma_SimpleTransfer(&AxiDma1, (UINTPTR) tx_buffer_ptr,
-							NUM_TRN_OBJ * SIZE_FEATURE * FEATURES,
-							XAXIDMA_DMA_TO_DEVICE);
+			status = tracedTransfer(&AxiDma1, KNN_TRACK_DMA1_TX, (UINTPTR) tx_buffer_ptr,
+					NUM_TRN_OBJ * SIZE_FEATURE * FEATURES, XAXIDMA_DMA_TO_DEVICE, i+1);
 			if (status != XST_SUCCESS) {
 				xil_printf("DMA1: Failed snd trn\n");
 				return XST_FAILURE;
@@ -267,21 +317,24 @@ int XAxiDma_Simple_KNN(u16 device_0_ID, u16 device_1_ID){
 	    }
 
 	    /* Wait for TX and RX */
-	    while (XAxiDma_Busy(&AxiDma0,XAXIDMA_DMA_TO_DEVICE)){}
-	    while (XAxiDma_Busy(&AxiDma0,XAXIDMA_DEVICE_TO_DMA)){}
+	    tracedWait(&AxiDma0, KNN_TRACK_DMA0_TX, XAXIDMA_DMA_TO_DEVICE, i);
+	    tracedWait(&AxiDma0, KNN_TRACK_DMA0_RX, XAXIDMA_DEVICE_TO_DMA, i);
 	    if ((i+1) < NUM_TST_OBJ){
-			while (XAxiDma_Busy(&AxiDma1,XAXIDMA_DMA_TO_DEVICE)){}
-			while (XAxiDma_Busy(&AxiDma1,XAXIDMA_DEVICE_TO_DMA)){}
+			tracedWait(&AxiDma1, KNN_TRACK_DMA1_TX, XAXIDMA_DMA_TO_DEVICE, i+1);
+			tracedWait(&AxiDma1, KNN_TRACK_DMA1_RX, XAXIDMA_DEVICE_TO_DMA, i+1);
 	    }
 	}
 
+	knnPerfEnd(KNN_PHASE_DISTANCE);
 	XTime_GetTime(&t_kernel_end);
 
 	/************************************************************************/
 
 	// TODO - Sanity Check
+    KNN_TRACE_BEGIN(trace, KNN_TRACK_CPU0, KNN_TRACE_CACHE, 0);
     Xil_DCacheInvalidateRange((INTPTR) (distances),
     		(unsigned)(sizeof(float)) * NUM_TST_OBJ * NUM_TRN_OBJ);
+    KNN_TRACE_END(trace, KNN_TRACK_CPU0, KNN_TRACE_CACHE, 0);
 
     /************************************************************************/
 
@@ -289,7 +342,14 @@ int XAxiDma_Simple_KNN(u16 device_0_ID, u16 device_1_ID){
 
     /* From the distance matrix assign labels to testing objects */
 	for (i = 0; i < NUM_TST_OBJ; i++){
+		KNN_TRACE_BEGIN(trace, KNN_TRACK_CPU0, KNN_TRACE_SELECTION, i);
+		knnPerfBegin(KNN_PHASE_SELECTION);
 		selectionSortK((float *)(&distances[i*NUM_TRN_OBJ]), closest, NUM_TRN_OBJ, K);
+		knnPerfEnd(KNN_PHASE_SELECTION);
+		KNN_TRACE_END(trace, KNN_TRACK_CPU0, KNN_TRACE_SELECTION, i);
+
+		KNN_TRACE_BEGIN(trace, KNN_TRACK_CPU0, KNN_TRACE_VOTING, i);
+		knnPerfBegin(KNN_PHASE_VOTING);
 		for (j = 0; j < CLASSES; j++){
 			votes[j] = 0;
 		}
@@ -308,6 +368,8 @@ int XAxiDma_Simple_KNN(u16 device_0_ID, u16 device_1_ID){
 			}
 		}
 		label_prediction[i] = assigned_label;
+		knnPerfEnd(KNN_PHASE_VOTING);
+		KNN_TRACE_END(trace, KNN_TRACK_CPU0, KNN_TRACE_VOTING, i);
 	}
 
 	/************************************************************************/
@@ -333,6 +395,13 @@ int XAxiDma_Simple_KNN(u16 device_0_ID, u16 device_1_ID){
 			(int) (1.0 * (t_kernel_end - t_kernel_start) / (COUNTS_PER_SECOND/1000000)),
 			(int) (1.0 * (t_end - t_start) / (COUNTS_PER_SECOND/1000000))
 	);
+
+	knnPerfReport((u64) NUM_TST_OBJ * NUM_TRN_OBJ);
+
+#ifdef KNN_TRACE_ENABLE
+	xil_printf("\nCPU0: Chrome trace\n");
+	knnTraceExport(stdout, &trace, 1);
+#endif
 	return XST_SUCCESS;
 }
 
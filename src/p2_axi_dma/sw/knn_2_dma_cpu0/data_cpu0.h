@@ -107,3 +107,16 @@ char label_strings[CLASSES][100] = {
 #define END_CLASS_0 24
 /** CPU1 has ended classification */
 #define END_CLASS_1 25
+
+/************************************************************************/
+
+/* Tracing */
+
+/** Record a Chrome trace timeline of the run, printed at the end */
+//#define KNN_TRACE_ENABLE 1
+/** Events held by each core trace ring buffer (power of 2) */
+#define TRACE_CAPACITY 65536
+/** Base address of the CPU0 trace ring buffer */
+#define TRACE_CPU0_BASE_ADDR 	(void *)	0x01C000000
+/** Base address of the CPU1 trace ring buffer */
+#define TRACE_CPU1_BASE_ADDR 	(void *)	0x01C200000
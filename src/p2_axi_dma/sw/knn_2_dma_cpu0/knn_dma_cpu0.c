@@ -22,6 +22,7 @@
 #include "xil_cache_l.h"
 
 #include "data_cpu0.h"
+#include "knn_trace.h"
 
 /************************************************************************/
 
@@ -52,6 +53,9 @@ void selectionSortK(float *distances, int *smallest, int size, int k);
 /** Global AXI DMA instance */
 XAxiDma AxiDma0, AxiDma1;
 
+/** CPU0 trace ring buffer */
+KnnTraceBuffer *trace;
+
 /** Global Sync Semaphore */
 volatile int *sync = SEM_ADDR;
 
@@ -64,6 +68,45 @@ XTime t_kernel_start, t_kernel_end;
 
 /************************************************************************/
 
+/**
+ * @brief Starts a simple DMA transfer, tracing its activity on a channel
+ * @param dma DMA instance
+ * @param track Trace track of the channel
+ * @param buffer Buffer address
+ * @param length Transfer length in bytes
+ * @param direction XAXIDMA_DMA_TO_DEVICE or XAXIDMA_DEVICE_TO_DMA
+ * @param obj Index of the tst object being processed
+ * @return XST_SUCCESS on success, XST_FAILURE otherwise
+ */
+static inline int tracedTransfer(XAxiDma *dma, int track, UINTPTR buffer,
+		u32 length, int direction, u32 obj){
+
+	int status;
+
+	KNN_TRACE_BEGIN(trace, KNN_TRACK_CPU0, KNN_TRACE_SUBMIT, obj);
+	status = XAxiDma_SimpleTransfer(dma, buffer, length, direction);
+	KNN_TRACE_END(trace, KNN_TRACK_CPU0, KNN_TRACE_SUBMIT, obj);
+	KNN_TRACE_BEGIN(trace, track, KNN_TRACE_TRANSFER, obj);
+	return status;
+}
+
+/**
+ * @brief Busy-waits for a DMA channel, closing its traced activity
+ * @param dma DMA instance
+ * @param track Trace track of the channel
+ * @param direction XAXIDMA_DMA_TO_DEVICE or XAXIDMA_DEVICE_TO_DMA
+ * @param obj Index of the tst object being processed
+ */
+static inline void tracedWait(XAxiDma *dma, int track, int direction, u32 obj){
+
+	KNN_TRACE_BEGIN(trace, KNN_TRACK_CPU0, KNN_TRACE_BUSY_WAIT, obj);
+	while (XAxiDma_Busy(dma, direction)){}
+	KNN_TRACE_END(trace, track, KNN_TRACE_TRANSFER, obj);
+	KNN_TRACE_END(trace, KNN_TRACK_CPU0, KNN_TRACE_BUSY_WAIT, obj);
+}
+
+/************************************************************************/
+
 /**
  * @brief main program
  * @return XST_SUCCESS on success.
@@ -79,8 +122,14 @@ int main(){
 	/* Disable cache on OCM region */
 	Xil_SetTlbAttributes(0xFFFF0000, 0x14de2);
 
+#ifdef KNN_TRACE_ENABLE
+	trace = knnTraceInit(TRACE_CPU0_BASE_ADDR, TRACE_CAPACITY, 0);
+#endif
+
+	KNN_TRACE_BEGIN(trace, KNN_TRACK_CPU0, KNN_TRACE_BARRIER, START_1);
 	*sync = START_0;
 	while (*sync != START_1){};
+	KNN_TRACE_END(trace, KNN_TRACK_CPU0, KNN_TRACE_BARRIER, START_1);
 
 	xil_printf("CPU0: SYNC\n");
 
@@ -219,8 +268,8 @@ int XAxiDma_Simple_KNN(u16 device_0_ID, u16 device_1_ID){
 
 		/* Send a test object - DMA 0 */
 		tx_buffer_ptr = (float *)&(data_tst[i*FEATURES]);
-		status = XAxiDma_SimpleTransfer(&AxiDma0, (UINTPTR) tx_buffer_ptr,
-				SIZE_FEATURE * FEATURES, XAXIDMA_DMA_TO_DEVICE);
+		status = tracedTransfer(&AxiDma0, KNN_TRACK_DMA0_TX, (UINTPTR) tx_buffer_ptr,
+				SIZE_FEATURE * FEATURES, XAXIDMA_DMA_TO_DEVICE, i);
 		if (status != XST_SUCCESS){
 			xil_printf("DMA0: Failed snd tst obj\n");
 			return XST_FAILURE;
@@ -229,8 +278,8 @@ int XAxiDma_Simple_KNN(u16 device_0_ID, u16 device_1_ID){
 		if ((i+1) <= LAST_CPU0){
 			/* Send a test object - DMA 1 */
 			tx_buffer_ptr = (float *)&(data_tst[(i+1)*FEATURES]);
-			status = XAxiDma_SimpleTransfer(&AxiDma1, (UINTPTR) tx_buffer_ptr,
-					SIZE_FEATURE * FEATURES, XAXIDMA_DMA_TO_DEVICE);
+			status = tracedTransfer(&AxiDma1, KNN_TRACK_DMA1_TX, (UINTPTR) tx_buffer_ptr,
+					SIZE_FEATURE * FEATURES, XAXIDMA_DMA_TO_DEVICE, i+1);
 			if (status != XST_SUCCESS){
 				xil_printf("DMA1: Failed snd tst obj\n");
 				return XST_FAILURE;
@@ -238,15 +287,15 @@ int XAxiDma_Simple_KNN(u16 device_0_ID, u16 device_1_ID){
 		}
 
 		/* Wait for TX */
-		while (XAxiDma_Busy(&AxiDma0, XAXIDMA_DMA_TO_DEVICE)){};
+		tracedWait(&AxiDma0, KNN_TRACK_DMA0_TX, XAXIDMA_DMA_TO_DEVICE, i);
 		if ((i+1) <= LAST_CPU0){
-			while (XAxiDma_Busy(&AxiDma1, XAXIDMA_DMA_TO_DEVICE)){};
+			tracedWait(&AxiDma1, KNN_TRACK_DMA1_TX, XAXIDMA_DMA_TO_DEVICE, i+1);
 		}
 
 		/* Receive distance buffer - DMA 0 */
 		rx_buffer_ptr = (float *) (distances + i*NUM_TRN_OBJ);
-		status = XAxiDma_SimpleTransfer(&AxiDma0,(UINTPTR) (rx_buffer_ptr),
-				sizeof(float) * NUM_TRN_OBJ , XAXIDMA_DEVICE_TO_DMA);
+		status = tracedTransfer(&AxiDma0, KNN_TRACK_DMA0_RX, (UINTPTR) (rx_buffer_ptr),
+				sizeof(float) * NUM_TRN_OBJ, XAXIDMA_DEVICE_TO_DMA, i);
 		if (status != XST_SUCCESS) {
 			xil_printf("DMA0: Failed rcv dist\n");
 			return XST_FAILURE;
@@ -255,8 +304,8 @@ int XAxiDma_Simple_KNN(u16 device_0_ID, u16 device_1_ID){
 		/* Receive distance buffer - DMA 1 */
 		if ((i+1) <= LAST_CPU0){
 			rx_buffer_ptr = (float *) (distances + (i+1)*NUM_TRN_OBJ);
-			status = XAxiDma_SimpleTransfer(&AxiDma1,(UINTPTR) (rx_buffer_ptr),
-					sizeof(float) * NUM_TRN_OBJ , XAXIDMA_DEVICE_TO_DMA);
+			status = tracedTransfer(&AxiDma1, KNN_TRACK_DMA1_RX, (UINTPTR) (rx_buffer_ptr),
+					sizeof(float) * NUM_TRN_OBJ, XAXIDMA_DEVICE_TO_DMA, i+1);
 			if (status != XST_SUCCESS) {
 				xil_printf("DMA1: Failed rcv dist\n");
 				return XST_FAILURE;
@@ -265,9 +314,8 @@ int XAxiDma_Simple_KNN(u16 device_0_ID, u16 device_1_ID){
 
 		/* Send full training set - DMA 0 */
 		tx_buffer_ptr = (float *)data_trn;
-		status = XAxiDma_SimpleTransfer(&AxiDma0, (UINTPTR) tx_buffer_ptr,
-						NUM_TRN_OBJ * SIZE_FEATURE * FEATURES,
-						XAXIDMA_DMA_TO_DEVICE);
+		status = tracedTransfer(&AxiDma0, KNN_TRACK_DMA0_TX, (UINTPTR) tx_buffer_ptr,
+				NUM_TRN_OBJ * SIZE_FEATURE * FEATURES, XAXIDMA_DMA_TO_DEVICE, i);
 	    if (status != XST_SUCCESS) {
 	    	xil_printf("DMA0: Failed snd trn\n");
 	    	return XST_FAILURE;
@@ -275,9 +323,8 @@ int XAxiDma_Simple_KNN(u16 device_0_ID, u16 device_1_ID){
 
 	    if ((i+1) <= LAST_CPU0){
 			/* Send full training set - DMA 1 */
-			status = XAxiDma_SimpleTransfer(&AxiDma1, (UINTPTR) tx_buffer_ptr,
-							NUM_TRN_OBJ * SIZE_FEATURE * FEATURES,
-							XAXIDMA_DMA_TO_DEVICE);
+			status = tracedTransfer(&AxiDma1, KNN_TRACK_DMA1_TX, (UINTPTR) tx_buffer_ptr,
+					NUM_TRN_OBJ * SIZE_FEATURE * FEATURES, XAXIDMA_DMA_TO_DEVICE, i+1);
 			if (status != XST_SUCCESS) {
 				xil_printf("DMA1: Failed snd trn\n");
 				return XST_FAILURE;
@@ -285,28 +332,32 @@ int XAxiDma_Simple_KNN(u16 device_0_ID, u16 device_1_ID){
 	    }
 
 	    /* Wait for TX and RX */
-	    while (XAxiDma_Busy(&AxiDma0,XAXIDMA_DMA_TO_DEVICE)){}
-	    while (XAxiDma_Busy(&AxiDma0,XAXIDMA_DEVICE_TO_DMA)){}
+	    tracedWait(&AxiDma0, KNN_TRACK_DMA0_TX, XAXIDMA_DMA_TO_DEVICE, i);
+	    tracedWait(&AxiDma0, KNN_TRACK_DMA0_RX, XAXIDMA_DEVICE_TO_DMA, i);
 	    if ((i+1) <= LAST_CPU0){
-			while (XAxiDma_Busy(&AxiDma1,XAXIDMA_DMA_TO_DEVICE)){}
-			while (XAxiDma_Busy(&AxiDma1,XAXIDMA_DEVICE_TO_DMA)){}
+			tracedWait(&AxiDma1, KNN_TRACK_DMA1_TX, XAXIDMA_DMA_TO_DEVICE, i+1);
+			tracedWait(&AxiDma1, KNN_TRACK_DMA1_RX, XAXIDMA_DEVICE_TO_DMA, i+1);
 	    }
 	}
 
 	/************************************************************************/
 
 	/* Synchronisation */
+	KNN_TRACE_BEGIN(trace, KNN_TRACK_CPU0, KNN_TRACE_BARRIER, END_DIST_1);
 	*sync = END_DIST_0;
 	/* Wait for CPU1 to finish calculations */
 	while(*sync != END_DIST_1){}
+	KNN_TRACE_END(trace, KNN_TRACK_CPU0, KNN_TRACE_BARRIER, END_DIST_1);
 
 	XTime_GetTime(&t_kernel_end);
 
 	// TODO - DEBUG
 	//xil_printf("CPU0: CPU1 finished dist\n");
 
+    KNN_TRACE_BEGIN(trace, KNN_TRACK_CPU0, KNN_TRACE_CACHE, 0);
     Xil_DCacheInvalidateRange((INTPTR) (distances),
     		(unsigned)(sizeof(float)) * NUM_TST_OBJ * NUM_TRN_OBJ);
+    KNN_TRACE_END(trace, KNN_TRACK_CPU0, KNN_TRACE_CACHE, 0);
 
     /************************************************************************/
 
@@ -314,7 +365,11 @@ int XAxiDma_Simple_KNN(u16 device_0_ID, u16 device_1_ID){
 
     /* From the distance matrix assign labels to testing objects */
 	for (i = FIRST_CPU0_CLASS; i <= LAST_CPU0_CLASS; i++){
+		KNN_TRACE_BEGIN(trace, KNN_TRACK_CPU0, KNN_TRACE_SELECTION, i);
 		selectionSortK((float *)(&distances[i*NUM_TRN_OBJ]), closest, NUM_TRN_OBJ, K);
+		KNN_TRACE_END(trace, KNN_TRACK_CPU0, KNN_TRACE_SELECTION, i);
+
+		KNN_TRACE_BEGIN(trace, KNN_TRACK_CPU0, KNN_TRACE_VOTING, i);
 		for (j = 0; j < CLASSES; j++){
 			votes[j] = 0;
 		}
@@ -333,20 +388,25 @@ int XAxiDma_Simple_KNN(u16 device_0_ID, u16 device_1_ID){
 			}
 		}
 		label_prediction[i] = assigned_label;
+		KNN_TRACE_END(trace, KNN_TRACK_CPU0, KNN_TRACE_VOTING, i);
 	}
 
 	/************************************************************************/
 
 	/* Synchronisation */
 
+	KNN_TRACE_BEGIN(trace, KNN_TRACK_CPU0, KNN_TRACE_BARRIER, END_CLASS_1);
 	*sync = END_CLASS_0;
 	while(*sync != END_CLASS_1){}
+	KNN_TRACE_END(trace, KNN_TRACK_CPU0, KNN_TRACE_BARRIER, END_CLASS_1);
 
 	// TODO - DEBUG
 	//xil_printf("CPU0: CPU1 has finished\n");
 
+	KNN_TRACE_BEGIN(trace, KNN_TRACK_CPU0, KNN_TRACE_CACHE, 0);
 	Xil_DCacheInvalidateRange((INTPTR) (label_prediction),
 		    	(unsigned)(sizeof(int) * NUM_TST_OBJ));
+	KNN_TRACE_END(trace, KNN_TRACK_CPU0, KNN_TRACE_CACHE, 0);
 
 	/************************************************************************/
 
@@ -371,6 +431,20 @@ int XAxiDma_Simple_KNN(u16 device_0_ID, u16 device_1_ID){
 			(int) (1.0 * (t_kernel_end - t_kernel_start) / (COUNTS_PER_SECOND/1000000)),
 			(int) (1.0 * (t_end - t_start) / (COUNTS_PER_SECOND/1000000))
 	);
+
+#ifdef KNN_TRACE_ENABLE
+	/* CPU1 flushed its ring buffer before signalling END_CLASS_1 */
+	{
+		KnnTraceBuffer *buffers[2];
+
+		buffers[0] = trace;
+		buffers[1] = (KnnTraceBuffer *) TRACE_CPU1_BASE_ADDR;
+		Xil_DCacheInvalidateRange((INTPTR) buffers[1],
+				KNN_TRACE_BUFFER_SIZE(TRACE_CAPACITY));
+		xil_printf("\nCPU0: Chrome trace\n");
+		knnTraceExport(stdout, buffers, 2);
+	}
+#endif
 	return XST_SUCCESS;
 }
 
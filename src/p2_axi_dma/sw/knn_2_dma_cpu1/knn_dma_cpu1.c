@@ -21,6 +21,7 @@
 #include "xil_cache_l.h"
 
 #include "data_cpu1.h"
+#include "knn_trace.h"
 
 /************************************************************************/
 
@@ -46,6 +47,9 @@ void selectionSortK(float *distances, int *smallest, int size, int k);
 /** Global Sync Semaphore */
 volatile int *sync = SEM_ADDR;
 
+/** CPU1 trace ring buffer */
+KnnTraceBuffer *trace;
+
 /************************************************************************/
 
 /**
@@ -67,8 +71,14 @@ int main(int argc, char** argv){
 	/* Disable cache on OCM region */
 	Xil_SetTlbAttributes(0xFFFF0000, 0x14de2);
 
+#ifdef KNN_TRACE_ENABLE
+	trace = knnTraceInit(TRACE_CPU1_BASE_ADDR, TRACE_CAPACITY, 0);
+#endif
+
+	KNN_TRACE_BEGIN(trace, KNN_TRACK_CPU1, KNN_TRACE_BARRIER, START_0);
 	while (*sync != START_0){};
 	*sync = START_1;
+	KNN_TRACE_END(trace, KNN_TRACK_CPU1, KNN_TRACE_BARRIER, START_0);
 
 	XTime_GetTime(&t_start);
 
@@ -88,30 +98,38 @@ int main(int argc, char** argv){
 
     /* For object in testing set */
     for (i = FIRST_CPU1; i <= LAST_CPU1; i++){
+    	KNN_TRACE_BEGIN(trace, KNN_TRACK_CPU1, KNN_TRACE_DISTANCE, i);
     	/* For object in training set */
     	for (j = 0; j < NUM_TRN_OBJ; j++){
     		distances[i*NUM_TRN_OBJ + j] = euclideanDistance(&(data_tst[i*FEATURES]), &(data_trn[j*FEATURES]), FEATURES);
         }
+    	KNN_TRACE_END(trace, KNN_TRACK_CPU1, KNN_TRACE_DISTANCE, i);
     }
 
     XTime_GetTime(&t_kernel_end);
 
     /************************************************************************/
 
+    KNN_TRACE_BEGIN(trace, KNN_TRACK_CPU1, KNN_TRACE_CACHE, 0);
     Xil_DCacheFlushRange((INTPTR) (distances),
         		(unsigned)(sizeof(float)) * NUM_TST_OBJ * NUM_TRN_OBJ);
+    KNN_TRACE_END(trace, KNN_TRACK_CPU1, KNN_TRACE_CACHE, 0);
 
     /* Synchronisation */
 
     /* Notify CPU0 that distance calculations are done */
+    KNN_TRACE_BEGIN(trace, KNN_TRACK_CPU1, KNN_TRACE_BARRIER, END_DIST_0);
     while(*sync != END_DIST_0){}
     *sync = END_DIST_1;
+    KNN_TRACE_END(trace, KNN_TRACK_CPU1, KNN_TRACE_BARRIER, END_DIST_0);
 
     /************************************************************************/
 
     /* Classification */
+    KNN_TRACE_BEGIN(trace, KNN_TRACK_CPU1, KNN_TRACE_CACHE, 0);
     Xil_DCacheInvalidateRange((INTPTR) (distances),
     		(unsigned)(sizeof(float)) * NUM_TST_OBJ * NUM_TRN_OBJ);
+    KNN_TRACE_END(trace, KNN_TRACK_CPU1, KNN_TRACE_CACHE, 0);
 
 	/** Occurrence of a given class */
 	int vote = 0;
@@ -126,7 +144,11 @@ int main(int argc, char** argv){
 
     /* From the distance matrix assign labels to testing objects */
 	for (i = FIRST_CPU1_CLASS; i <= LAST_CPU1_CLASS; i++){
+		KNN_TRACE_BEGIN(trace, KNN_TRACK_CPU1, KNN_TRACE_SELECTION, i);
 		selectionSortK((float *)(&distances[i*NUM_TRN_OBJ]), closest, NUM_TRN_OBJ, K);
+		KNN_TRACE_END(trace, KNN_TRACK_CPU1, KNN_TRACE_SELECTION, i);
+
+		KNN_TRACE_BEGIN(trace, KNN_TRACK_CPU1, KNN_TRACE_VOTING, i);
 		for (j = 0; j < CLASSES; j++){
 			votes[j] = 0;
 		}
@@ -145,17 +167,26 @@ int main(int argc, char** argv){
 			}
 		}
 		label_prediction[i] = assigned_label;
+		KNN_TRACE_END(trace, KNN_TRACK_CPU1, KNN_TRACE_VOTING, i);
 	}
 
     /************************************************************************/
 
     /* Synchronisation */
 
+	 KNN_TRACE_BEGIN(trace, KNN_TRACK_CPU1, KNN_TRACE_CACHE, 0);
 	 Xil_DCacheFlushRange((INTPTR) (label_prediction),
 			 (unsigned)(sizeof(int) * NUM_TST_OBJ));
+	 KNN_TRACE_END(trace, KNN_TRACK_CPU1, KNN_TRACE_CACHE, 0);
 
     /* Notify CPU0 that distance calculations are done */
+    KNN_TRACE_BEGIN(trace, KNN_TRACK_CPU1, KNN_TRACE_BARRIER, END_CLASS_0);
     while(*sync != END_CLASS_0){}
+#ifdef KNN_TRACE_ENABLE
+    /* Close the barrier and publish the ring buffer before CPU0 exports it */
+    KNN_TRACE_END(trace, KNN_TRACK_CPU1, KNN_TRACE_BARRIER, END_CLASS_0);
+    Xil_DCacheFlushRange((INTPTR) trace, KNN_TRACE_BUFFER_SIZE(TRACE_CAPACITY));
+#endif
     *sync = END_CLASS_1;
 
     /************************************************************************/
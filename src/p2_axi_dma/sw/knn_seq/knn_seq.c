@@ -18,6 +18,7 @@
 #include "xil_cache_l.h"
 
 #include "data_seq.h"
+#include "knn_perf.h"
 
 /************************************************************************/
 
@@ -52,6 +53,9 @@ int main(int argc, char** argv){
 
 	XTime_GetTime(&t_start);
 
+	/* Start HW performance counters */
+	knnPerfInit();
+
 	/** Output distance matrix */
 	float *distances = OUT_DIST_BASE_ADDR;
 
@@ -68,6 +72,7 @@ int main(int argc, char** argv){
     /* Calculate distance matrix */
 
     XTime_GetTime(&t_kernel_start);
+    knnPerfBegin(KNN_PHASE_DISTANCE);
 
     /* For object in testing set */
     for (i = 0; i < NUM_TST_OBJ; i++){
@@ -77,6 +82,7 @@ int main(int argc, char** argv){
         }
     }
 
+    knnPerfEnd(KNN_PHASE_DISTANCE);
     XTime_GetTime(&t_kernel_end);
 
     /************************************************************************/
@@ -98,7 +104,11 @@ int main(int argc, char** argv){
 
     /* From the distance matrix assign labels to testing objects */
 	for (i = 0; i < NUM_TST_OBJ ; i++){
+		knnPerfBegin(KNN_PHASE_SELECTION);
 		selectionSortK((float *)(&distances[i*NUM_TRN_OBJ]), closest, NUM_TRN_OBJ, K);
+		knnPerfEnd(KNN_PHASE_SELECTION);
+
+		knnPerfBegin(KNN_PHASE_VOTING);
 		for (j = 0; j < CLASSES; j++){
 			votes[j] = 0;
 		}
@@ -117,6 +127,7 @@ int main(int argc, char** argv){
 			}
 		}
 		label_prediction[i] = assigned_label;
+		knnPerfEnd(KNN_PHASE_VOTING);
 	}
 
 	/************************************************************************/
@@ -143,6 +154,8 @@ int main(int argc, char** argv){
 				(int) (1.0 * (t_end - t_start) / (COUNTS_PER_SECOND/1000000))
 		);
 
+	knnPerfReport((u64) NUM_TST_OBJ * NUM_TRN_OBJ);
+
     return 0;
 }
 
@@ -0,0 +1,399 @@
+/*
+ * @file knn_module.c
+ * @brief CPython bindings of the context API (knn_context.h)
+ *
+ * knn.Classifier(data, labels, k, classes, block=0, threads=0) builds a
+ * context from any C-contiguous buffer: a float32 array of shape
+ * (num_obj, features) and an int32 array of num_obj labels, e.g. NumPy
+ * arrays. classify(queries, out_labels, out_indices=None,
+ * out_distances=None) reads the queries in place and writes the labels,
+ * and optionally the K neighbours of each query, straight into the
+ * caller's preallocated arrays; nothing is copied or converted.
+ *
+ * The GIL is released while the context is built and while a batch is
+ * classified. A batch is split across the worker threads, each with its
+ * own scratch buffer, allocated with the classifier; a lock serializes
+ * concurrent classify() calls on the same classifier.
+ *
+ *     clf = knn.Classifier(trn, trn_labels, 7, 2)
+ *     labels = numpy.empty(len(tst), dtype=numpy.int32)
+ *     clf.classify(tst, labels)
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <structmember.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "knn_context.h"
+
+/** Queries classified per knnClassifyBatch call */
+#define MODULE_CHUNK 256
+/** Smallest batch share worth a thread */
+#define MODULE_MIN_SHARE 64
+
+/** @brief Python classifier object */
+typedef struct ClassifierObject_Struct{
+    PyObject_HEAD
+    KnnContext *ctx;            /**< Context, read-only */
+    int num_obj;                /**< Training objects */
+    int features;               /**< Feature dimensionality */
+    int k;                      /**< Number of neighbours */
+    int classes;                /**< Number of classes */
+    int threads;                /**< Worker threads */
+    void **scratch;             /**< Scratch buffer of each worker */
+    DistIndexPair **lists;      /**< Neighbour chunk of each worker (MODULE_CHUNK x k) */
+    pthread_mutex_t lock;       /**< Serializes classify() calls */
+}ClassifierObject;
+
+/** @brief Share of a batch handed to one worker */
+typedef struct ClassifyTask_Struct{
+    ClassifierObject *clf;      /**< Classifier */
+    int worker;                 /**< Worker number, selects the scratch */
+    const float *queries;       /**< Batch queries */
+    int first;                  /**< First query of the share */
+    int last;                   /**< One past the last query */
+    int *labels;                /**< Output labels of the batch */
+    int *indices;               /**< Output indices of the batch, may be NULL */
+    float *distances;           /**< Output distances of the batch, may be NULL */
+}ClassifyTask;
+
+/************************************************************************/
+
+/**
+ * @brief Gets a C-contiguous buffer of 4-byte items of one kind
+ *
+ * @param obj Object exporting the buffer
+ * @param view Output view, release with PyBuffer_Release
+ * @param kind 'f' for float32, 'i' for int32
+ * @param ndim Required number of dimensions
+ * @param writable Request a writable buffer
+ * @param name Argument name for error messages
+ * @return 0 on success, -1 with a Python exception set.
+ */
+static int moduleGetBuffer(PyObject *obj, Py_buffer *view, char kind, int ndim,
+        int writable, const char *name){
+
+    const char *fmt;
+
+    if (PyObject_GetBuffer(obj, view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT |
+            (writable ? PyBUF_WRITABLE : 0)) != 0){
+        return -1;
+    }
+    fmt = view->format ? view->format : "B";
+    if (*fmt == '<' || *fmt == '=' || *fmt == '@'){
+        fmt++;
+    }
+    if (view->itemsize != 4 || fmt[1] != '\0' ||
+        (kind == 'f' && fmt[0] != 'f') ||
+        (kind == 'i' && fmt[0] != 'i' && !(fmt[0] == 'l' && sizeof(long) == 4))){
+        PyErr_Format(PyExc_TypeError, "%s must be %s", name,
+                kind == 'f' ? "float32" : "int32");
+        PyBuffer_Release(view);
+        return -1;
+    }
+    if (view->ndim != ndim){
+        PyErr_Format(PyExc_ValueError, "%s must have %d dimension%s", name, ndim,
+                ndim > 1 ? "s" : "");
+        PyBuffer_Release(view);
+        return -1;
+    }
+    return 0;
+}
+
+/** @brief Classifies one share of a batch, MODULE_CHUNK queries at a time */
+static void *classifyWorker(void *arg){
+
+    ClassifyTask *task = arg;
+    ClassifierObject *clf = task->clf;
+    DistIndexPair *list = clf->lists[task->worker];
+    int i, j, n, want = task->indices != NULL || task->distances != NULL;
+
+    for (i = task->first; i < task->last; i += n){
+        n = (task->last - i < MODULE_CHUNK) ? task->last - i : MODULE_CHUNK;
+        knnClassifyBatch(clf->ctx, clf->scratch[task->worker],
+                &(task->queries[(size_t) i * clf->features]), n, &(task->labels[i]),
+                want ? list : NULL);
+        for (j = 0; want && j < n * clf->k; j++){
+            if (task->indices != NULL){
+                task->indices[(size_t) i * clf->k + j] = list[j].index;
+            }
+            if (task->distances != NULL){
+                task->distances[(size_t) i * clf->k + j] = list[j].distance;
+            }
+        }
+    }
+    return NULL;
+}
+
+/************************************************************************/
+
+/** @brief Classifier.__init__ */
+static int classifierInit(ClassifierObject *self, PyObject *args, PyObject *kwds){
+
+    static char *kwlist[] = { "data", "labels", "k", "classes", "block", "threads", NULL };
+    PyObject *data_obj, *labels_obj;
+    Py_buffer data, labels;
+    KnnTrainSet train;
+    KnnOptions opts;
+    int t, status, threads = 0;
+
+    opts.block = 0;
+    if (self->ctx != NULL){
+        PyErr_SetString(PyExc_RuntimeError, "Classifier already initialized");
+        return -1;
+    }
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OOii|ii", kwlist, &data_obj,
+            &labels_obj, &opts.k, &opts.classes, &opts.block, &threads)){
+        return -1;
+    }
+    if (moduleGetBuffer(data_obj, &data, 'f', 2, 0, "data") != 0){
+        return -1;
+    }
+    if (moduleGetBuffer(labels_obj, &labels, 'i', 1, 0, "labels") != 0){
+        PyBuffer_Release(&data);
+        return -1;
+    }
+    if (labels.shape[0] != data.shape[0] || data.shape[0] > INT_MAX || data.shape[1] > INT_MAX){
+        PyErr_SetString(PyExc_ValueError, "data and labels must have the same number of objects");
+        PyBuffer_Release(&data);
+        PyBuffer_Release(&labels);
+        return -1;
+    }
+
+    train.data = data.buf;
+    train.labels = labels.buf;
+    train.num_obj = (int) data.shape[0];
+    train.features = (int) data.shape[1];
+    Py_BEGIN_ALLOW_THREADS
+    status = knnContextCreate(&train, &opts, &self->ctx);
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&data);
+    PyBuffer_Release(&labels);
+    if (status != 0){
+        self->ctx = NULL;
+        PyErr_SetString(PyExc_ValueError, "invalid training set or options "
+                "(k in 1..num_obj, labels in 0..classes-1, block 0, 8 or 16)");
+        return -1;
+    }
+
+    self->num_obj = train.num_obj;
+    self->features = train.features;
+    self->k = opts.k;
+    self->classes = opts.classes;
+    self->threads = (threads > 0) ? threads : (int) sysconf(_SC_NPROCESSORS_ONLN);
+    self->threads = (self->threads > 0) ? self->threads : 1;
+    self->scratch = PyMem_Calloc(self->threads, sizeof(void *));
+    self->lists = PyMem_Calloc(self->threads, sizeof(DistIndexPair *));
+    if (self->scratch == NULL || self->lists == NULL){
+        PyErr_NoMemory();
+        return -1;
+    }
+    for (t = 0; t < self->threads; t++){
+        self->scratch[t] = PyMem_Malloc(knnScratchSize(self->ctx));
+        self->lists[t] = PyMem_Malloc(sizeof(DistIndexPair) * MODULE_CHUNK * self->k);
+        if (self->scratch[t] == NULL || self->lists[t] == NULL){
+            PyErr_NoMemory();
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/** @brief Classifier deallocation */
+static void classifierDealloc(ClassifierObject *self){
+
+    int t;
+
+    for (t = 0; t < self->threads; t++){
+        if (self->scratch != NULL){
+            PyMem_Free(self->scratch[t]);
+        }
+        if (self->lists != NULL){
+            PyMem_Free(self->lists[t]);
+        }
+    }
+    PyMem_Free(self->scratch);
+    PyMem_Free(self->lists);
+    knnContextDestroy(self->ctx);
+    pthread_mutex_destroy(&self->lock);
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+/** @brief Classifier allocation */
+static PyObject *classifierNew(PyTypeObject *type, PyObject *args, PyObject *kwds){
+
+    ClassifierObject *self = (ClassifierObject *) type->tp_alloc(type, 0);
+
+    (void) args; (void) kwds;
+    if (self != NULL){
+        pthread_mutex_init(&self->lock, NULL);
+    }
+    return (PyObject *) self;
+}
+
+/** @brief Classifier.classify */
+static PyObject *classifierClassify(ClassifierObject *self, PyObject *args, PyObject *kwds){
+
+    static char *kwlist[] = { "queries", "out_labels", "out_indices", "out_distances", NULL };
+    PyObject *q_obj, *l_obj, *i_obj = Py_None, *d_obj = Py_None;
+    Py_buffer q, l, ix, dx;
+    ClassifyTask *tasks;
+    pthread_t *workers;
+    int t, n, share, threads, started, ok = 0;
+
+    if (self->ctx == NULL){
+        PyErr_SetString(PyExc_RuntimeError, "Classifier not initialized");
+        return NULL;
+    }
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OO|OO", kwlist, &q_obj, &l_obj,
+            &i_obj, &d_obj)){
+        return NULL;
+    }
+    ix.obj = NULL;
+    dx.obj = NULL;
+    if (moduleGetBuffer(q_obj, &q, 'f', 2, 0, "queries") != 0){
+        return NULL;
+    }
+    if (moduleGetBuffer(l_obj, &l, 'i', 1, 1, "out_labels") != 0){
+        PyBuffer_Release(&q);
+        return NULL;
+    }
+    if ((i_obj == Py_None || moduleGetBuffer(i_obj, &ix, 'i', 2, 1, "out_indices") == 0) &&
+        (d_obj == Py_None || moduleGetBuffer(d_obj, &dx, 'f', 2, 1, "out_distances") == 0)){
+        ok = 1;
+    }
+    if (ok && (q.shape[1] != self->features || q.shape[0] > INT_MAX || l.shape[0] != q.shape[0] ||
+        (ix.obj != NULL && (ix.shape[0] != q.shape[0] || ix.shape[1] != self->k)) ||
+        (dx.obj != NULL && (dx.shape[0] != q.shape[0] || dx.shape[1] != self->k)))){
+        PyErr_Format(PyExc_ValueError, "expected queries (n, %d), out_labels (n,) and "
+                "out_indices / out_distances (n, %d)", self->features, self->k);
+        ok = 0;
+    }
+
+    if (ok){
+        n = (int) q.shape[0];
+        threads = (n / MODULE_MIN_SHARE < self->threads) ? n / MODULE_MIN_SHARE : self->threads;
+        threads = (threads > 0) ? threads : 1;
+        share = (n + threads - 1) / threads;
+        tasks = PyMem_Malloc(sizeof(ClassifyTask) * threads);
+        workers = PyMem_Malloc(sizeof(pthread_t) * threads);
+        if (tasks == NULL || workers == NULL){
+            PyErr_NoMemory();
+            ok = 0;
+        } else {
+            for (t = 0; t < threads; t++){
+                tasks[t].clf = self;
+                tasks[t].worker = t;
+                tasks[t].queries = q.buf;
+                tasks[t].first = (t * share < n) ? t * share : n;
+                tasks[t].last = ((t + 1) * share < n) ? (t + 1) * share : n;
+                tasks[t].labels = l.buf;
+                tasks[t].indices = ix.obj ? ix.buf : NULL;
+                tasks[t].distances = dx.obj ? dx.buf : NULL;
+            }
+            Py_BEGIN_ALLOW_THREADS
+            pthread_mutex_lock(&self->lock);
+            for (started = 1; started < threads; started++){
+                if (pthread_create(&workers[started], NULL, classifyWorker, &tasks[started]) != 0){
+                    break;
+                }
+            }
+            classifyWorker(&tasks[0]);
+            for (t = started; t < threads; t++){
+                classifyWorker(&tasks[t]);      /* workers that did not start */
+            }
+            for (t = 1; t < started; t++){
+                pthread_join(workers[t], NULL);
+            }
+            pthread_mutex_unlock(&self->lock);
+            Py_END_ALLOW_THREADS
+        }
+        PyMem_Free(tasks);
+        PyMem_Free(workers);
+    }
+
+    PyBuffer_Release(&q);
+    PyBuffer_Release(&l);
+    if (ix.obj != NULL){
+        PyBuffer_Release(&ix);
+    }
+    if (dx.obj != NULL){
+        PyBuffer_Release(&dx);
+    }
+    if (!ok){
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+/************************************************************************/
+
+/** Classifier methods */
+static PyMethodDef classifierMethods[] = {
+    { "classify", (PyCFunction) (void (*)(void)) classifierClassify, METH_VARARGS | METH_KEYWORDS,
+      "classify(queries, out_labels, out_indices=None, out_distances=None)\n\n"
+      "Classifies float32 queries (n, features) into the int32 array out_labels (n,).\n"
+      "The training indices (int32) and squared distances (float32) of the K\n"
+      "neighbours of each query are written to out_indices / out_distances (n, k)\n"
+      "when given. The GIL is released while classifying." },
+    { NULL, NULL, 0, NULL }
+};
+
+/** Classifier read-only attributes */
+static PyMemberDef classifierMembers[] = {
+    { "num_obj", T_INT, offsetof(ClassifierObject, num_obj), READONLY, "Training objects" },
+    { "features", T_INT, offsetof(ClassifierObject, features), READONLY, "Feature dimensionality" },
+    { "k", T_INT, offsetof(ClassifierObject, k), READONLY, "Number of neighbours" },
+    { "classes", T_INT, offsetof(ClassifierObject, classes), READONLY, "Number of classes" },
+    { "threads", T_INT, offsetof(ClassifierObject, threads), READONLY, "Worker threads" },
+    { NULL, 0, 0, 0, NULL }
+};
+
+/** Classifier type */
+static PyTypeObject ClassifierType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "knn.Classifier",
+    .tp_basicsize = sizeof(ClassifierObject),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "Classifier(data, labels, k, classes, block=0, threads=0)\n\n"
+              "k-NN classifier over a float32 training set (num_obj, features) with\n"
+              "int32 labels; the set is copied once. threads=0 uses every online CPU.",
+    .tp_new = classifierNew,
+    .tp_init = (initproc) classifierInit,
+    .tp_dealloc = (destructor) classifierDealloc,
+    .tp_methods = classifierMethods,
+    .tp_members = classifierMembers,
+};
+
+/** Module definition */
+static struct PyModuleDef knnModule = {
+    PyModuleDef_HEAD_INIT,
+    .m_name = "knn",
+    .m_doc = "Batched k-NN classification over buffer-protocol arrays",
+    .m_size = -1,
+};
+
+/** @brief Module initialization */
+PyMODINIT_FUNC PyInit_knn(void){
+
+    PyObject *m;
+
+    if (PyType_Ready(&ClassifierType) < 0){
+        return NULL;
+    }
+    m = PyModule_Create(&knnModule);
+    if (m == NULL){
+        return NULL;
+    }
+    Py_INCREF(&ClassifierType);
+    if (PyModule_AddObject(m, "Classifier", (PyObject *) &ClassifierType) < 0){
+        Py_DECREF(&ClassifierType);
+        Py_DECREF(m);
+        return NULL;
+    }
+    return m;
+}
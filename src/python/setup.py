@@ -0,0 +1,15 @@
+# Builds the knn extension module, from this directory:
+#     python3 setup.py build_ext --inplace
+from setuptools import setup, Extension
+
+common = '../common'
+sources = ['knn_module.c'] + ['%s/%s' % (common, name) for name in
+    ('knn_context.c', 'knn_layout.c', 'knn_kernels.c', 'knn_arena.c')]
+
+setup(
+    name='knn',
+    version='1.0',
+    description='Batched k-NN classification over buffer-protocol arrays',
+    ext_modules=[Extension('knn', sources=sources, include_dirs=[common],
+        extra_compile_args=['-O3', '-march=native'], libraries=['m', 'pthread'])],
+)
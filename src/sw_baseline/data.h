@@ -31,6 +31,8 @@ char label_strings[CLASSES][100] = {
 #define TST_DATA_BIN    "iris_tst_data.bin"
 #define TRN_LABEL_BIN   "iris_trn_label.bin"
 #define TST_LABEL_BIN   "iris_tst_label.bin"
+#define TRN_NORM_BIN    "iris_trn_norm_data.bin"
+#define NORM_STATS_BIN  "iris_trn_norm_stats.bin"
 
 #endif
 
@@ -47,6 +49,8 @@ char label_strings[CLASSES][100] = {
 #define TST_DATA_BIN    "wine_tst_data.bin"
 #define TRN_LABEL_BIN   "wine_trn_label.bin"
 #define TST_LABEL_BIN   "wine_tst_label.bin"
+#define TRN_NORM_BIN    "wine_trn_norm_data.bin"
+#define NORM_STATS_BIN  "wine_trn_norm_stats.bin"
 #define SIZE_FEATURE 4
 char label_strings[CLASSES][100] = {
     "Red", "White" };
@@ -12,29 +12,85 @@
 
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "data.h"
+#include "knn_kernels.h"
+#include "knn_dataset.h"
+#include "knn_perf.h"
+#include "knn_eval.h"
+#include "knn_graph.h"
+#include "knn_policy.h"
+#include "knn_pipeline.h"
+#include "knn_layout.h"
+#include "knn_abandon.h"
+#include "knn_pivot.h"
+#include "knn_order.h"
+#include "knn_project.h"
+#include "knn_norm.h"
+#include "knn_lsh.h"
+#include "knn_store.h"
+#include "knn_stream.h"
+#include "knn_arena.h"
+#include "knn_cache.h"
+#include "knn_timer.h"
 
 /** K-nearest neighbours parameter */
 #define K 3
 
-/** @brief Distance from test object A to trn object B, an label of B */
-typedef struct DistLabelPair_Struct{
-    float distance;   /**< Distance from a given test object to B */
-    int label;        /**< Class label of B */
-}DistLabelPair;
+/** Seed of the cross-validation fold assignment */
+#define CV_SEED 42
 
-float distance(float* a, float* b, int size){
-    
-    int i;
-    float diff;
-    float sum = 0.0;
-    for (i = 0; i < size; i++){
-        diff = (a[i] - b[i]);
-        sum += diff * diff;
-    }
-    return sum;
-}
+/** Default output file of the all-kNN graph */
+#define GRAPH_FILE "trn_graph.knng"
+
+/** Default output file of the LSH index */
+#define LSH_FILE "trn_lsh.knnc"
+
+/** Default hash functions per LSH table */
+#define LSH_HASHES 4
+
+/** Every UPDATE_REMOVE_EVERY-th object is removed by the update run */
+#define UPDATE_REMOVE_EVERY 10
+
+/** Tombstoned fraction that triggers a background compaction */
+#define UPDATE_COMPACT_RATIO 0.05f
+
+/** Polling interval of the background compactor (ms) */
+#define UPDATE_COMPACT_MS 5
+
+/** Default output file of the fitted projection */
+#define PROJ_FILE "trn_proj.knnp"
+
+/** Smallest number of neighbours per cached list, so later runs with a larger K hit */
+#define CACHE_KMAX 32
+
+/** @brief Command line options */
+typedef struct RunOptions_Struct{
+    int kmax;           /**< Largest K of the sweep (-s), 0 to classify with K */
+    int folds;          /**< Number of cross-validation folds (-c), 0 to skip */
+    int graph_k;        /**< Neighbours of the all-kNN graph (-g), 0 to skip */
+    const char *output; /**< Output file (-o) */
+    int threads;        /**< Worker threads (-t) */
+    int metric;         /**< Distance metric (-m), -1 for the default path */
+    int vote;           /**< Vote policy (-w), -1 for the default path */
+    int pipeline;       /**< Classify through the pipeline dispatch table (-p) */
+    int block;          /**< Blocked layout block size (-b), 0 for row-major */
+    int abandon;        /**< Early-abandoning scan (-a) */
+    int pivots;         /**< Number of LAESA pivots (-P), 0 to skip */
+    int morton;         /**< Morton-ordered scan with block pruning (-z) */
+    int proj_dim;       /**< Projected dimensionality (-d), 0 to skip */
+    int proj_random;    /**< Random projection instead of PCA (-j) */
+    int rerank;         /**< Candidates re-ranked in the original space (-x), 0 to skip */
+    int normalize;      /**< Classify against the normalized training set (-n) */
+    int lsh_tables;     /**< LSH hash tables (-l), 0 to skip */
+    int lsh_hashes;     /**< Hash functions per LSH table (-H) */
+    int lsh_probes;     /**< Extra buckets probed per LSH table (-r) */
+    int update_batch;   /**< Objects per append of the update run (-u), 0 to skip */
+    int stream_block;   /**< Rows per block of the out-of-core scan (-S), 0 to skip */
+    const char *cache;  /**< Testing set neighbour cache file (-C), NULL to skip */
+}RunOptions;
 
 /**
  *  @brief Reads the dataset to memory 
@@ -45,90 +101,1079 @@ void readDataset(   float **trn_data,
                     int **trn_label,
                     int **tst_label){
 
-    FILE *fp_trn_data, *fp_trn_label, *fp_tst_data, *fp_tst_label;
+    if (loadBinarySet(TRN_DATA_BIN, TRN_LABEL_BIN, NUM_TRN_OBJ, FEATURES,
+            trn_data, trn_label) != 0 ||
+        loadBinarySet(TST_DATA_BIN, TST_LABEL_BIN, NUM_TST_OBJ, FEATURES,
+            tst_data, tst_label) != 0){
+        printf("Error reading input files!\n");
+        exit(-1);
+    }
+}
 
-    float feature;
-    int   label;
+/**
+ * @brief Neighbour lists of the testing set, from the cache when it matches
+ *
+ * The key is computed on the raw features, before any metric-specific
+ * preprocessing. On a miss the lists are computed with at least
+ * CACHE_KMAX entries and written to the cache file (-C); cosine
+ * normalizes both sets in place first.
+ *
+ * @param opts Command line options
+ * @param metric Distance metric
+ * @param data_trn Training set feature vectors
+ * @param data_tst Testing set feature vectors
+ * @param k Neighbours needed per list
+ * @param cache Mapped cache on a hit, release with knnCacheClose
+ * @param computed Lists computed on a miss, NULL on a hit, release with free
+ * @param stride Output number of entries per list, >= k
+ * @return Lists (NUM_TST_OBJ x stride), NULL on failure.
+ */
+const DistIndexPair *cachedNeighbours(const RunOptions *opts, KnnMetric metric,
+        float *data_trn, float *data_tst, int k, KnnCache *cache,
+        DistIndexPair **computed, int *stride){
 
-    float *tmp_trn_data = malloc(sizeof(float) * FEATURES * NUM_TRN_OBJ);
-    float *tmp_tst_data = malloc(sizeof(float) * FEATURES * NUM_TST_OBJ);
-    int *tmp_trn_label = malloc(sizeof(int) * NUM_TRN_OBJ);
-    int *tmp_tst_label = malloc(sizeof(int) * NUM_TST_OBJ);
-    
-    int i, j;
+    const char *path = opts->cache;
+    KnnCacheKey key;
+    uint64_t t = knnNanos();
+    int kmax = (k > CACHE_KMAX) ? k : CACHE_KMAX;
 
-    /* Open files for reading dataset */
-    fp_trn_data  = fopen(TRN_DATA_BIN, "rb");
-    fp_tst_data  = fopen(TST_DATA_BIN, "rb");
-    fp_trn_label = fopen(TRN_LABEL_BIN, "rb");
-    fp_tst_label = fopen(TST_LABEL_BIN, "rb");
-    
-    if (fp_trn_data == NULL ||
-        fp_tst_data == NULL ||
-        fp_trn_label == NULL ||
-        fp_tst_label == NULL){
-        printf("Error reading input files!\n");
-        exit(-1);
+    *computed = NULL;
+    knnCacheKeyInit(&key, data_trn, NUM_TRN_OBJ, data_tst, NUM_TST_OBJ, FEATURES, metric);
+    if (knnCacheOpen(path, &key, k, cache) == 0){
+        printf("Neighbour cache hit: %s, %d neighbours per object (us): %d\n", path,
+                cache->kmax, (int) ((knnNanos() - t) / 1000));
+        *stride = cache->kmax;
+        return cache->lists;
     }
 
-    /* Generate trn set from binary data files */
-    for (i = 0; i < NUM_TRN_OBJ; i++){
-        for (j = 0; j < FEATURES; j++){
-            fread(&feature, sizeof(float), 1,  fp_trn_data);
-            //printf("[%d] %f ", i, feature);
-            tmp_trn_data[i*FEATURES + j] = feature;
+    if (metric == KNN_METRIC_COSINE){
+        knnNormalizeRows(data_trn, NUM_TRN_OBJ, FEATURES);
+        knnNormalizeRows(data_tst, NUM_TST_OBJ, FEATURES);
+    }
+    *computed = malloc(sizeof(DistIndexPair) * NUM_TST_OBJ * kmax);
+    if (*computed == NULL){
+        return NULL;
+    }
+    knnPolicyNeighbours(metric)(data_tst, NUM_TST_OBJ, data_trn, NUM_TRN_OBJ,
+            FEATURES, kmax, *computed);
+    if (knnCacheWrite(path, &key, *computed, kmax) != 0){
+        printf("Cannot write the neighbour cache %s\n", path);
+    }
+    printf("Neighbour cache miss: %s written, %d neighbours per object (us): %d\n",
+            path, kmax, (int) ((knnNanos() - t) / 1000));
+    *stride = kmax;
+    return *computed;
+}
+
+/**
+ * @brief Evaluates every K <= kmax on the testing set and with k-fold CV
+ *
+ * The Kmax nearest neighbours of each object are computed once and every
+ * K is scored from the same sorted list.
+ *
+ * @param opts Command line options
+ * @param data_trn Training set feature vectors
+ * @param data_tst Testing set feature vectors
+ * @param label_trn Training set labels
+ * @param label_tst Testing set labels
+ * @return 0 on success, -1 on allocation or cache failure.
+ */
+int runEvaluation(const RunOptions *opts, float *data_trn, float *data_tst,
+        int *label_trn, int *label_tst){
+
+    int kmax = (opts->kmax > 0) ? opts->kmax : K;
+    int *correct = malloc(sizeof(int) * kmax * (opts->folds > 0 ? opts->folds : 1));
+    int *fold_size = malloc(sizeof(int) * (opts->folds > 0 ? opts->folds : 1));
+    DistIndexPair *neighbours;
+    const DistIndexPair *lists;
+    KnnCache cache;
+    int votes[CLASSES];
+    double mean;
+    int i, k, f, stride;
+
+    if (correct == NULL || fold_size == NULL){
+        free(correct);
+        free(fold_size);
+        return -1;
+    }
+
+    if (opts->kmax > 0 && opts->cache != NULL){
+        lists = cachedNeighbours(opts, KNN_METRIC_L2SQ, data_trn, data_tst, kmax,
+                &cache, &neighbours, &stride);
+        if (lists == NULL){
+            free(correct);
+            free(fold_size);
+            return -1;
+        }
+        memset(correct, 0, sizeof(int) * kmax);
+        for (i = 0; i < NUM_TST_OBJ; i++){
+            knnSweepQuery(&(lists[(size_t) i*stride]), kmax, kmax, label_trn,
+                    label_tst[i], votes, CLASSES, correct);
         }
-        fread(&label, sizeof(int), 1,  fp_trn_label);
-        //printf("%d (%s)\n", label, label_strings[label]);
-        tmp_trn_label[i] = label; 
+        if (neighbours == NULL){
+            knnCacheClose(&cache);
+        }
+    } else if (opts->kmax > 0){
+        neighbours = malloc(sizeof(DistIndexPair) * NUM_TST_OBJ * kmax);
+        if (neighbours == NULL){
+            free(correct);
+            free(fold_size);
+            return -1;
+        }
+        knnNeighbours(data_tst, NUM_TST_OBJ, data_trn, NUM_TRN_OBJ, FEATURES,
+                kmax, neighbours);
+        knnSweepK(neighbours, NUM_TST_OBJ, kmax, label_trn, label_tst,
+                CLASSES, correct);
+    }
+    if (opts->kmax > 0){
+
+        printf("\nK sweep on testing set (%d objects)\nK;correct;accuracy\n", NUM_TST_OBJ);
+        for (k = 1; k <= kmax; k++){
+            printf("%d;%d;%.2f%%\n", k, correct[k-1], (correct[k-1] * 100.0)/NUM_TST_OBJ);
+        }
+        free(neighbours);
+    }
+
+    if (opts->folds > 1){
+        knnCrossValidate(data_trn, label_trn, NUM_TRN_OBJ, FEATURES, CLASSES,
+                kmax, opts->folds, CV_SEED, correct, fold_size);
+
+        printf("\n%d-fold cross-validation on training set (%d objects)\nK", 
+                opts->folds, NUM_TRN_OBJ);
+        for (f = 0; f < opts->folds; f++){
+            printf(";fold %d", f);
+        }
+        printf(";mean\n");
+        for (k = 1; k <= kmax; k++){
+            printf("%d", k);
+            mean = 0.0;
+            for (f = 0; f < opts->folds; f++){
+                printf(";%.2f%%", (correct[f*kmax + k-1] * 100.0)/fold_size[f]);
+                mean += (correct[f*kmax + k-1] * 100.0)/fold_size[f];
+            }
+            printf(";%.2f%%\n", mean / opts->folds);
+        }
+    }
+
+    free(correct);
+    free(fold_size);
+    return 0;
+}
+
+/**
+ * @brief Builds the all-kNN graph of the training set
+ *
+ * Writes the CSR graph to disk and reports leave-one-out accuracy for
+ * every K up to the graph K.
+ *
+ * @param opts Command line options
+ * @param data_trn Training set feature vectors
+ * @param label_trn Training set labels
+ * @return 0 on success.
+ */
+int runGraph(const RunOptions *opts, float *data_trn, int *label_trn){
+
+    KnnGraph graph;
+    uint64_t t_start, t_end;
+    int *correct = malloc(sizeof(int) * opts->graph_k);
+    const char *path = opts->output ? opts->output : GRAPH_FILE;
+    int k;
+
+    t_start = knnNanos();
+    if (knnGraphBuild(data_trn, NUM_TRN_OBJ, FEATURES, opts->graph_k,
+            opts->threads, &graph) != 0){
+        printf("Error building the all-kNN graph!\n");
+        return -1;
+    }
+    t_end = knnNanos();
+
+    if (knnGraphWrite(&graph, path) != 0){
+        printf("Error writing %s!\n", path);
+        return -1;
+    }
+    printf("All-kNN graph of %d objects, K = %d, %d threads: %d edges in %s\n"
+            "Build time (us): %d\n", NUM_TRN_OBJ, opts->graph_k, opts->threads,
+            graph.row_ptr[NUM_TRN_OBJ], path, (int) ((t_end - t_start) / 1000));
+
+    knnGraphLeaveOneOut(&graph, label_trn, CLASSES, correct);
+    printf("\nLeave-one-out on training set (%d objects)\nK;correct;accuracy\n", NUM_TRN_OBJ);
+    for (k = 1; k <= opts->graph_k; k++){
+        printf("%d;%d;%.2f%%\n", k, correct[k-1], (correct[k-1] * 100.0)/NUM_TRN_OBJ);
+    }
+
+    knnGraphFree(&graph);
+    free(correct);
+    return 0;
+}
+
+/**
+ * @brief Classifies the testing set with a specialized (metric, vote) pair
+ *
+ * The classifier is looked up once; its inner loops are compiled for the
+ * chosen metric and vote policy. Cosine normalizes both sets in place.
+ * With -C the neighbour lists come from the cache and only the vote runs.
+ *
+ * @param opts Command line options
+ * @param data_trn Training set feature vectors
+ * @param data_tst Testing set feature vectors
+ * @param label_trn Training set labels
+ * @param label_tst Testing set labels
+ * @return 0 on success.
+ */
+int runPolicy(const RunOptions *opts, float *data_trn, float *data_tst,
+        int *label_trn, int *label_tst){
+
+    KnnMetric metric = (opts->metric >= 0) ? opts->metric : KNN_METRIC_L2SQ;
+    KnnVote vote = (opts->vote >= 0) ? opts->vote : KNN_VOTE_MAJORITY;
+    KnnClassifierFn classify = knnPolicyClassifier(metric, vote);
+    DistIndexPair list[K];
+    const DistIndexPair *lists;
+    DistIndexPair *computed;
+    KnnCache cache;
+    float votes[CLASSES];
+    int label_prediction[NUM_TST_OBJ];
+    uint64_t t_start, t_end;
+    int i, stride, correct = 0;
+
+    if (opts->cache != NULL){
+        t_start = knnNanos();
+        lists = cachedNeighbours(opts, metric, data_trn, data_tst, K, &cache,
+                &computed, &stride);
+        if (lists == NULL){
+            return -1;
+        }
+        for (i = 0; i < NUM_TST_OBJ; i++){
+            label_prediction[i] = knnPolicyVote(&(lists[(size_t) i*stride]), K,
+                    label_trn, vote, CLASSES, votes);
+        }
+        t_end = knnNanos();
+        if (computed == NULL){
+            knnCacheClose(&cache);
+        }
+        free(computed);
+    } else {
+        if (metric == KNN_METRIC_COSINE){
+            knnNormalizeRows(data_trn, NUM_TRN_OBJ, FEATURES);
+            knnNormalizeRows(data_tst, NUM_TST_OBJ, FEATURES);
+        }
+
+        t_start = knnNanos();
+        classify(data_tst, NUM_TST_OBJ, data_trn, label_trn, NUM_TRN_OBJ,
+                FEATURES, K, CLASSES, list, votes, label_prediction);
+        t_end = knnNanos();
     }
 
     for (i = 0; i < NUM_TST_OBJ; i++){
-        for (j = 0; j < FEATURES; j++){
-            fread(&feature, sizeof(float), 1,  fp_tst_data);
-            //printf("[%d] %f ", i, feature);
-            tmp_tst_data[i*FEATURES + j] = feature;
+        if (label_prediction[i] == label_tst[i]){
+            correct++;
         }
-        fread(&label, sizeof(int), 1,  fp_tst_label);
-        //printf("%d (%s)\n", label, label_strings[label]);
-        tmp_tst_label[i] = label;
+        printf("tst object %d assigned to class %d (%s)\n", i, label_prediction[i],
+                label_strings[label_prediction[i]]);
     }
+    printf("Total of %d correctly classified (%.2f%%)\n", correct,
+            (correct * 100.0)/NUM_TST_OBJ);
+    printf("Classification time (us): %d\n", (int) ((t_end - t_start) / 1000));
+    return 0;
+}
 
-    fclose(fp_trn_data); fclose(fp_trn_label);
-    fclose(fp_tst_data); fclose(fp_tst_label);
-    
-    *trn_data = tmp_trn_data;
-    *tst_data = tmp_tst_data;
-    *trn_label = tmp_trn_label;
-    *tst_label = tmp_tst_label;
-}
-
-/** @brief Sorts an array of floats with Selection Sort for K iterations O(n*K)
- *
- * @param array Array of floats to be sorted
- * @param size The size of the array
- * @param k Number of iterations (sorted objects)
- * @return Void.
- */
-void selectionSortK(DistLabelPair *array, int size, int k){
-    int i, j;
-    int min;
-    float tmp_distance;
-    int tmp_label;
-
-    for (i = 0; i < k; i++){
-        min = i;
-        for (j = i + 1; j < size; j++){
-            if (array[min].distance > array[j].distance){
-                min = j;
+/**
+ * @brief Classifies the testing set through the pipeline dispatch table
+ *
+ * Uses the pipeline specialized for (FEATURES, K) when one exists and the
+ * generic pipeline otherwise.
+ *
+ * @param data_trn Training set feature vectors
+ * @param data_tst Testing set feature vectors
+ * @param label_trn Training set labels
+ * @param label_tst Testing set labels
+ * @return 0 on success.
+ */
+int runPipeline(float *data_trn, float *data_tst, int *label_trn, int *label_tst){
+
+    KnnPipelineFn classify = knnPipelineSelect(FEATURES, K, CLASSES);
+    int label_prediction[NUM_TST_OBJ];
+    uint64_t t_start, t_end;
+    int i, correct = 0;
+
+    t_start = knnNanos();
+    if (classify(data_tst, NUM_TST_OBJ, data_trn, label_trn, NUM_TRN_OBJ,
+            FEATURES, K, CLASSES, label_prediction) != 0){
+        printf("Error running the pipeline!\n");
+        return -1;
+    }
+    t_end = knnNanos();
+
+    for (i = 0; i < NUM_TST_OBJ; i++){
+        if (label_prediction[i] == label_tst[i]){
+            correct++;
+        }
+        printf("tst object %d assigned to class %d (%s)\n", i, label_prediction[i],
+                label_strings[label_prediction[i]]);
+    }
+    printf("Total of %d correctly classified (%.2f%%)\n", correct,
+            (correct * 100.0)/NUM_TST_OBJ);
+    printf("Pipeline: %s (FEATURES = %d, K = %d)\n",
+            (classify == knnPipelineGeneric) ? "generic" : "specialized", FEATURES, K);
+    printf("Classification time (us): %d\n", (int) ((t_end - t_start) / 1000));
+    return 0;
+}
+
+/**
+ * @brief Classifies the testing set against a blocked feature-major training set
+ *
+ * The training set is read again from its binaries, straight into the
+ * blocked layout.
+ *
+ * @param opts Command line options
+ * @param data_tst Testing set feature vectors
+ * @param label_tst Testing set labels
+ * @return 0 on success.
+ */
+int runBlocked(const RunOptions *opts, float *data_tst, int *label_tst){
+
+    KnnBlockedSet set;
+    int label_prediction[NUM_TST_OBJ];
+    uint64_t t_start, t_end;
+    int i, correct = 0;
+
+    if (knnBlockedLoad(TRN_DATA_BIN, TRN_LABEL_BIN, NUM_TRN_OBJ, FEATURES,
+            opts->block, &set) != 0){
+        printf("Error reading input files in blocks of %d!\n", opts->block);
+        return -1;
+    }
+
+    t_start = knnNanos();
+    if (knnBlockedClassify(&set, data_tst, NUM_TST_OBJ, K, CLASSES, label_prediction) != 0){
+        printf("Error classifying against the blocked set!\n");
+        knnBlockedFree(&set);
+        return -1;
+    }
+    t_end = knnNanos();
+
+    for (i = 0; i < NUM_TST_OBJ; i++){
+        if (label_prediction[i] == label_tst[i]){
+            correct++;
+        }
+        printf("tst object %d assigned to class %d (%s)\n", i, label_prediction[i],
+                label_strings[label_prediction[i]]);
+    }
+    printf("Total of %d correctly classified (%.2f%%)\n", correct,
+            (correct * 100.0)/NUM_TST_OBJ);
+    printf("Blocked layout: %d blocks of %d objects\n", set.num_blocks, set.block);
+    printf("Classification time (us): %d\n", (int) ((t_end - t_start) / 1000));
+
+    knnBlockedFree(&set);
+    return 0;
+}
+
+/**
+ * @brief Classifies the testing set with early-abandoning distances
+ *
+ * Runs the abandoning scan in the original feature order, then reorders
+ * both sets by descending training variance and runs the full and the
+ * abandoning scans again. Reports the features summed per candidate and
+ * checks that both scans return the same neighbour lists.
+ *
+ * @param data_trn Training set feature vectors, reordered in place
+ * @param data_tst Testing set feature vectors, reordered in place
+ * @param label_trn Training set labels
+ * @param label_tst Testing set labels
+ * @return 0 on success, -1 if the scans disagree.
+ */
+int runAbandon(float *data_trn, float *data_tst, int *label_trn, int *label_tst){
+
+    DistIndexPair *full = malloc(sizeof(DistIndexPair) * NUM_TST_OBJ * K);
+    DistIndexPair *pruned = malloc(sizeof(DistIndexPair) * NUM_TST_OBJ * K);
+    double candidates = (double) NUM_TST_OBJ * NUM_TRN_OBJ;
+    int order[FEATURES];
+    int closest[K];
+    int votes[CLASSES];
+    uint64_t evaluated, t_full, t_pruned;
+    int i, j, mismatches = 0, correct = 0;
+
+    evaluated = knnAbandonNeighbours(data_tst, NUM_TST_OBJ, data_trn, NUM_TRN_OBJ,
+            FEATURES, K, pruned);
+    printf("Original feature order: %.2f of %d features per candidate\n",
+            evaluated / candidates, FEATURES);
+
+    if (knnVarianceOrder(data_trn, NUM_TRN_OBJ, FEATURES, order) != 0 ||
+        knnPermuteFeatures(data_trn, NUM_TRN_OBJ, FEATURES, order) != 0 ||
+        knnPermuteFeatures(data_tst, NUM_TST_OBJ, FEATURES, order) != 0){
+        printf("Error reordering the features!\n");
+        free(full); free(pruned);
+        return -1;
+    }
+
+    t_full = knnNanos();
+    knnNeighbours(data_tst, NUM_TST_OBJ, data_trn, NUM_TRN_OBJ, FEATURES, K, full);
+    t_full = knnNanos() - t_full;
+
+    t_pruned = knnNanos();
+    evaluated = knnAbandonNeighbours(data_tst, NUM_TST_OBJ, data_trn, NUM_TRN_OBJ,
+            FEATURES, K, pruned);
+    t_pruned = knnNanos() - t_pruned;
+    printf("Variance feature order: %.2f of %d features per candidate\n",
+            evaluated / candidates, FEATURES);
+
+    for (i = 0; i < NUM_TST_OBJ * K; i++){
+        if (full[i].index != pruned[i].index || full[i].distance != pruned[i].distance){
+            mismatches++;
+        }
+    }
+    for (i = 0; i < NUM_TST_OBJ; i++){
+        for (j = 0; j < K; j++){
+            closest[j] = label_trn[ pruned[i*K + j].index ];
+        }
+        if (majorityVote(closest, K, votes, CLASSES) == label_tst[i]){
+            correct++;
+        }
+    }
+    printf("Total of %d correctly classified (%.2f%%)\n", correct,
+            (correct * 100.0)/NUM_TST_OBJ);
+    printf("Full scan (us): %d\nAbandoning scan (us): %d\nNeighbour mismatches: %d\n",
+            (int) (t_full / 1000), (int) (t_pruned / 1000), mismatches);
+
+    free(full);
+    free(pruned);
+    return mismatches ? -1 : 0;
+}
+
+/**
+ * @brief Classifies the testing set with pivot lower-bound pruning
+ *
+ * Reports the fraction of training objects skipped and checks that the
+ * neighbour lists match the full scan.
+ *
+ * @param opts Command line options
+ * @param data_trn Training set feature vectors
+ * @param data_tst Testing set feature vectors
+ * @param label_trn Training set labels
+ * @param label_tst Testing set labels
+ * @return 0 on success, -1 if the scans disagree.
+ */
+int runPivots(const RunOptions *opts, float *data_trn, float *data_tst,
+        int *label_trn, int *label_tst){
+
+    DistIndexPair *full = malloc(sizeof(DistIndexPair) * NUM_TST_OBJ * K);
+    DistIndexPair *pruned = malloc(sizeof(DistIndexPair) * NUM_TST_OBJ * K);
+    KnnPivots pivots;
+    int closest[K];
+    int votes[CLASSES];
+    uint64_t skipped, t_build, t_full, t_pruned;
+    int i, j, mismatches = 0, correct = 0;
+
+    if (full == NULL || pruned == NULL){
+        printf("Error allocating neighbour lists!\n");
+        free(full);
+        free(pruned);
+        return -1;
+    }
+
+    t_build = knnNanos();
+    if (knnPivotsBuild(data_trn, NUM_TRN_OBJ, FEATURES, opts->pivots, &pivots) != 0){
+        printf("Error selecting pivots!\n");
+        free(full);
+        free(pruned);
+        return -1;
+    }
+    t_build = knnNanos() - t_build;
+
+    t_full = knnNanos();
+    knnNeighbours(data_tst, NUM_TST_OBJ, data_trn, NUM_TRN_OBJ, FEATURES, K, full);
+    t_full = knnNanos() - t_full;
+
+    t_pruned = knnNanos();
+    skipped = knnPivotNeighbours(&pivots, data_tst, NUM_TST_OBJ, data_trn,
+            NUM_TRN_OBJ, FEATURES, K, pruned);
+    t_pruned = knnNanos() - t_pruned;
+    if (skipped == UINT64_MAX){
+        printf("Error running the pivot scan!\n");
+        knnPivotsFree(&pivots);
+        free(full);
+        free(pruned);
+        return -1;
+    }
+
+    for (i = 0; i < NUM_TST_OBJ * K; i++){
+        if (full[i].index != pruned[i].index || full[i].distance != pruned[i].distance){
+            mismatches++;
+        }
+    }
+    for (i = 0; i < NUM_TST_OBJ; i++){
+        for (j = 0; j < K; j++){
+            closest[j] = label_trn[ pruned[i*K + j].index ];
+        }
+        if (majorityVote(closest, K, votes, CLASSES) == label_tst[i]){
+            correct++;
+        }
+    }
+    printf("Total of %d correctly classified (%.2f%%)\n", correct,
+            (correct * 100.0)/NUM_TST_OBJ);
+    printf("%d pivots, pruned %.2f%% of %d candidates\n", pivots.num_pivots,
+            (skipped * 100.0) / ((double) NUM_TST_OBJ * NUM_TRN_OBJ), NUM_TST_OBJ * NUM_TRN_OBJ);
+    printf("Pivot selection (us): %d\nFull scan (us): %d\nPivot scan (us): %d\n"
+            "Neighbour mismatches: %d\n", (int) (t_build / 1000), (int) (t_full / 1000),
+            (int) (t_pruned / 1000), mismatches);
+
+    knnPivotsFree(&pivots);
+    free(full);
+    free(pruned);
+    return mismatches ? -1 : 0;
+}
+
+/**
+ * @brief Classifies the testing set against the Morton-ordered training set
+ *
+ * Reorders a copy of the training set along a Morton curve, boxes every
+ * 64 objects and scans blocks nearest box first. Reports the blocks
+ * skipped and checks the neighbour lists against the full scan.
+ *
+ * @param data_trn Training set feature vectors
+ * @param data_tst Testing set feature vectors
+ * @param label_trn Training set labels
+ * @param label_tst Testing set labels
+ * @return 0 on success, -1 if the scans disagree.
+ */
+int runMorton(float *data_trn, float *data_tst, int *label_trn, int *label_tst){
+
+    DistIndexPair *full = malloc(sizeof(DistIndexPair) * NUM_TST_OBJ * K);
+    DistIndexPair *pruned = malloc(sizeof(DistIndexPair) * NUM_TST_OBJ * K);
+    float *ordered = malloc(sizeof(float) * NUM_TRN_OBJ * FEATURES);
+    int *perm = malloc(sizeof(int) * NUM_TRN_OBJ);
+    KnnBoxes boxes;
+    int closest[K];
+    int votes[CLASSES];
+    uint64_t skipped, t_build, t_full, t_pruned;
+    int i, j, mismatches = 0, correct = 0;
+
+    t_build = knnNanos();
+    memcpy(ordered, data_trn, sizeof(float) * NUM_TRN_OBJ * FEATURES);
+    if (knnMortonOrder(ordered, NUM_TRN_OBJ, FEATURES, perm) != 0 ||
+        knnApplyOrder(ordered, NULL, NUM_TRN_OBJ, FEATURES, perm) != 0 ||
+        knnBoxesBuild(ordered, NUM_TRN_OBJ, FEATURES, &boxes) != 0){
+        printf("Error compiling the training set!\n");
+        return -1;
+    }
+    t_build = knnNanos() - t_build;
+
+    t_full = knnNanos();
+    knnNeighbours(data_tst, NUM_TST_OBJ, data_trn, NUM_TRN_OBJ, FEATURES, K, full);
+    t_full = knnNanos() - t_full;
+
+    t_pruned = knnNanos();
+    if (knnBoxNeighbours(&boxes, data_tst, NUM_TST_OBJ, ordered, perm, K, pruned,
+            &skipped) != 0){
+        printf("Error scanning the boxes!\n");
+        return -1;
+    }
+    t_pruned = knnNanos() - t_pruned;
+
+    for (i = 0; i < NUM_TST_OBJ * K; i++){
+        if (full[i].index != pruned[i].index || full[i].distance != pruned[i].distance){
+            mismatches++;
+        }
+    }
+    for (i = 0; i < NUM_TST_OBJ; i++){
+        for (j = 0; j < K; j++){
+            closest[j] = label_trn[ pruned[i*K + j].index ];
+        }
+        if (majorityVote(closest, K, votes, CLASSES) == label_tst[i]){
+            correct++;
+        }
+    }
+    printf("Total of %d correctly classified (%.2f%%)\n", correct,
+            (correct * 100.0)/NUM_TST_OBJ);
+    printf("%d blocks of %d objects, skipped %.2f%% of block visits\n", boxes.num_blocks,
+            KNN_BOX_BLOCK, (skipped * 100.0) / ((double) NUM_TST_OBJ * boxes.num_blocks));
+    printf("Compile (us): %d\nFull scan (us): %d\nBlock scan (us): %d\n"
+            "Neighbour mismatches: %d\n", (int) (t_build / 1000), (int) (t_full / 1000),
+            (int) (t_pruned / 1000), mismatches);
+
+    knnBoxesFree(&boxes);
+    free(full); free(pruned); free(ordered); free(perm);
+    return mismatches ? -1 : 0;
+}
+
+/**
+ * @brief Classifies the testing set in a reduced feature space
+ *
+ * Fits PCA (or draws a random projection) on the training set, saves it,
+ * reads the training set again projecting it on the fly and projects the
+ * testing set. With re-ranking, the best candidates in the reduced space
+ * are re-ranked with exact distances in the original space. Reports the
+ * recall of the exact neighbours and the fraction of the full-scan
+ * distance work performed.
+ *
+ * @param opts Command line options
+ * @param data_trn Training set feature vectors
+ * @param data_tst Testing set feature vectors
+ * @param label_trn Training set labels
+ * @param label_tst Testing set labels
+ * @return 0 on success.
+ */
+int runProject(const RunOptions *opts, float *data_trn, float *data_tst,
+        int *label_trn, int *label_tst){
+
+    int dim = opts->proj_dim;
+    int cand = (opts->rerank > K) ? opts->rerank : K;
+    DistIndexPair *full = malloc(sizeof(DistIndexPair) * NUM_TST_OBJ * K);
+    DistIndexPair *reduced = malloc(sizeof(DistIndexPair) * NUM_TST_OBJ * cand);
+    DistIndexPair *found = reduced;
+    float *proj_tst = malloc(sizeof(float) * NUM_TST_OBJ * dim);
+    float *proj_trn;
+    int *proj_label;
+    KnnProjection proj;
+    int closest[K];
+    int votes[CLASSES];
+    uint64_t t_fit, t_full, t_reduced;
+    int stride = cand;
+    int i, j, l, hits = 0, correct = 0;
+
+    t_fit = knnNanos();
+    if ((opts->proj_random ? knnRandomFit(FEATURES, dim, CV_SEED, &proj)
+                           : knnPcaFit(data_trn, NUM_TRN_OBJ, FEATURES, dim, &proj)) != 0){
+        printf("Error fitting a %d-dimensional projection!\n", dim);
+        return -1;
+    }
+    t_fit = knnNanos() - t_fit;
+    if (knnProjectionWrite(&proj, opts->output ? opts->output : PROJ_FILE) != 0 ||
+        knnLoadProjected(TRN_DATA_BIN, TRN_LABEL_BIN, NUM_TRN_OBJ, &proj,
+            &proj_trn, &proj_label) != 0){
+        printf("Error writing the projection or reading input files!\n");
+        return -1;
+    }
+    knnProject(&proj, data_tst, NUM_TST_OBJ, proj_tst);
+
+    t_full = knnNanos();
+    knnNeighbours(data_tst, NUM_TST_OBJ, data_trn, NUM_TRN_OBJ, FEATURES, K, full);
+    t_full = knnNanos() - t_full;
+
+    t_reduced = knnNanos();
+    knnNeighbours(proj_tst, NUM_TST_OBJ, proj_trn, NUM_TRN_OBJ, dim, cand, reduced);
+    if (opts->rerank > 0){
+        found = malloc(sizeof(DistIndexPair) * NUM_TST_OBJ * K);
+        knnRerankNeighbours(reduced, cand, data_tst, NUM_TST_OBJ, data_trn,
+                FEATURES, K, found);
+        stride = K;
+    }
+    t_reduced = knnNanos() - t_reduced;
+
+    for (i = 0; i < NUM_TST_OBJ; i++){
+        for (j = 0; j < K; j++){
+            for (l = 0; l < K; l++){
+                if (full[i*K + j].index == found[i*stride + l].index){
+                    hits++;
+                    break;
+                }
+            }
+            closest[j] = label_trn[ found[i*stride + j].index ];
+        }
+        if (majorityVote(closest, K, votes, CLASSES) == label_tst[i]){
+            correct++;
+        }
+    }
+    printf("Total of %d correctly classified (%.2f%%)\n", correct,
+            (correct * 100.0)/NUM_TST_OBJ);
+    printf("%s projection %d -> %d features, %d candidates re-ranked\n",
+            opts->proj_random ? "Random" : "PCA", FEATURES, dim, opts->rerank);
+    printf("Neighbour recall: %.2f%%\nDistance work: %.2f%% of the full scan\n",
+            (hits * 100.0) / (NUM_TST_OBJ * K),
+            100.0 * ((double) NUM_TRN_OBJ * dim + (opts->rerank > 0 ? cand * FEATURES : 0))
+                / ((double) NUM_TRN_OBJ * FEATURES));
+    printf("Fit (us): %d\nFull scan (us): %d\nReduced scan (us): %d\n",
+            (int) (t_fit / 1000), (int) (t_full / 1000), (int) (t_reduced / 1000));
+
+    if (found != reduced){
+        free(found);
+    }
+    knnProjectionFree(&proj);
+    free(full); free(reduced); free(proj_tst); free(proj_trn); free(proj_label);
+    return 0;
+}
+
+/**
+ * @brief Classifies the testing set against the normalized training set
+ *
+ * The training set and its statistics come from the binaries written by
+ * gen_data; the queries are normalized in one pass before the scan.
+ * Reports accuracy and the features summed per candidate by the
+ * early-abandoning scan on raw and on normalized features.
+ *
+ * @param data_trn Raw training set feature vectors
+ * @param data_tst Testing set feature vectors, normalized in place
+ * @param label_tst Testing set labels
+ * @return 0 on success.
+ */
+int runNormalized(float *data_trn, float *data_tst, int *label_tst){
+
+    DistIndexPair *neighbours = malloc(sizeof(DistIndexPair) * NUM_TST_OBJ * K);
+    double candidates = (double) NUM_TST_OBJ * NUM_TRN_OBJ;
+    KnnNormStats stats;
+    float *norm_trn;
+    int *norm_label;
+    int closest[K];
+    int votes[CLASSES];
+    uint64_t evaluated, t_norm, t_scan;
+    int i, j, correct = 0;
+
+    if (knnNormRead(NORM_STATS_BIN, &stats) != 0 || stats.features != FEATURES ||
+        loadBinarySet(TRN_NORM_BIN, TRN_LABEL_BIN, NUM_TRN_OBJ, FEATURES,
+            &norm_trn, &norm_label) != 0){
+        printf("Error reading %s or %s!\n", NORM_STATS_BIN, TRN_NORM_BIN);
+        return -1;
+    }
+
+    evaluated = knnAbandonNeighbours(data_tst, NUM_TST_OBJ, data_trn, NUM_TRN_OBJ,
+            FEATURES, K, neighbours);
+    printf("Raw features: %.2f of %d features per candidate\n",
+            evaluated / candidates, FEATURES);
+
+    t_norm = knnNanos();
+    knnNormApply(&stats, data_tst, NUM_TST_OBJ);
+    t_norm = knnNanos() - t_norm;
+
+    t_scan = knnNanos();
+    knnNeighbours(data_tst, NUM_TST_OBJ, norm_trn, NUM_TRN_OBJ, FEATURES, K, neighbours);
+    t_scan = knnNanos() - t_scan;
+
+    for (i = 0; i < NUM_TST_OBJ; i++){
+        for (j = 0; j < K; j++){
+            closest[j] = norm_label[ neighbours[i*K + j].index ];
+        }
+        if (majorityVote(closest, K, votes, CLASSES) == label_tst[i]){
+            correct++;
+        }
+    }
+
+    evaluated = knnAbandonNeighbours(data_tst, NUM_TST_OBJ, norm_trn, NUM_TRN_OBJ,
+            FEATURES, K, neighbours);
+    printf("Normalized features: %.2f of %d features per candidate\n",
+            evaluated / candidates, FEATURES);
+    printf("Total of %d correctly classified (%.2f%%)\n", correct,
+            (correct * 100.0)/NUM_TST_OBJ);
+    printf("%s normalization of %d queries (us): %d\nScan (us): %d\n",
+            stats.mode == KNN_NORM_MINMAX ? "Min-max" : "Z-score", NUM_TST_OBJ,
+            (int) (t_norm / 1000), (int) (t_scan / 1000));
+
+    knnNormFree(&stats);
+    free(neighbours); free(norm_trn); free(norm_label);
+    return 0;
+}
+
+/**
+ * @brief Maps the LSH container and checks it indexes the current training set
+ *
+ * @return 0 if the container exists, matches the dataset hash and holds
+ *         an index with the requested parameters, -1 otherwise.
+ */
+int mapLsh(const RunOptions *opts, const char *path, uint64_t hash,
+        KnnContainer *container, KnnLsh *lsh){
+
+    if (knnContainerMap(path, container) != 0){
+        return -1;
+    }
+    if (container->header->dataset_hash != hash || knnLshMap(container, lsh) != 0){
+        knnContainerUnmap(container);
+        return -1;
+    }
+    if (lsh->tables != opts->lsh_tables || lsh->hashes != opts->lsh_hashes ||
+        lsh->num_obj != NUM_TRN_OBJ || lsh->features != FEATURES){
+        knnLshFree(lsh);
+        knnContainerUnmap(container);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Classifies the testing set with LSH candidates
+ *
+ * The index is mapped from its container when the container's dataset
+ * hash and parameters match; otherwise it is rebuilt, written and
+ * mapped. Candidates from every table are re-ranked with exact
+ * distances. Reports the fraction of the training set re-ranked and the
+ * recall of the exact neighbours.
+ *
+ * @param opts Command line options
+ * @param data_trn Training set feature vectors
+ * @param data_tst Testing set feature vectors
+ * @param label_trn Training set labels
+ * @param label_tst Testing set labels
+ * @return 0 on success.
+ */
+int runLsh(const RunOptions *opts, float *data_trn, float *data_tst,
+        int *label_trn, int *label_tst){
+
+    const char *path = opts->output ? opts->output : LSH_FILE;
+    DistIndexPair *full = malloc(sizeof(DistIndexPair) * NUM_TST_OBJ * K);
+    DistIndexPair *found = malloc(sizeof(DistIndexPair) * NUM_TST_OBJ * K);
+    KnnContainer container;
+    KnnLsh lsh;
+    int closest[K];
+    int votes[CLASSES];
+    uint64_t hash, candidates, t_open, t_full, t_lsh;
+    int i, j, l, n, rebuilt = 0, hits = 0, correct = 0;
+
+    t_open = knnNanos();
+    hash = knnDatasetHash(data_trn, label_trn, NUM_TRN_OBJ, FEATURES);
+    if (mapLsh(opts, path, hash, &container, &lsh) != 0){
+        rebuilt = 1;
+        if (knnLshBuild(data_trn, NUM_TRN_OBJ, FEATURES, opts->lsh_tables,
+                opts->lsh_hashes, 0.0f, CV_SEED, opts->threads, &lsh) != 0 ||
+            knnLshWriteContainer(&lsh, hash, path) != 0){
+            printf("Error building or writing the LSH index %s!\n", path);
+            return -1;
+        }
+        knnLshFree(&lsh);
+        if (mapLsh(opts, path, hash, &container, &lsh) != 0){
+            printf("Error mapping %s!\n", path);
+            return -1;
+        }
+    }
+    t_open = knnNanos() - t_open;
+
+    t_full = knnNanos();
+    knnNeighbours(data_tst, NUM_TST_OBJ, data_trn, NUM_TRN_OBJ, FEATURES, K, full);
+    t_full = knnNanos() - t_full;
+
+    t_lsh = knnNanos();
+    if (knnLshNeighbours(&lsh, data_tst, NUM_TST_OBJ, data_trn, K, opts->lsh_probes,
+            found, &candidates) != 0){
+        printf("Error querying the LSH index!\n");
+        knnLshFree(&lsh);
+        knnContainerUnmap(&container);
+        free(full); free(found);
+        return -1;
+    }
+    t_lsh = knnNanos() - t_lsh;
+
+    for (i = 0; i < NUM_TST_OBJ; i++){
+        n = 0;
+        for (j = 0; j < K; j++){
+            for (l = 0; l < K; l++){
+                if (full[i*K + j].index == found[i*K + l].index){
+                    hits++;
+                    break;
+                }
+            }
+            if (found[i*K + j].index >= 0){
+                closest[n++] = label_trn[ found[i*K + j].index ];
+            }
+        }
+        if (n > 0 && majorityVote(closest, n, votes, CLASSES) == label_tst[i]){
+            correct++;
+        }
+    }
+    printf("Total of %d correctly classified (%.2f%%)\n", correct,
+            (correct * 100.0)/NUM_TST_OBJ);
+    printf("%d tables x %d hashes, width %.3f, %d probes, index %s %s\n", lsh.tables,
+            lsh.hashes, lsh.width, opts->lsh_probes, path,
+            rebuilt ? "rebuilt" : "mapped (up to date)");
+    printf("Candidates re-ranked: %.2f%% of the training set\nNeighbour recall: %.2f%%\n",
+            (candidates * 100.0) / ((double) NUM_TST_OBJ * NUM_TRN_OBJ),
+            (hits * 100.0) / (NUM_TST_OBJ * K));
+    printf("Index open (us): %d\nFull scan (us): %d\nLSH scan (us): %d\n",
+            (int) (t_open / 1000), (int) (t_full / 1000), (int) (t_lsh / 1000));
+
+    knnLshFree(&lsh);
+    knnContainerUnmap(&container);
+    free(full); free(found);
+    return 0;
+}
+
+/**
+ * @brief Compares the store's neighbour lists with a full scan of its live objects
+ *
+ * @param store Store
+ * @param data_tst Testing set feature vectors
+ * @param correct Output number of testing objects classified correctly
+ * @param label_tst Testing set labels
+ * @return Recall of the exact neighbours, in percent.
+ */
+double checkStore(KnnStore *store, float *data_tst, int *label_tst, int *correct){
+
+    int live = knnStoreLive(store);
+    float *data = malloc(sizeof(float) * live * FEATURES);
+    int *labels = malloc(sizeof(int) * live);
+    int *ids = malloc(sizeof(int) * live);
+    DistIndexPair *full = malloc(sizeof(DistIndexPair) * NUM_TST_OBJ * K);
+    DistIndexPair *found = malloc(sizeof(DistIndexPair) * NUM_TST_OBJ * K);
+    int prediction[NUM_TST_OBJ];
+    int i, j, l, hits = 0;
+
+    knnStoreGather(store, data, labels, ids);
+    knnNeighbours(data_tst, NUM_TST_OBJ, data, live, FEATURES, K, full);
+    *correct = 0;
+    if (knnStoreNeighbours(store, data_tst, NUM_TST_OBJ, K, found, NULL, NULL) != 0 ||
+        knnStoreClassify(store, data_tst, NUM_TST_OBJ, K, CLASSES, prediction) != 0){
+        printf("Error querying the store!\n");
+        free(data); free(labels); free(ids); free(full); free(found);
+        return 0.0;
+    }
+
+    for (i = 0; i < NUM_TST_OBJ; i++){
+        for (j = 0; j < K; j++){
+            for (l = 0; l < K; l++){
+                if (ids[ full[i*K + j].index ] == found[i*K + l].index){
+                    hits++;
+                    break;
+                }
             }
         }
-        if (min != i){
-            tmp_distance = array[i].distance; tmp_label = array[i].label;
-            array[i].distance = array[min].distance; array[i].label = array[min].label;
-            array[min].distance = tmp_distance; array[min].label = tmp_label;
+        if (prediction[i] == label_tst[i]){
+            (*correct)++;
+        }
+    }
+    free(data); free(labels); free(ids); free(full); free(found);
+    return (hits * 100.0) / (NUM_TST_OBJ * K);
+}
+
+/**
+ * @brief Updates a growable training set while classifying against it
+ *
+ * Appends three quarters of the training set, optionally attaches an LSH
+ * index (-l), appends the rest as a delta, removes every 10th object and
+ * lets the background compactor drop the tombstones and re-index while
+ * queries keep running. Checks the neighbour lists against a full scan of the live
+ * objects before and after compaction.
+ *
+ * @param opts Command line options
+ * @param data_trn Training set feature vectors
+ * @param data_tst Testing set feature vectors
+ * @param label_trn Training set labels
+ * @param label_tst Testing set labels
+ * @return 0 on success.
+ */
+int runUpdates(const RunOptions *opts, float *data_trn, float *data_tst,
+        int *label_trn, int *label_tst){
+
+    int base = NUM_TRN_OBJ * 3 / 4;
+    int prediction[NUM_TST_OBJ];
+    KnnStore store;
+    KnnStoreStats stats;
+    uint64_t t_append, t_remove, t_wait, compactions, queries = 0;
+    double recall;
+    int i, n, correct;
+
+    if (knnStoreInit(&store, FEATURES) != 0){
+        printf("Error creating the store!\n");
+        return -1;
+    }
+
+    t_append = knnNanos();
+    for (i = 0; i < base; i += n){
+        n = (base - i < opts->update_batch) ? base - i : opts->update_batch;
+        knnStoreAppend(&store, &(data_trn[i*FEATURES]), &(label_trn[i]), n);
+    }
+    if (opts->lsh_tables > 0 &&
+        knnStoreIndex(&store, opts->lsh_tables, opts->lsh_hashes, opts->lsh_probes,
+            opts->threads) != 0){
+        printf("Error indexing the store!\n");
+        return -1;
+    }
+    for (i = base; i < NUM_TRN_OBJ; i += n){
+        n = (NUM_TRN_OBJ - i < opts->update_batch) ? NUM_TRN_OBJ - i : opts->update_batch;
+        knnStoreAppend(&store, &(data_trn[i*FEATURES]), &(label_trn[i]), n);
+    }
+    t_append = knnNanos() - t_append;
+
+    t_remove = knnNanos();
+    for (i = 0; i < NUM_TRN_OBJ; i += UPDATE_REMOVE_EVERY){
+        knnStoreRemove(&store, i);
+    }
+    t_remove = knnNanos() - t_remove;
+
+    recall = checkStore(&store, data_tst, label_tst, &correct);
+    knnStoreStats(&store, &stats);
+    printf("Before compaction: %d objects, %d tombstoned, %d indexed, generation %d\n",
+            stats.count, stats.dead, stats.indexed, (int) stats.generation);
+    printf("Total of %d correctly classified (%.2f%%), neighbour recall %.2f%%\n",
+            correct, (correct * 100.0)/NUM_TST_OBJ, recall);
+
+    /* Queries keep running while the compactor drops the tombstones */
+    t_wait = knnNanos();
+    compactions = stats.compactions;
+    knnStoreStartCompactor(&store, UPDATE_COMPACT_RATIO, UPDATE_COMPACT_MS);
+    do {
+        if (knnStoreClassify(&store, data_tst, NUM_TST_OBJ, K, CLASSES, prediction) != 0){
+            printf("Error querying the store!\n");
+            knnStoreFree(&store);
+            return -1;
+        }
+        queries += NUM_TST_OBJ;
+        knnStoreStats(&store, &stats);
+        n = (stats.compactions > compactions && stats.dead == 0 &&
+                (opts->lsh_tables == 0 || stats.attached));
+    } while (!n);
+    knnStoreStopCompactor(&store);
+    t_wait = knnNanos() - t_wait;
+
+    recall = checkStore(&store, data_tst, label_tst, &correct);
+    knnStoreStats(&store, &stats);
+    printf("After compaction: %d objects, %d tombstoned, %d indexed, generation %d\n",
+            stats.count, stats.dead, stats.indexed, (int) stats.generation);
+    printf("Total of %d correctly classified (%.2f%%), neighbour recall %.2f%%\n",
+            correct, (correct * 100.0)/NUM_TST_OBJ, recall);
+    printf("Appends of %d objects and indexing (us): %d\nRemovals (us): %d\n"
+            "Background compaction (us): %d, %d queries served meanwhile\n",
+            opts->update_batch, (int) (t_append / 1000), (int) (t_remove / 1000),
+            (int) (t_wait / 1000), (int) queries);
+
+    knnStoreFree(&store);
+    return 0;
+}
+
+/**
+ * @brief Classifies the testing set streaming the training set from disk
+ *
+ * Only the testing set and the training labels are loaded; the training
+ * features are read block by block by a reader thread while the previous
+ * block is scanned. Runs before readDataset().
+ *
+ * @param opts Command line options
+ * @return 0 on success.
+ */
+int runStream(const RunOptions *opts){
+
+    DistIndexPair *neighbours = malloc(sizeof(DistIndexPair) * NUM_TST_OBJ * K);
+    KnnStreamStats stats;
+    float *data_tst;
+    int *label_tst, *label_trn;
+    int closest[K];
+    int votes[CLASSES];
+    int i, j, correct = 0;
+
+    if (loadBinarySet(TST_DATA_BIN, TST_LABEL_BIN, NUM_TST_OBJ, FEATURES,
+            &data_tst, &label_tst) != 0 ||
+        loadBinaryLabels(TRN_LABEL_BIN, NUM_TRN_OBJ, &label_trn) != 0){
+        printf("Error reading input files!\n");
+        return -1;
+    }
+    if (knnStreamNeighbours(TRN_DATA_BIN, NUM_TRN_OBJ, FEATURES, data_tst,
+            NUM_TST_OBJ, K, opts->stream_block, neighbours, &stats) != 0){
+        printf("Error streaming %s!\n", TRN_DATA_BIN);
+        return -1;
+    }
+
+    for (i = 0; i < NUM_TST_OBJ; i++){
+        for (j = 0; j < K; j++){
+            closest[j] = label_trn[ neighbours[i*K + j].index ];
+        }
+        if (majorityVote(closest, K, votes, CLASSES) == label_tst[i]){
+            correct++;
         }
     }
+    printf("Total of %d correctly classified (%.2f%%)\n", correct,
+            (correct * 100.0)/NUM_TST_OBJ);
+    printf("Streamed %.2f MB in %d blocks of %d objects\n", stats.bytes / 1e6,
+            stats.blocks, opts->stream_block);
+    printf("Total (us): %d\nRead (us): %d\nScan (us): %d\nScan waiting for reads (us): %d\n"
+            "Throughput (MB/s): %.1f\n", (int) (stats.total_ns / 1000),
+            (int) (stats.read_ns / 1000), (int) (stats.scan_ns / 1000),
+            (int) (stats.wait_ns / 1000), stats.bytes * 1e3 / stats.total_ns);
+
+    free(neighbours); free(data_tst); free(label_tst); free(label_trn);
+    return 0;
 }
 
 /**
@@ -142,8 +1187,14 @@ int main(int argc, char** argv){
     int i,j;
     int correct = 0;    /**< Number of correctly classified objects */
     int votes[CLASSES]; /**< Array for storing the class of each K nearest neighbour */
+    int closest[K];     /**< Labels of the K nearest neighbours */
     int assigned_label; /**< Label assigned to a single test object */
+    int label_prediction[NUM_TST_OBJ]; /**< Final classification output */
     float accuracy;     /**< correctly_classified / total */
+    RunOptions opts;    /**< Command line options */
+    KnnArena arena;     /**< Holds the distance matrix */
+    DistLabelPair *dist_label;  /**< Distance matrix (NUM_TST_OBJ x NUM_TRN_OBJ) */
+    int opt;
    
     /* SW - Fill dataset arrays */
     float *data_trn;
@@ -151,11 +1202,117 @@ int main(int argc, char** argv){
     int *label_trn;
     int *label_tst;  
     
-    DistLabelPair **dist_label = malloc(sizeof(DistLabelPair*) * NUM_TST_OBJ);
-    for (i = 0; i < NUM_TST_OBJ; i++){
-        dist_label[i] = malloc(sizeof(DistLabelPair) * NUM_TRN_OBJ);
+    opts.kmax = 0;
+    opts.folds = 0;
+    opts.graph_k = 0;
+    opts.output = NULL;
+    opts.threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    opts.metric = -1;
+    opts.vote = -1;
+    opts.pipeline = 0;
+    opts.block = 0;
+    opts.abandon = 0;
+    opts.pivots = 0;
+    opts.morton = 0;
+    opts.proj_dim = 0;
+    opts.proj_random = 0;
+    opts.rerank = 0;
+    opts.normalize = 0;
+    opts.lsh_tables = 0;
+    opts.lsh_hashes = LSH_HASHES;
+    opts.lsh_probes = 0;
+    opts.update_batch = 0;
+    opts.stream_block = 0;
+    opts.cache = NULL;
+    while ((opt = getopt(argc, argv, "s:c:g:o:t:m:w:pb:aP:zd:jx:nl:H:r:u:S:C:")) != -1){
+        switch (opt){
+        case 's': opts.kmax = atoi(optarg); break;
+        case 'c': opts.folds = atoi(optarg); break;
+        case 'g': opts.graph_k = atoi(optarg); break;
+        case 'o': opts.output = optarg; break;
+        case 't': opts.threads = atoi(optarg); break;
+        case 'm':
+            if ((opts.metric = knnParseMetric(optarg)) < 0){
+                printf("Unknown metric %s (l2, l1, linf, cos)\n", optarg);
+                return -1;
+            }
+            break;
+        case 'w':
+            if ((opts.vote = knnParseVote(optarg)) < 0){
+                printf("Unknown vote policy %s (majority, invdist)\n", optarg);
+                return -1;
+            }
+            break;
+        case 'p': opts.pipeline = 1; break;
+        case 'b': opts.block = atoi(optarg); break;
+        case 'a': opts.abandon = 1; break;
+        case 'P': opts.pivots = atoi(optarg); break;
+        case 'z': opts.morton = 1; break;
+        case 'd': opts.proj_dim = atoi(optarg); break;
+        case 'j': opts.proj_random = 1; break;
+        case 'x': opts.rerank = atoi(optarg); break;
+        case 'n': opts.normalize = 1; break;
+        case 'l': opts.lsh_tables = atoi(optarg); break;
+        case 'H': opts.lsh_hashes = atoi(optarg); break;
+        case 'r': opts.lsh_probes = atoi(optarg); break;
+        case 'u': opts.update_batch = atoi(optarg); break;
+        case 'S': opts.stream_block = atoi(optarg); break;
+        case 'C': opts.cache = optarg; break;
+        default:
+            printf("Usage: %s [-s kmax] [-c folds] [-g k] [-o file] [-t threads]"
+                    " [-m metric] [-w vote] [-p] [-b 8|16] [-a] [-P pivots] [-z]"
+                    " [-d dim [-j] [-x candidates]] [-n]"
+                    " [-l tables [-H hashes] [-r probes]] [-u batch] [-S block] [-C file]\n", argv[0]);
+            return -1;
+        }
+    }
+
+    if (opts.stream_block > 0){
+        return runStream(&opts);
     }
+
+    knnPerfInit();
+
+    knnPerfBegin(KNN_PHASE_LOAD);
     readDataset(&data_trn, &data_tst, &label_trn, &label_tst);    
+    knnPerfEnd(KNN_PHASE_LOAD);
+
+    if (opts.graph_k > 0){
+        return runGraph(&opts, data_trn, label_trn);
+    }
+    if (opts.kmax > 0 || opts.folds > 1){
+        return runEvaluation(&opts, data_trn, data_tst, label_trn, label_tst);
+    }
+    if (opts.metric >= 0 || opts.vote >= 0 || opts.cache != NULL){
+        return runPolicy(&opts, data_trn, data_tst, label_trn, label_tst);
+    }
+    if (opts.pipeline){
+        return runPipeline(data_trn, data_tst, label_trn, label_tst);
+    }
+    if (opts.block > 0){
+        return runBlocked(&opts, data_tst, label_tst);
+    }
+    if (opts.abandon){
+        return runAbandon(data_trn, data_tst, label_trn, label_tst);
+    }
+    if (opts.pivots > 0){
+        return runPivots(&opts, data_trn, data_tst, label_trn, label_tst);
+    }
+    if (opts.morton){
+        return runMorton(data_trn, data_tst, label_trn, label_tst);
+    }
+    if (opts.proj_dim > 0){
+        return runProject(&opts, data_trn, data_tst, label_trn, label_tst);
+    }
+    if (opts.normalize){
+        return runNormalized(data_trn, data_tst, label_tst);
+    }
+    if (opts.update_batch > 0){
+        return runUpdates(&opts, data_trn, data_tst, label_trn, label_tst);
+    }
+    if (opts.lsh_tables > 0){
+        return runLsh(&opts, data_trn, data_tst, label_trn, label_tst);
+    }
 
     // DEBUG
     
@@ -177,38 +1334,45 @@ int main(int argc, char** argv){
         printf("%d (%s)\n", label_tst[i], label_strings[label_tst[i]]);
     }
 
+    /* One slab for the whole distance matrix */
+    if (knnArenaInit(&arena, sizeof(DistLabelPair) * NUM_TST_OBJ * NUM_TRN_OBJ) != 0){
+        printf("Cannot allocate the distance matrix\n");
+        return -1;
+    }
+    dist_label = knnArenaAlloc(&arena, sizeof(DistLabelPair) * NUM_TST_OBJ * NUM_TRN_OBJ);
+
     /* Calculate distance matrix */
+    knnPerfBegin(KNN_PHASE_DISTANCE);
     /* For object in testing set */
     for (i = 0; i < NUM_TST_OBJ; i++){
         for(j = 0; j < NUM_TRN_OBJ; j++){
-        	dist_label[i][j].distance = distance( &(data_tst[i*FEATURES]), &(data_trn[j*FEATURES]), FEATURES);
-        	dist_label[i][j].label = label_trn[j];
-        	//printf("tst obj %d - distance to trn obj %d of class %d is %f \n", i, j, label_trn[j], dist_label[i][j].distance);
+        	dist_label[(size_t) i*NUM_TRN_OBJ + j].distance = distance( &(data_tst[i*FEATURES]), &(data_trn[j*FEATURES]), FEATURES);
+        	dist_label[(size_t) i*NUM_TRN_OBJ + j].label = label_trn[j];
+        	//printf("tst obj %d - distance to trn obj %d of class %d is %f \n", i, j, label_trn[j], dist_label[(size_t) i*NUM_TRN_OBJ + j].distance);
         }
     }
 
-    /* From the distance matrix assign labels to testing objects */
-    for (i = 0; i <  NUM_TST_OBJ; i++){
+    knnPerfEnd(KNN_PHASE_DISTANCE);
 
-        selectionSortK((DistLabelPair*) (dist_label[i]), NUM_TRN_OBJ, K);
-        for (j = 0; j < CLASSES; j++){
-            votes[j] = 0;
-        }
+    /* Select the K nearest neighbours of each testing object */
+    knnPerfBegin(KNN_PHASE_SELECTION);
+    for (i = 0; i <  NUM_TST_OBJ; i++){
+        selectionSortK(&(dist_label[(size_t) i*NUM_TRN_OBJ]), NUM_TRN_OBJ, K);
+    }
+    knnPerfEnd(KNN_PHASE_SELECTION);
 
+    /* From the distance matrix assign labels to testing objects */
+    knnPerfBegin(KNN_PHASE_VOTING);
+    for (i = 0; i <  NUM_TST_OBJ; i++){
         for (j = 0; j < K; j++){
-            votes[ dist_label[i][j].label ]++;
+            closest[j] = dist_label[(size_t) i*NUM_TRN_OBJ + j].label;
         }
+        label_prediction[i] = majorityVote(closest, K, votes, CLASSES);
+    }
+    knnPerfEnd(KNN_PHASE_VOTING);
 
-        assigned_label = 0;
-        int vote = 0;
-        
-        for (j = 0; j < CLASSES; j++){
-            if (votes[j] > vote){
-            	vote = votes[j];
-                assigned_label = j;
-            }
-        }
-        
+    for (i = 0; i <  NUM_TST_OBJ; i++){
+        assigned_label = label_prediction[i];
         if (assigned_label == label_tst[i]){
             correct++;
         }
@@ -218,5 +1382,9 @@ int main(int argc, char** argv){
     accuracy = (correct * 100.0)/NUM_TST_OBJ;
     printf("Total of %d correctly classified (%.2f%%)\n", correct, accuracy);
 
+    knnPerfReport((uint64_t) NUM_TST_OBJ * NUM_TRN_OBJ);
+    knnPerfClose();
+    knnArenaFree(&arena);
+
     return 0;
 }
@@ -0,0 +1,674 @@
+/*
+ * @file knn_bench.c
+ * @brief Micro-benchmark suite for the individual KNN kernels
+ *
+ * Measures each kernel of the classifier on its own: every distance
+ * kernel variant, every top-K selector, the majority vote, the
+ * specialized pipelines against the generic one and the dataset loader.
+ * Each case is warmed up, repeated, stripped of slow outliers (median +
+ * 3 scaled MADs) and timed with the cycle counter. Results are reported
+ * in ns/element and GB/s.
+ *
+ * Usage: knn_bench [-r reps] [-w warmup] [-b budget_ms] [-n max_n]
+ *                  [dist] [topk] [vote] [pipe] [load]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "knn_kernels.h"
+#include "knn_policy.h"
+#include "knn_pipeline.h"
+#include "knn_layout.h"
+#include "knn_dataset.h"
+#include "knn_timer.h"
+
+/************************************************************************/
+
+/* Macros Definition */
+
+/** Default number of timed repetitions per case */
+#define BENCH_REPS 15
+/** Default number of untimed warm-up runs per case */
+#define BENCH_WARMUP 2
+/** Default time budget per case (ms), repetitions are cut to fit */
+#define BENCH_BUDGET_MS 2000
+/** Minimum number of timed repetitions per case */
+#define BENCH_MIN_REPS 3
+/** Maximum number of samples kept per case */
+#define BENCH_MAX_REPS 1000
+/** Default largest array size for the top-K sweep */
+#define BENCH_MAX_N 10000000
+/** Rows scanned by each distance case */
+#define BENCH_DIST_ROWS (1 << 16)
+/** Queries voted in each voting case */
+#define BENCH_VOTE_QUERIES (1 << 14)
+/** Training objects scanned by each pipeline case */
+#define BENCH_PIPE_TRN 4096
+/** Queries classified by each pipeline case */
+#define BENCH_PIPE_QUERIES 64
+/** Classes of the pipeline cases */
+#define BENCH_PIPE_CLASSES 8
+/** Objects in the synthetic loader set */
+#define BENCH_LOAD_OBJS (1 << 20)
+/** Features in the synthetic loader set */
+#define BENCH_LOAD_FEATURES 12
+
+/************************************************************************/
+
+/* Types */
+
+/** @brief A single benchmark case */
+typedef struct BenchCase_Struct{
+    const char *suite;          /**< Suite the case belongs to */
+    char name[64];              /**< Kernel and parameters */
+    void (*setup)(void *arg);   /**< Untimed preparation before each run, may be NULL */
+    void (*run)(void *arg);     /**< Timed body */
+    void *arg;                  /**< Argument passed to setup and run */
+    double elements;            /**< Elements processed per run */
+    double bytes;               /**< Bytes of input touched per run */
+}BenchCase;
+
+/** @brief Benchmark runner configuration */
+typedef struct BenchConfig_Struct{
+    int reps;                   /**< Timed repetitions */
+    int warmup;                 /**< Untimed warm-up runs */
+    int budget_ms;              /**< Time budget per case */
+    long max_n;                 /**< Largest N in the top-K sweep */
+    double cycles_per_ns;       /**< Calibrated cycle counter rate */
+}BenchConfig;
+
+/** @brief Arguments of a distance case */
+typedef struct DistArg_Struct{
+    int variant;                /**< 0 distance, 1 distanceUnrolled, 2 distanceBatch,
+                                     3..6 knnDistance_{L2SQ,L1,LINF,COSINE},
+                                     7..8 knnBlockedDistances 8/16 */
+    int features;               /**< Feature dimensionality */
+    int rows;                   /**< Number of training rows */
+    float *query;               /**< Query feature vector */
+    float *data;                /**< Row-major training rows */
+    float *out;                 /**< Output distances */
+    KnnBlockedSet blocked[2];   /**< data in blocks of 8 and 16 */
+}DistArg;
+
+/** @brief Arguments of a top-K case */
+typedef struct TopKArg_Struct{
+    int variant;                /**< 0 selectionSortK, 1 selectInsertionK, 2 selectHeapK */
+    int n;                      /**< Number of candidate distances */
+    int k;                      /**< Number of neighbours */
+    const float *distances;     /**< Pristine candidate distances */
+    const DistLabelPair *pairs; /**< Pristine candidate pairs */
+    DistLabelPair *work;        /**< Scratch copy sorted in place */
+    DistIndexPair *out;         /**< Selected neighbours */
+}TopKArg;
+
+/** @brief Arguments of a voting case */
+typedef struct VoteArg_Struct{
+    int queries;                /**< Number of voted queries */
+    int k;                      /**< Neighbours per query */
+    int classes;                /**< Number of classes */
+    const int *labels;          /**< Neighbour labels (queries x k) */
+    int *votes;                 /**< Vote counters */
+}VoteArg;
+
+/** @brief Arguments of a pipeline case */
+typedef struct PipeArg_Struct{
+    KnnPipelineFn fn;           /**< Pipeline under test */
+    int features;               /**< Feature dimensionality */
+    int k;                      /**< Number of neighbours */
+    const float *queries;       /**< Query feature vectors */
+    const float *data;          /**< Training feature vectors */
+    const int *labels;          /**< Training labels */
+    int *out;                   /**< Predicted labels */
+    int failed;                 /**< A run returned an error */
+}PipeArg;
+
+/** @brief Arguments of a loader case */
+typedef struct LoadArg_Struct{
+    const char *data_bin;       /**< Feature vectors file */
+    const char *label_bin;      /**< Labels file */
+    int num_obj;                /**< Objects in the set */
+    int features;               /**< Features per object */
+    float *data;                /**< Loaded feature vectors */
+    int *labels;                /**< Loaded labels */
+}LoadArg;
+
+/************************************************************************/
+
+/* Global Variables */
+
+/** Sink preventing the compiler from discarding kernel results */
+volatile float bench_sink;
+
+/************************************************************************/
+
+/* Runner */
+
+/** @brief Ascending comparison of doubles for qsort */
+static int cmpDouble(const void *a, const void *b){
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Runs one case and prints its line of the report
+ *
+ * @param cfg Runner configuration
+ * @param bc Benchmark case
+ */
+static void benchRun(const BenchConfig *cfg, BenchCase *bc){
+
+    static double samples[BENCH_MAX_REPS];
+    static double deviations[BENCH_MAX_REPS];
+    uint64_t c0, c1;
+    double median, mad, cutoff, sum, best, first = 0.0;
+    int i, reps, kept;
+
+    /* Warm-up, also sizes the repetitions to the time budget */
+    for (i = 0; i < cfg->warmup || i == 0; i++){
+        if (bc->setup){
+            bc->setup(bc->arg);
+        }
+        c0 = knnCycles();
+        bc->run(bc->arg);
+        c1 = knnCycles();
+        first = (c1 - c0) / cfg->cycles_per_ns;
+    }
+    reps = cfg->reps;
+    if (first * reps > cfg->budget_ms * 1e6){
+        reps = (int) (cfg->budget_ms * 1e6 / first);
+    }
+    if (reps < BENCH_MIN_REPS){
+        reps = BENCH_MIN_REPS;
+    }
+    if (reps > BENCH_MAX_REPS){
+        reps = BENCH_MAX_REPS;
+    }
+
+    for (i = 0; i < reps; i++){
+        if (bc->setup){
+            bc->setup(bc->arg);
+        }
+        c0 = knnCycles();
+        bc->run(bc->arg);
+        c1 = knnCycles();
+        samples[i] = (c1 - c0) / cfg->cycles_per_ns;
+    }
+
+    /* Outlier rejection: drop samples above median + 3 scaled MADs */
+    qsort(samples, reps, sizeof(double), cmpDouble);
+    median = samples[reps/2];
+    for (i = 0; i < reps; i++){
+        deviations[i] = (samples[i] > median) ? samples[i] - median : median - samples[i];
+    }
+    qsort(deviations, reps, sizeof(double), cmpDouble);
+    mad = 1.4826 * deviations[reps/2];
+    cutoff = median + 3.0 * mad;
+
+    sum = 0.0;
+    kept = 0;
+    best = samples[0];
+    for (i = 0; i < reps; i++){
+        if (samples[i] <= cutoff){
+            sum += samples[i];
+            kept++;
+        }
+    }
+    sum /= kept;
+
+    printf("%-5s %-34s %10.3f %10.3f %9.3f %12.1f %12.1f %4d/%d\n",
+            bc->suite, bc->name,
+            median / bc->elements, best / bc->elements,
+            bc->bytes / median,
+            median / 1000.0, sum / 1000.0, kept, reps);
+}
+
+/** @brief Prints the report header */
+static void benchHeader(void){
+    printf("%-5s %-34s %10s %10s %9s %12s %12s %s\n",
+            "suite", "case", "ns/elem", "best", "GB/s",
+            "median(us)", "mean(us)", "kept");
+}
+
+/************************************************************************/
+
+/* Helpers */
+
+/** @brief Allocates n floats uniformly distributed in [0, 1) */
+static float *randomFloats(long n){
+    long i;
+    float *a = malloc(sizeof(float) * n);
+
+    if (a == NULL){
+        printf("Out of memory!\n");
+        exit(-1);
+    }
+    for (i = 0; i < n; i++){
+        a[i] = (float) rand() / ((float) RAND_MAX + 1.0f);
+    }
+    return a;
+}
+
+/************************************************************************/
+
+/* Distance kernels */
+
+/** @brief Timed body of a distance case */
+static void distRun(void *arg){
+    DistArg *d = arg;
+    int j;
+
+    switch (d->variant){
+    case 0:
+        for (j = 0; j < d->rows; j++){
+            d->out[j] = distance(d->query, &(d->data[j*d->features]), d->features);
+        }
+        break;
+    case 1:
+        for (j = 0; j < d->rows; j++){
+            d->out[j] = distanceUnrolled(d->query, &(d->data[j*d->features]), d->features);
+        }
+        break;
+    case 2:
+        distanceBatch(d->query, d->data, d->rows, d->features, d->out);
+        break;
+    case 3:
+        for (j = 0; j < d->rows; j++){
+            d->out[j] = knnDistance_L2SQ(d->query, &(d->data[j*d->features]), d->features);
+        }
+        break;
+    case 4:
+        for (j = 0; j < d->rows; j++){
+            d->out[j] = knnDistance_L1(d->query, &(d->data[j*d->features]), d->features);
+        }
+        break;
+    case 5:
+        for (j = 0; j < d->rows; j++){
+            d->out[j] = knnDistance_LINF(d->query, &(d->data[j*d->features]), d->features);
+        }
+        break;
+    case 6:
+        for (j = 0; j < d->rows; j++){
+            d->out[j] = knnDistance_COSINE(d->query, &(d->data[j*d->features]), d->features);
+        }
+        break;
+    default:
+        knnBlockedDistances(&(d->blocked[d->variant - 7]), d->query, d->out);
+        break;
+    }
+    bench_sink = d->out[d->rows - 1];
+}
+
+/** @brief Distance kernel suite */
+static void benchDistance(const BenchConfig *cfg){
+
+    static const int features[] = { 4, 12, 16, 32, 64 };
+    static const char *names[] = { "distance", "distanceUnrolled", "distanceBatch",
+            "policy L2SQ", "policy L1", "policy LINF", "policy COSINE",
+            "blocked B=8", "blocked B=16" };
+    int *labels = calloc(BENCH_DIST_ROWS, sizeof(int));
+    BenchCase bc;
+    DistArg arg;
+    unsigned f;
+    int v;
+
+    for (f = 0; f < sizeof(features)/sizeof(features[0]); f++){
+        arg.features = features[f];
+        arg.rows = BENCH_DIST_ROWS;
+        arg.query = randomFloats(arg.features);
+        arg.data = randomFloats((long) arg.rows * arg.features);
+        arg.out = malloc(sizeof(float) * arg.rows);
+        knnBlockedFromRows(arg.data, labels, arg.rows, arg.features,
+                KNN_LAYOUT_BLOCK8, &arg.blocked[0]);
+        knnBlockedFromRows(arg.data, labels, arg.rows, arg.features,
+                KNN_LAYOUT_BLOCK16, &arg.blocked[1]);
+
+        for (v = 0; v < (int) (sizeof(names)/sizeof(names[0])); v++){
+            arg.variant = v;
+            bc.suite = "dist";
+            snprintf(bc.name, sizeof(bc.name), "%s F=%d", names[v], arg.features);
+            bc.setup = NULL;
+            bc.run = distRun;
+            bc.arg = &arg;
+            bc.elements = (double) arg.rows * arg.features;
+            bc.bytes = bc.elements * sizeof(float);
+            benchRun(cfg, &bc);
+        }
+        free(arg.query); free(arg.data); free(arg.out);
+        knnBlockedFree(&arg.blocked[0]); knnBlockedFree(&arg.blocked[1]);
+    }
+    free(labels);
+}
+
+/************************************************************************/
+
+/* Top-K selectors */
+
+/** @brief Restores the pristine candidates sorted in place by selectionSortK */
+static void topkSetup(void *arg){
+    TopKArg *t = arg;
+
+    if (t->variant == 0){
+        memcpy(t->work, t->pairs, sizeof(DistLabelPair) * t->n);
+    }
+}
+
+/** @brief Timed body of a top-K case */
+static void topkRun(void *arg){
+    TopKArg *t = arg;
+
+    switch (t->variant){
+    case 0:
+        selectionSortK(t->work, t->n, t->k);
+        bench_sink = t->work[t->k - 1].distance;
+        break;
+    case 1:
+        selectInsertionK(t->distances, t->n, t->k, t->out);
+        bench_sink = t->out[t->k - 1].distance;
+        break;
+    default:
+        selectHeapK(t->distances, t->n, t->k, t->out);
+        bench_sink = t->out[t->k - 1].distance;
+        break;
+    }
+}
+
+/** @brief Top-K selector suite, K in 1..64 and N in 10^2..max_n */
+static void benchTopK(const BenchConfig *cfg){
+
+    static const int ks[] = { 1, 2, 4, 8, 16, 32, 64 };
+    static const char *names[] = { "selectionSortK", "selectInsertionK", "selectHeapK" };
+    BenchCase bc;
+    TopKArg arg;
+    DistLabelPair *pairs;
+    DistIndexPair out[64];
+    float *distances;
+    long n, i;
+    unsigned k;
+    int v;
+
+    for (n = 100; n <= cfg->max_n; n *= 10){
+        distances = randomFloats(n);
+        pairs = malloc(sizeof(DistLabelPair) * n);
+        arg.work = malloc(sizeof(DistLabelPair) * n);
+        for (i = 0; i < n; i++){
+            pairs[i].distance = distances[i];
+            pairs[i].label = (int) i;
+        }
+        arg.n = (int) n;
+        arg.distances = distances;
+        arg.pairs = pairs;
+        arg.out = out;
+
+        for (k = 0; k < sizeof(ks)/sizeof(ks[0]); k++){
+            arg.k = ks[k];
+            for (v = 0; v < 3; v++){
+                arg.variant = v;
+                bc.suite = "topk";
+                snprintf(bc.name, sizeof(bc.name), "%s N=%ld K=%d", names[v], n, arg.k);
+                bc.setup = topkSetup;
+                bc.run = topkRun;
+                bc.arg = &arg;
+                bc.elements = (double) n;
+                bc.bytes = (double) n * ((v == 0) ? sizeof(DistLabelPair) : sizeof(float));
+                benchRun(cfg, &bc);
+            }
+        }
+        free(distances); free(pairs); free(arg.work);
+    }
+}
+
+/************************************************************************/
+
+/* Voting */
+
+/** @brief Timed body of a voting case */
+static void voteRun(void *arg){
+    VoteArg *v = arg;
+    int i;
+    int acc = 0;
+
+    for (i = 0; i < v->queries; i++){
+        acc += majorityVote(&(v->labels[i*v->k]), v->k, v->votes, v->classes);
+    }
+    bench_sink = (float) acc;
+}
+
+/** @brief Voting suite for different CLASSES and K */
+static void benchVote(const BenchConfig *cfg){
+
+    static const int classes[] = { 2, 3, 8, 16, 64 };
+    static const int ks[] = { 3, 16, 64 };
+    BenchCase bc;
+    VoteArg arg;
+    int *labels;
+    unsigned c, k;
+    long i;
+
+    for (c = 0; c < sizeof(classes)/sizeof(classes[0]); c++){
+        for (k = 0; k < sizeof(ks)/sizeof(ks[0]); k++){
+            arg.queries = BENCH_VOTE_QUERIES;
+            arg.k = ks[k];
+            arg.classes = classes[c];
+            labels = malloc(sizeof(int) * arg.queries * arg.k);
+            for (i = 0; i < (long) arg.queries * arg.k; i++){
+                labels[i] = rand() % arg.classes;
+            }
+            arg.labels = labels;
+            arg.votes = malloc(sizeof(int) * arg.classes);
+
+            bc.suite = "vote";
+            snprintf(bc.name, sizeof(bc.name), "majorityVote CLASSES=%d K=%d",
+                    arg.classes, arg.k);
+            bc.setup = NULL;
+            bc.run = voteRun;
+            bc.arg = &arg;
+            bc.elements = (double) arg.queries * arg.k;
+            bc.bytes = bc.elements * sizeof(int);
+            benchRun(cfg, &bc);
+
+            free(labels); free(arg.votes);
+        }
+    }
+}
+
+/************************************************************************/
+
+/* Pipelines */
+
+/** @brief Timed body of a pipeline case */
+static void pipeRun(void *arg){
+    PipeArg *p = arg;
+
+    if (p->fn(p->queries, BENCH_PIPE_QUERIES, p->data, p->labels, BENCH_PIPE_TRN,
+            p->features, p->k, BENCH_PIPE_CLASSES, p->out) != 0){
+        p->failed = 1;
+    }
+    bench_sink = (float) p->out[0];
+}
+
+/** @brief Specialized pipelines against the generic pipeline */
+static void benchPipeline(const BenchConfig *cfg){
+
+    static const int features[] = { 4, 12, 16, 32, 64 };
+    static const int ks[] = { 1, 4, 8, 16 };
+    BenchCase bc;
+    PipeArg arg;
+    float *queries, *data;
+    int *labels;
+    unsigned f, k;
+    int i, v;
+
+    labels = malloc(sizeof(int) * BENCH_PIPE_TRN);
+    for (i = 0; i < BENCH_PIPE_TRN; i++){
+        labels[i] = rand() % BENCH_PIPE_CLASSES;
+    }
+    arg.labels = labels;
+    arg.out = malloc(sizeof(int) * BENCH_PIPE_QUERIES);
+
+    for (f = 0; f < sizeof(features)/sizeof(features[0]); f++){
+        queries = randomFloats((long) BENCH_PIPE_QUERIES * features[f]);
+        data = randomFloats((long) BENCH_PIPE_TRN * features[f]);
+        arg.queries = queries;
+        arg.data = data;
+        arg.features = features[f];
+        for (k = 0; k < sizeof(ks)/sizeof(ks[0]); k++){
+            arg.k = ks[k];
+            for (v = 0; v < 2; v++){
+                arg.fn = v ? knnPipelineSelect(arg.features, arg.k, BENCH_PIPE_CLASSES)
+                           : knnPipelineGeneric;
+                bc.suite = "pipe";
+                snprintf(bc.name, sizeof(bc.name), "%s F=%d K=%d",
+                        v ? "specialized" : "generic", arg.features, arg.k);
+                bc.setup = NULL;
+                bc.run = pipeRun;
+                bc.arg = &arg;
+                bc.elements = (double) BENCH_PIPE_QUERIES * BENCH_PIPE_TRN * arg.features;
+                bc.bytes = (double) BENCH_PIPE_QUERIES * BENCH_PIPE_TRN * arg.features * sizeof(float);
+                arg.failed = 0;
+                benchRun(cfg, &bc);
+                if (arg.failed){
+                    printf("Error running %s, timings above are not valid!\n", bc.name);
+                }
+            }
+        }
+        free(queries); free(data);
+    }
+    free(labels); free(arg.out);
+}
+
+/************************************************************************/
+
+/* Loader */
+
+/** @brief Releases the set loaded by the previous run */
+static void loadSetup(void *arg){
+    LoadArg *l = arg;
+
+    free(l->data); free(l->labels);
+    l->data = NULL; l->labels = NULL;
+}
+
+/** @brief Timed body of a loader case */
+static void loadRun(void *arg){
+    LoadArg *l = arg;
+
+    if (loadBinarySet(l->data_bin, l->label_bin, l->num_obj, l->features,
+            &l->data, &l->labels) != 0){
+        printf("Error reading input files!\n");
+        exit(-1);
+    }
+}
+
+/** @brief Writes n items of size bytes to a new temporary file */
+static void writeTemp(char *path, const void *buf, size_t size, size_t n){
+    int fd = mkstemp(path);
+    FILE *fp = (fd < 0) ? NULL : fdopen(fd, "wb");
+
+    if (fp == NULL || fwrite(buf, size, n, fp) != n){
+        printf("Error writing %s!\n", path);
+        exit(-1);
+    }
+    fclose(fp);
+}
+
+/** @brief Loader throughput on a synthetic set in the page cache */
+static void benchLoad(const BenchConfig *cfg){
+
+    char data_bin[] = "/tmp/knn_bench_data_XXXXXX";
+    char label_bin[] = "/tmp/knn_bench_label_XXXXXX";
+    BenchCase bc;
+    LoadArg arg;
+    float *data;
+    int *labels;
+    long i;
+
+    arg.num_obj = BENCH_LOAD_OBJS;
+    arg.features = BENCH_LOAD_FEATURES;
+    data = randomFloats((long) arg.num_obj * arg.features);
+    labels = malloc(sizeof(int) * arg.num_obj);
+    for (i = 0; i < arg.num_obj; i++){
+        labels[i] = (int) (i & 1);
+    }
+    writeTemp(data_bin, data, sizeof(float), (size_t) arg.num_obj * arg.features);
+    writeTemp(label_bin, labels, sizeof(int), arg.num_obj);
+    free(data); free(labels);
+
+    arg.data_bin = data_bin;
+    arg.label_bin = label_bin;
+    arg.data = NULL;
+    arg.labels = NULL;
+
+    bc.suite = "load";
+    snprintf(bc.name, sizeof(bc.name), "loadBinarySet N=%d F=%d",
+            arg.num_obj, arg.features);
+    bc.setup = loadSetup;
+    bc.run = loadRun;
+    bc.arg = &arg;
+    bc.elements = (double) arg.num_obj;
+    bc.bytes = (double) arg.num_obj * (arg.features * sizeof(float) + sizeof(int));
+    benchRun(cfg, &bc);
+
+    loadSetup(&arg);
+    unlink(data_bin);
+    unlink(label_bin);
+}
+
+/************************************************************************/
+
+/**
+ * @brief main program
+ * @param argc Argument count
+ * @param argv Argument values
+ * @return 0 on success.
+ */
+int main(int argc, char** argv){
+
+    BenchConfig cfg;
+    int run_dist = 0, run_topk = 0, run_vote = 0, run_pipe = 0, run_load = 0;
+    int opt, i;
+
+    cfg.reps = BENCH_REPS;
+    cfg.warmup = BENCH_WARMUP;
+    cfg.budget_ms = BENCH_BUDGET_MS;
+    cfg.max_n = BENCH_MAX_N;
+
+    while ((opt = getopt(argc, argv, "r:w:b:n:")) != -1){
+        switch (opt){
+        case 'r': cfg.reps = atoi(optarg); break;
+        case 'w': cfg.warmup = atoi(optarg); break;
+        case 'b': cfg.budget_ms = atoi(optarg); break;
+        case 'n': cfg.max_n = atol(optarg); break;
+        default:
+            printf("Usage: %s [-r reps] [-w warmup] [-b budget_ms] [-n max_n]"
+                    " [dist] [topk] [vote] [pipe] [load]\n", argv[0]);
+            return -1;
+        }
+    }
+    for (i = optind; i < argc; i++){
+        if (strcmp(argv[i], "dist") == 0) run_dist = 1;
+        else if (strcmp(argv[i], "topk") == 0) run_topk = 1;
+        else if (strcmp(argv[i], "vote") == 0) run_vote = 1;
+        else if (strcmp(argv[i], "pipe") == 0) run_pipe = 1;
+        else if (strcmp(argv[i], "load") == 0) run_load = 1;
+    }
+    if (optind == argc){
+        run_dist = run_topk = run_vote = run_pipe = run_load = 1;
+    }
+
+    srand(42);
+    cfg.cycles_per_ns = knnCyclesPerNano(100);
+    printf("Cycle counter: %.3f ticks/ns, %d reps, %d warm-up, %d ms budget\n",
+            cfg.cycles_per_ns, cfg.reps, cfg.warmup, cfg.budget_ms);
+    benchHeader();
+
+    if (run_dist) benchDistance(&cfg);
+    if (run_topk) benchTopK(&cfg);
+    if (run_vote) benchVote(&cfg);
+    if (run_pipe) benchPipeline(&cfg);
+    if (run_load) benchLoad(&cfg);
+
+    return 0;
+}
@@ -0,0 +1,370 @@
+/*
+ * @file knn_load.c
+ * @brief Open-loop load generator for knn_server
+ *
+ * Replays testing vectors against a running knn_server at a fixed or
+ * Poisson arrival rate and sweeps the offered rate to find where the
+ * server saturates. Each connection has a sender thread, which sends
+ * every request at its scheduled time whether or not earlier ones were
+ * answered, and a receiver thread, which timestamps the responses.
+ *
+ * Two latencies are recorded per request in HDR-style histograms
+ * (knn_hist.c): the service time, from the moment the request was
+ * written, and the corrected latency, from the moment it was scheduled.
+ * When the server falls behind, the sender blocks on a full socket and
+ * writes late; the service time then hides the queueing (coordinated
+ * omission), the corrected latency does not.
+ *
+ * The sweep starts at start_rate requests/s and multiplies it by step
+ * until max_rate, or until the server saturates: throughput below 95% of
+ * the offered rate, or a corrected p99 over the SLO.
+ * The knee is the last rate that met both. The vectors repeat, so run
+ * the server without its query cache (no -Q) to measure classification.
+ *
+ * Usage: knn_load [-s socket] [-c conns] [-v vectors] [-k k] [-p]
+ *                 [-d seconds] [-r start_rate] [-R max_rate] [-x step]
+ *                 [-l slo_us] tst_data num_tst features
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "knn_dataset.h"
+#include "knn_hist.h"
+#include "knn_protocol.h"
+#include "knn_timer.h"
+
+/************************************************************************/
+
+/* Macros Definition */
+
+/** Default number of connections */
+#define LOAD_CONNS 4
+/** Default vectors per request */
+#define LOAD_VECTORS 1
+/** Default K */
+#define LOAD_K 3
+/** Default duration of each step (s) */
+#define LOAD_SECONDS 2.0
+/** Default first offered rate (requests/s) */
+#define LOAD_START_RATE 1000.0
+/** Default largest offered rate (requests/s) */
+#define LOAD_MAX_RATE 1000000.0
+/** Default rate multiplier between steps */
+#define LOAD_STEP 2.0
+/** Default p99 latency objective (us) */
+#define LOAD_SLO_US 10000
+/** Fraction of the offered rate the server must sustain */
+#define LOAD_MIN_THROUGHPUT 0.95
+/** Largest latency tracked (ns) */
+#define LOAD_MAX_LATENCY 60000000000ull
+
+/** @brief Load generator options */
+typedef struct LoadConfig_Struct{
+    const char *socket;     /**< Server socket */
+    int conns;              /**< Connections */
+    int vectors;            /**< Vectors per request */
+    int k;                  /**< Neighbours per vector */
+    int poisson;            /**< Poisson arrivals, fixed interval otherwise */
+    double seconds;         /**< Duration of a step */
+    double start_rate;      /**< First offered rate (requests/s) */
+    double max_rate;        /**< Largest offered rate (requests/s) */
+    double step;            /**< Rate multiplier between steps */
+    uint64_t slo_ns;        /**< Corrected p99 objective */
+    const float *tst;       /**< Testing vectors */
+    int num_tst;            /**< Number of testing vectors */
+    int features;           /**< Feature dimensionality */
+}LoadConfig;
+
+/** @brief State of one connection during a step */
+typedef struct LoadConn_Struct{
+    const LoadConfig *cfg;  /**< Options */
+    int fd;                 /**< Socket */
+    int num_req;            /**< Requests scheduled in the step */
+    int first_vec;          /**< Testing vector of the first request */
+    uint64_t start;         /**< Step start (ns) */
+    uint64_t deadline;      /**< Sender gives up after this time (ns) */
+    uint64_t *intended;     /**< Scheduled send time of each request */
+    uint64_t *sent;         /**< Actual send time of each request */
+    int num_sent;           /**< Requests written (atomic) */
+    int sender_done;        /**< Set by the sender when it stops (atomic) */
+    int errors;             /**< Responses with a non-OK status */
+    KnnHist service;        /**< Latency from the send time */
+    KnnHist corrected;      /**< Latency from the scheduled time */
+}LoadConn;
+
+/************************************************************************/
+
+/** @brief xorshift32 step */
+static inline uint32_t xorshift32(uint32_t *state){
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+/**
+ * @brief Fills the schedule of one connection
+ *
+ * @return Number of requests scheduled within the step.
+ */
+static int loadSchedule(const LoadConfig *cfg, double rate, uint32_t seed,
+        uint64_t *intended, int max_req){
+
+    double t = 0.0, u, mean = 1e9 / rate;
+    int n;
+
+    for (n = 0; n < max_req; n++){
+        if (cfg->poisson){
+            u = (xorshift32(&seed) >> 8) * (1.0 / 16777216.0);
+            t += -log(1.0 - u) * mean;
+        } else {
+            t += mean;
+        }
+        if (t >= cfg->seconds * 1e9){
+            break;
+        }
+        intended[n] = (uint64_t) t;
+    }
+    return n;
+}
+
+/** @brief Sender thread, writes each request at its scheduled time */
+static void *loadSender(void *arg){
+
+    LoadConn *c = arg;
+    const LoadConfig *cfg = c->cfg;
+    struct timespec ts;
+    uint64_t now;
+    int i, vec;
+
+    for (i = 0; i < c->num_req; i++){
+        now = knnNanos();
+        if (now < c->intended[i]){
+            ts.tv_sec = c->intended[i] / 1000000000ull;
+            ts.tv_nsec = c->intended[i] % 1000000000ull;
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        } else if (now > c->deadline){
+            break;      /* saturated, the rest would never be sent in time */
+        }
+        vec = (c->first_vec + i * cfg->vectors) % (cfg->num_tst - cfg->vectors + 1);
+        c->sent[i] = knnNanos();
+        if (knnProtoSend(c->fd, i, &(cfg->tst[(size_t) vec * cfg->features]),
+                cfg->vectors, cfg->features, cfg->k, 0) != 0){
+            break;
+        }
+        __atomic_store_n(&c->num_sent, i + 1, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&c->sender_done, 1, __ATOMIC_RELEASE);
+    shutdown(c->fd, SHUT_WR);
+    return NULL;
+}
+
+/** @brief Receiver thread, timestamps responses until the sender's last one */
+static void *loadReceiver(void *arg){
+
+    LoadConn *c = arg;
+    KnnResponseHeader hdr;
+    int *labels = malloc(sizeof(int) * c->cfg->vectors);
+    uint64_t now;
+    int received = 0;
+
+    while (!__atomic_load_n(&c->sender_done, __ATOMIC_ACQUIRE) ||
+            received < __atomic_load_n(&c->num_sent, __ATOMIC_ACQUIRE)){
+        if (knnProtoReceive(c->fd, &hdr, labels, NULL, c->cfg->vectors, 0) != 0 ||
+            hdr.id >= (uint32_t) c->num_req){
+            break;
+        }
+        now = knnNanos();
+        if (hdr.status != KNN_PROTO_OK){
+            c->errors++;
+        }
+        knnHistRecord(&c->service, now - c->sent[hdr.id]);
+        knnHistRecord(&c->corrected, now - c->intended[hdr.id]);
+        received++;
+    }
+    free(labels);
+    return NULL;
+}
+
+/**
+ * @brief Runs one step at an offered rate
+ *
+ * @param cfg Options
+ * @param rate Offered rate over all connections (requests/s)
+ * @param service Output latencies from the send time, reset first
+ * @param corrected Output latencies from the scheduled time, reset first
+ * @param offered Output number of requests scheduled
+ * @param errors Output number of error responses
+ * @return Elapsed time of the step (s), negative on connection errors.
+ */
+static double loadStep(const LoadConfig *cfg, double rate, KnnHist *service,
+        KnnHist *corrected, uint64_t *offered, int *errors){
+
+    LoadConn *conns = calloc(cfg->conns, sizeof(LoadConn));
+    pthread_t *threads = malloc(sizeof(pthread_t) * 2 * cfg->conns);
+    int max_req = (int) (rate / cfg->conns * cfg->seconds * 1.5) + 16;
+    uint64_t start, elapsed;
+    int i, j, status = 0;
+
+    knnHistReset(service);
+    knnHistReset(corrected);
+    *offered = 0;
+    *errors = 0;
+    for (i = 0; i < cfg->conns; i++){
+        conns[i].cfg = cfg;
+        conns[i].intended = malloc(sizeof(uint64_t) * max_req);
+        conns[i].sent = malloc(sizeof(uint64_t) * max_req);
+        conns[i].fd = knnProtoConnect(cfg->socket);
+        conns[i].first_vec = (int) (((int64_t) i * cfg->num_tst) / cfg->conns);
+        conns[i].num_req = loadSchedule(cfg, rate / cfg->conns, 0x9E3779B9u * (i + 1),
+                conns[i].intended, max_req);
+        knnHistInit(&conns[i].service, LOAD_MAX_LATENCY, KNN_HIST_SUB_BITS);
+        knnHistInit(&conns[i].corrected, LOAD_MAX_LATENCY, KNN_HIST_SUB_BITS);
+        status = (conns[i].fd < 0) ? -1 : status;
+    }
+
+    start = knnNanos() + 1000000;   /* leave the threads 1 ms to start */
+    for (i = 0; i < cfg->conns && status == 0; i++){
+        conns[i].start = start;
+        conns[i].deadline = start + (uint64_t) (2.0 * cfg->seconds * 1e9);
+        for (j = 0; j < conns[i].num_req; j++){
+            conns[i].intended[j] += start;
+        }
+        *offered += conns[i].num_req;
+    }
+    for (i = 0; i < cfg->conns && status == 0; i++){
+        pthread_create(&threads[2*i], NULL, loadSender, &conns[i]);
+        pthread_create(&threads[2*i + 1], NULL, loadReceiver, &conns[i]);
+    }
+    for (i = 0; i < cfg->conns && status == 0; i++){
+        pthread_join(threads[2*i], NULL);
+        pthread_join(threads[2*i + 1], NULL);
+        knnHistAdd(service, &conns[i].service);
+        knnHistAdd(corrected, &conns[i].corrected);
+        *errors += conns[i].errors;
+    }
+    elapsed = knnNanos() - start;
+
+    for (i = 0; i < cfg->conns; i++){
+        if (conns[i].fd >= 0){
+            close(conns[i].fd);
+        }
+        free(conns[i].intended);
+        free(conns[i].sent);
+        knnHistFree(&conns[i].service);
+        knnHistFree(&conns[i].corrected);
+    }
+    free(conns);
+    free(threads);
+    return (status == 0) ? elapsed / 1e9 : -1.0;
+}
+
+/** @brief Prints the percentiles of a histogram in microseconds */
+static void loadPrintLatency(const char *name, const KnnHist *hist){
+    printf("  %-9s  mean %9.1f  p50 %9.1f  p90 %9.1f  p99 %9.1f  p99.9 %9.1f  max %9.1f\n",
+            name, knnHistMean(hist) / 1e3, knnHistValueAt(hist, 50.0) / 1e3,
+            knnHistValueAt(hist, 90.0) / 1e3, knnHistValueAt(hist, 99.0) / 1e3,
+            knnHistValueAt(hist, 99.9) / 1e3, knnHistValueAt(hist, 100.0) / 1e3);
+}
+
+/**
+ * @brief main program
+ * @param argc Argument count
+ * @param argv Argument values
+ * @return 0 on success.
+ */
+int main(int argc, char** argv){
+
+    LoadConfig cfg;
+    KnnHist service, corrected;
+    uint64_t offered;
+    double rate, elapsed, throughput, knee = 0.0;
+    float *tst = NULL;
+    int opt, errors, saturated = 0;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.socket = KNN_PROTO_SOCKET;
+    cfg.conns = LOAD_CONNS;
+    cfg.vectors = LOAD_VECTORS;
+    cfg.k = LOAD_K;
+    cfg.seconds = LOAD_SECONDS;
+    cfg.start_rate = LOAD_START_RATE;
+    cfg.max_rate = LOAD_MAX_RATE;
+    cfg.step = LOAD_STEP;
+    cfg.slo_ns = LOAD_SLO_US * 1000ull;
+    while ((opt = getopt(argc, argv, "s:c:v:k:pd:r:R:x:l:")) != -1){
+        switch (opt){
+        case 's': cfg.socket = optarg; break;
+        case 'c': cfg.conns = atoi(optarg); break;
+        case 'v': cfg.vectors = atoi(optarg); break;
+        case 'k': cfg.k = atoi(optarg); break;
+        case 'p': cfg.poisson = 1; break;
+        case 'd': cfg.seconds = atof(optarg); break;
+        case 'r': cfg.start_rate = atof(optarg); break;
+        case 'R': cfg.max_rate = atof(optarg); break;
+        case 'x': cfg.step = atof(optarg); break;
+        case 'l': cfg.slo_ns = strtoull(optarg, NULL, 10) * 1000ull; break;
+        default:
+            optind = argc;
+            break;
+        }
+    }
+    if (argc - optind != 3 || cfg.conns < 1 || cfg.vectors < 1 ||
+        cfg.vectors > KNN_PROTO_MAX_COUNT || cfg.step <= 1.0 || cfg.start_rate <= 0.0){
+        printf("Usage: %s [-s socket] [-c conns] [-v vectors] [-k k] [-p]\n"
+               "       [-d seconds] [-r start_rate] [-R max_rate] [-x step]\n"
+               "       [-l slo_us] tst_data num_tst features\n", argv[0]);
+        return -1;
+    }
+    argv += optind;
+    cfg.num_tst = atoi(argv[1]);
+    cfg.features = atoi(argv[2]);
+    if (cfg.vectors > cfg.num_tst || loadBinaryData(argv[0], cfg.num_tst, cfg.features, &tst) != 0){
+        printf("Error reading input files!\n");
+        return -1;
+    }
+    cfg.tst = tst;
+    knnHistInit(&service, LOAD_MAX_LATENCY, KNN_HIST_SUB_BITS);
+    knnHistInit(&corrected, LOAD_MAX_LATENCY, KNN_HIST_SUB_BITS);
+
+    printf("%s arrivals, %d connections, %d vectors per request, K = %d, "
+           "p99 objective %.0f us\n", cfg.poisson ? "Poisson" : "Fixed rate",
+           cfg.conns, cfg.vectors, cfg.k, cfg.slo_ns / 1e3);
+    for (rate = cfg.start_rate; rate <= cfg.max_rate && !saturated; rate *= cfg.step){
+        elapsed = loadStep(&cfg, rate, &service, &corrected, &offered, &errors);
+        if (elapsed < 0.0){
+            printf("Cannot connect to %s\n", cfg.socket);
+            break;
+        }
+        throughput = corrected.total / elapsed;
+        printf("\nOffered %.0f req/s: answered %llu of %llu (%.0f req/s, %.0f vectors/s), %d errors\n",
+                rate, (unsigned long long) corrected.total, (unsigned long long) offered,
+                throughput, throughput * cfg.vectors, errors);
+        loadPrintLatency("service", &service);
+        loadPrintLatency("corrected", &corrected);
+        saturated = throughput < LOAD_MIN_THROUGHPUT * offered / cfg.seconds || errors > 0 ||
+                knnHistValueAt(&corrected, 99.0) > cfg.slo_ns;
+        if (!saturated){
+            knee = rate;
+        }
+    }
+    if (knee > 0.0){
+        printf("\nKnee: %.0f req/s (%.0f vectors/s) within the p99 objective\n",
+                knee, knee * cfg.vectors);
+    } else {
+        printf("\nNo offered rate met the p99 objective\n");
+    }
+
+    knnHistFree(&service);
+    knnHistFree(&corrected);
+    free(tst);
+    return 0;
+}
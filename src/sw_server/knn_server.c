@@ -0,0 +1,588 @@
+/*
+ * @file knn_server.c
+ * @brief Long-running k-NN query server over a Unix domain socket
+ *
+ * Loads the training set once and answers classification requests framed
+ * as in knn_protocol.h. One thread per connection reads request frames
+ * into a shared FIFO; a single batcher thread gathers the queued vectors
+ * into micro-batches and runs each batch through knnNeighbours(), then
+ * writes the responses, so requests from every client share the batched
+ * distance loop.
+ *
+ * A batch is closed when it holds max_batch vectors or when waiting any
+ * longer would make the oldest queued request miss the latency target:
+ * its age plus the estimated time to compute the batch (an EWMA of the
+ * measured cost per vector) reaches the target. A larger target gives
+ * larger batches and more throughput, a smaller one a lower p99. The
+ * batcher only waits while vectors arrive faster than they are computed
+ * (EWMA of the gap between arrivals per vector); at low load an idle
+ * batcher takes whatever is queued at once.
+ *
+ * With -Q, results are kept in a query cache (knn_query_cache.h) of that
+ * many entries: vectors found there skip the distance loop, the others
+ * are inserted once computed. With -q the cache key is quantized to that
+ * step, so near-duplicate queries share a result.
+ *
+ * Usage: knn_server [-s socket] [-b max_batch] [-L target_us]
+ *                   [-Q cache_entries] [-q quantum]
+ *                   trn_data trn_label num_trn features classes
+ *
+ * SIGHUP reloads the training files and invalidates the cache. SIGINT or
+ * SIGTERM stops the server and prints its batching and cache statistics.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "knn_kernels.h"
+#include "knn_arena.h"
+#include "knn_dataset.h"
+#include "knn_eval.h"
+#include "knn_protocol.h"
+#include "knn_query_cache.h"
+#include "knn_timer.h"
+
+/** Default largest number of vectors in a micro-batch */
+#define MAX_BATCH 256
+/** Default latency target (us) */
+#define TARGET_US 1000
+/** Weight of the newest sample in the cost and arrival gap estimates */
+#define COST_EWMA 0.125
+/** Accept loop polling interval (ms), bounds the shutdown delay */
+#define POLL_MS 200
+/** Default query cache entries, 0 disables the cache (opt-in with -Q) */
+#define CACHE_ENTRIES 0
+/** Longest neighbour list kept in the query cache */
+#define CACHE_K 16
+
+/** @brief Client connection, shared by its reader and its pending requests */
+typedef struct Connection_Struct{
+    int fd;                     /**< Socket */
+    int refs;                   /**< Reader plus pending requests (atomic) */
+}Connection;
+
+/** @brief Request waiting in the batch queue */
+typedef struct Pending_Struct{
+    Connection *conn;           /**< Connection to answer on */
+    KnnRequestHeader hdr;       /**< Request header */
+    int status;                 /**< KnnProtoStatus, not OK requests are only answered */
+    float *vectors;             /**< Feature vectors (count x features) */
+    uint64_t arrival;           /**< Time the request was queued (ns) */
+    struct Pending_Struct *next;    /**< Next request in FIFO order */
+}Pending;
+
+/** @brief Server state */
+typedef struct Server_Struct{
+    float *data;                /**< Training feature vectors */
+    int *labels;                /**< Training labels */
+    int num_obj;                /**< Number of training objects */
+    int features;               /**< Feature dimensionality */
+    int classes;                /**< Number of classes */
+    int max_batch;              /**< Largest number of vectors in a batch */
+    uint64_t target_ns;         /**< Latency target */
+    const char *trn_data;       /**< Training features file, for reloads */
+    const char *trn_label;      /**< Training labels file, for reloads */
+    KnnQueryCache cache;        /**< Query result cache */
+    int cache_entries;          /**< Cache entries, 0 when disabled */
+    double cost_ns;             /**< Estimated compute time per vector */
+    double gap_ns;              /**< Estimated time between arrivals per vector */
+    uint64_t last_arrival;      /**< Arrival time of the newest request */
+    Pending *head, *tail;       /**< Request FIFO */
+    int queued;                 /**< Vectors in the FIFO */
+    int stop;                   /**< Set on shutdown */
+    pthread_mutex_t lock;       /**< Protects the FIFO, the estimates and stop */
+    pthread_cond_t cond;        /**< Signals new requests and shutdown */
+    uint64_t requests;          /**< Requests answered */
+    uint64_t vectors;           /**< Vectors classified */
+    uint64_t computed;          /**< Vectors not answered by the cache */
+    uint64_t batches;           /**< Batches computed */
+    int largest;                /**< Largest batch (vectors) */
+}Server;
+
+/** Set by the signal handler */
+static volatile sig_atomic_t running = 1;
+/** Set on SIGHUP, cleared by the batcher once reloaded */
+static volatile sig_atomic_t reload = 0;
+
+/** @brief SIGINT / SIGTERM handler */
+static void onSignal(int sig){
+    (void) sig;
+    running = 0;
+}
+
+/** @brief SIGHUP handler */
+static void onReload(int sig){
+    (void) sig;
+    reload = 1;
+}
+
+/** @brief Drops a reference to a connection, closing it with the last one */
+static void connectionRelease(Connection *conn){
+    if (__atomic_sub_fetch(&conn->refs, 1, __ATOMIC_ACQ_REL) == 0){
+        close(conn->fd);
+        free(conn);
+    }
+}
+
+/** @brief Appends a request to the FIFO, updating the arrival rate estimate */
+static void serverEnqueue(Server *server, Pending *p){
+
+    uint64_t gap;
+
+    pthread_mutex_lock(&server->lock);
+    if (p->status == KNN_PROTO_OK){
+        /* Readers stamp arrivals before taking the lock, order may differ */
+        gap = (p->arrival > server->last_arrival) ? p->arrival - server->last_arrival : 0;
+        gap = (gap < server->target_ns) ? gap : server->target_ns;
+        server->gap_ns += COST_EWMA * ((double) gap / p->hdr.count - server->gap_ns);
+        server->last_arrival = p->arrival;
+    }
+    p->next = NULL;
+    if (server->tail != NULL){
+        server->tail->next = p;
+    } else {
+        server->head = p;
+    }
+    server->tail = p;
+    server->queued += (p->status == KNN_PROTO_OK) ? (int) p->hdr.count : 0;
+    pthread_cond_signal(&server->cond);
+    pthread_mutex_unlock(&server->lock);
+}
+
+/** @brief Connection thread, reads request frames until the client leaves */
+static void *connectionReader(void *arg){
+
+    Connection *conn = ((void **) arg)[0];
+    Server *server = ((void **) arg)[1];
+    KnnRequestHeader hdr;
+    Pending *p;
+    size_t size;
+
+    free(arg);
+    while (knnProtoReadFull(conn->fd, &hdr, sizeof(hdr)) == 0){
+        if (hdr.magic != KNN_PROTO_REQUEST_MAGIC || hdr.version != KNN_PROTO_VERSION ||
+            hdr.count > KNN_PROTO_MAX_COUNT || hdr.features > KNN_PROTO_MAX_FEATURES){
+            break;      /* framing lost, drop the connection */
+        }
+        p = malloc(sizeof(Pending));
+        size = sizeof(float) * (size_t) hdr.count * hdr.features;
+        if (p == NULL || (p->vectors = malloc(size + 1)) == NULL){
+            free(p);
+            break;
+        }
+        if (knnProtoReadFull(conn->fd, p->vectors, size) != 0){
+            free(p->vectors);
+            free(p);
+            break;
+        }
+        p->conn = conn;
+        p->hdr = hdr;
+        p->arrival = knnNanos();
+        p->status = KNN_PROTO_OK;
+        if ((int) hdr.features != server->features || hdr.count < 1 || hdr.k < 1 ||
+            hdr.k > KNN_PROTO_MAX_K || (int) hdr.k > server->num_obj){
+            p->status = KNN_PROTO_BAD_SHAPE;
+        }
+        __atomic_add_fetch(&conn->refs, 1, __ATOMIC_ACQ_REL);
+        serverEnqueue(server, p);
+    }
+    connectionRelease(conn);
+    return NULL;
+}
+
+/**
+ * @brief Waits until a batch should be closed and takes it off the FIFO
+ *
+ * Waiting for more vectors only pays off when they arrive faster than the
+ * batcher computes them; otherwise the queued requests are taken at once.
+ *
+ * @return First request of the batch, NULL on shutdown with an empty FIFO.
+ */
+static Pending *serverTakeBatch(Server *server, int *num_vectors){
+
+    Pending *first, *last, *p;
+    struct timespec ts;
+    uint64_t deadline, now;
+    int n;
+
+    pthread_mutex_lock(&server->lock);
+    while (server->head == NULL && !server->stop){
+        pthread_cond_wait(&server->cond, &server->lock);
+    }
+    while (server->head != NULL && !server->stop && server->queued < server->max_batch &&
+            server->gap_ns < server->cost_ns){
+        deadline = server->head->arrival + server->target_ns;
+        now = knnNanos();
+        if (deadline <= now + (uint64_t) (server->cost_ns * (server->queued + 1))){
+            break;
+        }
+        deadline -= (uint64_t) (server->cost_ns * (server->queued + 1));
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += deadline - now;
+        ts.tv_sec += ts.tv_nsec / 1000000000;
+        ts.tv_nsec %= 1000000000;
+        pthread_cond_timedwait(&server->cond, &server->lock, &ts);
+    }
+
+    /* Whole requests in FIFO order, at least one */
+    first = server->head;
+    last = NULL;
+    n = 0;
+    for (p = first; p != NULL; p = p->next){
+        if (last != NULL && p->status == KNN_PROTO_OK &&
+            n + (int) p->hdr.count > server->max_batch){
+            break;
+        }
+        n += (p->status == KNN_PROTO_OK) ? (int) p->hdr.count : 0;
+        last = p;
+    }
+    if (last != NULL){
+        server->head = last->next;
+        if (server->head == NULL){
+            server->tail = NULL;
+        }
+        last->next = NULL;
+        server->queued -= n;
+    }
+    pthread_mutex_unlock(&server->lock);
+    *num_vectors = n;
+    return first;
+}
+
+/**
+ * @brief Reloads the training set, called by the batcher between batches
+ *
+ * Only the batcher reads the set and inserts into the cache, so swapping
+ * the arrays and bumping the cache generation here cannot race with a
+ * batch; cached results of the previous set are never served again.
+ */
+static void serverReload(Server *server){
+
+    float *data;
+    int *labels;
+
+    reload = 0;
+    if (loadBinarySet(server->trn_data, server->trn_label, server->num_obj,
+            server->features, &data, &labels) != 0){
+        printf("Reload failed, keeping the current training set\n");
+        fflush(stdout);
+        return;
+    }
+    free(server->data);
+    free(server->labels);
+    server->data = data;
+    server->labels = labels;
+    if (server->cache_entries > 0){
+        knnQueryCacheInvalidate(&server->cache);
+    }
+    printf("Training set reloaded\n");
+    fflush(stdout);
+}
+
+/** @brief Writes the response of one request from the per-vector results */
+static void serverRespond(Pending *p, const int *res_labels, const DistIndexPair *res_nb,
+        KnnNeighbour *out_nb){
+
+    KnnResponseHeader rsp;
+    int i, j, k = p->hdr.k;
+
+    memset(&rsp, 0, sizeof(rsp));
+    rsp.magic = KNN_PROTO_RESPONSE_MAGIC;
+    rsp.version = KNN_PROTO_VERSION;
+    rsp.status = p->status;
+    rsp.id = p->hdr.id;
+    if (p->status == KNN_PROTO_OK){
+        rsp.count = p->hdr.count;
+        rsp.k = (p->hdr.flags & KNN_PROTO_NEIGHBOURS) ? k : 0;
+        for (i = 0; i < (int) rsp.count * (int) rsp.k; i++){
+            j = i / k * KNN_PROTO_MAX_K + i % k;
+            out_nb[i].distance = res_nb[j].distance;
+            out_nb[i].index = res_nb[j].index;
+        }
+    }
+    if (knnProtoWriteFull(p->conn->fd, &rsp, sizeof(rsp)) != 0 ||
+        knnProtoWriteFull(p->conn->fd, res_labels, sizeof(int) * rsp.count) != 0 ||
+        knnProtoWriteFull(p->conn->fd, out_nb, sizeof(KnnNeighbour) * rsp.count * rsp.k) != 0){
+        shutdown(p->conn->fd, SHUT_RDWR);
+    }
+}
+
+/**
+ * @brief Batcher thread, computes micro-batches until shutdown
+ *
+ * Vectors of a batch are first looked up in the query cache; only the
+ * misses are packed and computed, then voted and inserted. Results are
+ * kept per vector (KNN_PROTO_MAX_K neighbours each) until every request
+ * of the batch is answered. Every buffer is sized for the largest batch
+ * and carved from a single arena, so the batch loop does not allocate.
+ */
+static void *serverBatcher(void *arg){
+
+    Server *server = arg;
+    size_t cap = (server->max_batch > KNN_PROTO_MAX_COUNT) ? server->max_batch : KNN_PROTO_MAX_COUNT;
+    KnnArena arena;
+    float *batch;
+    DistIndexPair *lists, *res_nb, *nb;
+    int *res_labels, *misses, *votes;
+    KnnNeighbour *out_nb;
+    int closest[KNN_PROTO_MAX_K];
+    const float *vec;
+    Pending *first, *p, *next;
+    uint64_t t;
+    int n, m, i, j, c, pos, k, kmax, with_nb;
+
+    if (knnArenaInit(&arena, knnArenaSpan(sizeof(float) * cap * server->features)
+            + knnArenaSpan(sizeof(DistIndexPair) * cap * KNN_PROTO_MAX_K) * 2
+            + knnArenaSpan(sizeof(int) * cap) * 2
+            + knnArenaSpan(sizeof(KnnNeighbour) * KNN_PROTO_MAX_COUNT * KNN_PROTO_MAX_K)
+            + knnArenaSpan(sizeof(int) * server->classes)) != 0){
+        printf("Cannot allocate the batch buffers\n");
+        exit(-1);
+    }
+    batch = knnArenaAlloc(&arena, sizeof(float) * cap * server->features);
+    lists = knnArenaAlloc(&arena, sizeof(DistIndexPair) * cap * KNN_PROTO_MAX_K);
+    res_nb = knnArenaAlloc(&arena, sizeof(DistIndexPair) * cap * KNN_PROTO_MAX_K);
+    res_labels = knnArenaAlloc(&arena, sizeof(int) * cap);
+    misses = knnArenaAlloc(&arena, sizeof(int) * cap);
+    out_nb = knnArenaAlloc(&arena, sizeof(KnnNeighbour) * KNN_PROTO_MAX_COUNT * KNN_PROTO_MAX_K);
+    votes = knnArenaAlloc(&arena, sizeof(int) * server->classes);
+
+    while ((first = serverTakeBatch(server, &n)) != NULL){
+        if (reload){
+            serverReload(server);
+        }
+
+        /* Cache lookups, misses packed into the batch */
+        kmax = 1;
+        m = 0;
+        pos = 0;
+        for (p = first; p != NULL; p = p->next){
+            if (p->status != KNN_PROTO_OK){
+                continue;
+            }
+            with_nb = p->hdr.flags & KNN_PROTO_NEIGHBOURS;
+            for (i = 0; i < (int) p->hdr.count; i++, pos++){
+                vec = &(p->vectors[(size_t) i * server->features]);
+                if (server->cache_entries > 0 &&
+                    knnQueryCacheLookup(&server->cache, vec, p->hdr.k, &(res_labels[pos]),
+                        with_nb ? &(res_nb[(size_t) pos * KNN_PROTO_MAX_K]) : NULL)){
+                    continue;
+                }
+                memcpy(&(batch[(size_t) m * server->features]), vec,
+                        sizeof(float) * server->features);
+                misses[m++] = pos;
+                kmax = ((int) p->hdr.k > kmax) ? (int) p->hdr.k : kmax;
+            }
+        }
+
+        if (m > 0){
+            t = knnNanos();
+            knnNeighbours(batch, m, server->data, server->num_obj, server->features,
+                    kmax, lists);
+            t = knnNanos() - t;
+            pthread_mutex_lock(&server->lock);
+            server->cost_ns += COST_EWMA * ((double) t / m - server->cost_ns);
+            pthread_mutex_unlock(&server->lock);
+            server->batches++;
+            server->computed += m;
+            server->largest = (m > server->largest) ? m : server->largest;
+        }
+        server->vectors += n;
+
+        /* Votes of the computed vectors, inserted into the cache */
+        j = 0;
+        pos = 0;
+        for (p = first; p != NULL && j < m; p = p->next){
+            if (p->status != KNN_PROTO_OK){
+                continue;
+            }
+            k = p->hdr.k;
+            for (i = 0; i < (int) p->hdr.count; i++, pos++){
+                if (j == m || misses[j] != pos){
+                    continue;
+                }
+                nb = &(res_nb[(size_t) pos * KNN_PROTO_MAX_K]);
+                memcpy(nb, &(lists[(size_t) j * kmax]), sizeof(DistIndexPair) * k);
+                for (c = 0; c < k; c++){
+                    closest[c] = server->labels[nb[c].index];
+                }
+                res_labels[pos] = majorityVote(closest, k, votes, server->classes);
+                if (server->cache_entries > 0){
+                    knnQueryCacheInsert(&server->cache, &(p->vectors[(size_t) i * server->features]),
+                            k, res_labels[pos], nb);
+                }
+                j++;
+            }
+        }
+
+        pos = 0;
+        for (p = first; p != NULL; p = next){
+            next = p->next;
+            serverRespond(p, &(res_labels[pos]), &(res_nb[(size_t) pos * KNN_PROTO_MAX_K]), out_nb);
+            pos += (p->status == KNN_PROTO_OK) ? (int) p->hdr.count : 0;
+            server->requests++;
+            connectionRelease(p->conn);
+            free(p->vectors);
+            free(p);
+        }
+    }
+
+    knnArenaFree(&arena);
+    return NULL;
+}
+
+/**
+ * @brief main program
+ * @param argc Argument count
+ * @param argv Argument values
+ * @return 0 on success.
+ */
+int main(int argc, char** argv){
+
+    const char *path = KNN_PROTO_SOCKET;
+    struct sockaddr_un addr;
+    struct sigaction sa;
+    struct pollfd pfd;
+    pthread_t batcher, reader;
+    pthread_attr_t attr;
+    Connection *conn;
+    Server server;
+    KnnQueryCacheStats stats;
+    float quantum = 0.0f;
+    void **arg;
+    int listen_fd, fd, opt;
+
+    memset(&server, 0, sizeof(server));
+    server.max_batch = MAX_BATCH;
+    server.target_ns = TARGET_US * 1000ull;
+    server.gap_ns = server.target_ns;
+    server.cache_entries = CACHE_ENTRIES;
+    while ((opt = getopt(argc, argv, "s:b:L:Q:q:")) != -1){
+        switch (opt){
+        case 's': path = optarg; break;
+        case 'b': server.max_batch = atoi(optarg); break;
+        case 'L': server.target_ns = strtoull(optarg, NULL, 10) * 1000ull; break;
+        case 'Q': server.cache_entries = atoi(optarg); break;
+        case 'q': quantum = atof(optarg); break;
+        default:
+            optind = argc;
+            break;
+        }
+    }
+    if (argc - optind != 5 || server.max_batch < 1 || server.cache_entries < 0 ||
+        quantum < 0.0f){
+        printf("Usage: %s [-s socket] [-b max_batch] [-L target_us]\n"
+               "       [-Q cache_entries] [-q quantum]\n"
+               "       trn_data trn_label num_trn features classes\n", argv[0]);
+        return -1;
+    }
+    argv += optind;
+    server.trn_data = argv[0];
+    server.trn_label = argv[1];
+    server.num_obj = atoi(argv[2]);
+    server.features = atoi(argv[3]);
+    server.classes = atoi(argv[4]);
+    if (loadBinarySet(argv[0], argv[1], server.num_obj, server.features,
+            &server.data, &server.labels) != 0){
+        printf("Error reading input files!\n");
+        return -1;
+    }
+    if (server.cache_entries > 0 && knnQueryCacheInit(&server.cache, server.cache_entries,
+            KNN_QCACHE_SHARDS, server.features, CACHE_K, quantum) != 0){
+        printf("Cannot allocate the query cache\n");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)){
+        printf("Socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 ||
+        listen(listen_fd, SOMAXCONN) != 0){
+        printf("Error listening on %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onSignal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sa.sa_handler = onReload;
+    sigaction(SIGHUP, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    pthread_mutex_init(&server.lock, NULL);
+    pthread_cond_init(&server.cond, NULL);
+    pthread_create(&batcher, NULL, serverBatcher, &server);
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    printf("Serving %d objects of %d features on %s (max batch %d, target %d us, "
+           "cache %d entries, quantum %g)\n", server.num_obj, server.features, path,
+            server.max_batch, (int) (server.target_ns / 1000), server.cache_entries, quantum);
+    fflush(stdout);
+
+    pfd.fd = listen_fd;
+    pfd.events = POLLIN;
+    while (running){
+        if (poll(&pfd, 1, POLL_MS) <= 0 || (fd = accept(listen_fd, NULL, NULL)) < 0){
+            continue;
+        }
+        conn = malloc(sizeof(Connection));
+        arg = malloc(sizeof(void *) * 2);
+        if (conn == NULL || arg == NULL){
+            free(conn); free(arg);
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        conn->refs = 1;
+        arg[0] = conn;
+        arg[1] = &server;
+        if (pthread_create(&reader, &attr, connectionReader, arg) != 0){
+            free(conn); free(arg);
+            close(fd);
+        }
+    }
+
+    /* Answer what is queued, then stop */
+    pthread_mutex_lock(&server.lock);
+    server.stop = 1;
+    pthread_cond_broadcast(&server.cond);
+    pthread_mutex_unlock(&server.lock);
+    pthread_join(batcher, NULL);
+    close(listen_fd);
+    unlink(path);
+
+    printf("\nRequests: %llu\nVectors: %llu (computed %llu)\n"
+           "Batches: %llu (mean %.2f, largest %d vectors)\n"
+           "Compute per vector (us): %.2f\n", (unsigned long long) server.requests,
+           (unsigned long long) server.vectors, (unsigned long long) server.computed,
+           (unsigned long long) server.batches,
+           server.batches ? (double) server.computed / server.batches : 0.0,
+           server.largest, server.cost_ns / 1000.0);
+    if (server.cache_entries > 0){
+        knnQueryCacheStats(&server.cache, &stats);
+        printf("Cache hits: %llu, misses: %llu (hit rate %.2f%%)\n"
+               "Cache inserts: %llu, evictions: %llu, entries: %llu / %llu\n",
+               (unsigned long long) stats.hits, (unsigned long long) stats.misses,
+               stats.hits + stats.misses ? 100.0 * stats.hits / (stats.hits + stats.misses) : 0.0,
+               (unsigned long long) stats.inserts, (unsigned long long) stats.evictions,
+               (unsigned long long) stats.entries, (unsigned long long) stats.capacity);
+        knnQueryCacheFree(&server.cache);
+    }
+    return 0;
+}
@@ -0,0 +1,176 @@
+/*
+ * @file knn_condense.c
+ * @brief Shrinks a training set with Wilson editing and Hart condensation
+ *
+ * Reads the training and testing binaries, edits the training set (ENN),
+ * condenses what is left (CNN) and writes the reduced set in the same
+ * raw format, so any classifier variant can load it (set NUM_TRN_OBJ to
+ * the reported size). Reports the size reduction and the test accuracy
+ * and classification time before and after.
+ *
+ * Usage: knn_condense [-m enn|cnn|both] [-e k_edit] [-k k] [-t threads]
+ *                     trn_data trn_label num_trn tst_data tst_label num_tst
+ *                     features classes out_prefix
+ *
+ * Writes <out_prefix>_data.bin and <out_prefix>_label.bin.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "knn_kernels.h"
+#include "knn_dataset.h"
+#include "knn_eval.h"
+#include "knn_condense.h"
+#include "knn_timer.h"
+
+/** Default K of the classifier used for the report */
+#define K 3
+/** Default K of Wilson editing */
+#define K_EDIT 3
+
+/**
+ * @brief Classifies the testing set, returns the number of hits
+ *
+ * @param elapsed Output, classification time (ns)
+ * @return Number of hits, -1 if the scratch could not be allocated.
+ */
+static int classify(float *data_trn, int *label_trn, int num_trn,
+        float *data_tst, int *label_tst, int num_tst, int features,
+        int classes, int k, uint64_t *elapsed){
+
+    DistIndexPair *neighbours = malloc(sizeof(DistIndexPair) * (size_t) num_tst * k);
+    int *closest = malloc(sizeof(int) * k);
+    int *votes = malloc(sizeof(int) * classes);
+    int i, j, n, correct = 0;
+
+    if (neighbours == NULL || closest == NULL || votes == NULL){
+        free(neighbours); free(closest); free(votes);
+        return -1;
+    }
+
+    *elapsed = knnNanos();
+    knnNeighbours(data_tst, num_tst, data_trn, num_trn, features, k, neighbours);
+    for (i = 0; i < num_tst; i++){
+        for (j = 0, n = 0; j < k; j++){
+            if (neighbours[(size_t) i*k + j].index >= 0){
+                closest[n++] = label_trn[ neighbours[(size_t) i*k + j].index ];
+            }
+        }
+        if (majorityVote(closest, n, votes, classes) == label_tst[i]){
+            correct++;
+        }
+    }
+    *elapsed = knnNanos() - *elapsed;
+
+    free(neighbours); free(closest); free(votes);
+    return correct;
+}
+
+/**
+ * @brief main program
+ * @param argc Argument count
+ * @param argv Argument values
+ * @return 0 on success.
+ */
+int main(int argc, char** argv){
+
+    float *data_trn, *data_tst, *data_red;
+    int *label_trn, *label_tst, *label_red, *keep;
+    int num_trn, num_tst, num_red, features, classes;
+    int k = K, k_edit = K_EDIT, edit = 1, condense = 1;
+    int threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    int correct_full, correct_red, opt, i;
+    uint64_t t_full, t_red, t_reduce;
+
+    while ((opt = getopt(argc, argv, "m:e:k:t:")) != -1){
+        switch (opt){
+        case 'm':
+            edit = strcmp(optarg, "cnn") != 0;
+            condense = strcmp(optarg, "enn") != 0;
+            break;
+        case 'e': k_edit = atoi(optarg); break;
+        case 'k': k = atoi(optarg); break;
+        case 't': threads = atoi(optarg); break;
+        default:
+            optind = argc;
+            break;
+        }
+    }
+    if (argc - optind != 9){
+        printf("Usage: %s [-m enn|cnn|both] [-e k_edit] [-k k] [-t threads]\n"
+               "       trn_data trn_label num_trn tst_data tst_label num_tst"
+               " features classes out_prefix\n", argv[0]);
+        return -1;
+    }
+    argv += optind;
+    num_trn = atoi(argv[2]);
+    num_tst = atoi(argv[5]);
+    features = atoi(argv[6]);
+    classes = atoi(argv[7]);
+
+    if (loadBinarySet(argv[0], argv[1], num_trn, features, &data_trn, &label_trn) != 0 ||
+        loadBinarySet(argv[3], argv[4], num_tst, features, &data_tst, &label_tst) != 0){
+        printf("Error reading input files!\n");
+        return -1;
+    }
+
+    keep = malloc(sizeof(int) * num_trn);
+    data_red = malloc(sizeof(float) * (size_t) num_trn * features);
+    label_red = malloc(sizeof(int) * num_trn);
+    if (keep == NULL || data_red == NULL || label_red == NULL){
+        printf("Error allocating the reduced set!\n");
+        return -1;
+    }
+    for (i = 0; i < num_trn; i++){
+        keep[i] = 1;
+    }
+
+    t_reduce = knnNanos();
+    num_red = num_trn;
+    if (edit){
+        num_red = knnWilsonEdit(data_trn, label_trn, num_trn, features, classes,
+                k_edit, threads, keep);
+        printf("Wilson editing (K = %d): %d of %d objects kept\n", k_edit, num_red, num_trn);
+    }
+    if (condense && num_red > 0){
+        num_red = knnHartCondense(data_trn, label_trn, num_trn, features, threads, keep);
+        printf("Hart condensation: %d objects in the store\n", num_red);
+    }
+    t_reduce = knnNanos() - t_reduce;
+    if (num_red <= 0){
+        printf("Error reducing the training set!\n");
+        return -1;
+    }
+    num_red = knnCompactSet(data_trn, label_trn, num_trn, features, keep,
+            data_red, label_red);
+
+    correct_full = classify(data_trn, label_trn, num_trn, data_tst, label_tst,
+            num_tst, features, classes, k, &t_full);
+    correct_red = classify(data_red, label_red, num_red, data_tst, label_tst,
+            num_tst, features, classes, k, &t_red);
+    if (correct_full < 0 || correct_red < 0){
+        printf("Error classifying the testing set!\n");
+        return -1;
+    }
+
+    printf("\nReduction time (us): %d, %d threads\n", (int) (t_reduce / 1000), threads);
+    printf("Training set: %d -> %d objects (%.2f%% of the original)\n",
+            num_trn, num_red, (num_red * 100.0) / num_trn);
+    printf("Accuracy (K = %d): %.2f%% -> %.2f%%\n", k,
+            (correct_full * 100.0) / num_tst, (correct_red * 100.0) / num_tst);
+    printf("Classification time (us): %d -> %d (%.2fx)\n", (int) (t_full / 1000),
+            (int) (t_red / 1000), t_red ? (double) t_full / t_red : 0.0);
+
+    if (writeBinaryArray(argv[8], "data", data_red, sizeof(float), (size_t) num_red * features) != 0 ||
+        writeBinaryArray(argv[8], "label", label_red, sizeof(int), num_red) != 0){
+        printf("Error writing output files!\n");
+        return -1;
+    }
+
+    free(data_trn); free(label_trn); free(data_tst); free(label_tst);
+    free(data_red); free(label_red); free(keep);
+    return 0;
+}